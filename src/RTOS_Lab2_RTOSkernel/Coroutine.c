@@ -0,0 +1,116 @@
+// ************************** Coroutine.c **************************
+// Stackless cooperative tasks (protothread style) multiplexed on a single host thread.
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	All coroutines share the stack of one host thread. The host walks the list of
+	coroutines, resuming each one that is not sleeping. A coroutine which waits on a
+	semaphore polls it with OS_Wait_noblock, so it never blocks the host thread.
+
+	When a full pass makes no progress the host sleeps for COROUTINE_IDLE_SLEEP ms,
+	so idle coroutines cost no more than a periodic poll.
+*/
+
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+#include "LinkedList.h"
+#include "Coroutine.h"
+
+Coroutine_t *coroutine_list_head = 0;
+uint8_t coroutine_cnt = 0;
+uint32_t coroutine_cnt_alive = 0;
+
+// Signed compare handles wrap around of OS_MsTime
+static int co_is_awake(Coroutine_t *co, uint32_t now) {
+	return !co->sleeping || (int32_t)(now - co->wake_time) >= 0;
+}
+
+//******** Coroutine_Host ***************
+// Thread which runs every coroutine until it waits, yields or exits
+// Inputs: none
+// Outputs: none
+void Coroutine_Host(void) {
+	for(;;) {
+		uint8_t progress = 0;
+		uint32_t now = OS_MsTime();
+
+		Coroutine_t *co = coroutine_list_head;
+		while(co) {
+			Coroutine_t *next = co->next_ptr;
+			if(co_is_awake(co, now)) {
+				co->sleeping = 0;
+				uint16_t lc = co->lc;
+
+				int status = co->func(co);
+				if(status == CO_EXITED) {
+					int I = StartCritical();
+					LL_remove((LL_node_t **)&coroutine_list_head, (LL_node_t *)co);
+					coroutine_cnt_alive--;
+					EndCritical(I);
+					Heap_KernelFree(co);
+					progress = 1;
+				}
+				else if(status == CO_YIELDED || co->lc != lc) {
+					progress = 1;	// Moved to a new wait point
+				}
+			}
+			co = next;
+		}
+
+		if(!progress) {
+			OS_Sleep(COROUTINE_IDLE_SLEEP);
+		}
+	}
+}
+
+//******** Coroutine_Init ***************
+// Start the host thread which runs all coroutines
+// Inputs: priority of the host thread
+// Outputs: 1 if successful, 0 if the host thread could not be added
+int Coroutine_Init(uint32_t priority) {
+	return OS_AddThread(&Coroutine_Host, COROUTINE_HOST_STACK_SIZE, priority);
+}
+
+//******** Coroutine_Add ***************
+// Add a coroutine to the host thread
+// Inputs:
+//		func: coroutine body, must start with CO_BEGIN and end with CO_END
+//		arg:	user state, available to the body as co->arg
+// Outputs: pointer to the coroutine, 0 if it could not be allocated
+Coroutine_t* Coroutine_Add(int (*func)(Coroutine_t *co), void *arg) {
+	// From the kernel heap, the host thread frees it whichever process added it
+	Coroutine_t *co = Heap_KernelMalloc(sizeof(Coroutine_t));
+	if(!co) {
+		return 0;
+	}
+
+	co->lc = 0;
+	co->sleeping = 0;
+	co->wake_time = 0;
+	co->func = func;
+	co->arg = arg;
+
+	int I = StartCritical();
+	co->id = ++coroutine_cnt;
+	coroutine_cnt_alive++;
+	LL_append_linear((LL_node_t **)&coroutine_list_head, (LL_node_t *)co);
+	EndCritical(I);
+	return co;
+}
+
+//******** Coroutine_SetWake ***************
+// Used by CO_SLEEP, mark a coroutine as sleeping for ms milliseconds
+// Inputs: coroutine and time to sleep in ms
+// Outputs: none
+void Coroutine_SetWake(Coroutine_t *co, uint32_t ms) {
+	co->wake_time = OS_MsTime() + ms;
+	co->sleeping = 1;
+}
+
+//******** Coroutine_Count ***************
+// Outputs: number of coroutines which have not yet exited
+uint32_t Coroutine_Count(void) {
+	return coroutine_cnt_alive;
+}
@@ -0,0 +1,110 @@
+// ************************** Coroutine.h **************************
+// Stackless cooperative tasks (protothread style) multiplexed on a single host thread.
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	A coroutine is a resumable function with a small state struct instead of a stack.
+	Each call runs the function from its last wait point until it blocks, yields or exits.
+
+	NOTE: Local variables are NOT preserved across wait points (there is no stack).
+				Anything that must survive a CO_YIELD/CO_WAIT_* belongs in the arg struct.
+
+				The wait macros expand to case labels keyed on __LINE__, so they can not be
+				used inside a switch statement in the coroutine body, and only one may
+				appear on each source line.
+
+	Example:
+		int Blink(Coroutine_t *co) {
+			CO_BEGIN(co);
+			for(;;) {
+				PF1 ^= 0x02;
+				CO_SLEEP(co, 500);
+			}
+			CO_END(co);
+		}
+
+		Coroutine_Init(3);
+		Coroutine_Add(&Blink, 0);
+*/
+
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+
+// Stack size of the host thread. Coroutine bodies run on this stack (and must fit in it)
+#define COROUTINE_HOST_STACK_SIZE 512
+
+// Time the host thread sleeps when no coroutine could make progress (in ms)
+#define COROUTINE_IDLE_SLEEP 1
+
+// Return values of a coroutine body
+#define CO_WAITING 0				// Blocked on a semaphore, timer or condition
+#define CO_YIELDED 1				// Gave up the host voluntarily, run again next pass
+#define CO_EXITED  2				// Finished, the host will free the coroutine
+
+typedef struct Coroutine {
+	struct Coroutine *next_ptr, *prev_ptr;	// For use in linked lists
+	uint16_t lc;														// Local continuation (line number of the last wait point)
+	uint8_t id;
+	uint8_t sleeping;												// Boolean for whether wake_time is valid
+	uint32_t wake_time;											// In ms (OS_MsTime)
+	int (*func)(struct Coroutine *co);
+	void *arg;
+} Coroutine_t;
+
+
+// ************************************** MACROS **************************************
+
+#define CO_BEGIN(co)	switch((co)->lc) { case 0:
+
+#define CO_END(co)		} (co)->lc = 0; return CO_EXITED
+
+// Exit from anywhere in the body
+#define CO_EXIT(co)		do { (co)->lc = 0; return CO_EXITED; } while(0)
+
+// Let every other coroutine run once before continuing
+#define CO_YIELD(co)	do { (co)->lc = __LINE__; return CO_YIELDED; case __LINE__:; } while(0)
+
+// Block until cond is true. cond is re-evaluated on every pass of the host
+#define CO_WAIT_UNTIL(co, cond) \
+	do { (co)->lc = __LINE__; case __LINE__: if(!(cond)) return CO_WAITING; } while(0)
+
+// Decrement a counting semaphore, blocking the coroutine (not the host) while it is unavailable
+#define CO_WAIT_SEMA(co, semaPt)	CO_WAIT_UNTIL(co, OS_Wait_noblock(semaPt))
+
+// Sleep for at least ms milliseconds
+#define CO_SLEEP(co, ms) \
+	do { Coroutine_SetWake(co, ms); (co)->lc = __LINE__; return CO_WAITING; case __LINE__:; } while(0)
+
+
+// ************************************** FUNCTIONS **************************************
+
+//******** Coroutine_Init ***************
+// Start the host thread which runs all coroutines
+// Inputs: priority of the host thread
+// Outputs: 1 if successful, 0 if the host thread could not be added
+int Coroutine_Init(uint32_t priority);
+
+//******** Coroutine_Add ***************
+// Add a coroutine to the host thread
+// Inputs:
+//		func: coroutine body, must start with CO_BEGIN and end with CO_END
+//		arg:	user state, available to the body as co->arg
+// Outputs: pointer to the coroutine, 0 if it could not be allocated
+Coroutine_t* Coroutine_Add(int (*func)(Coroutine_t *co), void *arg);
+
+//******** Coroutine_SetWake ***************
+// Used by CO_SLEEP, mark a coroutine as sleeping for ms milliseconds
+// Inputs: coroutine and time to sleep in ms
+// Outputs: none
+void Coroutine_SetWake(Coroutine_t *co, uint32_t ms);
+
+//******** Coroutine_Count ***************
+// Outputs: number of coroutines which have not yet exited
+uint32_t Coroutine_Count(void);
+
+#endif
@@ -73,8 +73,15 @@ void scheduler_update_priority(TCB_t *thread, uint8_t new_priority) {
 	// TODO
 }
 
+// Threads of a process which exhausted its CPU reservation are not run
+// Background threads run to completion and are never throttled
+static uint8_t is_throttled(TCB_t *thread) {
+	return thread->process != 0 && thread->process->throttled;
+}
+
 /* scheduler_next
 Simple round robin scheduler which just goes in order around the list
+Threads of throttled processes are skipped, falling through to lower priorities
 
 Inputs: None
 Outputs: pointer to next thread that should be run
@@ -91,33 +98,34 @@ TCB_t* scheduler_next(void) {
 		return RunPt;
 	}
 	
-	TCB_t *head = 0;
-	uint8_t i = 0;
-	// Find first LL with a non-null pointer
-	while((head == 0) && (i < MAX_THREAD_PRIORITY)) {
-		head = Priority_Levels[i];
-		i++;
-	}
-	i--;
-	
-	if(head == 0) { // Nothing is scheduled, use the base OS program
-		EndCritical(I);
-		return &INIT_TCB;
-	}
-	
-	// For background threads only
-	if(i == 0) {
+	// Background threads first
+	if(Priority_Levels[0] != 0) {
 		locked = 1;
 		thread_to_schedule = (TCB_t *)PrioQ_pop((PrioQ_node_t **) &Priority_Levels[0]);
 		EndCritical(I);
 		return thread_to_schedule;
 	}
 	
-	// Execute round robin scheduling on that list
-	thread_to_schedule = head->next_ptr;
-	Priority_Levels[i] = thread_to_schedule;
+	// Find first LL with a runnable thread
+	for(uint8_t i = 1; i < MAX_THREAD_PRIORITY; i++) {
+		TCB_t *head = Priority_Levels[i];
+		if(head == 0) {
+			continue;
+		}
+		
+		// Execute round robin scheduling on that list
+		thread_to_schedule = head->next_ptr;
+		do {
+			if(!is_throttled(thread_to_schedule)) {
+				Priority_Levels[i] = thread_to_schedule;
+				EndCritical(I);
+				return thread_to_schedule;
+			}
+			thread_to_schedule = thread_to_schedule->next_ptr;
+		} while(thread_to_schedule != head->next_ptr);
+	}
+	
+	// Nothing is runnable, use the base OS program
 	EndCritical(I);
-	return thread_to_schedule;
+	return &INIT_TCB;
 }
-
-
@@ -38,7 +38,7 @@ void PrioQ_insert(PrioQ_node_t **head, PrioQ_node_t *node) {
 		if(prev_node == node) // no duplicates
 			return;
 		
-		if((prev_node->priority >= node->priority) && (node->priority <  n->priority)) {
+		if((prev_node->priority <= node->priority) && (node->priority <  n->priority)) {
 			// Insert here
 			node->next_ptr = n;
 			node->prev_ptr = prev_node;
@@ -0,0 +1,223 @@
+#include "AsyncIO.h"
+#include <string.h>
+
+PrioQ_node_t *aio_queue = 0;		// Submitted requests, highest priority first, in submission order within a priority
+Sema4Type aio_pending;					// Number of queued requests
+uint8_t aio_stage[AIO_STAGE_SIZE];	// Merged reads and writes, only used by the I/O thread
+
+
+// ******** aio_take ************
+// Remove the next request from the queue, along with the other queued requests of the same
+// file, direction and priority. The batch is sorted by file position (stable, so appends
+// stay in submission order)
+// input:  IORequest_t *batch[] - result, AIO_BATCH entries
+// output: number of requests taken
+static uint32_t aio_take(IORequest_t *batch[]) {
+	uint32_t n = 0;
+
+	int I = StartCritical();
+	IORequest_t *first = (IORequest_t *) PrioQ_pop(&aio_queue);
+	if(first == 0) {
+		EndCritical(I);
+		return 0;
+	}
+	batch[n++] = first;
+
+	// Requests of one priority are adjacent in the queue
+	PrioQ_node_t *node = aio_queue;
+	while(node != 0 && node->priority == first->node.priority && n < AIO_BATCH) {
+		PrioQ_node_t *next = node->next_ptr;
+		IORequest_t *req = (IORequest_t *) node;
+		if(req->file == first->file && req->op == first->op) {
+			PrioQ_remove(&aio_queue, node);
+			OS_Wait_noblock(&aio_pending); // Counted when it was submitted
+			batch[n++] = req;
+		}
+		node = next;
+	}
+	EndCritical(I);
+
+	// Insertion sort, the batch is small
+	for(uint32_t i = 1; i < n; i++) {
+		IORequest_t *req = batch[i];
+		uint32_t j = i;
+		while(j > 0 && batch[j-1]->pos > req->pos) {
+			batch[j] = batch[j-1];
+			j--;
+		}
+		batch[j] = req;
+	}
+	return n;
+}
+
+// ******** aio_complete ************
+static void aio_complete(IORequest_t *req, uint32_t result) {
+	req->result = result;
+	req->state = AIO_DONE;
+	if(req->callback) {
+		req->callback(req);
+	}
+	OS_Signal(&req->done);
+}
+
+// ******** aio_service ************
+// Service a batch from aio_take, merging runs of contiguous requests which fit in aio_stage
+static void aio_service(IORequest_t *batch[], uint32_t n) {
+	File_t *file = batch[0]->file;
+	uint8_t write = batch[0]->op == AIO_WRITE;
+
+	// Appends go after the end of the file and every other write in the batch
+	if(write) {
+		uint32_t end = eFile_F_length(file);
+		for(uint32_t i = 0; i < n && batch[i]->pos != AIO_APPEND; i++) {
+			if(batch[i]->pos + batch[i]->size > end) {
+				end = batch[i]->pos + batch[i]->size;
+			}
+		}
+		for(uint32_t i = 0; i < n; i++) {
+			if(batch[i]->pos == AIO_APPEND) {
+				batch[i]->pos = end;
+				end += batch[i]->size;
+			}
+		}
+	}
+
+	uint32_t i = 0;
+	while(i < n) {
+		// Find the run of requests starting at i
+		uint32_t pos = batch[i]->pos;
+		uint32_t len = batch[i]->size;
+		uint32_t j = i+1;
+		while(j < n && batch[j]->pos == pos + len && len + batch[j]->size <= AIO_STAGE_SIZE) {
+			len += batch[j]->size;
+			j++;
+		}
+
+		uint32_t r = 0;
+		if(j > i+1 && write) {
+			uint32_t ofs = 0;
+			for(uint32_t k = i; k < j; k++) {
+				memcpy(&aio_stage[ofs], batch[k]->buffer, batch[k]->size);
+				ofs += batch[k]->size;
+			}
+			r = eFile_F_write_at(file, aio_stage, len, pos);
+		}
+		else if(j > i+1) {
+			r = eFile_F_read_at(file, aio_stage, len, pos);
+		}
+
+		if(j > i+1 && r == len) {
+			uint32_t ofs = 0;
+			for(uint32_t k = i; k < j; k++) {
+				if(!write) {
+					memcpy(batch[k]->buffer, &aio_stage[ofs], batch[k]->size);
+				}
+				ofs += batch[k]->size;
+				aio_complete(batch[k], batch[k]->size);
+			}
+		}
+		else {
+			// Alone, or the merged request failed (e.g. a read past the end of the file)
+			for(uint32_t k = i; k < j; k++) {
+				if(write) {
+					r = eFile_F_write_at(file, batch[k]->buffer, batch[k]->size, batch[k]->pos);
+				}
+				else {
+					r = eFile_F_read_at(file, batch[k]->buffer, batch[k]->size, batch[k]->pos);
+				}
+				aio_complete(batch[k], r);
+			}
+		}
+		i = j;
+	}
+}
+
+// ******** aio_thread ************
+// The disk I/O thread, services batches as they are submitted
+static void aio_thread(void) {
+	IORequest_t *batch[AIO_BATCH];
+	while(1) {
+		OS_Wait(&aio_pending);
+		uint32_t n = aio_take(batch);
+		if(n) {
+			aio_service(batch, n);
+		}
+	}
+}
+
+
+// ******** AIO_Init ************
+// Start the disk I/O thread
+// input:  uint32_t priority - priority of the I/O thread
+// output: 1 on success, 0 on fail
+int AIO_Init(uint32_t priority) {
+	aio_queue = 0;
+	OS_InitSemaphore(&aio_pending, 0);
+	return OS_AddThread(&aio_thread, 256, priority);
+}
+
+// ******** AIO_Request ************
+// Fill in a request descriptor
+// input:  IORequest_t *req  - descriptor to fill in
+//				 uint8_t op        - AIO_READ or AIO_WRITE
+//				 File_t *file      - open file
+//				 void *buffer      - data to write, or where to read into
+//				 uint32_t size     - number of bytes
+//				 uint32_t pos      - file position, AIO_APPEND to write at the end of the file
+//				 uint32_t priority - 0 is serviced first
+// output: none
+void AIO_Request(IORequest_t *req, uint8_t op, File_t *file, void *buffer,
+									uint32_t size, uint32_t pos, uint32_t priority) {
+	req->node.next_ptr = 0;
+	req->node.prev_ptr = 0;
+	req->node.priority = priority;
+	req->node.data = req;
+	req->file = file;
+	req->buffer = buffer;
+	req->size = size;
+	req->pos = pos;
+	req->op = op;
+	req->state = AIO_DONE;
+	req->result = 0;
+	req->callback = 0;
+}
+
+// ******** AIO_Submit ************
+// Queue a request for the I/O thread and return without waiting for it.
+// Does not block, so it may also be called from a periodic task
+// input:  IORequest_t *req - filled in request, not already queued
+// output: 1 on success, 0 on fail
+int AIO_Submit(IORequest_t *req) {
+	if(req->file == 0 || req->file->iNode == 0 || req->size == 0 ||
+		(req->op == AIO_READ && req->pos == AIO_APPEND)) {
+		return 0;
+	}
+
+	req->state = AIO_QUEUED;
+	req->result = 0;
+	OS_InitSemaphore(&req->done, 0);
+
+	int I = StartCritical();
+	PrioQ_insert(&aio_queue, &req->node);
+	EndCritical(I);
+
+	OS_Signal(&aio_pending);
+	return 1;
+}
+
+// ******** AIO_Wait ************
+// Block until a submitted request completes
+// input:  IORequest_t *req - submitted request
+// output: bytes read or written, 0 on fail
+uint32_t AIO_Wait(IORequest_t *req) {
+	OS_Wait(&req->done);
+	return req->result;
+}
+
+// ******** AIO_Done ************
+// Check without blocking whether a submitted request has completed
+// input:  IORequest_t *req - submitted request
+// output: 1 if complete, 0 if still queued
+int AIO_Done(IORequest_t *req) {
+	return req->state == AIO_DONE;
+}
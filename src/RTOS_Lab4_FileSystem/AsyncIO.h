@@ -0,0 +1,91 @@
+/*
+Asynchronous file reads and writes, serviced by a disk I/O thread.
+
+A thread fills in an IORequest_t and submits it, then keeps running. The I/O thread
+takes queued requests highest priority first (0 is highest, as for threads) and, for
+each, batches every other queued request of the same file, direction and priority.
+A batch is serviced in file position order, and runs of contiguous small requests
+are merged into one staged read or write, so e.g. many short log records appended
+back to back cost one eFile write (and one read-modify-write of the last block).
+
+On completion the request's result is set, its callback (if any) is run on the I/O
+thread, and its done semaphore is signalled.
+
+The request (and its buffer and file) belong to the caller and must stay valid until
+the request completes.
+*/
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab3_RTOSpriority/PriorityQueue.h"
+
+#define AIO_READ  0
+#define AIO_WRITE 1
+
+// Write position meaning the end of the file when the request is serviced
+#define AIO_APPEND 0xFFFFFFFF
+
+// Most bytes merged into one staged read or write
+#define AIO_STAGE_SIZE 1024
+
+// Most requests serviced in one batch
+#define AIO_BATCH 8
+
+#define AIO_QUEUED 0
+#define AIO_DONE   1
+
+typedef struct IORequest {
+	PrioQ_node_t node;								// Queue link and priority, must be first
+	File_t *file;
+	void *buffer;
+	uint32_t size;
+	uint32_t pos;											// File position, or AIO_APPEND for writes (set to where the data went)
+	uint8_t op;												// AIO_READ or AIO_WRITE
+	volatile uint8_t state;						// AIO_QUEUED or AIO_DONE
+	uint32_t result;									// Bytes read or written, 0 on fail
+	Sema4Type done;										// Signalled on completion
+	void (*callback)(struct IORequest *req);	// Optional, run on the I/O thread
+} IORequest_t;
+
+// ******** AIO_Init ************
+// Start the disk I/O thread
+// input:  uint32_t priority - priority of the I/O thread
+// output: 1 on success, 0 on fail
+int AIO_Init(uint32_t priority);
+
+// ******** AIO_Request ************
+// Fill in a request descriptor
+// input:  IORequest_t *req  - descriptor to fill in
+//				 uint8_t op        - AIO_READ or AIO_WRITE
+//				 File_t *file      - open file
+//				 void *buffer      - data to write, or where to read into
+//				 uint32_t size     - number of bytes
+//				 uint32_t pos      - file position, AIO_APPEND to write at the end of the file
+//				 uint32_t priority - 0 is serviced first
+// output: none
+void AIO_Request(IORequest_t *req, uint8_t op, File_t *file, void *buffer,
+									uint32_t size, uint32_t pos, uint32_t priority);
+
+// ******** AIO_Submit ************
+// Queue a request for the I/O thread and return without waiting for it
+// input:  IORequest_t *req - filled in request, not already queued
+// output: 1 on success, 0 on fail
+int AIO_Submit(IORequest_t *req);
+
+// ******** AIO_Wait ************
+// Block until a submitted request completes
+// input:  IORequest_t *req - submitted request
+// output: bytes read or written, 0 on fail
+uint32_t AIO_Wait(IORequest_t *req);
+
+// ******** AIO_Done ************
+// Check without blocking whether a submitted request has completed
+// input:  IORequest_t *req - submitted request
+// output: 1 if complete, 0 if still queued
+int AIO_Done(IORequest_t *req);
+
+#endif
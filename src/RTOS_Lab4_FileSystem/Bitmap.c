@@ -2,8 +2,10 @@
 
 #include "Bitmap.h"
 #include <stdio.h>
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
 #include "../RTOS_Labs_common/eFile.h"
-#include "../RTOS_Labs_common/eDisk.h"
+#include "Journal.h"
 
 
 #define BITMAP_SECTORS 10
@@ -15,6 +17,40 @@ uint32_t BitmapEnd = 0;
 uint32_t loaded_sector = 0;	// TODO Implement for large bitmaps
 uint32_t cursor = 0;	// TODO implement cursor for more effecient searching 
 uint8_t BitmapBuf[BLOCK_SIZE];
+uint32_t BitmapChanges = 0;	// BITMAP_CHANGED/BITMAP_FREED since the last Bitmap_Snapshot
+Sema4Type bitmap_lock;			// Guards BitmapBuf, cursor and BitmapChanges, taken by every Bitmap_* function
+
+// Unlocked helpers, bitmap_lock must be held
+static uint32_t bit_isAllocd(uint32_t idx) {
+	return (BitmapBuf[idx/8] >> (idx % 8)) & 0x1;
+}
+
+static void bit_free(uint32_t idx) {
+	BitmapBuf[idx/8] &= ~(0x1 << (idx % 8));
+	BitmapChanges |= BITMAP_CHANGED | BITMAP_FREED;
+}
+
+static uint32_t bit_allocOne(void) {
+	uint32_t i = cursor, j = 0;
+	while(BitmapBuf[i] == 0xFF) {
+		i = (i+1) % BLOCK_SIZE;
+		
+		// Didn't find any valid sectors
+		if(i == cursor) {
+			return -1;
+		}
+	}
+	
+	cursor = i;
+	while((BitmapBuf[i] >> j) & 0x1) {
+		j++;
+	}
+		
+	BitmapBuf[i] |= 0x1 << j;
+	BitmapChanges |= BITMAP_CHANGED;
+	
+	return i*8 + j;
+}
 
 
 // ******** Bitmap_Reset ************
@@ -22,14 +58,27 @@ uint8_t BitmapBuf[BLOCK_SIZE];
 // input:  none
 // output: none
 void Bitmap_Reset(void) {
+	OS_Wait(&bitmap_lock);
 	loaded_sector = 0;
 	cursor = 0;
-	for(uint32_t i; i < BLOCK_SIZE; i++) {
+	for(uint32_t i = 0; i < BLOCK_SIZE; i++) {
 		BitmapBuf[i] = 0x00;
 	}
 	// 0. - bitmap
 	// 1. - root dir header
 	BitmapBuf[0] = 0b00000011;
+	
+	// 2. - journal
+	for(uint32_t i = JOURNAL_START; i < JOURNAL_START + JOURNAL_SECTORS; i++) {
+		BitmapBuf[i/8] |= 0x1 << (i % 8);
+	}
+	
+	// Past the end of a small drive
+	for(uint32_t i = NumSectors; i < 8*BLOCK_SIZE; i++) {
+		BitmapBuf[i/8] |= 0x1 << (i % 8);
+	}
+	BitmapChanges = BITMAP_CHANGED;
+	OS_Signal(&bitmap_lock);
 }
 
 
@@ -39,7 +88,7 @@ void Bitmap_Reset(void) {
 // output: none
 void Bitmap_Write_Out(void) {
 	printf("Writing out bitmap!\r\n");
-	eDisk_WriteBlock(BitmapBuf, loaded_sector);
+	BlockDev_Write(eFileDev, BitmapBuf, loaded_sector, 1);
 }
 
 // ******** Bitmap_Read_In ************
@@ -47,7 +96,7 @@ void Bitmap_Write_Out(void) {
 // input:  none
 // output: none
 void Bitmap_Read_In(uint32_t sector) {
-	eDisk_ReadBlock(BitmapBuf, sector);
+	BlockDev_Read(eFileDev, BitmapBuf, sector, 1);
 }
 
 // ******** Bitmap_Mount ************
@@ -56,7 +105,10 @@ void Bitmap_Read_In(uint32_t sector) {
 // output: none
 void Bitmap_Mount(void) {
 	// TODO Support general bitmap
+	OS_Wait(&bitmap_lock);
 	Bitmap_Read_In(0);
+	BitmapChanges = 0;
+	OS_Signal(&bitmap_lock);
 }
 
 // ******** Bitmap_Unmount ************
@@ -65,7 +117,9 @@ void Bitmap_Mount(void) {
 // output: none
 void Bitmap_Unmount(void) {
 	// TODO Support general bitmap
+	OS_Wait(&bitmap_lock);
 	Bitmap_Write_Out();
+	OS_Signal(&bitmap_lock);
 }
 
 
@@ -80,6 +134,7 @@ void Bitmap_Init(uint32_t size) {
 	}
 	
 	BitmapEnd = (size+BLOCK_SIZE-1) / BLOCK_SIZE; // Effectively math.ceil(size/block_size)
+	OS_InitSemaphore(&bitmap_lock, 1);
 	
 	Bitmap_Reset();
 }
@@ -94,24 +149,10 @@ void Bitmap_Init(uint32_t size) {
 //							that has been allocated
 uint32_t Bitmap_AllocOne(void) {
 	// TODO Support general bitmap
-	uint32_t i = cursor, j = 0;
-	while(BitmapBuf[i] == 0xFF) {
-		i = (i+1) % BLOCK_SIZE;
-		
-		// Didn't find any valid sectors
-		if(i == cursor) {
-			return -1;
-		}
-	}
-	
-	cursor = i;
-	while((BitmapBuf[i] >> j) & 0x1) {
-		j++;
-	}
-		
-	BitmapBuf[i] |= 0x1 << j;
-	
-	return i*8 + j;
+	OS_Wait(&bitmap_lock);
+	uint32_t s = bit_allocOne();
+	OS_Signal(&bitmap_lock);
+	return s;
 }
 
 
@@ -121,10 +162,96 @@ uint32_t Bitmap_AllocOne(void) {
 //				 uint32_t    N - number of sectors to allocate
 // output: buffer contains N allocated sectors
 void Bitmap_AllocN(uint32_t *buf, uint32_t N) {
+	OS_Wait(&bitmap_lock);
 	for(uint32_t i = 0; i < N; i++) {
-		buf[i] = Bitmap_AllocOne();
+		buf[i] = bit_allocOne();
 	}
+	OS_Signal(&bitmap_lock);
+}
+
+
+// ******** Bitmap_AllocRun ************
+// Allocate up to N contiguous free sectors, preferring a run starting at goal
+// input:  uint32_t goal - sector to continue from (e.g. the end of a file), 0 for none
+//				 uint32_t    N - number of sectors wanted
+//				 uint32_t *len - result, number of sectors allocated (1 to N)
+// output: first sector of the run, -1 if the disk is full
+uint32_t Bitmap_AllocRun(uint32_t goal, uint32_t N, uint32_t *len) {
+	// TODO Support general bitmap
+	uint32_t nbits = BLOCK_SIZE*8;
+	uint32_t start = -1;
+	uint32_t run = 0;
 	
+	// The search and the marking must be one step, or two threads could take the same run
+	OS_Wait(&bitmap_lock);
+	if(goal != 0 && goal < nbits && !bit_isAllocd(goal)) {
+		start = goal;
+	}
+	else {
+		// First run of N free sectors after the cursor, otherwise the longest run seen
+		uint32_t i = cursor*8;
+		uint32_t scanned = 0;
+		while(scanned < nbits) {
+			if(i % 8 == 0 && BitmapBuf[i/8] == 0xFF) {
+				i += 8;
+				scanned += 8;
+			}
+			else if(!bit_isAllocd(i)) {
+				uint32_t r = 1;
+				while(r < N && i+r < nbits && !bit_isAllocd(i+r)) {
+					r++;
+				}
+				if(r > run) {
+					start = i;
+					run = r;
+					if(run == N) {
+						break;
+					}
+				}
+				i += r;
+				scanned += r;
+			}
+			else {
+				i++;
+				scanned++;
+			}
+			
+			if(i >= nbits) {
+				i = 0;
+			}
+		}
+		
+		if(run == 0) {
+			OS_Signal(&bitmap_lock);
+			return -1; // Didn't find any valid sectors
+		}
+	}
+	
+	run = 0;
+	while(run < N && start+run < nbits && !bit_isAllocd(start+run)) {
+		BitmapBuf[(start+run)/8] |= 0x1 << ((start+run) % 8);
+		run++;
+	}
+	
+	cursor = ((start+run)/8) % BLOCK_SIZE;
+	BitmapChanges |= BITMAP_CHANGED;
+	OS_Signal(&bitmap_lock);
+	*len = run;
+	return start;
+}
+
+
+// ******** Bitmap_FreeRun ************
+// Free N contiguous sectors
+// input:  uint32_t start - first sector of the run
+//				 uint32_t     N - number of sectors
+// output: none
+void Bitmap_FreeRun(uint32_t start, uint32_t N) {
+	OS_Wait(&bitmap_lock);
+	for(uint32_t i = 0; i < N; i++) {
+		bit_free(start+i);
+	}
+	OS_Signal(&bitmap_lock);
 }
 
 
@@ -144,7 +271,10 @@ uint32_t Bitmap_isFree(uint32_t idx) {
 // output: 0 if free, 1 if allocated
 uint32_t Bitmap_isAllocd(uint32_t idx) {
 	// TODO support general bitmap
-	return (BitmapBuf[idx/8] >> (idx % 8)) & 0x1;
+	OS_Wait(&bitmap_lock);
+	uint32_t r = bit_isAllocd(idx);
+	OS_Signal(&bitmap_lock);
+	return r;
 }
 
 
@@ -153,8 +283,25 @@ uint32_t Bitmap_isAllocd(uint32_t idx) {
 // input:  uint32_t idx - the sector number to free
 // output: none
 void Bitmap_free(uint32_t idx) {
-	BitmapBuf[idx/8] &= ~(0x1 << (idx % 8));
+	OS_Wait(&bitmap_lock);
+	bit_free(idx);
+	OS_Signal(&bitmap_lock);
 }
 
 
-
+// ******** Bitmap_Snapshot ************
+// Copy the bitmap sector and return and clear what happened to it since the last call,
+// as one step so the image matches the changes, for journaling
+// input:  void *buff       - result, BLOCK_SIZE copy of the bitmap sector
+//				 uint32_t *sector - result, the sector the image belongs in
+// output: BITMAP_CHANGED and/or BITMAP_FREED
+uint32_t Bitmap_Snapshot(void *buff, uint32_t *sector) {
+	// TODO Support general bitmap
+	OS_Wait(&bitmap_lock);
+	memcpy(buff, BitmapBuf, BLOCK_SIZE);
+	*sector = loaded_sector;
+	uint32_t c = BitmapChanges;
+	BitmapChanges = 0;
+	OS_Signal(&bitmap_lock);
+	return c;
+}
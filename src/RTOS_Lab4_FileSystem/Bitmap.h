@@ -5,6 +5,9 @@ Definitions for a bitmap intended to be used specifically with the FS.
 because the bitmap can grow very large, and we do not have VM, the entire BM is not kept in RAM,
 hence this implementation is not usable for anything except the filesys bitmap
 
+Every Bitmap_* function takes the bitmap lock, so threads allocating for different files
+(under their own iNode locks, outside any journal transaction) never get the same sectors.
+
 */
 
 
@@ -14,6 +17,10 @@ hence this implementation is not usable for anything except the filesys bitmap
 
 #include <stdint.h>
 
+// Bitmap_Changes flags
+#define BITMAP_CHANGED 0x01		// A sector was allocated or freed
+#define BITMAP_FREED	 0x02		// A sector was freed
+
 // ******** Bitmap_Reset ************
 // Reset the bitmap buffer to that of a newly formatted drive
 // input:  none
@@ -47,6 +54,21 @@ uint32_t Bitmap_AllocOne(void);
 // output: buffer contains N allocated sectors
 void Bitmap_AllocN(uint32_t *buf, uint32_t N); 
 
+// ******** Bitmap_AllocRun ************
+// Allocate up to N contiguous free sectors, preferring a run starting at goal
+// input:  uint32_t goal - sector to continue from (e.g. the end of a file), 0 for none
+//				 uint32_t    N - number of sectors wanted
+//				 uint32_t *len - result, number of sectors allocated (1 to N)
+// output: first sector of the run, -1 if the disk is full
+uint32_t Bitmap_AllocRun(uint32_t goal, uint32_t N, uint32_t *len);
+
+// ******** Bitmap_FreeRun ************
+// Free N contiguous sectors
+// input:  uint32_t start - first sector of the run
+//				 uint32_t     N - number of sectors
+// output: none
+void Bitmap_FreeRun(uint32_t start, uint32_t N);
+
 // ******** Bitmap_isFree ************
 // Check whether a specific sector is free
 // input:  uint32_t idx - the sector number to inspect
@@ -65,6 +87,14 @@ uint32_t Bitmap_isAllocd(uint32_t idx);
 // output: none
 void Bitmap_free(uint32_t idx);
 
+// ******** Bitmap_Snapshot ************
+// Copy the bitmap sector and return and clear what happened to it since the last call,
+// as one step so the image matches the changes, for journaling
+// input:  void *buff       - result, BLOCK_SIZE copy of the bitmap sector
+//				 uint32_t *sector - result, the sector the image belongs in
+// output: BITMAP_CHANGED and/or BITMAP_FREED
+uint32_t Bitmap_Snapshot(void *buff, uint32_t *sector);
+
 // ******** Bitmap_Unmount ************
 // Write the bitmap to disk
 // input:  none
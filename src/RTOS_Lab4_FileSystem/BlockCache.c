@@ -0,0 +1,147 @@
+#include "BlockCache.h"
+#include <string.h>
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+
+#define BCACHE_NONE 0xFFFFFFFF
+
+uint8_t BCacheData[BCACHE_BLOCKS][BLOCK_SIZE];
+uint32_t BCacheSector[BCACHE_BLOCKS];		// Sector held by each buffer, BCACHE_NONE if empty
+uint32_t BCacheNext = 0;								// Buffer the next read-ahead starts at
+Sema4Type bcache_lock;
+
+
+// ******** bcache_find ************
+// Buffer holding a sector, bcache_lock must be held
+// output: buffer index, -1 if not cached
+static int32_t bcache_find(uint32_t sector) {
+	for(int32_t i = 0; i < BCACHE_BLOCKS; i++) {
+		if(BCacheSector[i] == sector) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// ******** bcache_drop ************
+// Drop cached copies of a range of sectors, bcache_lock must be held
+static void bcache_drop(uint32_t sector, uint32_t count) {
+	for(uint32_t i = 0; i < BCACHE_BLOCKS; i++) {
+		if(BCacheSector[i] - sector < count) {
+			BCacheSector[i] = BCACHE_NONE;
+		}
+	}
+}
+
+
+// ******** BCache_Init ************
+// Initialize the cache lock and empty the cache
+// input:  none
+// output: none
+void BCache_Init(void) {
+	OS_InitSemaphore(&bcache_lock, 1);
+	BCache_Reset();
+}
+
+// ******** BCache_Reset ************
+// Empty the cache, e.g. when a drive is formatted or mounted
+// input:  none
+// output: none
+void BCache_Reset(void) {
+	for(uint32_t i = 0; i < BCACHE_BLOCKS; i++) {
+		BCacheSector[i] = BCACHE_NONE;
+	}
+	BCacheNext = 0;
+}
+
+// ******** BCache_Read ************
+// Read a block, from the cache if it is there
+// input:  void *buff      - result buffer
+//				 uint32_t sector - sector to read
+// output: 1 on success, 0 on fail
+int BCache_Read(void *buff, uint32_t sector) {
+	OS_Wait(&bcache_lock);
+	int32_t i = bcache_find(sector);
+	if(i >= 0) {
+		memcpy(buff, BCacheData[i], BLOCK_SIZE);
+		OS_Signal(&bcache_lock);
+		return 1;
+	}
+	OS_Signal(&bcache_lock);
+
+	// Not cached, a lone block is not worth keeping
+	return BlockDev_Read(eFileDev, buff, sector, 1);
+}
+
+// ******** BCache_Write ************
+// Write a block to disk, updating its cached copy
+// input:  const void *buff - block to write
+//				 uint32_t sector  - target sector
+// output: 1 on success, 0 on fail
+int BCache_Write(const void *buff, uint32_t sector) {
+	OS_Wait(&bcache_lock);
+	int r = BlockDev_Write(eFileDev, buff, sector, 1);
+	int32_t i = bcache_find(sector);
+	if(i >= 0) {
+		if(r) {
+			memcpy(BCacheData[i], buff, BLOCK_SIZE);
+		}
+		else {
+			BCacheSector[i] = BCACHE_NONE; // Unknown what made it to the disk
+		}
+	}
+	OS_Signal(&bcache_lock);
+	return r;
+}
+
+// ******** BCache_Prefetch ************
+// Read contiguous sectors into the cache with one disk command.
+// Nothing is read if the first sector is already cached
+// input:  uint32_t sector - first sector
+//				 uint32_t count  - number of sectors, at most BCACHE_BLOCKS are read
+// output: 1 on success, 0 on fail
+int BCache_Prefetch(uint32_t sector, uint32_t count) {
+	if(count == 0) {
+		return 1;
+	}
+	if(count > BCACHE_BLOCKS) {
+		count = BCACHE_BLOCKS;
+	}
+
+	OS_Wait(&bcache_lock);
+	if(bcache_find(sector) >= 0) {
+		OS_Signal(&bcache_lock);
+		return 1;
+	}
+
+	// Keep the destination contiguous
+	if(BCacheNext + count > BCACHE_BLOCKS) {
+		BCacheNext = 0;
+	}
+	uint32_t first = BCacheNext;
+	bcache_drop(sector, count);
+	for(uint32_t i = 0; i < count; i++) {
+		BCacheSector[first + i] = BCACHE_NONE;
+	}
+
+	int r = BlockDev_Read(eFileDev, BCacheData[first], sector, count);
+	if(r) {
+		for(uint32_t i = 0; i < count; i++) {
+			BCacheSector[first + i] = sector + i;
+		}
+		BCacheNext = first + count;
+	}
+	OS_Signal(&bcache_lock);
+	return r;
+}
+
+// ******** BCache_Invalidate ************
+// Drop cached copies of a range of sectors, e.g. when they are allocated
+// input:  uint32_t sector - first sector
+//				 uint32_t count  - number of sectors
+// output: none
+void BCache_Invalidate(uint32_t sector, uint32_t count) {
+	OS_Wait(&bcache_lock);
+	bcache_drop(sector, count);
+	OS_Signal(&bcache_lock);
+}
@@ -0,0 +1,68 @@
+/*
+Cache of file data blocks, filled by read-ahead.
+
+A read-ahead reads several contiguous sectors with one multi-block disk command
+(one command and one wait for the card, instead of one per block) into a ring of
+BCACHE_BLOCKS buffers. The ring is filled in order, so the oldest read-ahead is
+replaced first, and a read-ahead never wraps (it starts over at the first buffer),
+keeping its destination contiguous.
+
+Only blocks brought in by a read-ahead are cached. Writes go straight to the disk
+and update a cached copy if there is one. Metadata (iNodes, directories, the bitmap)
+is never read through the cache.
+*/
+
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+
+// Cached blocks (BLOCK_SIZE bytes each)
+#define BCACHE_BLOCKS 8
+
+// Read-ahead window in blocks: the first on a sequential read, and the most
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX (BCACHE_BLOCKS/2)
+
+// ******** BCache_Init ************
+// Initialize the cache lock and empty the cache
+// input:  none
+// output: none
+void BCache_Init(void);
+
+// ******** BCache_Reset ************
+// Empty the cache, e.g. when a drive is formatted or mounted
+// input:  none
+// output: none
+void BCache_Reset(void);
+
+// ******** BCache_Read ************
+// Read a block, from the cache if it is there
+// input:  void *buff      - result buffer
+//				 uint32_t sector - sector to read
+// output: 1 on success, 0 on fail
+int BCache_Read(void *buff, uint32_t sector);
+
+// ******** BCache_Write ************
+// Write a block to disk, updating its cached copy
+// input:  const void *buff - block to write
+//				 uint32_t sector  - target sector
+// output: 1 on success, 0 on fail
+int BCache_Write(const void *buff, uint32_t sector);
+
+// ******** BCache_Prefetch ************
+// Read contiguous sectors into the cache with one disk command.
+// Nothing is read if the first sector is already cached
+// input:  uint32_t sector - first sector
+//				 uint32_t count  - number of sectors, at most BCACHE_BLOCKS are read
+// output: 1 on success, 0 on fail
+int BCache_Prefetch(uint32_t sector, uint32_t count);
+
+// ******** BCache_Invalidate ************
+// Drop cached copies of a range of sectors, e.g. when they are allocated
+// input:  uint32_t sector - first sector
+//				 uint32_t count  - number of sectors
+// output: none
+void BCache_Invalidate(uint32_t sector, uint32_t count);
+
+#endif
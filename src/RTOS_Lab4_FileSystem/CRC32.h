@@ -0,0 +1,26 @@
+/*
+CRC-32 (the zlib/Ethernet CRC) for checksumming file system metadata.
+
+Table driven, slicing-by-4: four 256 entry tables (4KB, in flash) let each aligned word
+be folded into the CRC with four lookups instead of a lookup per byte. A 512 byte block
+takes ~20-25us on the TM4C123 at 80 MHz, against ~550us to move it over the SPI bus.
+Slicing-by-8 would halve the loop count again for 4KB more flash, but the lookups are
+flash reads, so it gains little here.
+
+Results match zlib's crc32(), so a CRC can be checked on the host with any CRC-32 tool.
+*/
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+// ******** CRC32 ************
+// CRC-32 of a buffer, or of several buffers in a row by passing the result of the last
+// input:  uint32_t crc   - 0 to start, or the CRC of the data before buff
+//				 const void *buff - data, any alignment
+//				 uint32_t len  - bytes in buff
+// output: the CRC of everything so far
+uint32_t CRC32(uint32_t crc, const void *buff, uint32_t len);
+
+#endif
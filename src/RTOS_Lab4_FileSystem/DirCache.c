@@ -0,0 +1,127 @@
+#include <string.h>
+#include "DirCache.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab2_RTOSkernel/LinkedList.h"
+
+typedef struct DirCacheEntry {
+	struct DirCacheEntry *next_ptr, *prev_ptr;	// LRU order, head is the least recently used
+	uint32_t parent;														// 0 if the entry is unused
+	uint32_t hash;
+	uint32_t child;
+	uint8_t isDir;
+	char name[MAX_FILE_NAME_LENGTH+1];
+} DirCacheEntry_t;
+
+DirCacheEntry_t DirCache[DIRCACHE_ENTRIES];
+DirCacheEntry_t *DirCache_LRU_Head = 0;
+uint32_t DirCache_hits = 0;
+uint32_t DirCache_misses = 0;
+
+// Must be called in a critical section
+static DirCacheEntry_t* dircache_find(uint32_t parent, uint32_t hash, const char name[]) {
+	for(DirCacheEntry_t *e = DirCache_LRU_Head; e != 0; e = e->next_ptr) {
+		if(e->parent == parent && e->hash == hash && strcmp(e->name, name) == 0) {
+			return e;
+		}
+	}
+	return 0;
+}
+
+// Must be called in a critical section
+static void dircache_touch(DirCacheEntry_t *e) {
+	LL_remove((LL_node_t **) &DirCache_LRU_Head, (LL_node_t *) e);
+	LL_append_linear((LL_node_t **) &DirCache_LRU_Head, (LL_node_t *) e);
+}
+
+
+// ******** DirCache_Reset ************
+// Drop every entry (e.g. on format or mount)
+// input:  none
+// output: none
+void DirCache_Reset(void) {
+	int I = StartCritical();
+	DirCache_LRU_Head = 0;
+	for(uint32_t i = 0; i < DIRCACHE_ENTRIES; i++) {
+		DirCache[i].parent = 0;
+		LL_append_linear((LL_node_t **) &DirCache_LRU_Head, (LL_node_t *) &DirCache[i]);
+	}
+	DirCache_hits = 0;
+	DirCache_misses = 0;
+	EndCritical(I);
+}
+
+// ******** DirCache_Lookup ************
+// Find a cached name within a directory
+// output: 1 if the name is cached (positive or negative), 0 on a miss
+int DirCache_Lookup(uint32_t parent, const char name[], uint32_t *child, uint8_t *isDir) {
+	uint32_t hash = Dir_Hash(name);
+	
+	int I = StartCritical();
+	DirCacheEntry_t *e = dircache_find(parent, hash, name);
+	if(!e) {
+		DirCache_misses++;
+		EndCritical(I);
+		return 0;
+	}
+	
+	*child = e->child;
+	*isDir = e->isDir;
+	dircache_touch(e);
+	DirCache_hits++;
+	EndCritical(I);
+	return 1;
+}
+
+// ******** DirCache_Insert ************
+// Add or update a cached name, evicting the least recently used entry if needed
+// output: none
+void DirCache_Insert(uint32_t parent, const char name[], uint32_t child, uint8_t isDir) {
+	uint32_t hash = Dir_Hash(name);
+	if(strlen(name) > MAX_FILE_NAME_LENGTH) {
+		return;
+	}
+	
+	int I = StartCritical();
+	DirCacheEntry_t *e = dircache_find(parent, hash, name);
+	if(!e) {
+		e = DirCache_LRU_Head; // Unused entries are always moved to the head
+		e->parent = parent;
+		e->hash = hash;
+		strcpy(e->name, name);
+	}
+	e->child = child;
+	e->isDir = isDir;
+	dircache_touch(e);
+	EndCritical(I);
+}
+
+// ******** DirCache_InvalidateDir ************
+// Drop every name cached for a directory (e.g. when it is removed)
+// output: none
+void DirCache_InvalidateDir(uint32_t parent) {
+	int I = StartCritical();
+	DirCacheEntry_t *e = DirCache_LRU_Head;
+	while(e) {
+		DirCacheEntry_t *next = e->next_ptr;
+		if(e->parent == parent) {
+			// Reuse it first
+			e->parent = 0;
+			LL_remove((LL_node_t **) &DirCache_LRU_Head, (LL_node_t *) e);
+			e->next_ptr = DirCache_LRU_Head;
+			e->prev_ptr = 0;
+			if(DirCache_LRU_Head) {
+				DirCache_LRU_Head->prev_ptr = e;
+			}
+			DirCache_LRU_Head = e;
+		}
+		e = next;
+	}
+	EndCritical(I);
+}
+
+// ******** DirCache_Stats ************
+// output: none
+void DirCache_Stats(uint32_t *hits, uint32_t *misses) {
+	*hits = DirCache_hits;
+	*misses = DirCache_misses;
+}
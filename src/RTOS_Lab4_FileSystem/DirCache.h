@@ -0,0 +1,52 @@
+/*
+Directory entry cache. Maps (parent directory sector, name) to the child's header
+sector so that path walks do not have to open and search each directory.
+
+Negative entries (child sector 0) remember names which do not exist.
+Entries are evicted least recently used first. eFile keeps the cache coherent by
+calling DirCache_Insert on every add and remove.
+*/
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stdint.h>
+
+#define DIRCACHE_ENTRIES 16
+
+// ******** DirCache_Reset ************
+// Drop every entry (e.g. on format or mount)
+// input:  none
+// output: none
+void DirCache_Reset(void);
+
+// ******** DirCache_Lookup ************
+// Find a cached name within a directory
+// input:  uint32_t parent - header sector of the directory
+//				 const char name[] - name within the directory
+//				 uint32_t *child - result, header sector of the entry (0 if the name does not exist)
+//				 uint8_t *isDir - result, whether the entry is a directory
+// output: 1 if the name is cached (positive or negative), 0 on a miss
+int DirCache_Lookup(uint32_t parent, const char name[], uint32_t *child, uint8_t *isDir);
+
+// ******** DirCache_Insert ************
+// Add or update a cached name, evicting the least recently used entry if needed
+// input:  uint32_t parent - header sector of the directory
+//				 const char name[] - name within the directory
+//				 uint32_t child - header sector of the entry, 0 to record that it does not exist
+//				 uint8_t isDir - whether the entry is a directory
+// output: none
+void DirCache_Insert(uint32_t parent, const char name[], uint32_t child, uint8_t isDir);
+
+// ******** DirCache_InvalidateDir ************
+// Drop every name cached for a directory (e.g. when it is removed)
+// input:  uint32_t parent - header sector of the directory
+// output: none
+void DirCache_InvalidateDir(uint32_t parent);
+
+// ******** DirCache_Stats ************
+// input:  uint32_t *hits, uint32_t *misses - results, lookups since the last reset
+// output: none
+void DirCache_Stats(uint32_t *hits, uint32_t *misses);
+
+#endif
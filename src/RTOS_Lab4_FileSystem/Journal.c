@@ -0,0 +1,393 @@
+#include "Journal.h"
+#include <string.h>
+#include "Bitmap.h"
+#include "CRC32.h"
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eFile.h"
+
+#define JOURNAL_SUPER_MAGIC  0x4A524E4C		// "JRNL"
+#define JOURNAL_COMMIT_MAGIC 0x434D4954		// "CMIT"
+#define JSLOT_NONE 0xFFFFFFFF
+
+// Slot n of the log is sector JOURNAL_START+1+n
+#define JSLOT_SECTOR(n) (JOURNAL_START + 1 + (n))
+
+typedef struct JournalSuper {
+	uint32_t magic;
+	uint32_t seq;											// Sequence number of the first transaction in the log
+	uint8_t pad[BLOCK_SIZE - 8];
+} JournalSuper_t;
+
+typedef struct JournalCommit {
+	uint32_t magic;
+	uint32_t seq;
+	uint32_t count;										// Images in the slots just before this one
+	uint32_t targets[JOURNAL_MAX_BLOCKS];
+	uint32_t sums[JOURNAL_MAX_BLOCKS];
+	uint8_t pad[BLOCK_SIZE - 12 - 8*JOURNAL_MAX_BLOCKS];
+} JournalCommit_t;
+
+typedef char JournalSuper_size_check[sizeof(JournalSuper_t) == BLOCK_SIZE ? 1 : -1];
+typedef char JournalCommit_size_check[sizeof(JournalCommit_t) == BLOCK_SIZE ? 1 : -1];
+
+// The log always starts at slot 0, a checkpoint empties it
+uint32_t JournalTarget[JOURNAL_SLOTS];	// Target sector of each slot in use, JSLOT_NONE if unused
+uint32_t JournalHead = 0;								// Slots before this belong to committed transactions
+uint32_t JournalSeq = 1;								// Sequence number of the next commit
+uint32_t JournalGen = 0;								// Incremented by every checkpoint, lets readers detect one
+
+// Open transaction, its images are in slots JournalHead to JournalHead+TxCount-1
+uint32_t TxCount = 0;
+uint32_t TxSums[JOURNAL_MAX_BLOCKS];
+uint32_t TxChanges = 0;									// Bitmap changes of pieces already committed (Journal_Write)
+
+Sema4Type journal_lock;
+TCB_t *journal_owner = 0;
+uint32_t journal_depth = 0;
+uint8_t jbuff[BLOCK_SIZE];							// Commit, superblock and checkpoint buffer, journal_lock must be held
+
+
+// ******** journal_sum ************
+// CRC32 of a block image
+static uint32_t journal_sum(const void *buff) {
+	return CRC32(0, buff, BLOCK_SIZE);
+}
+
+// ******** journal_reset ************
+// Forget every slot, the log restarts at slot 0
+static void journal_reset(void) {
+	for(uint32_t i = 0; i < JOURNAL_SLOTS; i++) {
+		JournalTarget[i] = JSLOT_NONE;
+	}
+	JournalHead = 0;
+	TxCount = 0;
+}
+
+// ******** journal_write_super ************
+static int journal_write_super(void) {
+	JournalSuper_t *sb = (JournalSuper_t *) jbuff;
+	memset(jbuff, 0, BLOCK_SIZE);
+	sb->magic = JOURNAL_SUPER_MAGIC;
+	sb->seq = JournalSeq;
+	return BlockDev_Write(eFileDev, jbuff, JOURNAL_START, 1);
+}
+
+// ******** journal_checkpoint ************
+// Copy the newest image of each logged block in place, then empty the log.
+// The superblock is written last, a crash before then replays the same images again
+static int journal_checkpoint(void) {
+	int r = 1;
+	for(uint32_t i = 0; i < JournalHead; i++) {
+		uint32_t t = JournalTarget[i];
+		if(t == JSLOT_NONE) {
+			continue;
+		}
+
+		// Only the newest image of a block is copied
+		uint8_t newest = 1;
+		for(uint32_t j = i+1; j < JournalHead; j++) {
+			if(JournalTarget[j] == t) {
+				newest = 0;
+				break;
+			}
+		}
+
+		if(newest) {
+			r &= BlockDev_Read(eFileDev, jbuff, JSLOT_SECTOR(i), 1);
+			r &= BlockDev_Write(eFileDev, jbuff, t, 1);
+		}
+	}
+
+	if(!r) {
+		return 0; // Keep the log, it is still needed
+	}
+
+	r = journal_write_super();
+	int I = StartCritical();
+	JournalGen++;
+	journal_reset();
+	EndCritical(I);
+	return r;
+}
+
+// ******** journal_log ************
+// Write a block image to a slot of the open transaction, reusing the slot of an
+// earlier image of the same sector. Fails if the transaction is full
+static int journal_log(const void *buff, uint32_t sector) {
+	uint32_t i;
+	for(i = 0; i < TxCount; i++) {
+		if(JournalTarget[JournalHead + i] == sector) {
+			break;
+		}
+	}
+
+	if(i == TxCount) {
+		if(TxCount == JOURNAL_MAX_BLOCKS) {
+			return 0;
+		}
+		TxCount++;
+	}
+
+	uint32_t slot = JournalHead + i;
+	if(!BlockDev_Write(eFileDev, buff, JSLOT_SECTOR(slot), 1)) {
+		return 0;
+	}
+	JournalTarget[slot] = sector;
+	TxSums[i] = journal_sum(buff);
+	return 1;
+}
+
+// ******** journal_commit ************
+// Log the bitmap if it changed, then write the commit block of the open transaction.
+// The bitmap is copied into jbuff under its lock (Bitmap_Snapshot), so allocations by
+// threads outside the transaction can not tear the image or lose a change
+// output: 1 on success, 0 on fail. *changes gets the bitmap changes
+static int journal_commit(uint32_t *changes) {
+	uint32_t sector;
+	*changes = Bitmap_Snapshot(jbuff, &sector);
+	if(*changes & BITMAP_CHANGED) {
+		if(!journal_log(jbuff, sector)) {
+			return 0;
+		}
+	}
+
+	if(TxCount == 0) {
+		return 1;
+	}
+
+	JournalCommit_t *c = (JournalCommit_t *) jbuff;
+	memset(jbuff, 0, BLOCK_SIZE);
+	c->magic = JOURNAL_COMMIT_MAGIC;
+	c->seq = JournalSeq;
+	c->count = TxCount;
+	for(uint32_t i = 0; i < TxCount; i++) {
+		c->targets[i] = JournalTarget[JournalHead + i];
+		c->sums[i] = TxSums[i];
+	}
+	if(!BlockDev_Write(eFileDev, jbuff, JSLOT_SECTOR(JournalHead + TxCount), 1)) {
+		return 0;
+	}
+
+	// Now visible to every reader
+	JournalHead += TxCount + 1;
+	JournalSeq++;
+	TxCount = 0;
+	return 1;
+}
+
+// ******** journal_make_room ************
+// Checkpoint if the largest transaction would not fit in the rest of the log
+static int journal_make_room(void) {
+	if(JournalHead + TxCount + JOURNAL_MAX_BLOCKS + 1 > JOURNAL_SLOTS) {
+		return journal_checkpoint();
+	}
+	return 1;
+}
+
+
+// ******** Journal_Init ************
+// Initialize the journal lock
+// input:  none
+// output: none
+void Journal_Init(void) {
+	OS_InitSemaphore(&journal_lock, 1);
+	journal_owner = 0;
+	journal_depth = 0;
+	journal_reset();
+}
+
+// ******** Journal_Format ************
+// Write an empty journal, for a newly formatted drive
+// input:  none
+// output: 1 on success, 0 on fail
+int Journal_Format(void) {
+	OS_Wait(&journal_lock);
+	journal_reset();
+	JournalSeq = 1;
+	int r = journal_write_super();
+	OS_Signal(&journal_lock);
+	return r;
+}
+
+// ******** Journal_Mount ************
+// Replay committed transactions and checkpoint them, before the bitmap is read
+// input:  none
+// output: 1 on success, 0 on fail (e.g. no journal on the drive)
+int Journal_Mount(void) {
+	uint32_t targets[JOURNAL_MAX_BLOCKS];
+	uint32_t sums[JOURNAL_MAX_BLOCKS];
+
+	OS_Wait(&journal_lock);
+	journal_reset();
+	JournalSuper_t *sb = (JournalSuper_t *) jbuff;
+	if(!BlockDev_Read(eFileDev, jbuff, JOURNAL_START, 1) || sb->magic != JOURNAL_SUPER_MAGIC) {
+		OS_Signal(&journal_lock);
+		return 0;
+	}
+	JournalSeq = sb->seq;
+
+	for(;;) {
+		// The commit block of the next transaction follows its images
+		JournalCommit_t *c = (JournalCommit_t *) jbuff;
+		uint32_t count = 0;
+		uint8_t found = 0;
+		for(uint32_t k = 1; k <= JOURNAL_MAX_BLOCKS && JournalHead + k < JOURNAL_SLOTS; k++) {
+			if(BlockDev_Read(eFileDev, jbuff, JSLOT_SECTOR(JournalHead + k), 1) &&
+				c->magic == JOURNAL_COMMIT_MAGIC && c->seq == JournalSeq && c->count == k) {
+				count = k;
+				found = 1;
+				break;
+			}
+		}
+		if(!found) {
+			break;
+		}
+
+		memcpy(targets, c->targets, sizeof targets);
+		memcpy(sums, c->sums, sizeof sums);
+
+		// A torn transaction ends the log
+		for(uint32_t i = 0; i < count; i++) {
+			if(!BlockDev_Read(eFileDev, jbuff, JSLOT_SECTOR(JournalHead + i), 1) || journal_sum(jbuff) != sums[i]) {
+				found = 0;
+				break;
+			}
+		}
+		if(!found) {
+			break;
+		}
+
+		for(uint32_t i = 0; i < count; i++) {
+			JournalTarget[JournalHead + i] = targets[i];
+		}
+		JournalHead += count + 1;
+		JournalSeq++;
+	}
+
+	int r = journal_checkpoint();
+	OS_Signal(&journal_lock);
+	return r;
+}
+
+// ******** Journal_Begin ************
+// Start (or nest) a transaction for the current thread
+// input:  none
+// output: none
+void Journal_Begin(void) {
+	if(journal_depth && journal_owner == RunPt) {
+		journal_depth++;
+		return;
+	}
+
+	OS_Wait(&journal_lock);
+	journal_owner = RunPt;
+	journal_depth = 1;
+	TxCount = 0;
+	TxChanges = 0;
+	journal_make_room();
+}
+
+// ******** Journal_End ************
+// End a transaction, committing it if it is the outermost
+// input:  none
+// output: 1 on success, 0 on fail
+int Journal_End(void) {
+	if(journal_depth > 1) {
+		journal_depth--;
+		return 1;
+	}
+
+	// Still the owner while the bitmap is logged
+	uint32_t changes;
+	int r = journal_commit(&changes);
+	changes |= TxChanges;
+
+	// A freed sector may be reused for file data, which is never logged.
+	// Older images of it must not be replayed or checkpointed over that data
+	if(changes & BITMAP_FREED) {
+		r &= journal_checkpoint();
+	}
+
+	journal_depth = 0;
+	journal_owner = 0;
+	OS_Signal(&journal_lock);
+	return r;
+}
+
+// ******** Journal_Write ************
+// Write a metadata block. Inside a transaction it is logged, otherwise written in place
+// input:  const void *buff - block to write
+//				 uint32_t sector  - target sector
+// output: 1 on success, 0 on fail
+int Journal_Write(const void *buff, uint32_t sector) {
+	if(!journal_depth || journal_owner != RunPt) {
+		// A transaction of its own, an in place write could be undone by a checkpoint
+		Journal_Begin();
+		int r = Journal_Write(buff, sector);
+		r &= Journal_End();
+		return r;
+	}
+
+	// A block logged twice in one transaction keeps its slot
+	uint32_t i;
+	for(i = 0; i < TxCount; i++) {
+		if(JournalTarget[JournalHead + i] == sector) {
+			break;
+		}
+	}
+
+	// The last slot is kept for the bitmap. A transaction too large for the rest is
+	// committed in pieces, each with the bitmap, so committed metadata never points at
+	// sectors still marked free. Only the pieces are atomic, not the whole
+	if(i == TxCount && TxCount == JOURNAL_MAX_BLOCKS - 1) {
+		uint32_t changes;
+		if(!journal_commit(&changes) || !journal_make_room()) {
+			return 0;
+		}
+		TxChanges |= changes;
+	}
+	return journal_log(buff, sector);
+}
+
+// ******** Journal_Read ************
+// Read a metadata block, seeing the newest logged image of it
+// input:  void *buff      - result buffer
+//				 uint32_t sector - sector to read
+// output: 1 on success, 0 on fail
+int Journal_Read(void *buff, uint32_t sector) {
+	uint32_t gen, r;
+	do {
+		gen = JournalGen;
+
+		// The owner also sees its own open transaction
+		uint32_t end = JournalHead;
+		if(journal_depth && journal_owner == RunPt) {
+			end += TxCount;
+		}
+
+		uint32_t s = sector;
+		for(uint32_t i = end; i > 0; i--) {
+			if(JournalTarget[i-1] == sector) {
+				s = JSLOT_SECTOR(i-1);
+				break;
+			}
+		}
+		r = BlockDev_Read(eFileDev, buff, s, 1);
+
+		// Read again if a checkpoint reused the slot meanwhile
+	} while(gen != JournalGen);
+	return r;
+}
+
+// ******** Journal_Checkpoint ************
+// Write the newest image of every logged block in place and empty the journal
+// input:  none
+// output: 1 on success, 0 on fail
+int Journal_Checkpoint(void) {
+	uint32_t changes;
+	Journal_Begin();
+	int r = journal_commit(&changes);
+	r &= journal_checkpoint();
+	r &= Journal_End();
+	return r;
+}
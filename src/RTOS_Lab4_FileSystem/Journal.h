@@ -0,0 +1,88 @@
+/*
+Write-ahead journal for file system metadata (iNodes, directory blocks, the bitmap).
+
+A transaction groups the metadata blocks of one operation (e.g. creating a file).
+Their images are appended to a circular region of the disk, followed by a commit block
+listing the target sectors and a checksum of each image. The operation has happened
+once the commit block is on disk; a transaction without one is ignored by replay.
+
+Committed blocks are NOT written in place right away. Reads of them are served from the
+journal until a checkpoint copies the newest image of each in place, so a block updated
+by many transactions (the bitmap, a directory's iNode) is written in place once.
+Checkpoints happen when the journal fills, after a transaction frees sectors (so a freed
+metadata sector reused for data can never be overwritten by an old image), and on unmount.
+
+eFile_Mount replays every committed transaction since the last checkpoint, no disk scan needed.
+
+Lock order: a transaction must be started before taking any iNode lock or eFile buffer.
+Transactions nest within a thread, only the outermost Journal_End commits.
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+// Journal region, reserved by Bitmap_Reset. The first sector is the journal superblock
+#define JOURNAL_START 2
+#define JOURNAL_SECTORS 64
+#define JOURNAL_SLOTS (JOURNAL_SECTORS-1)
+
+// Most blocks in one commit, the last one kept for the bitmap. A larger transaction (e.g.
+// syncing an iNode with many changed extent leaves) is committed in pieces of up to
+// JOURNAL_MAX_BLOCKS-1 blocks, each logging the bitmap as it is then. Such a transaction
+// is NOT atomic: a crash between pieces keeps the earlier ones, whose metadata never
+// points at sectors marked free, but the operation may be half done
+#define JOURNAL_MAX_BLOCKS 14
+
+// ******** Journal_Init ************
+// Initialize the journal lock
+// input:  none
+// output: none
+void Journal_Init(void);
+
+// ******** Journal_Format ************
+// Write an empty journal, for a newly formatted drive
+// input:  none
+// output: 1 on success, 0 on fail
+int Journal_Format(void);
+
+// ******** Journal_Mount ************
+// Replay committed transactions and checkpoint them, before the bitmap is read
+// input:  none
+// output: 1 on success, 0 on fail (e.g. no journal on the drive)
+int Journal_Mount(void);
+
+// ******** Journal_Begin ************
+// Start (or nest) a transaction for the current thread
+// input:  none
+// output: none
+void Journal_Begin(void);
+
+// ******** Journal_End ************
+// End a transaction, committing it if it is the outermost
+// input:  none
+// output: 1 on success, 0 on fail
+int Journal_End(void);
+
+// ******** Journal_Write ************
+// Write a metadata block. Inside a transaction it is logged, otherwise written in place
+// input:  const void *buff - block to write
+//				 uint32_t sector  - target sector
+// output: 1 on success, 0 on fail
+int Journal_Write(const void *buff, uint32_t sector);
+
+// ******** Journal_Read ************
+// Read a metadata block, seeing the newest logged image of it
+// input:  void *buff      - result buffer
+//				 uint32_t sector - sector to read
+// output: 1 on success, 0 on fail
+int Journal_Read(void *buff, uint32_t sector);
+
+// ******** Journal_Checkpoint ************
+// Write the newest image of every logged block in place and empty the journal
+// input:  none
+// output: 1 on success, 0 on fail
+int Journal_Checkpoint(void);
+
+#endif
@@ -0,0 +1,168 @@
+#include "LZ.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5			// The block ends with at least this many literals
+#define LZ_MATCH_LIMIT 12				// No match starts in the last LZ_MATCH_LIMIT bytes
+#define LZ_MAX_OFFSET 0xFFFF
+
+static uint32_t read32(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t lz_hash(uint32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// ******** lz_length ************
+// Write the part of a length past its 4 bit field, 255 at a time
+static uint32_t lz_length(uint8_t *p, uint32_t len) {
+	uint32_t n = 0;
+	while(len >= 255) {
+		p[n++] = 255;
+		len -= 255;
+	}
+	p[n++] = len;
+	return n;
+}
+
+// ******** lz_sequence ************
+// Emit literals then a match (match length 0 for the final literals only sequence)
+// output: bytes written, 0 if they do not fit
+static uint32_t lz_sequence(uint8_t *dst, uint32_t room, const uint8_t *lit, uint32_t nlit, uint32_t offset, uint32_t match) {
+	// Worst case: token, literal length bytes, literals, offset, match length bytes
+	if(1 + nlit/255 + 1 + nlit + 2 + match/255 + 1 > room) {
+		return 0;
+	}
+
+	uint32_t n = 1;
+	uint8_t token = (nlit < 15 ? nlit : 15) << 4;
+	if(nlit >= 15) {
+		n += lz_length(&dst[n], nlit - 15);
+	}
+	memcpy(&dst[n], lit, nlit);
+	n += nlit;
+
+	if(match) {
+		uint32_t ml = match - LZ_MIN_MATCH;
+		token |= ml < 15 ? ml : 15;
+		dst[n++] = offset;
+		dst[n++] = offset >> 8;
+		if(ml >= 15) {
+			n += lz_length(&dst[n], ml - 15);
+		}
+	}
+	dst[0] = token;
+	return n;
+}
+
+uint32_t LZ_Compress(const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap, uint16_t *table) {
+	uint32_t ip = 0, anchor = 0, op = 0;
+
+	if(n >= LZ_MATCH_LIMIT) {
+		uint32_t limit = n - LZ_MATCH_LIMIT;			// Last position a match may start at
+		uint32_t end = n - LZ_LAST_LITERALS;			// Matches stop here
+		memset(table, 0, LZ_HASH_SIZE * sizeof(uint16_t));
+
+		ip = 1;
+		while(ip <= limit) {
+			uint32_t seq = read32(&src[ip]);
+			uint32_t h = lz_hash(seq);
+			uint32_t ref = table[h];
+			table[h] = ip;
+
+			if(ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(&src[ref]) != seq) {
+				// Skip faster the longer nothing matches, so incompressible data costs little
+				ip += 1 + ((ip - anchor) >> 5);
+				continue;
+			}
+
+			// Grow the match backwards into the literals, then forwards
+			while(ip > anchor && ref > 0 && src[ip-1] == src[ref-1]) {
+				ip--;
+				ref--;
+			}
+			uint32_t len = LZ_MIN_MATCH;
+			while(ip + len < end && src[ref + len] == src[ip + len]) {
+				len++;
+			}
+
+			uint32_t k = lz_sequence(&dst[op], cap - op, &src[anchor], ip - anchor, ip - ref, len);
+			if(k == 0) {
+				return 0;
+			}
+			op += k;
+			ip += len;
+			anchor = ip;
+
+			// Positions inside the match are not hashed, except the one just before the end
+			if(ip - 2 <= limit) {
+				table[lz_hash(read32(&src[ip - 2]))] = ip - 2;
+			}
+		}
+	}
+
+	uint32_t k = lz_sequence(&dst[op], cap - op, &src[anchor], n - anchor, 0, 0);
+	return k ? op + k : 0;
+}
+
+uint32_t LZ_Decompress(const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap) {
+	uint32_t ip = 0, op = 0;
+	while(ip < n) {
+		uint8_t token = src[ip++];
+
+		uint32_t nlit = token >> 4;
+		if(nlit == 15) {
+			uint8_t b;
+			do {
+				if(ip >= n) {
+					return 0;
+				}
+				b = src[ip++];
+				nlit += b;
+			} while(b == 255);
+		}
+		if(nlit > n - ip || nlit > cap - op) {
+			return 0;
+		}
+		memcpy(&dst[op], &src[ip], nlit);
+		ip += nlit;
+		op += nlit;
+		if(ip == n) {
+			break;		// The final literals
+		}
+
+		if(n - ip < 2) {
+			return 0;
+		}
+		uint32_t offset = src[ip] | (src[ip+1] << 8);
+		ip += 2;
+		uint32_t len = token & 15;
+		if(len == 15) {
+			uint8_t b;
+			do {
+				if(ip >= n) {
+					return 0;
+				}
+				b = src[ip++];
+				len += b;
+			} while(b == 255);
+		}
+		len += LZ_MIN_MATCH;
+		if(offset == 0 || offset > op || len > cap - op) {
+			return 0;
+		}
+
+		// The match may overlap what it is copying (a run), so by bytes unless it is far enough back
+		if(offset >= len) {
+			memcpy(&dst[op], &dst[op - offset], len);
+			op += len;
+		}
+		else {
+			for(uint32_t i = 0; i < len; i++, op++) {
+				dst[op] = dst[op - offset];
+			}
+		}
+	}
+	return op;
+}
@@ -0,0 +1,42 @@
+/*
+Fast LZ compression in the LZ4 block format, for compressed files (see eFile_F_compress).
+
+A block is a list of sequences, each a token byte (literal count and match length, 4 bits
+each, 15 meaning more length bytes follow), the literals, and a 2 byte offset back to the
+match. The last sequence is literals only. Matches are found with one hash table probe
+per position, so compression is a single pass and decompression is copies only.
+
+The compressor needs a caller supplied table of LZ_HASH_SIZE entries and no other memory.
+Both sides check every bound, so a damaged block decompresses to an error, never past
+the output buffer.
+*/
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+
+// Hash table entries (a power of 2), positions in the input, so an input is at most 64KB
+#define LZ_HASH_LOG 9
+#define LZ_HASH_SIZE (1 << LZ_HASH_LOG)
+
+// ******** LZ_Compress ************
+// Compress a block
+// input:  const uint8_t *src - data to compress, at most 64KB
+//				 uint32_t n         - bytes in src
+//				 uint8_t *dst       - output
+//				 uint32_t cap       - bytes available at dst
+//				 uint16_t *table    - LZ_HASH_SIZE entries of work space
+// output: compressed size, 0 if it does not fit in cap
+uint32_t LZ_Compress(const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap, uint16_t *table);
+
+// ******** LZ_Decompress ************
+// Decompress a block made by LZ_Compress
+// input:  const uint8_t *src - compressed block
+//				 uint32_t n         - bytes in src, exactly the compressed size
+//				 uint8_t *dst       - output
+//				 uint32_t cap       - bytes available at dst
+// output: decompressed size, 0 if the block is damaged or does not fit in cap
+uint32_t LZ_Decompress(const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap);
+
+#endif
@@ -95,6 +95,9 @@
 #include "../RTOS_Labs_common/UART0int.h"
 #include "../RTOS_Labs_common/eDisk.h"
 #include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab4_FileSystem/SampleLog.h"
+#include "../RTOS_Lab4_FileSystem/CRC32.h"
+#include "../RTOS_Lab4_FileSystem/AsyncIO.h"
 #include "../RTOS_Labs_common/ADC.h"
 
 //*********Prototype for FFT in cr4_fft_64_stm32.s, STMicroelectronics
@@ -172,12 +175,13 @@ void DSP(void){
 
 //******** Robot *************** 
 // foreground thread, accepts data from producer
+// logs (time, ADC sample) to a binary sample log, decode it with tools/slog2csv
 // inputs:  none
 // outputs: none
 char FileName[8]="robot0";
+SLog_t RobotLog;      // too big for the Robot's stack
 void Robot(void){   
   uint32_t data;      // ADC sample, 0 to 1023
-  uint32_t voltage;   // in mV,      0 to 3300
   uint32_t distance;  // in mm,      100 to 800
   uint32_t time;      // in 10msec,  0 to 1000 
   
@@ -186,23 +190,22 @@ void Robot(void){
   OS_Fifo_Init(256);
 
   printf("Robot running...");
-  if (OS_RedirectToFile(FileName)){ // robot0, robot1,...,robot7
-    printf(" Error redirecting to file.\n\r");
+  eFile_Remove(FileName);  // ignore error if file doesn't exist
+  if (!SLog_Create(FileName, &RobotLog)){ // robot0, robot1,...,robot7
+    printf(" Error creating log file.\n\r");
     Running = 0;
     OS_Kill();
     return;
   }
-  printf("time(s)\tdata(V)\tdistance(mm)\n\r");
   do{
     PIDWork++;    // performance measurement
     time = OS_MsTime();          // 10ms resolution in this OS
     data = OS_Fifo_Get();        // 1000 Hz sampling get from producer
-    voltage = (300*data)/1024;   // in mV
     distance = IRDistance_Convert(data,1);
-    printf("%0u.%02u\t%0u.%03u \t%5u\n\r",time/100,time%100,voltage/1000,voltage%1000,distance);
+    SLog_Put(&RobotLog, time, data);
   }
   while(time < 200);       // change this to mean 2 seconds
-  OS_EndRedirectToFile();
+  SLog_Close(&RobotLog);
   ST7735_Message(0,1,"IR0 (mm) =",distance); 
   printf("done.\n\r");
   FileName[5] = (FileName[5]+1)&0xF7; // 0 to 7
@@ -626,6 +629,165 @@ void TestBandwidthMain(void) {
 }
 
 
+//************************* Test CRC ***************************
+/* Time the metadata checksum against a block read, to see what
+ * the CRCs on iNodes, extents and directories cost per block
+ */
+#define CRC_BLOCKS 64
+void TestCRC(void) {
+	uint8_t buffer[512];
+	uint32_t crc = 0;
+
+	printf("Starting CRC Test...\r\n");
+	eDisk_Init(0);
+	eDisk_ReadBlock(buffer, 7);
+
+	uint32_t start = OS_Time();
+	for(uint32_t n = 0; n < CRC_BLOCKS; n++) {
+		crc = CRC32(crc, buffer, 512);
+	}
+	uint32_t crc_time = OS_TimeDifference(start, OS_Time()) / CRC_BLOCKS;
+
+	start = OS_Time();
+	for(uint32_t n = 0; n < CRC_BLOCKS; n++) {
+		eDisk_ReadBlock(buffer, 7);
+	}
+	uint32_t read_time = OS_TimeDifference(start, OS_Time()) / CRC_BLOCKS;
+
+	printf("CRC Test Complete! (crc %08x)\r\n"
+				 "  CRC32 per block: %d us\r\n"
+				 "   Read per block: %d us\r\n",
+	crc, crc_time / TIME_1US, read_time / TIME_1US);
+}
+
+void TestCRCMain(void) {
+	OS_Init();
+	PortD_Init();
+	OS_AddThread(&TestCRC, 128, 5);
+	OS_AddPeriodicThread(&disk_timerproc,TIME_1MS,0);
+	OS_Launch(10 * TIME_1MS);
+}
+
+
+//************************* Test AsyncIO ***************************
+/* Log records from a periodic task through the disk I/O thread, then append
+ * the same records synchronously, and compare the disk writes. Each period
+ * submits a burst of records, which the I/O thread merges into one eFile write.
+ * Formats the card
+ */
+#define AIO_RECORDS 64
+#define AIO_BURST 8
+#define AIO_RECORD_SIZE 16
+
+// Block device passing everything to the SD card, counting the writes
+volatile uint32_t DiskWrites = 0;
+static int counted_read(void *ctx, void *buff, uint32_t sector, uint32_t count) {
+	return BlockDev_Read(ctx, buff, sector, count);
+}
+static int counted_write(void *ctx, const void *buff, uint32_t sector, uint32_t count) {
+	DiskWrites++;
+	return BlockDev_Write(ctx, buff, sector, count);
+}
+static uint32_t counted_count(void *ctx) {
+	return BlockDev_Count(ctx);
+}
+static int counted_flush(void *ctx) {
+	return BlockDev_Flush(ctx);
+}
+static int counted_trim(void *ctx, uint32_t sector, uint32_t count) {
+	return BlockDev_Trim(ctx, sector, count);
+}
+static const BlockDevOps_t CountedOps = {
+	counted_read, counted_write, counted_count, counted_flush, counted_trim
+};
+
+File_t AIOFile;
+IORequest_t AIOReq[AIO_RECORDS];
+char AIORecord[AIO_RECORDS][AIO_RECORD_SIZE];
+volatile uint32_t AIOSubmitted = AIO_RECORDS;	// Nothing to submit until TestAIO starts the logger
+Sema4Type AIOBurst;								// Signalled for every burst submitted
+
+// Periodic task, hands the next burst to the I/O thread without blocking
+void AIOLogger(void) {
+	if(AIOSubmitted < AIO_RECORDS) {
+		for(uint32_t n = 0; n < AIO_BURST; n++) {
+			AIO_Submit(&AIOReq[AIOSubmitted++]);
+		}
+		OS_Signal(&AIOBurst);
+	}
+}
+
+void TestAIO(void) {
+	File_t f;
+	char record[AIO_RECORD_SIZE];
+	int ok = 1;
+
+	printf("Starting AsyncIO Test...\r\n");
+	eDisk_Init(0);
+	if(BlockDev_Find("sd") == 0) {
+		BlockDev_Register("sd", &eDisk_Ops, 0);
+	}
+	BlockDev_Register("counted", &CountedOps, BlockDev_Find("sd"));
+	ok &= eFile_SetDevice("counted") && eFile_Init() && eFile_Format() && eFile_Mount();
+	ok &= eFile_Create("aio.log") && eFile_Open("aio.log", &AIOFile) && AIO_Init(1);
+	if(!ok) {
+		printf("AsyncIO Test could not set up the file system\r\n");
+		return;
+	}
+
+	for(uint32_t i = 0; i < AIO_RECORDS; i++) {
+		memset(AIORecord[i], 'a' + i%26, AIO_RECORD_SIZE);
+		AIO_Request(&AIOReq[i], AIO_WRITE, &AIOFile, AIORecord[i], AIO_RECORD_SIZE, AIO_APPEND, 1);
+	}
+	OS_InitSemaphore(&AIOBurst, 0);
+	uint32_t start = DiskWrites;
+	AIOSubmitted = 0;
+
+	// A request can only be waited on once it is submitted
+	for(uint32_t i = 0; i < AIO_RECORDS; i++) {
+		if(i % AIO_BURST == 0) {
+			OS_Wait(&AIOBurst);
+		}
+		ok &= AIO_Wait(&AIOReq[i]) == AIO_RECORD_SIZE && AIOReq[i].pos == i*AIO_RECORD_SIZE;
+	}
+	uint32_t aio_writes = DiskWrites - start;
+
+	ok &= eFile_F_length(&AIOFile) == AIO_RECORDS*AIO_RECORD_SIZE;
+	for(uint32_t i = 0; i < AIO_RECORDS; i++) {
+		ok &= eFile_F_read_at(&AIOFile, record, AIO_RECORD_SIZE, i*AIO_RECORD_SIZE) == AIO_RECORD_SIZE &&
+					memcmp(record, AIORecord[i], AIO_RECORD_SIZE) == 0;
+	}
+	ok &= eFile_F_close(&AIOFile);
+
+	ok &= eFile_Create("sync.log") && eFile_Open("sync.log", &f);
+	start = DiskWrites;
+	for(uint32_t i = 0; i < AIO_RECORDS; i++) {
+		ok &= eFile_F_write(&f, AIORecord[i], AIO_RECORD_SIZE) == AIO_RECORD_SIZE;
+	}
+	uint32_t sync_writes = DiskWrites - start;
+	ok &= eFile_F_close(&f);
+	eFile_Unmount();
+
+	// Both files take the same metadata writes, each merged record saves a data write
+	ok &= aio_writes + AIO_RECORDS - AIO_RECORDS/AIO_BURST <= sync_writes;
+
+	printf("AsyncIO Test %s\r\n"
+				 "  %d records in bursts of %d: %d disk writes\r\n"
+				 "       appended synchronously: %d disk writes\r\n",
+	ok ? "Passed!" : "FAILED", AIO_RECORDS, AIO_BURST, aio_writes, sync_writes);
+}
+
+void TestAIOMain(void) {
+	OS_Init();
+	PortD_Init();
+	OS_AddThread(&TestAIO, 256, 5);
+	OS_AddThread(&Idle, 128, 7);
+	OS_AddPeriodicThread(&disk_timerproc,TIME_1MS,0);
+	OS_AddPeriodicThread(&AIOLogger,10*TIME_1MS,1);
+	OS_Launch(10 * TIME_1MS);
+}
+
+
 //************************* Test Filesystem ***************************
 /* Test the reliability of the filesystem in the face of bad operation
  * 
@@ -706,8 +868,14 @@ void FS_tester(void) {
 	
 	passed = 0;
 	passed += eFile_F_read(&d, s2, 30) == 0;
+	eFile_Open("test.txt", &d);
+	eFile_F_preallocate(&d, 2048);	// blocks past the end, so only the size stops the reads
+	passed += eFile_F_read_at(&d, s2, 30, 1000) == 0;	// past the end
+	passed += eFile_F_read_at(&d, s2, 1, strlen(s)+1) == 0;	// at the end
+	passed += eFile_F_read_at(&d, s2, 30, 0) == 0;	// running past the end
+	eFile_F_close(&d);
 	
-	if(passed) {
+	if(passed==4) {
 		printf("All tests passed!\r\n");
 	}
 	else {
@@ -755,6 +923,8 @@ int main(void) { 			// main
 	// Testmain1();	// Passed
 	// Testmain2();
 	// TestBandwidthMain(); // Passed - 304.48 KBps down alone, 178KBps up / down
+	// TestCRCMain();
+	// TestAIOMain();
 	// TestFSMain();
 	
 	realmain();
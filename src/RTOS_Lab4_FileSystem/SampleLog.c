@@ -0,0 +1,322 @@
+#include "SampleLog.h"
+#include <string.h>
+
+#define SLOG_MAX_COUNT 0xFFFF
+
+// ******** chunk_offset ************
+// File position of a chunk, the header is block 0
+static uint32_t chunk_offset(uint32_t chunk) {
+	return (chunk + 1) * BLOCK_SIZE;
+}
+
+// ******** varint_put ************
+// Encode v 7 bits at a time, low first, the top bit set on all but the last byte
+// output: bytes used, at most 5
+static uint32_t varint_put(uint8_t *p, uint32_t v) {
+	uint32_t n = 0;
+	while(v >= 0x80) {
+		p[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+// ******** varint_get ************
+// Decode a varint from the current chunk's payload at log->pos
+// output: 1 on success, 0 if it runs past the encoded bytes
+static int varint_get(SLog_t *log, uint32_t *v) {
+	SLogChunk_t *c = (SLogChunk_t *) log->buff;
+	uint8_t *p = log->buff + sizeof(SLogChunk_t);
+	*v = 0;
+	for(uint32_t shift = 0; shift < 35 && log->pos < c->bytes; shift += 7) {
+		uint8_t b = p[log->pos++];
+		*v |= (uint32_t)(b & 0x7F) << shift;
+		if(!(b & 0x80)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Zigzag maps small negative and positive differences to small unsigned numbers
+static uint32_t zigzag(uint32_t d) {
+	return (d << 1) ^ (uint32_t)((int32_t) d >> 31);
+}
+
+static uint32_t unzigzag(uint32_t z) {
+	return (z >> 1) ^ (0 - (z & 1));
+}
+
+
+/* ---------------------------------------- Writing ---------------------------------------- */
+
+// ******** slog_write_chunk ************
+// Write out the current chunk, full or not
+static int slog_write_chunk(SLog_t *log) {
+	SLogChunk_t *c = (SLogChunk_t *) log->buff;
+	c->count = log->n;
+	c->bytes = log->pos;
+	return eFile_F_write_at(&log->file, log->buff, BLOCK_SIZE, chunk_offset(log->chunk)) == BLOCK_SIZE;
+}
+
+// ******** slog_index ************
+// Add the chunk about to start at time to the index, if it falls on the stride.
+// Uses buff, which is free between chunks
+static int slog_index(SLog_t *log, uint32_t time) {
+	if(log->chunks % log->stride) {
+		return 1;
+	}
+
+	SLogHeader_t *h = (SLogHeader_t *) log->buff;
+	if(eFile_F_read_at(&log->file, h, BLOCK_SIZE, 0) != BLOCK_SIZE) {
+		return 0;
+	}
+	if(h->entries == SLOG_INDEX_ENTRIES) {
+		// Full, keep every other entry
+		for(uint32_t i = 0; i < SLOG_INDEX_ENTRIES/2; i++) {
+			h->index[i] = h->index[2*i];
+		}
+		h->entries = SLOG_INDEX_ENTRIES/2;
+		h->stride *= 2;
+		log->stride = h->stride;
+	}
+	if(log->chunks % log->stride == 0) {
+		h->index[h->entries++] = time;
+	}
+	return eFile_F_write_at(&log->file, h, BLOCK_SIZE, 0) == BLOCK_SIZE;
+}
+
+int SLog_Create(const char path[], SLog_t *log) {
+	if(!eFile_Create(path) || !eFile_Open(path, &log->file)) {
+		return 0;
+	}
+
+	SLogHeader_t *h = (SLogHeader_t *) log->buff;
+	memset(h, 0, BLOCK_SIZE);
+	h->magic = SLOG_MAGIC;
+	h->version = SLOG_VERSION;
+	h->chunk_size = BLOCK_SIZE;
+	h->stride = 1;
+	h->entries = 0;
+	if(eFile_F_write_at(&log->file, h, BLOCK_SIZE, 0) != BLOCK_SIZE) {
+		eFile_F_close(&log->file);
+		return 0;
+	}
+
+	log->chunks = 0;
+	log->chunk = 0;
+	log->pos = 0;
+	log->n = 0;
+	log->time = 0;
+	log->value = 0;
+	log->stride = 1;
+	log->writing = 1;
+	return 1;
+}
+
+int SLog_Put(SLog_t *log, uint32_t time, int32_t value) {
+	uint8_t enc[10];
+	uint32_t len = 0;
+
+	if(log->n) {
+		if(time < log->time) {
+			return 0;
+		}
+		len = varint_put(enc, time - log->time);
+		len += varint_put(&enc[len], zigzag((uint32_t) value - (uint32_t) log->value));
+		if(log->pos + len > SLOG_PAYLOAD || log->n == SLOG_MAX_COUNT) {
+			if(!slog_write_chunk(log)) {
+				return 0;
+			}
+			log->n = 0;
+		}
+	}
+
+	if(log->n == 0) {
+		// Start a chunk, the first sample is stored in full
+		if(!slog_index(log, time)) {
+			return 0;
+		}
+		SLogChunk_t *c = (SLogChunk_t *) log->buff;
+		memset(log->buff, 0, BLOCK_SIZE);
+		c->time = time;
+		c->value = value;
+		log->chunk = log->chunks++;
+		log->pos = 0;
+	}
+	else {
+		memcpy(&log->buff[sizeof(SLogChunk_t) + log->pos], enc, len);
+		log->pos += len;
+	}
+
+	log->n++;
+	log->time = time;
+	log->value = value;
+	return 1;
+}
+
+int SLog_Sync(SLog_t *log) {
+	if(!log->writing || log->n == 0) {
+		return 1;
+	}
+	return slog_write_chunk(log);
+}
+
+
+/* ---------------------------------------- Reading ---------------------------------------- */
+
+// ******** slog_load ************
+// Read a chunk into buff and start decoding it. Sequential loads read ahead
+static int slog_load(SLog_t *log, uint32_t chunk) {
+	SLogChunk_t *c = (SLogChunk_t *) log->buff;
+	eFile_F_seek(&log->file, chunk_offset(chunk));
+	int r = eFile_F_read(&log->file, log->buff, BLOCK_SIZE) == BLOCK_SIZE;
+	if(!r || c->bytes > SLOG_PAYLOAD) {
+		c->count = 0;		// Unreadable, read as empty
+	}
+	log->chunk = chunk;
+	log->pos = 0;
+	log->n = 0;
+	return r;
+}
+
+// ******** slog_chunk_time ************
+// Time of the first sample of a chunk, from its header alone
+static int slog_chunk_time(SLog_t *log, uint32_t chunk, uint32_t *time) {
+	return eFile_F_read_at(&log->file, time, sizeof(uint32_t), chunk_offset(chunk)) == sizeof(uint32_t);
+}
+
+int SLog_Open(const char path[], SLog_t *log) {
+	if(!eFile_Open(path, &log->file)) {
+		return 0;
+	}
+
+	SLogHeader_t *h = (SLogHeader_t *) log->buff;
+	uint32_t length = eFile_F_length(&log->file);
+	if(length < BLOCK_SIZE || eFile_F_read_at(&log->file, h, BLOCK_SIZE, 0) != BLOCK_SIZE ||
+		h->magic != SLOG_MAGIC || h->version != SLOG_VERSION || h->chunk_size != BLOCK_SIZE) {
+		eFile_F_close(&log->file);
+		return 0;
+	}
+
+	log->chunks = (length - BLOCK_SIZE) / BLOCK_SIZE;
+	log->writing = 0;
+	log->stride = h->stride;
+	memset(log->buff, 0, BLOCK_SIZE);
+	log->chunk = 0;
+	log->pos = 0;
+	log->n = 0;
+	if(log->chunks) {
+		slog_load(log, 0);
+	}
+	return 1;
+}
+
+int SLog_Seek(SLog_t *log, uint32_t time) {
+	// Find the last chunk starting before time: the index narrows it to one stride
+	// (or to the chunks past the last entry), a binary search over chunk headers does the rest
+	SLogHeader_t *h = (SLogHeader_t *) log->buff;
+	if(log->chunks == 0) {
+		return 1;
+	}
+	if(eFile_F_read_at(&log->file, h, BLOCK_SIZE, 0) != BLOCK_SIZE) {
+		return 0;
+	}
+
+	uint32_t lo = 0, hi = log->chunks;
+	if(h->entries && h->index[0] >= time) {
+		hi = 1;
+	}
+	else if(h->entries) {
+		uint32_t a = 0, b = h->entries;	// index[a] < time <= index[b]
+		while(b - a > 1) {
+			uint32_t mid = (a + b) / 2;
+			if(h->index[mid] < time) {
+				a = mid;
+			}
+			else {
+				b = mid;
+			}
+		}
+		lo = a * h->stride;
+		hi = b < h->entries ? b * h->stride : log->chunks;
+		if(hi > log->chunks) {
+			hi = log->chunks;
+		}
+		if(lo >= hi) {
+			lo = hi - 1;
+		}
+	}
+	while(hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2, t;
+		if(!slog_chunk_time(log, mid, &t)) {
+			return 0;
+		}
+		if(t < time) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	if(!slog_load(log, lo)) {
+		return 0;
+	}
+
+	// Skip the samples before time, leaving the first one after it unread
+	for(;;) {
+		uint32_t chunk = log->chunk, pos = log->pos, n = log->n, t;
+		uint32_t prev_time = log->time;
+		int32_t prev_value = log->value, v;
+		if(!SLog_Next(log, &t, &v)) {
+			return 1;
+		}
+		if(t >= time) {
+			if(log->chunk == chunk) {
+				log->pos = pos;
+				log->n = n;
+				log->time = prev_time;
+				log->value = prev_value;
+			}
+			else {
+				log->pos = 0;
+				log->n = 0;
+			}
+			return 1;
+		}
+	}
+}
+
+int SLog_Next(SLog_t *log, uint32_t *time, int32_t *value) {
+	SLogChunk_t *c = (SLogChunk_t *) log->buff;
+	while(log->n >= c->count) {
+		if(log->chunk + 1 >= log->chunks || !slog_load(log, log->chunk + 1)) {
+			return 0;
+		}
+	}
+
+	if(log->n == 0) {
+		log->time = c->time;
+		log->value = c->value;
+	}
+	else {
+		uint32_t dt, dv;
+		if(!varint_get(log, &dt) || !varint_get(log, &dv)) {
+			log->n = c->count;	// Damaged, skip the rest of the chunk
+			return SLog_Next(log, time, value);
+		}
+		log->time += dt;
+		log->value = (int32_t)((uint32_t) log->value + unzigzag(dv));
+	}
+	log->n++;
+	*time = log->time;
+	*value = log->value;
+	return 1;
+}
+
+int SLog_Close(SLog_t *log) {
+	int r = SLog_Sync(log);
+	r &= eFile_F_close(&log->file);
+	return r;
+}
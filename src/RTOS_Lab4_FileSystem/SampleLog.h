@@ -0,0 +1,115 @@
+/*
+Compact binary sample logs, e.g. for the Robot/DAS data logger.
+
+A log is a file of (time, value) samples with non-decreasing times, written append
+only. The first block of the file is a header, then every block is one chunk:
+
+	header  magic, version, and a sparse time index: the first time of every
+	        stride-th chunk. When the index fills, every other entry is dropped and
+	        the stride doubles, so it covers any length of log in one block
+	chunk   the first sample in full, then each following sample as the difference
+	        from the previous one (time as an unsigned varint, value as a zigzag
+	        varint). Samples a few ms and a few counts apart take 2 bytes instead of
+	        the ~20 of a formatted text line
+
+Chunks are written as whole, block aligned blocks. A reader finds a time with the
+index, then a binary search over at most stride chunk headers (or over the chunks
+written after the index was last updated), and decodes from there.
+
+tools/slog2csv.c turns a log in a disk image back into text.
+*/
+
+#ifndef SAMPLE_LOG_H
+#define SAMPLE_LOG_H
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/eFile.h"
+
+#define SLOG_MAGIC 0x474F4C53		// "SLOG"
+#define SLOG_VERSION 1
+
+// Index entries in the header block
+#define SLOG_INDEX_ENTRIES ((BLOCK_SIZE - 16) / 4)
+
+typedef struct SLogHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t chunk_size;							// BLOCK_SIZE
+	uint32_t stride;									// Chunks per index entry, a power of 2
+	uint32_t entries;									// Index entries in use
+	uint32_t index[SLOG_INDEX_ENTRIES];		// Time of the first sample of chunk i*stride
+} SLogHeader_t;
+
+typedef struct SLogChunk {
+	uint32_t time;										// First sample, in full
+	int32_t value;
+	uint16_t count;										// Samples in the chunk
+	uint16_t bytes;										// Encoded bytes following the header
+} SLogChunk_t;
+
+#define SLOG_PAYLOAD (BLOCK_SIZE - sizeof(SLogChunk_t))
+
+// An open log, for reading or for writing (~570 bytes, keep it off small stacks)
+typedef struct SLog {
+	File_t file;
+	uint32_t chunks;									// Chunks in the file (writing: including the current one)
+	uint32_t chunk;										// Chunk in buff
+	uint32_t pos;											// Byte of the payload to decode (reading) or append (writing) next
+	uint32_t n;												// Samples decoded or appended in this chunk
+	uint32_t time;										// Last sample
+	int32_t value;
+	uint32_t stride;									// Writing: chunks per index entry
+	uint8_t buff[BLOCK_SIZE];					// The chunk, SLogChunk_t then the payload (word aligned)
+	uint8_t writing;
+} SLog_t;
+
+// ******** SLog_Create ************
+// Create a new log and open it for writing
+// input:  const char path[] - file to create, must not exist
+//				 SLog_t *log       - result
+// output: 1 on success, 0 on fail
+int SLog_Create(const char path[], SLog_t *log);
+
+// ******** SLog_Put ************
+// Append a sample. Goes to the file when its chunk fills, or on SLog_Sync
+// input:  SLog_t *log    - log open for writing
+//				 uint32_t time  - sample time, not before the previous sample
+//				 int32_t value  - sample value
+// output: 1 on success, 0 on fail (time out of order, or write error)
+int SLog_Put(SLog_t *log, uint32_t time, int32_t value);
+
+// ******** SLog_Sync ************
+// Write out the current, partly filled chunk
+// input:  SLog_t *log - log open for writing
+// output: 1 on success, 0 on fail
+int SLog_Sync(SLog_t *log);
+
+// ******** SLog_Open ************
+// Open a log for reading, positioned at its first sample
+// input:  const char path[] - log file
+//				 SLog_t *log       - result
+// output: 1 on success, 0 on fail (missing, or not a log)
+int SLog_Open(const char path[], SLog_t *log);
+
+// ******** SLog_Seek ************
+// Position a log open for reading at its first sample at or after time
+// input:  SLog_t *log   - log open for reading
+//				 uint32_t time - time to find
+// output: 1 on success, 0 on fail (read error)
+int SLog_Seek(SLog_t *log, uint32_t time);
+
+// ******** SLog_Next ************
+// Read the next sample
+// input:  SLog_t *log      - log open for reading
+//				 uint32_t *time   - sample time
+//				 int32_t *value   - sample value
+// output: 1 on success, 0 at the end of the log
+int SLog_Next(SLog_t *log, uint32_t *time, int32_t *value);
+
+// ******** SLog_Close ************
+// Close a log, writing out the current chunk if it was open for writing
+// input:  SLog_t *log - log to close
+// output: 1 on success, 0 on fail
+int SLog_Close(SLog_t *log);
+
+#endif
@@ -10,35 +10,91 @@ iNodes are the structures that are actually stored on disk
 #include "../RTOS_Labs_common/OS.h"
 
 
-#define NUM_DIRECT_SECTORS 124
-#define NUM_INDIRECT_SECTORS BLOCK_SIZE/4
+// An extent maps a run of contiguous file blocks onto a run of contiguous sectors
+typedef struct Extent {
+	uint32_t start;		// First sector of the run
+	uint16_t length;	// Number of sectors
+	uint16_t flags;		// EXTENT_* flags
+} Extent_t;
+
+// Sectors are allocated but have never been written, they read as zeros without touching the disk
+#define EXTENT_UNWRITTEN 0x0001
+
+#define EXTENT_MAX_LENGTH 0xFFFF
+
+// The first NUM_INODE_EXTENTS extents live in the iNode itself.
+// The rest overflow into a two level tree: an index sector holding the sectors of up to
+// EXTENT_LEAVES leaf blocks, each packed with EXTENTS_PER_BLOCK extents in file order.
+// Both end in a CRC32 of the rest of the block (the index in its last word)
+#define NUM_INODE_EXTENTS 58
+#define EXTENTS_PER_BLOCK ((BLOCK_SIZE-8)/sizeof(Extent_t))
+#define EXTENT_LEAVES (BLOCK_SIZE/4 - 1)
+#define MAX_EXTENTS (NUM_INODE_EXTENTS + EXTENT_LEAVES*EXTENTS_PER_BLOCK)
+
+// Directories hash entry names into up to DIR_INDEX_BLOCKS index sectors (allocated on demand)
+#define DIR_INDEX_BLOCKS 4
+
+// iNodeDisk flags
+#define INODE_COMPRESSED 0x0001		// Data is stored as compressed groups, see eFile_F_compress
+
+// Compressed files are split into groups of COMP_GROUP_BLOCKS blocks, each compressed on its own.
+// The group map, a plain file of its own, holds an entry per group: the block of the file where
+// the group is stored (<< 16) and its stored bytes (COMP_RAW if stored uncompressed), 0 for a hole
+#define COMP_GROUP_BLOCKS 4
+#define COMP_GROUP_SIZE (COMP_GROUP_BLOCKS*BLOCK_SIZE)
+#define COMP_RAW 0x8000
+#define COMP_BYTES 0x0FFF
+
+// Changed whenever the on-disk layout changes, a drive with another value must be reformatted
+#define INODE_MAGIC_BYTE 0x16
+#define INODE_MAGIC_HW 0x3456
 
 
 // Note - iNode's must be exactly BLOCKSIZE in length
 
-// Note - This supports ~8MB file length. 
-// 				To increase, allow for TIP (~1.08GB filesize)
-//														or QuadIP (~125GB filesize)
-//														or QuintIP (~15TB filesize)
+// Note - Files allocated sequentially on an unfragmented disk need one extent,
+//				so the size of a file is only limited by the disk
 typedef struct iNodeDisk {
+	uint32_t size;
 	uint8_t isDir;
-	uint16_t magicHW;
 	uint8_t magicByte;
-	uint32_t size;
-	uint32_t DP[NUM_DIRECT_SECTORS];
-	uint32_t SIP;
-	uint32_t DIP;
+	uint16_t magicHW;
+	uint16_t num_extents;									// Total, including the overflow tree
+	uint16_t flags;												// INODE_* flags
+	uint32_t extent_index;								// Index sector of the overflow tree, 0 if not yet allocated
+	Extent_t extents[NUM_INODE_EXTENTS];
+	
+	// Compressed files only (size is the uncompressed size)
+	uint32_t group_map;										// Header sector of the group map
+	uint32_t stored_blocks;								// Blocks holding compressed groups, the rest are spare
+	
+	// Directories only
+	uint32_t dir_index[DIR_INDEX_BLOCKS];	// Hash index sectors, 0 if not yet allocated
+	uint16_t dir_free;										// Head of the free entry list (entry number + 1), 0 if empty
+	uint16_t dir_next;										// Entries from here to the end of the file have never been used
+	uint32_t crc;													// CRC32 of the iNode up to here
 } iNodeDisk_t;
 
 typedef struct iNode {
-	struct PrioQ_Node *next_ptr, *prev_ptr;
-	uint32_t sector_num;	// Used as the priority level in the iNode list
+	struct iNode *next_ptr, *prev_ptr;	// Inactive list, while numOpen is 0
+	struct iNode *hash_next;						// Chain of the iNode hash bucket
+	uint32_t sector_num;
 	uint8_t numOpen;
-	uint8_t numReaders;
 	uint8_t removed;
-	Sema4Type NodeLock;
+	RWLock_t NodeLock;								// Readers share the node, writers have it alone
+	
+	// Extent cache, so mapping a file position never touches the disk
+	uint32_t *overflow_index;	// Copy of the overflow index sector followed by the overflow extents, 0 if none
+	Extent_t *overflow;				// Extents NUM_INODE_EXTENTS and up (inside the overflow_index allocation)
+	uint32_t overflow_cap;		// Number of extents overflow can hold
+	uint32_t map_hint;				// Last extent used, (first file block << 16) | extent number
+	uint32_t num_blocks;			// Sectors in all extents, may be more than the size needs (preallocated)
+	uint8_t dirty;						// iNode changed in memory since the last iNode_sync
+	uint16_t dirty_from;			// First overflow extent changed since the last iNode_sync
+	struct CompGroup *comp;		// Compressed files: the group being read or written, 0 until used
+	uint32_t gen;							// New on every load, create and write, so caches of file contents can spot a change
+	
 	iNodeDisk_t iNode;
-	// Parent sector?
 } iNode_t;
 
 
@@ -46,20 +102,14 @@ typedef struct iNode {
 // ------------------------ Function definitions ------------------------------
 
 
-uint32_t num_direct_sectors_occupied(iNode_t *node);
-uint32_t num_direct_sectors_free(iNode_t *node);
-
-uint32_t num_indirect_sectors_occupied(iNode_t *node);
-uint32_t num_indirect_sectors_free(iNode_t *node);
-
-uint32_t num_doubly_indirect_sectors_occupied(iNode_t *node);
-uint32_t num_doubly_indirect_sectors_free(iNode_t *node);
-
-int allocate_direct(iNode_t *iNode, uint32_t num_sectors);
-int allocate_indirect(iNode_t *iNode, uint32_t num_sectors);
-int allocate_doubly_indirect(iNode_t *iNode, uint32_t num_sectors);
 int allocate_space(iNode_t *iNode, uint32_t num_bytes);
+iNode_t* iNode_find(uint32_t sector);
+iNode_t* iNode_spawn(uint32_t sector);
+iNode_t* iNode_insert(iNode_t *node);
+void iNode_drop_cache(void);
 int iNode_create(uint32_t sector, uint32_t length, uint8_t isDir);
+int iNode_sync(iNode_t *node);
+int iNode_preallocate(iNode_t *node, uint32_t num_bytes);
 iNode_t* iNode_open(uint32_t sector);
 iNode_t* iNode_reopen(iNode_t *node);
 uint32_t iNode_get_sector(iNode_t *node);
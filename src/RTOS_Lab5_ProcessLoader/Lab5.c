@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <stdio.h> 
+#include <string.h>
 #include "../inc/tm4c123gh6pm.h"
 #include "../inc/CortexM.h"
 #include "../inc/LaunchPad.h"
@@ -41,6 +42,7 @@
 #include "../RTOS_Labs_common/eDisk.h"
 #include "../RTOS_Labs_common/eFile.h"
 #include "../RTOS_Lab5_ProcessLoader/svc.h"
+#include "../RTOS_Lab2_RTOSkernel/Coroutine.h"
 #include "../driverlib/mpu.h"
 
 
@@ -630,11 +632,233 @@ int Testmain3(void){   // Testmain3
 }
 
 
+//*****************Test project 4*************************
+// Syscall round trip benchmark
+// Measures bus cycles per SVC from an unprivileged thread, minus the cost
+// of calling the same kernel function directly
+#define SVC_BENCH_ITERATIONS 1000
+
+uint32_t SVCBenchCycles[4];
+uint32_t SVCBenchDirect;
+
+// Bus cycles for one call of f, averaged over SVC_BENCH_ITERATIONS
+uint32_t SVCBenchRun(uint32_t (*f)(void)){ uint32_t start; int i;
+  start = OS_Time();
+  for(i = 0; i < SVC_BENCH_ITERATIONS; i++){
+    f();
+  }
+  return OS_TimeDifference(start, OS_Time())/SVC_BENCH_ITERATIONS;
+}
+uint32_t SVCBenchFifoSize(void){
+  return SVC_Fifo_Size();
+}
+
+void TestSVCBench(void){ uint32_t version;
+  ST7735_DrawString(0, 0, "SVC benchmark        ", ST7735_WHITE);
+  version = SVC_ABIVersion();
+  printf("\n\rSyscall ABI %u.%u\n\r", version >> 16, version & 0xFFFF);
+
+  SVCBenchDirect = SVCBenchRun(&OS_Id);
+  SVCBenchCycles[0] = SVCBenchRun(&SVC_OS_Id);       // First table entry
+  SVCBenchCycles[1] = SVCBenchRun(&SVCBenchFifoSize);
+  SVCBenchCycles[2] = SVCBenchRun(&SVC_MsTime);
+  SVCBenchCycles[3] = SVCBenchRun(&SVC_ABIVersion);  // Last table entry
+
+  printf("Direct call  %u cycles\n\r", SVCBenchDirect);
+  printf("SVC #0  (Id)         %u cycles\n\r", SVCBenchCycles[0] - SVCBenchDirect);
+  printf("SVC #20 (Fifo_Size)  %u cycles\n\r", SVCBenchCycles[1] - SVCBenchDirect);
+  printf("SVC #26 (MsTime)     %u cycles\n\r", SVCBenchCycles[2] - SVCBenchDirect);
+  printf("SVC #32 (ABIVersion) %u cycles\n\r", SVCBenchCycles[3] - SVCBenchDirect);
+  ST7735_Message(1,0,"SVC #0  =",SVCBenchCycles[0] - SVCBenchDirect);
+  ST7735_Message(1,1,"SVC #32 =",SVCBenchCycles[3] - SVCBenchDirect);
+  SVC_OS_Kill();
+}
+
+int Testmain4(void){   // Testmain4
+  OS_Init();           // initialize, disable interrupts
+  PortD_Init();
+  OS_Fifo_Init(16);
+
+  // create initial foreground threads
+  NumCreated = 0;
+  NumCreated += OS_AddThread(&TestSVCBench,512,1);
+  NumCreated += OS_AddThread(&Idle,128,3);
+
+  OS_Launch(10*TIME_1MS); // doesn't return, interrupts enabled in here
+  return 0;               // this never executes
+}
+
+
+//*****************Test project 5*************************
+// memlib benchmark
+// Bus cycles per call of memcpy/memset/strcpy/strcmp at 8, 64 and 512 bytes,
+// against the byte loops they replaced (memcpy baseline is the corrected byte loop)
+#define MEM_BENCH_ITERATIONS 100
+
+uint8_t MemBenchSrc[516], MemBenchDst[516];
+uint32_t MemBenchCycles[3][4][2];   // [size][function][old, new]
+
+void* old_memcpy(void* dst, const void *src, size_t num_bytes){
+  for(uint32_t i = 0; i < num_bytes; i++){
+    *((volatile int8_t*)dst+i) = *((int8_t*)src+i);
+  }
+  return dst;
+}
+void* old_memset(void* dst, int v, size_t num_bytes){
+  for(uint32_t i = 0; i < num_bytes; i++){
+    *((volatile int8_t*)dst+i) = v;
+  }
+  return dst;
+}
+char* old_strcpy(char *dst, const char *src){
+  for(size_t i = 0; 1; i++){
+    ((volatile char *)dst)[i] = src[i];
+    if(src[i] == 0){
+      return dst;
+    }
+  }
+}
+int old_strcmp(const char *a, const char *b){
+  while(*a && *a == *b){ a++; b++; }
+  return (uint8_t)*a - (uint8_t)*b;
+}
+
+// Bus cycles for one call, averaged over MEM_BENCH_ITERATIONS
+uint32_t MemBenchRun(uint32_t f, uint32_t useNew, uint32_t n){ uint32_t start; int i;
+  char *d = (char *)MemBenchDst, *s = (char *)MemBenchSrc;
+  start = OS_Time();
+  for(i = 0; i < MEM_BENCH_ITERATIONS; i++){
+    switch(f){
+      case 0: useNew ? memcpy(d, s, n) : old_memcpy(d, s, n); break;
+      case 1: useNew ? memset(d, 0x5A, n) : old_memset(d, 0x5A, n); break;
+      case 2: useNew ? strcpy(d, s) : old_strcpy(d, s); break;
+      default: useNew ? strcmp(d, s) : old_strcmp(d, s); break;
+    }
+  }
+  return OS_TimeDifference(start, OS_Time())/MEM_BENCH_ITERATIONS;
+}
+
+void TestMemBench(void){ int i, f;
+  static const uint32_t sizes[3] = {8, 64, 512};
+  static const char *names[4] = {"memcpy", "memset", "strcpy", "strcmp"};
+  ST7735_DrawString(0, 0, "memlib benchmark     ", ST7735_WHITE);
+  for(i = 0; i < 3; i++){
+    old_memset(MemBenchSrc, 'x', sizes[i]-1);
+    MemBenchSrc[sizes[i]-1] = 0;
+    old_strcpy((char *)MemBenchDst, (char *)MemBenchSrc);   // strcmp runs the full length
+    for(f = 0; f < 4; f++){
+      MemBenchCycles[i][f][0] = MemBenchRun(f, 0, sizes[i]);
+      MemBenchCycles[i][f][1] = MemBenchRun(f, 1, sizes[i]);
+      printf("%s %3u bytes: old %5u new %5u cycles\n\r", names[f], sizes[i],
+        MemBenchCycles[i][f][0], MemBenchCycles[i][f][1]);
+    }
+  }
+  ST7735_Message(1,0,"memcpy 512 old=",MemBenchCycles[2][0][0]);
+  ST7735_Message(1,1,"memcpy 512 new=",MemBenchCycles[2][0][1]);
+  OS_Kill();
+}
+
+int Testmain5(void){   // Testmain5
+  OS_Init();           // initialize, disable interrupts
+  PortD_Init();
+
+  // create initial foreground threads
+  NumCreated = 0;
+  NumCreated += OS_AddThread(&TestMemBench,512,1);
+  NumCreated += OS_AddThread(&Idle,128,3);
+
+  OS_Launch(10*TIME_1MS); // doesn't return, interrupts enabled in here
+  return 0;               // this never executes
+}
+
+
+//*****************Test project 6*************************
+// Coroutines multiplexed on one host thread
+// Two counters take one step per pass and yield, a third waits on a semaphore the
+// first signals as it exits, then sleeps. The trace must alternate A B A B ... W,
+// and every coroutine must exit with its record given back to the kernel heap
+#define CO_TEST_STEPS 5
+
+typedef struct {
+  char name;
+  uint8_t steps;
+} CoTestArg_t;
+
+CoTestArg_t CoTestA = {'A', 0};
+CoTestArg_t CoTestB = {'B', 0};
+char CoTestTrace[2*CO_TEST_STEPS+2];
+uint32_t CoTestLen;
+Sema4Type CoTestDone;
+
+int CoTestCounter(Coroutine_t *co){ CoTestArg_t *a = co->arg;
+  CO_BEGIN(co);
+  while(a->steps < CO_TEST_STEPS){
+    a->steps++;
+    CoTestTrace[CoTestLen++] = a->name;
+    CO_YIELD(co);
+  }
+  if(a->name == 'A'){
+    OS_Signal(&CoTestDone);
+  }
+  CO_END(co);
+}
+
+int CoTestWaiter(Coroutine_t *co){
+  CO_BEGIN(co);
+  CO_WAIT_SEMA(co, &CoTestDone);
+  CO_SLEEP(co, 10);
+  CoTestTrace[CoTestLen++] = 'W';
+  CO_END(co);
+}
+
+void TestCoroutine(void){ heap_stats_t before, after; uint32_t i, time; int ok;
+  ST7735_DrawString(0, 0, "Coroutine test       ", ST7735_WHITE);
+  Heap_Stats(&before);
+  OS_InitSemaphore(&CoTestDone, 0);
+  ok = Coroutine_Add(&CoTestCounter, &CoTestA) != 0;
+  ok = ok && Coroutine_Add(&CoTestCounter, &CoTestB) != 0;
+  ok = ok && Coroutine_Add(&CoTestWaiter, 0) != 0;
+
+  time = OS_MsTime();
+  while(ok && Coroutine_Count() && OS_MsTime() - time < 1000){
+    OS_Sleep(10);
+  }
+  ok = ok && Coroutine_Count() == 0;
+  ok = ok && CoTestLen == 2*CO_TEST_STEPS+1 && CoTestTrace[2*CO_TEST_STEPS] == 'W';
+  for(i = 0; ok && i < 2*CO_TEST_STEPS; i++){
+    ok = CoTestTrace[i] == ((i & 1) ? 'B' : 'A');   // one step of each per pass
+  }
+  Heap_Stats(&after);
+  ok = ok && after.used == before.used;             // host freed every record
+
+  printf("\n\rCoroutine trace %s: %s\n\r", CoTestTrace, ok ? "PASS" : "FAIL");
+  ST7735_DrawString(0, 1, ok ? "Coroutines successful" : "Coroutines failed    ", ok ? ST7735_YELLOW : ST7735_RED);
+  OS_Kill();
+}
+
+int Testmain6(void){   // Testmain6
+  OS_Init();           // initialize, disable interrupts
+  PortD_Init();
+
+  // create initial foreground threads
+  NumCreated = 0;
+  NumCreated += OS_AddThread(&TestCoroutine,512,1);
+  NumCreated += Coroutine_Init(2);
+  NumCreated += OS_AddThread(&Idle,128,3);
+
+  OS_Launch(10*TIME_1MS); // doesn't return, interrupts enabled in here
+  return 0;               // this never executes
+}
+
+
 //*******************Trampo_line for selecting main to execute**********
 int main(void) { 			// main
 	// Testmain1(); // Passed
 	// Testmain2(); // Passed
   Testmain3(); // Passed
+	// Testmain4();
+	// Testmain5();
+	// Testmain6();
 	//basicmain();
 	
 	// realmain();
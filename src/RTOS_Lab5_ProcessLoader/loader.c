@@ -49,6 +49,8 @@ typedef struct {
 typedef struct {
   void *data;
   int segIdx;
+  size_t size;
+  size_t fileSize;
 } ELFSegment_t;
 
 typedef struct {
@@ -86,6 +88,26 @@ typedef struct {
   const ELFEnv_t *env;
 } ELFExec_t;
 
+#if LOADER_CACHE_ENTRIES
+/* A program as it is after loading and relocation. The text is shared by every
+ * running copy, each launch gets its own copy of the data */
+typedef struct {
+  uint32_t id;
+  uint32_t size;
+  uint32_t gen;
+  /* Symbols it was relocated against. Kept by value, callers may pass an env
+   * that lives on their stack */
+  const ELFSymbol_t *exported;
+  unsigned int exported_size;
+  off_t entry;
+  void *text;
+  void *data;
+  size_t dataSize;
+  size_t dataFileSize;
+  uint32_t lastUse;
+} ELFImage_t;
+#endif
+
 #endif
 
 typedef enum {
@@ -232,6 +254,8 @@ static int loadSegData(ELFExec_t *e, ELFSegment_t *s, Elf32_Phdr *h) {
   if (h->p_memsz > h->p_filesz) {
     LOADER_CLEAR((char*)s->data + h->p_filesz, h->p_memsz - h->p_filesz);
   }        
+  s->size = h->p_memsz;
+  s->fileSize = h->p_filesz;
   /* DBG("DATA: ", 0); */
   dumpData(s->data, h->p_memsz);
   return 0;
@@ -632,13 +656,116 @@ static int jumpTo(off_t ofs, void* text, void* data) {
   }
 }
 
+#if LOADER_CACHE_ENTRIES
+static ELFImage_t imageCache[LOADER_CACHE_ENTRIES];
+static uint32_t imageClock;
+
+static int jumpToShared(off_t ofs, void *text, void *data) {
+  entry_t *entry = (entry_t*)((char*)text + ofs);
+  return LOADER_JUMP_TO_SHARED(entry, text, data);
+}
+
+static ELFImage_t *findImage(LOADER_FD_T fd, const ELFEnv_t *env) {
+  int i;
+  for (i = 0; i < LOADER_CACHE_ENTRIES; i++) {
+    ELFImage_t *img = &imageCache[i];
+    if (img->text && img->id == LOADER_FILE_ID(fd)
+        && img->size == LOADER_FILE_SIZE(fd)
+        && img->gen == LOADER_FILE_GEN(fd) && img->exported == env->exported
+        && img->exported_size == env->exported_size)
+      return img;
+  }
+  return NULL;
+}
+
+static void dropImage(ELFImage_t *img) {
+  if (img->text)
+    LOADER_FREE(img->text);
+  if (img->data)
+    LOADER_FREE(img->data);
+  LOADER_CLEAR(img, sizeof(ELFImage_t));
+}
+
+/* Keep a loaded and relocated program: takes over its text, copies its initial
+ * data. Replaces the least recently used image no process is running, if no
+ * slot is free. Returns NULL (the program runs uncached) if there is none */
+static ELFImage_t *cacheImage(ELFExec_t *e) {
+  ELFImage_t *img = NULL;
+  int i;
+  if (!e->entry || !e->loadText.data)
+    return NULL;
+  for (i = 0; i < LOADER_CACHE_ENTRIES; i++) {
+    ELFImage_t *c = &imageCache[i];
+    if (!c->text) {
+      img = c;
+      break;
+    }
+    if (!LOADER_IN_USE(c->text) && (!img || c->lastUse < img->lastUse))
+      img = c;
+  }
+  if (!img)
+    return NULL;
+  dropImage(img);
+
+  if (e->loadData.fileSize) {
+    img->data = LOADER_ALIGN_ALLOC(e->loadData.fileSize, 4, ELF_SEC_READ);
+    if (!img->data)
+      return NULL;
+    memcpy(img->data, e->loadData.data, e->loadData.fileSize);
+    LOADER_PIN(img->data);
+  }
+  LOADER_PIN(e->loadText.data);
+  img->id = LOADER_FILE_ID(e->fd);
+  img->size = LOADER_FILE_SIZE(e->fd);
+  img->gen = LOADER_FILE_GEN(e->fd);
+  img->exported = e->env->exported;
+  img->exported_size = e->env->exported_size;
+  img->entry = e->entry;
+  img->text = e->loadText.data;
+  img->dataSize = e->loadData.size;
+  img->dataFileSize = e->loadData.fileSize;
+  img->lastUse = ++imageClock;
+  return img;
+}
+
+/* Start another copy of a cached program, no file access or relocation */
+static int launchImage(ELFImage_t *img) {
+  void *data = NULL;
+  int ret;
+  if (img->dataSize) {
+    data = LOADER_ALIGN_ALLOC(img->dataSize, 4, ELF_SEC_READ | ELF_SEC_WRITE);
+    if (!data) {
+      ERR("    GET MEMORY fail");
+      return -1;
+    }
+    memcpy(data, img->data, img->dataFileSize);
+    memset((char*)data + img->dataFileSize, 0, img->dataSize - img->dataFileSize);
+  }
+  img->lastUse = ++imageClock;
+  ret = jumpToShared(img->entry, img->text, data);
+  if (!ret && data)
+    LOADER_FREE(data);
+  return ret;
+}
+#endif
+
 int exec_elf(const char *path, const ELFEnv_t *env) {
 #ifdef VALVANOWARE
   static ELFExec_t exec;  // avoid stack overflow on limited microcontroller
 #else
   ELFExec_t exec;
 #endif  
-  if (initElf(&exec, LOADER_OPEN_FOR_RD(path)) != 0) {
+  LOADER_FD_T fd = LOADER_OPEN_FOR_RD(path);
+#if LOADER_CACHE_ENTRIES
+  if (LOADER_FD_VALID(fd)) {
+    ELFImage_t *img = findImage(fd, env);
+    if (img) {
+      LOADER_CLOSE(fd);
+      return launchImage(img);
+    }
+  }
+#endif
+  if (initElf(&exec, fd) != 0) {
     DBG("Invalid elf %s\n\r", path);
     return -1;
   }
@@ -649,9 +776,23 @@ int exec_elf(const char *path, const ELFEnv_t *env) {
     founded |= loadProgram(&exec);
     if (IS_FLAGS_SET(founded, FoundProgram)) {
       int ret = -1;
+      int relocated = 0;
       if (IS_FLAGS_SET(founded, FoundValid | FoundLoadDynamic)) {
-        relocateProgram(&exec);
+        relocated = relocateProgram(&exec);
       }
+#if LOADER_CACHE_ENTRIES
+      ELFImage_t *img = relocated == 0 ? cacheImage(&exec) : NULL;
+      if (img) {
+        ret = jumpToShared(exec.entry,
+                           exec.loadText.data, exec.loadData.data);
+        if (!ret) {
+          /* Not started, nothing else holds the data or the pinned text */
+          if (exec.loadData.data)
+            LOADER_FREE(exec.loadData.data);
+          dropImage(img);
+        }
+      } else
+#endif
       ret = jumpTo(exec.entry,
                    exec.loadText.data, exec.loadData.data);
       freeElf(&exec);
@@ -68,6 +68,10 @@ typedef struct {
 
 /**
  * Execute ELF file from "path" with environment "env"
+ *
+ * Executables are kept loaded and relocated after their first launch (see
+ * #LOADER_CACHE_ENTRIES), launching the same file again only copies its data
+ * segment and shares the text segment already in memory
  * @param path Path to file to load
  * @param env Pointer to environment struct
  * @retval 0 On successful
@@ -47,8 +47,9 @@
 #include "../RTOS_Labs_common/UART0int.h"
 #include "../RTOS_Labs_common/OS.h"
 
-// Declare extern OS_AddProcess function (implemented in OS.c)
-int OS_AddProcess(void(*entry)(void), void *text, void *data, 
+// Declare extern OS_AddProcess functions (implemented in OS.c)
+int OS_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[]);
+int OS_AddSharedProcess(void(*entry)(void), void *text, void *data, 
   unsigned long stackSize, unsigned long priority);
 
 typedef unsigned long int off_t;
@@ -72,6 +73,10 @@ uint32_t LOADER_WRITE(File_t* fd, void* buffer, size_t size) {
 #define LOADER_CLOSE(fd) eFile_F_close(fd)
 #define LOADER_SEEK_FROM_START(fd, off) eFile_F_seek(fd, off)
 #define LOADER_TELL(fd) (fd->pos)
+// Identity of the file for the image cache, valid while it is open
+#define LOADER_FILE_ID(fd) (fd->iNode->sector_num)
+#define LOADER_FILE_SIZE(fd) (fd->iNode->iNode.size)
+#define LOADER_FILE_GEN(fd) (fd->iNode->gen)
 
 #define LOADER_ALIGN_ALLOC(size, align, perm) Heap_Malloc(size)
 #define LOADER_FREE(ptr) Heap_Free(ptr)
@@ -80,7 +85,21 @@ void LOADER_CLEAR(void* ptr, size_t size) { int i; int32_t *p;
 }
 #define LOADER_STREQ(s1, s2) (strcmp(s1, s2) == 0)
 
-#define LOADER_JUMP_TO(entry, text, data) OS_AddProcess(entry, text, data, 128, 1)
+int LOADER_JUMP_TO(entry_t *entry, void *text, void *data) {
+  void *heaps[2] = {text, data};
+  unsigned long stack_pri[2] = {128, 1};
+  return OS_AddProcess(entry, heaps, stack_pri);
+}
+#define LOADER_JUMP_TO_SHARED(entry, text, data) OS_AddSharedProcess(entry, text, data, 128, 1)
+#define LOADER_IN_USE(text) loader_text_in_use(text)
+#define LOADER_PIN(ptr) Heap_SetOwner(ptr, 0, 0, HEAP_TAG_KERNEL)
+int loader_text_in_use(void *text) { PCB_t *p;
+  for(p = OS_get_process_list(); p != 0; p = p->next_ptr) if(p->text == text) return 1;
+  return 0;
+}
+
+// Parsed and relocated programs kept for a fast re-launch (text + initial data each)
+#define LOADER_CACHE_ENTRIES 2
 
 #define DBG(msg, par)
 #define ERR(msg) UART_OutString("ELF: " msg "\n\r")
@@ -139,6 +158,8 @@ extern void arch_jumpTo(entry_t entry);
 
 #endif
 
+#define LOADER_CACHE_ENTRIES 0
+
 #define DBG(...) printf("ELF: " __VA_ARGS__)
 #define ERR(msg) do { perror("ELF: " msg); __asm__ volatile ("bkpt"); } while(0)
 #define MSG(msg) puts("ELF: " msg)
@@ -280,6 +301,54 @@ extern void arch_jumpTo(entry_t entry);
  */
 #define LOADER_JUMP_TO(entry)
 
+/**
+ * Jump to cached code
+ *
+ * Execute code whose text segment stays owned by the image cache and may be
+ * shared with other running copies
+ *
+ * @param entry Pointer to function code to execute
+ * @param text Shared text segment
+ * @param data Data segment owned by the new process
+ */
+#define LOADER_JUMP_TO_SHARED(entry, text, data)
+
+/**
+ * Text segment in use
+ *
+ * @param text Text segment of a cached image
+ * @retval Non-zero if a running process executes from text
+ */
+#define LOADER_IN_USE(text)
+
+/**
+ * Keep a block
+ *
+ * Mark memory kept by the image cache so that it is not reclaimed with the
+ * thread that loaded it
+ *
+ * @param ptr Pointer to allocated memory
+ */
+#define LOADER_PIN(ptr)
+
+/**
+ * File identity macros
+ *
+ * Key of the image cache, a file with the same id, size and generation is
+ * assumed to hold the same program. The generation must change whenever the
+ * file may have been rewritten or recreated
+ *
+ * @param fd File descriptor
+ */
+#define LOADER_FILE_ID(fd)
+#define LOADER_FILE_SIZE(fd)
+#define LOADER_FILE_GEN(fd)
+
+/**
+ * Number of images kept by the image cache, 0 to disable it
+ */
+#define LOADER_CACHE_ENTRIES
+
 /**
  * Debug macro
  *
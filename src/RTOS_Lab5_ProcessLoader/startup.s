@@ -638,6 +638,8 @@ WaitForInterrupt
         WFI
         BX     LR
 
+;*********** SVC stubs ************************
+; SVC numbers must match enum SVC_Number in svc.h
    EXPORT  SVC_OS_Id
 SVC_OS_Id
    SVC #0
@@ -805,6 +807,12 @@ SVC_AddProcess
    SVC #31
    BX  LR
    
+   EXPORT  SVC_ABIVersion
+;returns SVC_ABI_VERSION in R0
+SVC_ABIVersion
+   SVC #32
+   BX  LR
+   
    
 ;******************************************************************************
 ;
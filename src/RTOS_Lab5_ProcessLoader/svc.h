@@ -1,5 +1,71 @@
 #import "../RTOS_Labs_common/os.h"
 
+#ifndef __SVC_H__
+#define __SVC_H__
+
+// ******** Syscall ABI ************
+// The SVC immediate indexes SVC_Table (OS.c), which the SVC_Handler in osasm.s
+// dispatches through after a bounds check. The SVC_* stubs in startup.s and the
+// user stubs in RTOS_Lab5_User/osasm.s encode these same numbers.
+//
+// Compatibility rules:
+//		- Never renumber or remove an entry, user ELFs have the numbers baked in
+//		- New syscalls are appended at the end and bump the minor version
+//		- Renumbering (avoid!) bumps the major version
+// An out of range or unimplemented syscall returns SVC_ENOSYS in R0.
+#define SVC_ABI_VERSION_MAJOR 1
+#define SVC_ABI_VERSION_MINOR 1
+#define SVC_ABI_VERSION ((SVC_ABI_VERSION_MAJOR << 16) | SVC_ABI_VERSION_MINOR)
+#define SVC_ENOSYS 0xFFFFFFFF
+
+enum SVC_Number {
+	SVC_NUM_OS_ID = 0,				// ABI 1.0
+	SVC_NUM_OS_KILL = 1,
+	SVC_NUM_OS_SLEEP = 2,
+	SVC_NUM_OS_TIME = 3,
+	SVC_NUM_OS_ADDTHREAD = 4,
+	SVC_NUM_CONTEXTSWITCH = 5,
+	SVC_NUM_INITSEMAPHORE = 6,
+	SVC_NUM_WAIT = 7,
+	SVC_NUM_SIGNAL = 8,
+	SVC_NUM_BWAIT = 9,
+	SVC_NUM_BSIGNAL = 10,
+	SVC_NUM_ADDPERIODICTHREAD = 11,
+	SVC_NUM_ADDSW1TASK = 12,
+	SVC_NUM_ADDSW2TASK = 13,
+	SVC_NUM_SUSPEND = 14,
+	SVC_NUM_LOCKSCHEDULER = 15,
+	SVC_NUM_UNLOCKSCHEDULER = 16,
+	SVC_NUM_FIFO_INIT = 17,
+	SVC_NUM_FIFO_PUT = 18,
+	SVC_NUM_FIFO_GET = 19,
+	SVC_NUM_FIFO_SIZE = 20,
+	SVC_NUM_MAILBOX_INIT = 21,
+	SVC_NUM_MAILBOX_SEND = 22,
+	SVC_NUM_MAILBOX_RECV = 23,
+	SVC_NUM_TIMEDIFFERENCE = 24,
+	SVC_NUM_CLEARMSTIME = 25,
+	SVC_NUM_MSTIME = 26,
+	SVC_NUM_REDIRECTTOFILE = 27,
+	SVC_NUM_ENDREDIRECTTOFILE = 28,
+	SVC_NUM_REDIRECTTOUART = 29,
+	SVC_NUM_REDIRECTTOST7735 = 30,
+	SVC_NUM_ADDPROCESS = 31,
+	SVC_NUM_ABIVERSION = 32,	// ABI 1.1
+	
+	SVC_TABLE_SIZE						// Must remain last
+};
+
+// Dispatch table and its size, read by SVC_Handler
+extern const void * const SVC_Table[SVC_TABLE_SIZE];
+extern const uint32_t SVC_TableSize;
+
+//******** OS_ABIVersion *************** 
+// Inputs: none
+// Outputs: SVC_ABI_VERSION, major version in the upper halfword
+uint32_t OS_ABIVersion(void);
+
+
 uint32_t SVC_OS_Id(void);
 void SVC_OS_Kill(void);
 void SVC_OS_Sleep(uint32_t t);
@@ -34,4 +100,6 @@ int SVC_EndRedirectToFile(void);
 int SVC_RedirectToUART(void);
 int SVC_RedirectToST7735(void);
 int SVC_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[]); 
+uint32_t SVC_ABIVersion(void);
 
+#endif
@@ -104,5 +104,12 @@ unsigned long OS_TimeDifference(unsigned long start, unsigned long stop){
   return start-stop;
 }
 
+// ******** OS_ABIVersion ************
+// Syscall ABI implemented by the kernel, major version in the upper halfword
+// Programs built against these stubs need major version 1 (added in 1.1)
+// Inputs:  none
+// Outputs: ABI version
+unsigned long OS_ABIVersion(void);
+
 
 #endif
@@ -2,6 +2,7 @@
 ;/* OSasm.s: low-level OS commands, written in assembly                       */
 ;/*****************************************************************************/
 ;Jonathan Valvano/Andreas Gerstlauer, OS Lab 5 solution, 2/28/16
+; SVC numbers must match enum SVC_Number in RTOS_Lab5_ProcessLoader/svc.h
 
 
         AREA |.text|, CODE, READONLY, ALIGN=2
@@ -14,6 +15,7 @@
 		EXPORT	OS_Kill
 		EXPORT	OS_Time
 		EXPORT	OS_AddThread
+		EXPORT	OS_ABIVersion
 			
 OS_Id
 	SVC		#0
@@ -35,6 +37,11 @@ OS_AddThread
 	SVC		#4
 	BX		LR
 
+; Added in syscall ABI 1.1
+OS_ABIVersion
+	SVC		#32
+	BX		LR
+
 
     ALIGN
     END
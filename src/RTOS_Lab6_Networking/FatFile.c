@@ -0,0 +1,267 @@
+#include <string.h>
+#include "FatFile.h"
+#include "../RTOS_Labs_common/heap.h"
+
+#define SECTOR _MAX_SS
+
+Sema4Type FatLock;
+static uint8_t FatReady;
+static uint32_t FatWriteGen;		// Opens for writing
+
+void FatFile_Init(void) {
+	if(!FatReady) {
+		OS_InitSemaphore(&FatLock, 1);
+		FatReady = 1;
+	}
+}
+
+
+// ------------------------------------- Sector buffer ----------------------------------- //
+// Everything before base is with FatFs whenever buff holds a sector, so FatFs only
+// ever seeks within the file it has
+
+// ******** fatfile_flush ************
+// Hand a dirty sector to FatFs. Called holding FatLock
+static int fatfile_flush(FatFile_t *f) {
+	if(!f->dirty) {
+		return 1;
+	}
+	UINT n = 0;
+	if(f_lseek(&f->fil, f->base) != FR_OK || f_write(&f->fil, f->buff, f->valid, &n) != FR_OK || n != f->valid) {
+		return 0;
+	}
+	f->dirty = 0;
+	return 1;
+}
+
+// ******** fatfile_load ************
+// Bring the sector at base into buff, writing out the one there. Called holding FatLock
+static int fatfile_load(FatFile_t *f, uint32_t base) {
+	if(f->base == base) {
+		return 1;
+	}
+	if(!fatfile_flush(f)) {
+		return 0;
+	}
+
+	f->base = FATFILE_NONE;
+	f->valid = 0;
+	if(base < f->length) {
+		UINT want = f->length - base < SECTOR ? f->length - base : SECTOR;
+		UINT n = 0;
+		if(f_lseek(&f->fil, base) != FR_OK || f_read(&f->fil, f->buff, want, &n) != FR_OK || n != want) {
+			return 0;
+		}
+		f->valid = n;
+	}
+	f->base = base;
+	return 1;
+}
+
+// ******** fatfile_drop ************
+// Write out and forget the buffered sector, before FatFs is used directly. Called holding FatLock
+static int fatfile_drop(FatFile_t *f) {
+	if(!fatfile_flush(f)) {
+		return 0;
+	}
+	f->base = FATFILE_NONE;
+	f->valid = 0;
+	return 1;
+}
+
+
+// ------------------------------------- Files ------------------------------------------- //
+
+FatFile_t* FatFile_Open(const char path[], BYTE mode) {
+	FatFile_t *f = Heap_KernelMalloc(sizeof(FatFile_t));
+	if(f == 0) {
+		return 0;
+	}
+
+	// Writes read back partly filled sectors, so writers can read too
+	if(mode & FA_WRITE) {
+		mode |= FA_READ;
+	}
+	OS_Wait(&FatLock);
+	if(mode & FA_WRITE) {
+		FatWriteGen++;
+	}
+	FRESULT r = f_open(&f->fil, path, mode);
+	OS_Signal(&FatLock);
+
+	if(r != FR_OK) {
+		Heap_KernelFree(f);
+		return 0;
+	}
+	f->pos = 0;
+	f->length = f_size(&f->fil);
+	f->base = FATFILE_NONE;
+	f->valid = 0;
+	f->dirty = 0;
+	return f;
+}
+
+uint32_t FatFile_Generation(void) {
+	return FatWriteGen;
+}
+
+uint32_t FatFile_Read(FatFile_t *f, void *buff, uint32_t size) {
+	uint8_t *p = buff;
+	uint32_t done = 0;
+	if(size > f->length - f->pos) {
+		size = f->length - f->pos;
+	}
+
+	OS_Wait(&FatLock);
+	while(done < size) {
+		uint32_t off = f->pos % SECTOR;
+		uint32_t left = size - done;
+
+		if(off == 0 && left >= SECTOR && f->base != f->pos) {
+			// Whole sectors go straight from the disk to the caller
+			UINT n = 0;
+			left -= left % SECTOR;
+			if(!fatfile_drop(f) || f_lseek(&f->fil, f->pos) != FR_OK || f_read(&f->fil, &p[done], left, &n) != FR_OK) {
+				break;
+			}
+			f->pos += n;
+			done += n;
+			if(n != left) {
+				break;
+			}
+			continue;
+		}
+
+		if(!fatfile_load(f, f->pos - off) || f->valid <= off) {
+			break;
+		}
+		uint32_t n = f->valid - off;
+		if(n > left) {
+			n = left;
+		}
+		memcpy(&p[done], &f->buff[off], n);
+		f->pos += n;
+		done += n;
+	}
+	OS_Signal(&FatLock);
+	return done;
+}
+
+uint32_t FatFile_Write(FatFile_t *f, const void *buff, uint32_t size) {
+	const uint8_t *p = buff;
+	uint32_t done = 0;
+
+	OS_Wait(&FatLock);
+	while(done < size) {
+		uint32_t off = f->pos % SECTOR;
+		uint32_t left = size - done;
+
+		if(off == 0 && left >= SECTOR && f->base != f->pos) {
+			// Whole sectors go straight from the caller to the disk
+			UINT n = 0;
+			left -= left % SECTOR;
+			if(!fatfile_drop(f) || f_lseek(&f->fil, f->pos) != FR_OK || f_write(&f->fil, &p[done], left, &n) != FR_OK) {
+				break;
+			}
+			f->pos += n;
+			done += n;
+			if(f->pos > f->length) {
+				f->length = f->pos;
+			}
+			if(n != left) {
+				break;
+			}
+			continue;
+		}
+
+		if(!fatfile_load(f, f->pos - off)) {
+			break;
+		}
+		uint32_t n = SECTOR - off;
+		if(n > left) {
+			n = left;
+		}
+		memcpy(&f->buff[off], &p[done], n);
+		f->dirty = 1;
+		if(off + n > f->valid) {
+			f->valid = off + n;
+		}
+		f->pos += n;
+		done += n;
+		if(f->pos > f->length) {
+			f->length = f->pos;
+		}
+	}
+	OS_Signal(&FatLock);
+	return done;
+}
+
+uint32_t FatFile_Forward(FatFile_t *f, UINT (*func)(const BYTE*, UINT), uint32_t size) {
+	uint32_t done = 0;
+	if(size > f->length - f->pos) {
+		size = f->length - f->pos;
+	}
+
+	// A sector per turn of the lock, so a slow stream does not hold up other files
+	while(done < size) {
+		UINT want = SECTOR - f->pos % SECTOR, n = 0;
+		if(want > size - done) {
+			want = size - done;
+		}
+		OS_Wait(&FatLock);
+		if(fatfile_drop(f) && f_lseek(&f->fil, f->pos) == FR_OK) {
+			f_forward(&f->fil, func, want, &n);
+		}
+		OS_Signal(&FatLock);
+		f->pos += n;
+		done += n;
+		if(n != want) {
+			break;
+		}
+	}
+	return done;
+}
+
+uint32_t FatFile_Seek(FatFile_t *f, uint32_t pos) {
+	// FatFs follows lazily, on the next sector moved
+	f->pos = pos < f->length ? pos : f->length;
+	return f->pos;
+}
+
+uint32_t FatFile_Tell(FatFile_t *f) {
+	return f->pos;
+}
+
+uint32_t FatFile_Length(FatFile_t *f) {
+	return f->length;
+}
+
+int FatFile_Expand(FatFile_t *f, uint32_t bytes) {
+	if(f->length != 0) {
+		return 0;
+	}
+	OS_Wait(&FatLock);
+	FRESULT r = f_expand(&f->fil, bytes, 1);
+	OS_Signal(&FatLock);
+	return r == FR_OK;
+}
+
+int FatFile_Sync(FatFile_t *f) {
+	OS_Wait(&FatLock);
+	int r = fatfile_flush(f) && f_sync(&f->fil) == FR_OK;
+	OS_Signal(&FatLock);
+	return r;
+}
+
+int FatFile_Close(FatFile_t *f) {
+	OS_Wait(&FatLock);
+	int r = fatfile_flush(f);
+	if(r && f_size(&f->fil) > f->length) {
+		// Give back what was preallocated and not written
+		r = f_lseek(&f->fil, f->length) == FR_OK && f_truncate(&f->fil) == FR_OK;
+	}
+	r &= f_close(&f->fil) == FR_OK;
+	OS_Signal(&FatLock);
+	Heap_KernelFree(f);
+	return r;
+}
@@ -0,0 +1,114 @@
+/*
+Handle based, buffered file access over FatFs, for several files open at once.
+
+FatFs is built tiny (_FS_TINY), so a FIL has no sector buffer of its own and every
+partial sector goes through the one window in the FATFS, shared with the FAT and
+directory sectors. Each FatFile_t carries its own sector instead: small reads and
+writes (e.g. eFile_Write's single bytes) are copied in and out of it, and only whole
+sectors reach FatFs, which hands sector aligned transfers straight to the disk.
+Two files streamed at once (a logger writing while the web server reads) therefore
+do not evict each other's data.
+
+Every FatFs call is made holding FatLock, since FatFs is not reentrant. A handle must
+not be used by two threads at once, separate handles may.
+
+Loggers should FatFile_Expand a new file to its expected size: the clusters are then
+one contiguous run allocated up front, so writing never searches the FAT and the card
+sees sequential writes. FatFile_Close trims the file back to the bytes written. Until
+then the file's size on the card is the preallocated size.
+
+FatFile_Forward streams a file to a function (e.g. a network send) from the volume's
+sector window with f_forward, without a copy through a caller buffer. It takes FatLock
+a sector at a time, so a slow stream does not stall a logger for the whole file.
+*/
+
+#ifndef FATFILE_H
+#define FATFILE_H
+
+#include <stdint.h>
+#include "ff.h"
+#include "../RTOS_Labs_common/OS.h"
+
+// Held around every call into FatFs
+extern Sema4Type FatLock;
+
+// An open file (~570 bytes, from the kernel heap)
+typedef struct FatFile {
+	FIL fil;
+	uint32_t pos;								// Position of the next read or write
+	uint32_t length;						// Bytes in the file, including any still in buff
+	uint32_t base;							// File position of buff, sector aligned, FATFILE_NONE when empty
+	uint16_t valid;							// Bytes of buff holding file data
+	uint8_t dirty;							// buff has bytes FatFs has not seen
+	uint8_t buff[_MAX_SS];
+} FatFile_t;
+
+#define FATFILE_NONE 0xFFFFFFFF
+
+// ******** FatFile_Init ************
+// Set up FatLock. Safe to call more than once, but not while files are open
+void FatFile_Init(void);
+
+// ******** FatFile_Open ************
+// Open a file on the mounted FAT volume
+// input:  const char path[] - path on the volume
+//				 BYTE mode         - FatFs mode, e.g. FA_READ, FA_WRITE | FA_OPEN_ALWAYS.
+//				                     Files open for writing can also be read
+// output: handle, 0 on fail
+FatFile_t* FatFile_Open(const char path[], BYTE mode);
+
+// ******** FatFile_Generation ************
+// Count of opens for writing, so a cache of file contents (the program loader's)
+// can tell that some file may have been rewritten
+// output: the count, only ever grows
+uint32_t FatFile_Generation(void);
+
+// ******** FatFile_Read ************
+// Read from the current position
+// output: bytes read, short at the end of the file or on a disk error
+uint32_t FatFile_Read(FatFile_t *f, void *buff, uint32_t size);
+
+// ******** FatFile_Write ************
+// Write at the current position, growing the file as needed. Partial sectors stay in
+// the handle until it moves to another sector, or FatFile_Sync/FatFile_Close
+// output: bytes written
+uint32_t FatFile_Write(FatFile_t *f, const void *buff, uint32_t size);
+
+// ******** FatFile_Forward ************
+// Pass up to size bytes from the current position to func, a sector (or less) at a time.
+// func(0, 0) is asked whether the stream is ready and ends the transfer by returning 0,
+// otherwise func(data, n) returns how many of the n bytes it took
+// output: bytes forwarded
+uint32_t FatFile_Forward(FatFile_t *f, UINT (*func)(const BYTE*, UINT), uint32_t size);
+
+// ******** FatFile_Seek ************
+// Move the current position, at most to the end of the file
+// output: the new position
+uint32_t FatFile_Seek(FatFile_t *f, uint32_t pos);
+
+// ******** FatFile_Tell ************
+// output: the current position
+uint32_t FatFile_Tell(FatFile_t *f);
+
+// ******** FatFile_Length ************
+// output: size of the file in bytes
+uint32_t FatFile_Length(FatFile_t *f);
+
+// ******** FatFile_Expand ************
+// Preallocate a contiguous run of clusters for an empty file open for writing
+// input:  FatFile_t *f    - empty file, open for writing
+//				 uint32_t bytes  - space to reserve
+// output: 1 on success, 0 on fail (not empty, or no contiguous space that large)
+int FatFile_Expand(FatFile_t *f, uint32_t bytes);
+
+// ******** FatFile_Sync ************
+// Write out buffered data and the directory entry, leaving the file safe to lose power
+// output: 1 on success, 0 on fail
+int FatFile_Sync(FatFile_t *f);
+
+// ******** FatFile_Close ************
+// Sync, trim unused preallocated space and close. The handle is freed either way
+// output: 1 on success, 0 on fail
+int FatFile_Close(FatFile_t *f);
+
+#endif
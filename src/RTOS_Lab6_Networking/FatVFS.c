@@ -0,0 +1,155 @@
+#include <string.h>
+#include "FatVFS.h"
+#include "FatFile.h"
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/heap.h"
+
+static FATFS FatVolume;
+
+
+// ******** fat_mode ************
+// FatFs open mode for a VFS open mode
+static BYTE fat_mode(uint8_t mode) {
+	BYTE m = 0;
+	if(mode & VFS_READ) {
+		m |= FA_READ;
+	}
+	if(mode & (VFS_WRITE | VFS_APPEND)) {
+		m |= FA_WRITE;
+	}
+	if(mode & VFS_CREATE) {
+		m |= FA_OPEN_ALWAYS;
+	}
+	return m ? m : FA_READ;
+}
+
+static void* fat_open(void *ctx, const char path[], uint8_t mode) {
+	FatFile_t *f = FatFile_Open(path, fat_mode(mode));
+	if(f && (mode & VFS_APPEND)) {
+		FatFile_Seek(f, FatFile_Length(f));
+	}
+	return f;
+}
+
+static uint32_t fat_read(void *file, void *buff, uint32_t size) {
+	return FatFile_Read(file, buff, size);
+}
+
+static uint32_t fat_write(void *file, const void *buff, uint32_t size) {
+	return FatFile_Write(file, buff, size);
+}
+
+static uint32_t fat_seek(void *file, uint32_t pos) {
+	return FatFile_Seek(file, pos);
+}
+
+static uint32_t fat_tell(void *file) {
+	return FatFile_Tell(file);
+}
+
+static uint32_t fat_length(void *file) {
+	return FatFile_Length(file);
+}
+
+static int fat_close(void *file) {
+	return FatFile_Close(file);
+}
+
+static void* fat_opendir(void *ctx, const char path[]) {
+	DIR *d = Heap_KernelMalloc(sizeof(DIR));
+	if(d == 0) {
+		return 0;
+	}
+
+	OS_Wait(&FatLock);
+	FRESULT r = f_opendir(d, path);
+	OS_Signal(&FatLock);
+
+	if(r != FR_OK) {
+		Heap_KernelFree(d);
+		return 0;
+	}
+	return d;
+}
+
+static int fat_readdir(void *dir, char name[], uint32_t *size) {
+	FILINFO fi;
+	OS_Wait(&FatLock);
+	FRESULT r = f_readdir(dir, &fi);
+	OS_Signal(&FatLock);
+
+	if(r != FR_OK || fi.fname[0] == 0) {
+		return 0;
+	}
+	strcpy(name, fi.fname);
+	*size = fi.fsize;
+	return 1;
+}
+
+static int fat_closedir(void *dir) {
+	OS_Wait(&FatLock);
+	FRESULT r = f_closedir(dir);
+	OS_Signal(&FatLock);
+	Heap_KernelFree(dir);
+	return r == FR_OK;
+}
+
+static int fat_create(void *ctx, const char path[]) {
+	FIL f;		// No sector buffer at _FS_TINY, small enough for the stack
+
+	OS_Wait(&FatLock);
+	FRESULT r = f_open(&f, path, FA_CREATE_NEW | FA_WRITE);
+	if(r == FR_OK) {
+		r = f_close(&f);
+	}
+	OS_Signal(&FatLock);
+	return r == FR_OK;
+}
+
+static int fat_mkdir(void *ctx, const char path[]) {
+	OS_Wait(&FatLock);
+	FRESULT r = f_mkdir(path);
+	OS_Signal(&FatLock);
+	return r == FR_OK;
+}
+
+static int fat_remove(void *ctx, const char path[]) {
+	OS_Wait(&FatLock);
+	FRESULT r = f_unlink(path);
+	OS_Signal(&FatLock);
+	return r == FR_OK;
+}
+
+const VFSOps_t FatFs_VFSOps = {
+	fat_open, fat_read, fat_write, fat_seek, fat_tell, fat_length, fat_close,
+	fat_opendir, fat_readdir, fat_closedir, fat_create, fat_mkdir, fat_remove
+};
+
+int FatVFS_Mount(const char prefix[]) {
+	FatFile_Init();
+
+	// Mount now rather than on first access, so a missing card fails here
+	OS_Wait(&FatLock);
+	FRESULT r = f_mount(&FatVolume, "", 1);
+	OS_Signal(&FatLock);
+	if(r != FR_OK) {
+		return 0;
+	}
+	if(!VFS_Mount(prefix, &FatFs_VFSOps, &FatVolume)) {
+		OS_Wait(&FatLock);
+		f_mount(0, "", 0);
+		OS_Signal(&FatLock);
+		return 0;
+	}
+	return 1;
+}
+
+int FatVFS_Unmount(const char prefix[]) {
+	if(!VFS_Unmount(prefix)) {
+		return 0;
+	}
+	OS_Wait(&FatLock);
+	f_mount(0, "", 0);
+	OS_Signal(&FatLock);
+	return 1;
+}
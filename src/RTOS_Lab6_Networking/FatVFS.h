@@ -0,0 +1,27 @@
+/*
+FatFs as a VFS backend (see VFS.h), for cards that are also read on a PC.
+
+Files are FatFile handles (FatFile.h): buffered, any number open at once up to the
+VFS descriptor table, and every call into FatFs is made holding FatLock.
+*/
+
+#ifndef FATVFS_H
+#define FATVFS_H
+
+#include "../RTOS_Labs_common/VFS.h"
+
+extern const VFSOps_t FatFs_VFSOps;
+
+// ******** FatVFS_Mount ************
+// Mount the FAT volume on drive 0 and attach it to the VFS
+// input:  const char prefix[] - mount point, e.g. "/fat"
+// output: 1 on success, 0 on fail (no card, no FAT volume, or the mount table is full)
+int FatVFS_Mount(const char prefix[]);
+
+// ******** FatVFS_Unmount ************
+// Detach the FAT volume from the VFS and unmount it
+// input:  const char prefix[] - mount point it was mounted at
+// output: 1 on success, 0 on fail (files still open)
+int FatVFS_Unmount(const char prefix[]);
+
+#endif
@@ -44,6 +44,7 @@
 #include "../RTOS_Labs_common/eDisk.h"
 #include "../RTOS_Labs_common/can0.h"
 #include "../RTOS_Labs_common/esp8266.h"
+#include "FatVFS.h"
 
 
 // CAN IDs are set dynamically at time of CAN0_Open
@@ -94,6 +95,19 @@ void Idle(void){
 
 //--------------end of Idle Task-----------------------------
 
+//------------------Init Task--------------------------------
+// foreground thread, runs at startup
+// mounts the SD card (FatFs) at /sd, next to the file system the Interpreter mounts at /
+// needs to execute after the disk timer has started
+// inputs:  none
+// outputs: none
+void Init(void){
+  if(!FatVFS_Mount("/sd")) {
+    printf("Error mounting the SD card at /sd\n\r");
+  }
+  OS_Kill();
+}
+
 //*******************final user main - bare bones OS, extend with your code**********
 int realmain(void){ // realmain
   OS_Init();        // initialize, disable interrupts
@@ -110,6 +124,7 @@ int realmain(void){ // realmain
 
   // create initial foreground threads
   NumCreated = 0;
+  NumCreated += OS_AddThread(&Init,128,1); 
   NumCreated += OS_AddThread(&Interpreter,128,2); 
   NumCreated += OS_AddThread(&Idle,128,5);  // at lowest priority 
  
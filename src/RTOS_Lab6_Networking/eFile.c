@@ -6,7 +6,7 @@
 #include <string.h>
 #include "../RTOS_Labs_common/OS.h"
 #include "../RTOS_Labs_common/eFile.h"
-#include "ff.h"
+#include "FatFile.h"
 #include <stdio.h>
 
 
@@ -16,7 +16,8 @@ extern Sema4Type LCDFree;  // this should really be handled in eDisk.c, not eFil
 // Static file system objects
 static FATFS g_sFatFs;
 static DIR d; 
-static FIL f; 
+static FatFile_t *wf;   // File open for writing, buffered so eFile_Write is a copy
+static FatFile_t *rf;   // File open for reading, separate so both can be open
 static FILINFO fi;
 
 
@@ -25,7 +26,7 @@ static FILINFO fi;
 // Input: none
 // Output: 0 if successful and 1 on failure (already initialized)
 int eFile_Init(void){ // initialize file system
-  // do nothing for FAT
+  FatFile_Init();
   return 0;
 }
 
@@ -35,7 +36,10 @@ int eFile_Init(void){ // initialize file system
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Format(void){ // erase disk, add format
 	OS_bWait(&LCDFree);
-  if(f_mkfs("", 0, 0)){
+	OS_Wait(&FatLock);
+	FRESULT r = f_mkfs("", 0, 0);
+	OS_Signal(&FatLock);
+  if(r){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -49,7 +53,10 @@ int eFile_Format(void){ // erase disk, add format
 // Output: 0 if successful and 1 on failure (already initialized)
 int eFile_Mount(void){ // mount disk
 	OS_bWait(&LCDFree);
-  if(f_mount(&g_sFatFs, "", 0)){
+	OS_Wait(&FatLock);
+	FRESULT r = f_mount(&g_sFatFs, "", 0);
+	OS_Signal(&FatLock);
+  if(r){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -62,8 +69,10 @@ int eFile_Mount(void){ // mount disk
 // Input: file name is an ASCII string up to seven characters 
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Create( const char name[]){  // create new file, make it empty 
+  FatFile_t *nf;
 	OS_bWait(&LCDFree);
-  if(f_open(&f, name, FA_CREATE_NEW)){
+  nf = FatFile_Open(name, FA_CREATE_NEW | FA_WRITE);
+  if(!nf || !FatFile_Close(nf)){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -76,11 +85,14 @@ int eFile_Create( const char name[]){  // create new file, make it empty
 // Input: file name is an ASCII string up to seven characters
 // Output: 0 if successful and 1 on failure (e.g., trouble reading from flash)
 int eFile_WOpen( const char name[]){      // open a file for writing 
+  if(wf) return 1;  // one file open for writing at a time
 	OS_bWait(&LCDFree);
-  if(f_open(&f, name, FA_WRITE)){
+  wf = FatFile_Open(name, FA_WRITE);
+  if(!wf){
 		OS_bSignal(&LCDFree);
     return 1;
   }
+  FatFile_Seek(wf, FatFile_Length(wf));
   OS_bSignal(&LCDFree);
   return 0;   
 }
@@ -90,9 +102,8 @@ int eFile_WOpen( const char name[]){      // open a file for writing
 // Input: data to be saved
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Write( char data){
-  unsigned written;
   OS_bWait(&LCDFree);
-  if(f_write(&f, &data, 1, &written) || (written != 1)){
+  if(!wf || FatFile_Write(wf, &data, 1) != 1){
     OS_bSignal(&LCDFree);
     return 1;
   }
@@ -105,8 +116,11 @@ int eFile_Write( char data){
 // Input: none
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_WClose(void){ // close the file for writing
+  FatFile_t *cf = wf;
+  if(!cf) return 1;
+  wf = 0;
 	OS_bWait(&LCDFree);
-  if(f_close(&f)){
+  if(!FatFile_Close(cf)){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -119,8 +133,10 @@ int eFile_WClose(void){ // close the file for writing
 // Input: file name is an ASCII string up to seven characters
 // Output: 0 if successful and 1 on failure (e.g., trouble reading from flash)
 int eFile_ROpen( const char name[]){      // open a file for reading 
+  if(rf) return 1;  // one file open for reading at a time
 	OS_bWait(&LCDFree);
-  if(f_open(&f, name, FA_READ)){
+  rf = FatFile_Open(name, FA_READ);
+  if(!rf){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -134,9 +150,8 @@ int eFile_ROpen( const char name[]){      // open a file for reading
 // Output: return by reference data
 //         0 if successful and 1 on failure (e.g., end of file)
 int eFile_ReadNext( char *pt){       // get next byte 
-  unsigned read;
   OS_bWait(&LCDFree);
-  if(f_read(&f, pt, 1, &read) || (read != 1)){
+  if(!rf || FatFile_Read(rf, pt, 1) != 1){
     OS_bSignal(&LCDFree);
     return 1;
   }
@@ -149,8 +164,11 @@ int eFile_ReadNext( char *pt){       // get next byte
 // Input: none
 // Output: 0 if successful and 1 on failure (e.g., wasn't open)
 int eFile_RClose(void){ // close the file for writing
+  FatFile_t *cf = rf;
+  if(!cf) return 1;
+  rf = 0;
 	OS_bWait(&LCDFree);
-  if(f_close(&f)){
+  if(!FatFile_Close(cf)){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -164,7 +182,10 @@ int eFile_RClose(void){ // close the file for writing
 // Output: 0 if successful and 1 on failure (e.g., trouble writing to flash)
 int eFile_Delete( const char name[]){  // remove this file 
 	OS_bWait(&LCDFree);
-  if(f_unlink(name)){
+	OS_Wait(&FatLock);
+	FRESULT r = f_unlink(name);
+	OS_Signal(&FatLock);
+  if(r){
     OS_bSignal(&LCDFree);
     return 1;
   }
@@ -179,7 +200,10 @@ int eFile_Delete( const char name[]){  // remove this file
 // Output: 0 if successful and 1 on failure (e.g., trouble reading from flash)
 int eFile_DOpen( const char name[]){ // open directory
 	OS_bWait(&LCDFree);
-  if(f_opendir(&d, name)) {
+	OS_Wait(&FatLock);
+	FRESULT r = f_opendir(&d, name);
+	OS_Signal(&FatLock);
+  if(r) {
 		OS_bSignal(&LCDFree);
 		return 1;
   }
@@ -194,7 +218,10 @@ int eFile_DOpen( const char name[]){ // open directory
 //         0 if successful and 1 on failure (e.g., end of file)
 int eFile_DirNext( char *name[], unsigned long *size){  // get next entry 
 	OS_bWait(&LCDFree);
-	if(f_readdir(&d, &fi) || !fi.fname[0]) {
+	OS_Wait(&FatLock);
+	FRESULT r = f_readdir(&d, &fi);
+	OS_Signal(&FatLock);
+	if(r || !fi.fname[0]) {
 		OS_bSignal(&LCDFree);
 		return 1;
   }
@@ -210,7 +237,10 @@ int eFile_DirNext( char *name[], unsigned long *size){  // get next entry
 // Output: 0 if successful and 1 on failure (e.g., wasn't open)
 int eFile_DClose(void){ // close the directory
 	OS_bWait(&LCDFree);
-  if(f_closedir(&d)){
+	OS_Wait(&FatLock);
+	FRESULT r = f_closedir(&d);
+	OS_Signal(&FatLock);
+  if(r){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -224,7 +254,10 @@ int eFile_DClose(void){ // close the directory
 // Output: 0 if successful and 1 on failure (not currently mounted)
 int eFile_Unmount(void){ 
 	OS_bWait(&LCDFree);
-  if(f_mount(NULL, "", 0)){
+	OS_Wait(&FatLock);
+	FRESULT r = f_mount(NULL, "", 0);
+	OS_Signal(&FatLock);
+  if(r){
 		OS_bSignal(&LCDFree);
     return 1;
   }
@@ -3989,6 +3989,79 @@ FRESULT f_forward (
 
 
 
+#if _USE_EXPAND && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Blocks to the File (backported from R0.12)      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_expand (
+  FIL* fp,    /* Pointer to the file object */
+  DWORD fsz,    /* File size to be expanded to */
+  BYTE opt    /* Operation mode 0:Find and prepare or 1:Find and allocate */
+)
+{
+  FRESULT res;
+  FATFS *fs;
+  DWORD n, clst, stcl, scl, ncl, tcl, lclst;
+
+
+  res = validate(fp);            /* Check validity of the object */
+  if (res != FR_OK) LEAVE_FF(fp->fs, res);
+  if (fp->err)              /* Check error */
+    LEAVE_FF(fp->fs, (FRESULT)fp->err);
+  if (fsz == 0 || fp->fsize != 0 || !(fp->flag & FA_WRITE))  /* Only an empty file open for writing */
+    LEAVE_FF(fp->fs, FR_DENIED);
+  fs = fp->fs;
+  n = (DWORD)fs->csize * SS(fs);  /* Cluster size */
+  tcl = fsz / n + ((fsz & (n - 1)) ? 1 : 0);  /* Number of clusters required */
+  stcl = fs->last_clust; lclst = 0;
+  if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+
+  scl = clst = stcl; ncl = 0;
+  for (;;) {    /* Find a contiguous cluster block */
+    n = get_fat(fs, clst);
+    if (++clst >= fs->n_fatent) clst = 2;
+    if (n == 1) { res = FR_INT_ERR; break; }
+    if (n == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
+    if (n == 0) {  /* Is it a free cluster? */
+      if (++ncl == tcl) break;  /* Break if a contiguous cluster block is found */
+    } else {
+      scl = clst; ncl = 0;    /* Not a free cluster */
+    }
+    if (clst == stcl) { res = FR_DENIED; break; }  /* No contiguous cluster? */
+    if (clst == 2) { scl = 2; ncl = 0; }  /* A block does not wrap around the end of the FAT */
+  }
+  if (res == FR_OK) {  /* A contiguous free area is found */
+    if (opt) {    /* Allocate it now */
+      for (clst = scl, n = tcl; n; clst++, n--) {  /* Create a cluster chain on the FAT */
+        res = put_fat(fs, clst, (n == 1) ? 0x0FFFFFFF : clst + 1);
+        if (res != FR_OK) break;
+        lclst = clst;
+      }
+    } else {    /* Set it as suggested point for next allocation */
+      lclst = scl - 1;
+    }
+  }
+
+  if (res == FR_OK) {
+    fs->last_clust = lclst;    /* Set suggested start cluster to start next */
+    if (opt) {  /* Is it allocated now? */
+      fp->sclust = scl;    /* Update object allocation information */
+      fp->fsize = fsz;
+      fp->flag |= FA__WRITTEN;
+      if (fs->free_clust != 0xFFFFFFFF) {  /* Update FSINFO */
+        fs->free_clust -= tcl;
+        fs->fsi_flag |= 1;
+      }
+    }
+  }
+
+  LEAVE_FF(fs, res);
+}
+#endif /* _USE_EXPAND */
+
+
+
 #if _USE_MKFS && !_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Create File System on the Drive                                       */
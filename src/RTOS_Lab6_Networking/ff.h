@@ -210,6 +210,7 @@ FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);      /* Read data from
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);  /* Write data to a file */
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);  /* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);                /* Move file pointer of a file object */
+FRESULT f_expand (FIL* fp, DWORD fsz, BYTE opt);          /* Allocate a contiguous block to the file */
 FRESULT f_truncate (FIL* fp);                    /* Truncate file */
 FRESULT f_sync (FIL* fp);                      /* Flush cached data of a writing file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);            /* Open a directory */
@@ -0,0 +1,137 @@
+// ************************** BlockDev.c **************************
+// Block device layer: named devices behind a small table of operations
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+#include <string.h>
+#include "BlockDev.h"
+#include "heap.h"
+
+BlockDev_t BlockDevs[BLOCKDEV_MAX];
+
+
+BlockDev_t* BlockDev_Register(const char name[], const BlockDevOps_t *ops, void *ctx) {
+	if(strlen(name) > BLOCKDEV_NAME_LENGTH) {
+		return 0;
+	}
+
+	BlockDev_t *dev = BlockDev_Find(name);
+	for(uint32_t i = 0; dev == 0 && i < BLOCKDEV_MAX; i++) {
+		if(BlockDevs[i].ops == 0) {
+			dev = &BlockDevs[i];
+		}
+	}
+	if(dev == 0) {
+		return 0;
+	}
+
+	strcpy(dev->name, name);
+	dev->ctx = ctx;
+	dev->ops = ops;
+	return dev;
+}
+
+BlockDev_t* BlockDev_Find(const char name[]) {
+	for(uint32_t i = 0; i < BLOCKDEV_MAX; i++) {
+		if(BlockDevs[i].ops && strcmp(BlockDevs[i].name, name) == 0) {
+			return &BlockDevs[i];
+		}
+	}
+	return 0;
+}
+
+void BlockDev_Remove(BlockDev_t *dev) {
+	if(dev) {
+		dev->ops = 0;
+		dev->ctx = 0;
+		dev->name[0] = 0;
+	}
+}
+
+int BlockDev_Read(BlockDev_t *dev, void *buff, uint32_t sector, uint32_t count) {
+	if(dev == 0 || count == 0) {
+		return 0;
+	}
+	return dev->ops->read(dev->ctx, buff, sector, count);
+}
+
+int BlockDev_Write(BlockDev_t *dev, const void *buff, uint32_t sector, uint32_t count) {
+	if(dev == 0 || count == 0) {
+		return 0;
+	}
+	return dev->ops->write(dev->ctx, buff, sector, count);
+}
+
+uint32_t BlockDev_Count(BlockDev_t *dev) {
+	if(dev == 0) {
+		return 0;
+	}
+	return dev->ops->count(dev->ctx);
+}
+
+int BlockDev_Flush(BlockDev_t *dev) {
+	if(dev == 0) {
+		return 0;
+	}
+	return dev->ops->flush ? dev->ops->flush(dev->ctx) : 1;
+}
+
+int BlockDev_Trim(BlockDev_t *dev, uint32_t sector, uint32_t count) {
+	if(dev == 0) {
+		return 0;
+	}
+	return dev->ops->trim ? dev->ops->trim(dev->ctx, sector, count) : 1;
+}
+
+
+// ------------------------------------- RAM disk ------------------------------------------- //
+
+// The allocation starts with the sector count, the sectors follow
+typedef struct RamDisk {
+	uint32_t sectors;
+	uint8_t data[];
+} RamDisk_t;
+
+static int ram_in_range(RamDisk_t *rd, uint32_t sector, uint32_t count) {
+	return sector < rd->sectors && count <= rd->sectors - sector;
+}
+
+static int ram_read(void *ctx, void *buff, uint32_t sector, uint32_t count) {
+	RamDisk_t *rd = ctx;
+	if(!ram_in_range(rd, sector, count)) {
+		return 0;
+	}
+	memcpy(buff, &rd->data[sector*BLOCKDEV_SECTOR], count*BLOCKDEV_SECTOR);
+	return 1;
+}
+
+static int ram_write(void *ctx, const void *buff, uint32_t sector, uint32_t count) {
+	RamDisk_t *rd = ctx;
+	if(!ram_in_range(rd, sector, count)) {
+		return 0;
+	}
+	memcpy(&rd->data[sector*BLOCKDEV_SECTOR], buff, count*BLOCKDEV_SECTOR);
+	return 1;
+}
+
+static uint32_t ram_count(void *ctx) {
+	return ((RamDisk_t *) ctx)->sectors;
+}
+
+const BlockDevOps_t RamDisk_Ops = {ram_read, ram_write, ram_count, 0, 0};
+
+BlockDev_t* BlockDev_AddRAM(const char name[], uint32_t sectors) {
+	RamDisk_t *rd = Heap_KernelMalloc(sizeof(RamDisk_t) + sectors*BLOCKDEV_SECTOR);
+	if(rd == 0) {
+		return 0;
+	}
+	rd->sectors = sectors;
+	memset(rd->data, 0, sectors*BLOCKDEV_SECTOR);
+
+	BlockDev_t *dev = BlockDev_Register(name, &RamDisk_Ops, rd);
+	if(dev == 0) {
+		Heap_KernelFree(rd);
+	}
+	return dev;
+}
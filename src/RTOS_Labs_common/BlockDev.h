@@ -0,0 +1,96 @@
+// ************************** BlockDev.h **************************
+// Block device layer: named devices behind a small table of operations
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	A block device is an ops table (read, write, count, flush, trim) and a context
+	pointer handed back to every op, registered under a name. Sectors are BLOCKDEV_SECTOR
+	bytes. Ops return 1 on success and 0 on fail, like the rest of the OS.
+
+	Backends:
+		"sd"    eDisk_Ops in eDisk.c, the SD card on SSI0 (registered by the OS at boot)
+		RAM     BlockDev_AddRAM, sectors allocated from the kernel heap. Fast scratch space,
+						but the heap is far too small on the board for an eFile drive
+		host    tools/hostdisk.c, an image file with a latency model (host builds only)
+
+	eFile works on one device at a time, see eFile_SetDevice.
+*/
+
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stdint.h>
+
+#define BLOCKDEV_SECTOR 512
+#define BLOCKDEV_MAX 4
+#define BLOCKDEV_NAME_LENGTH 7
+
+typedef struct BlockDevOps {
+	int (*read)(void *ctx, void *buff, uint32_t sector, uint32_t count);
+	int (*write)(void *ctx, const void *buff, uint32_t sector, uint32_t count);
+	uint32_t (*count)(void *ctx);											// Number of sectors
+	int (*flush)(void *ctx);														// Finish buffered writes, may be 0
+	int (*trim)(void *ctx, uint32_t sector, uint32_t count);	// Contents no longer needed, may be 0
+} BlockDevOps_t;
+
+typedef struct BlockDev {
+	char name[BLOCKDEV_NAME_LENGTH+1];
+	const BlockDevOps_t *ops;
+	void *ctx;
+} BlockDev_t;
+
+// ******** BlockDev_Register ************
+// Add a device, or replace the device already registered under the name
+// input:  const char name[]        - device name, at most BLOCKDEV_NAME_LENGTH characters
+//				 const BlockDevOps_t *ops - operations
+//				 void *ctx                - passed to every operation
+// output: the device, 0 if the table is full
+BlockDev_t* BlockDev_Register(const char name[], const BlockDevOps_t *ops, void *ctx);
+
+// ******** BlockDev_Find ************
+// Look up a device by name
+// input:  const char name[] - device name
+// output: the device, 0 if there is none
+BlockDev_t* BlockDev_Find(const char name[]);
+
+// ******** BlockDev_Remove ************
+// Take a device out of the table, its backend still owns the context
+// input:  BlockDev_t *dev - device to remove
+// output: none
+void BlockDev_Remove(BlockDev_t *dev);
+
+// ******** BlockDev_AddRAM ************
+// Register a RAM disk allocated from the kernel heap, initially zero
+// input:  const char name[] - device name
+//				 uint32_t sectors  - size of the disk
+// output: the device, 0 if out of memory or the table is full
+BlockDev_t* BlockDev_AddRAM(const char name[], uint32_t sectors);
+
+// ******** BlockDev_Read ************
+// Read count sectors starting at sector
+// output: 1 on success, 0 on fail
+int BlockDev_Read(BlockDev_t *dev, void *buff, uint32_t sector, uint32_t count);
+
+// ******** BlockDev_Write ************
+// Write count sectors starting at sector
+// output: 1 on success, 0 on fail
+int BlockDev_Write(BlockDev_t *dev, const void *buff, uint32_t sector, uint32_t count);
+
+// ******** BlockDev_Count ************
+// Size of a device
+// output: number of sectors, 0 if there is no device
+uint32_t BlockDev_Count(BlockDev_t *dev);
+
+// ******** BlockDev_Flush ************
+// Finish any buffered writes
+// output: 1 on success, 0 on fail
+int BlockDev_Flush(BlockDev_t *dev);
+
+// ******** BlockDev_Trim ************
+// Tell the device a range of sectors no longer holds anything useful
+// output: 1 on success (or if the device ignores trims), 0 on fail
+int BlockDev_Trim(BlockDev_t *dev, uint32_t sector, uint32_t count);
+
+#endif
@@ -17,6 +17,7 @@
 #include "../RTOS_Labs_common/UART0int.h"
 #include "../RTOS_Labs_common/eDisk.h"
 #include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Labs_common/VFS.h"
 #include "../RTOS_Lab5_ProcessLoader/loader.h"
 #include "../RTOS_Labs_common/esp8266.h"
 #include "Interpreter.h"
@@ -61,6 +62,9 @@ int save(int num_args, ...);
 int append(int num_args, ...);
 int format_drive(int num_armgs, ...);
 int run(int num_args, ...);
+int ps(int num_args, ...);
+int reserve(int num_args, ...);
+int heap(int num_args, ...);
 
 // TODO Move help messages into a file
 
@@ -86,6 +90,9 @@ const Command commands[] = {
 	{"save", &save},
 	{"format_drive", &format_drive},
 	{"run", &run},
+	{"ps", &ps},													// "ps\r\n\tCPU reservation and usage of each process\r\n\n"},
+	{"reserve", &reserve},								// "reserve <pid> <budget_ms> <period_ms>\r\n\tSet a process CPU reservation, budget 0 is unlimited\r\n\n"},
+	{"heap", &heap},											// "heap [pid]\r\n\tLive bytes per thread, top allocation sites and fragmentation of a heap\r\n\n"},
 	
 #if EFILE_H
 	{"ls", &ls},
@@ -126,23 +133,9 @@ void Interpreter_In(char *s, uint32_t n) {
 
 #if EFILE_H
 void pwd(void) {
-	Dir_t d;
-	Dir_t parent;
-	DirEntry_t de;
-	eFile_OpenCurrentDir(&d);
-	eFile_Open("..", &parent);
-	if(d.iNode->sector_num == parent.iNode->sector_num) {
-		// Only the root is its own parent
-		Interpreter_Out("[root] > ");
-	}
-	else {
-		eFile_D_lookup_by_sector(&parent, d.iNode->sector_num, &de);
-		char s[32];
-		sprintf(s, "[%s] > ", de.name);
-		Interpreter_Out(s);
-	}
-	eFile_D_close(&parent);
-	eFile_D_close(&d);
+	Interpreter_Out("[");
+	Interpreter_Out((char *) VFS_Cwd());
+	Interpreter_Out("] > ");
 }
 #endif
 
@@ -168,6 +161,13 @@ void Interpreter(void){
 	format_drive(0);
 	#endif
 	
+	#if EFILE_H
+	// The native file system is the root, unless the application mounted something else there
+	if(VFS_Find("/") == 0) {
+		VFS_Mount("/", &eFile_VFSOps, 0);
+	}
+	#endif
+	
 	while(1) {
 		// Read Command
 		#if EFILE_H
@@ -218,6 +218,7 @@ void Interpreter(void){
 			arg0[16*k + i] = 0; // Ensure null terminated string
 			k += 1; //Move to next argument
 		}
+		num_args = k;
 	
 		
 		int func_found = 0;
@@ -268,27 +269,34 @@ int run(int num_args, ...) {
 	char *path = va_arg(args, char*);
 	va_end(args);
 	
-	ELFEnv_t env = {symtab, 1};
+	static const ELFEnv_t env = {symtab, 1};
 	if(!exec_elf(path, &env)) {return 1;}
 	return 0;
 }
 
 #if EFILE_H
 int ls(int num_args, ...) {
-	Dir_t d;
-	eFile_Open(".", &d);
+	va_list args;
+	va_start(args, num_args);
+	char *path = va_arg(args, char*);
+	va_end(args);
+	
+	int d = VFS_OpenDir(num_args > 0 ? path : ".");
+	if(d < 0) {
+		return 1;
+	}
 	
-	char fn[MAX_FILE_NAME_LENGTH+1];
+	char fn[VFS_NAME_LENGTH];
 	uint32_t sz;
-	while(eFile_D_read_next(&d, fn, &sz)) {
+	while(VFS_ReadDir(d, fn, &sz)) {
 		char buf[128];
 		char dots[] = "..................................................................";
-		dots[MAX_FILE_NAME_LENGTH - strlen(fn)] = 0;
+		dots[strlen(fn) < MAX_FILE_NAME_LENGTH ? MAX_FILE_NAME_LENGTH - strlen(fn) : 0] = 0;
 		sprintf(buf, "%s%s%d\r\n", fn, dots, sz);
 		Interpreter_Out(buf);
 	}
 	
-	eFile_D_close(&d);
+	VFS_Close(d);
 	return 0;
 }
 
@@ -298,8 +306,7 @@ int cd(int num_args, ...) {
 	char *path = va_arg(args, char*);
 	va_end(args);
 
-	eFile_CD(path);
-	return 0;
+	return VFS_CD(path) != 1;
 }
 
 int cat(int num_args, ...) {
@@ -308,13 +315,17 @@ int cat(int num_args, ...) {
 	char *path = va_arg(args, char*);
 	va_end(args);
 	
-	File_t f;
-	eFile_Open(path, &f);
-	char buf[128];
-	while(eFile_F_read(&f, buf, 128)) {
+	int f = VFS_Open(path, VFS_READ);
+	if(f < 0) {
+		return 1;
+	}
+	char buf[129];
+	uint32_t n;
+	while((n = VFS_Read(f, buf, 128)) != 0) {
+		buf[n] = 0;
 		Interpreter_Out(buf);
-		memset(buf, 0, 128);
 	}
+	VFS_Close(f);
 	Interpreter_Out("\r\n"); // Flush out
 	return 0;
 }
@@ -327,10 +338,12 @@ int append(int num_args, ...) {
 	char *text = va_arg(args, char*);
 	va_end(args);
 	
-	File_t f;
-	eFile_Open(fp, &f);
-	eFile_F_write(&f, text, strlen(text));
-	eFile_F_close(&f);
+	int f = VFS_Open(fp, VFS_WRITE | VFS_APPEND);
+	if(f < 0) {
+		return 1;
+	}
+	VFS_Write(f, text, strlen(text));
+	VFS_Close(f);
 	
 	return 0;
 }
@@ -341,7 +354,7 @@ int rm(int num_args, ...) {
 	char *path = va_arg(args, char*);
 	va_end(args);
 	
-	return eFile_Remove(path) != 1;
+	return VFS_Remove(path) != 1;
 }
 
 int touch(int num_args, ...) {
@@ -350,7 +363,7 @@ int touch(int num_args, ...) {
 	char *path = va_arg(args, char*);
 	va_end(args);
 	
-	return eFile_Create(path) != 1;
+	return VFS_Create(path) != 1;
 }
 
 int mkdir(int num_args, ...) {
@@ -359,7 +372,7 @@ int mkdir(int num_args, ...) {
 	char *path = va_arg(args, char*);
 	va_end(args);
 	
-	return eFile_CreateDir(path) != 1;
+	return VFS_CreateDir(path) != 1;
 }
 #endif
 
@@ -483,6 +496,97 @@ int num_threads(int num_args, ...) {
 	return 0;
 }
 
+int ps(int num_args, ...) {
+	char s[100];
+	Interpreter_Out("pid threads budget/period(ms) last_period(ms) total(ms) throttled heap used/peak/size\r\n");
+	
+	// Note: values can change under us, this is only a snapshot for display
+	for(PCB_t *p = OS_get_process_list(); p != 0; p = p->next_ptr) {
+		sprintf(s, "%3u %7u %6u/%-6u %15u %9u %3u%-6s %u/%u/%u\r\n",
+			p->id, p->numThreadsAlive, p->budget, p->period, p->last_used,
+			p->total_used, p->throttle_cnt, p->throttled ? " (now)" : "",
+			p->heap.used, p->heap.peak, p->heap.size);
+		Interpreter_Out(s);
+	}
+	return 0;
+}
+
+int reserve(int num_args, ...) {
+	va_list args;
+	va_start(args, num_args);
+	uint32_t pid = strtoul(va_arg(args, char*), NULL, 10);
+	uint32_t budget = strtoul(va_arg(args, char*), NULL, 10);
+	uint32_t period = strtoul(va_arg(args, char*), NULL, 10);
+	va_end(args);
+	
+	if(!OS_SetReservation(pid, budget, period)) {
+		Interpreter_Out("Error: no such process or period is 0\r\n");
+		return 1;
+	}
+	return 0;
+}
+
+int heap(int num_args, ...) {
+	va_list args;
+	va_start(args, num_args);
+	uint32_t pid = num_args > 0 ? strtoul(va_arg(args, char*), NULL, 10) : 0;
+	va_end(args);
+	
+	heap_t *h = &BaseHeap;
+	if(pid) {
+		PCB_t *p = OS_get_process_list();
+		while(p && p->id != pid) {
+			p = p->next_ptr;
+		}
+		if(!p) {
+			Interpreter_Out("Error: no such process\r\n");
+			return 1;
+		}
+		h = &p->heap;
+	}
+	
+	// Too large for the interpreter stack
+	heap_profile_t *prof = malloc(sizeof(heap_profile_t));
+	if(!prof) {
+		Interpreter_Out("Error: out of memory\r\n");
+		return 1;
+	}
+	if(Heap_Profile(h, prof)) {
+		free(prof);
+		Interpreter_Out("Error: heap is corrupt\r\n");
+		return 1;
+	}
+	
+	char s[80];
+	sprintf(s, "size %u used %u peak %u free %u\r\n", h->size, h->used, h->peak, prof->free);
+	Interpreter_Out(s);
+	sprintf(s, "%u used blocks, %u free blocks, largest free %u\r\n", prof->used_blocks, prof->free_blocks, prof->largest_free);
+	Interpreter_Out(s);
+	
+	#if HEAP_PROFILE
+	uint32_t now = OS_MsTime();
+	Interpreter_Out("tid pid blocks bytes\r\n");
+	for(uint32_t i = 0; i < prof->num_owners; i++) {
+		sprintf(s, "%3u %3u %6u %5u\r\n", prof->owners[i].tid, prof->owners[i].pid, prof->owners[i].blocks, prof->owners[i].bytes);
+		Interpreter_Out(s);
+	}
+	if(prof->other_bytes) {
+		sprintf(s, "  (other) %5u\r\n", prof->other_bytes);
+		Interpreter_Out(s);
+	}
+	Interpreter_Out("caller     blocks bytes oldest(ms)\r\n");
+	for(uint32_t i = 0; i < prof->num_sites; i++) {
+		sprintf(s, "0x%08X %6u %5u %10u\r\n", prof->sites[i].caller, prof->sites[i].blocks, prof->sites[i].bytes, now - prof->sites[i].oldest);
+		Interpreter_Out(s);
+	}
+	#else
+	Interpreter_Out("Set HEAP_PROFILE in heap.h for per thread and call site usage\r\n");
+	#endif
+	
+	free(prof);
+	return 0;
+}
+
 int time(int num_args, ...) {
 	uint32_t t = OS_MsTime();
 	char s[64];
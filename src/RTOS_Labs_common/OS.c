@@ -75,6 +75,7 @@ TCB_t threads[MAX_NUM_THREADS];
 TCB_t *RunPt = 0; // Currently running thread
 TCB_t *inactive_thread_list_head = 0;
 TCB_t *sleeping_thread_list_head = 0;
+PCB_t *process_list_head = 0;
 
 
 
@@ -220,6 +221,53 @@ void DecrementSleepCounters(void) {
 	EndCritical(i);
 }
 
+/** ReservationTick
+ * @details Charge 1ms of CPU to the process of the running thread and replenish
+ * the budget of every process whose period has elapsed. A process which exhausts
+ * its budget is throttled: scheduler_next skips its threads until replenishment.
+ * @param  none
+ * @return none
+ * @brief Enforce per-process CPU reservations
+ */
+void ReservationTick(void) {
+	int i = StartCritical();
+	uint8_t reschedule = 0;
+	
+	PCB_t *proc = RunPt ? RunPt->process : 0;
+	if(proc && !RunPt->isBackgroundThread) {
+		proc->used++;
+		proc->total_used++;
+		if(proc->budget && !proc->throttled && proc->used >= proc->budget) {
+			proc->throttled = 1;
+			proc->throttle_cnt++;
+			reschedule = 1;	// Preempt now instead of at the end of the time slice
+		}
+	}
+	
+	for(proc = process_list_head; proc != 0; proc = proc->next_ptr) {
+		if(--proc->period_left == 0) {
+			proc->period_left = proc->period;
+			proc->last_used = proc->used;
+			proc->used = 0;
+			if(proc->throttled) {
+				proc->throttled = 0;
+				reschedule = 1;	// May now be the highest priority ready thread
+			}
+		}
+	}
+	
+	if(reschedule) {
+		ContextSwitch();
+	}
+	EndCritical(i);
+}
+
+// Timer5A 1ms tick
+void OS_MsTick(void) {
+	DecrementSleepCounters();
+	ReservationTick();
+}
+
 /*------------------------------------------------------------------------------
   Systick Interrupt Handler
   SysTick interrupt happens every 10 ms
@@ -234,8 +282,14 @@ void BackgroundThreadExit(void) {
 	scheduler_unlock(); // Force unlock
 	thread_cnt_alive--;
 	#if EFILE_H
+	OS_EndRedirectToFile();
 	iNode_close(RunPt->currentDir);
 	#endif
+	Heap_KernelFree(RunPt->cwd);
+	
+	#if HEAP_PROFILE && HEAP_RECLAIM_ON_KILL
+	Heap_ReclaimThread(RunPt->process ? &RunPt->process->heap : &BaseHeap, RunPt->id);
+	#endif
 	SVC_ContextSwitch();
 	EnableInterrupts(); // Force interrupt enable
 }
@@ -396,7 +450,7 @@ void OS_Init(void){
 	Heap_Init();
 	OS_MsTime_Init();
 	PortFEdge_Init();
-	Timer5A_Init(&DecrementSleepCounters, TIME_1MS, 1);
+	Timer5A_Init(&OS_MsTick, TIME_1MS, 1);
 	UART_Init();
 	DisableInterrupts();	// Disable after the OS clock is init so that we can track time ints disabled
 	OS_thread_init();
@@ -524,6 +578,127 @@ void OS_bSignal(Sema4Type *semaPt){
 	EndCritical(i);
 }; 
 
+// ******** rw_block ************
+// Block the running thread on a reader-writer lock queue.
+// Whoever wakes it has already handed it the lock. Interrupts must be disabled
+static void rw_block(TCB_t **queue) {
+	scheduler_unschedule(RunPt);
+	PrioQ_insert((PrioQ_node_t **) queue, (PrioQ_node_t *) RunPt);
+	ContextSwitch(); // Trigger PendSV
+	EnableInterrupts();
+}
+
+// ******** rw_wake_readers ************
+// Hand the lock to every blocked reader
+static void rw_wake_readers(RWLock_t *lock) {
+	TCB_t *thread;
+	while((thread = (TCB_t *) PrioQ_pop((PrioQ_node_t **) &lock->readers_head)) != 0) {
+		lock->state++;
+		scheduler_schedule(thread);
+	}
+}
+
+// ******** rw_wake_writer ************
+// Hand the free lock to the next writer, if any
+// output: 1 if a writer was woken
+static int rw_wake_writer(RWLock_t *lock) {
+	TCB_t *thread = (TCB_t *) PrioQ_pop((PrioQ_node_t **) &lock->writers_head);
+	if(thread == 0) {
+		return 0;
+	}
+	lock->writers_waiting--;
+	lock->state = -1;
+	scheduler_schedule(thread);
+	return 1;
+}
+
+void OS_InitRWLock(RWLock_t *lock) {
+	lock->state = 0;
+	lock->writers_waiting = 0;
+	lock->readers_head = 0;
+	lock->writers_head = 0;
+	lock->upgrader = 0;
+}
+
+void OS_ReadLock(RWLock_t *lock) {
+	DisableInterrupts();
+	if(lock->state >= 0 && lock->writers_waiting == 0 && lock->upgrader == 0) {
+		lock->state++;
+		EnableInterrupts();
+		return;
+	}
+	rw_block(&lock->readers_head);
+}
+
+void OS_ReadUnlock(RWLock_t *lock) {
+	int i = StartCritical();
+	lock->state--;
+	if(lock->upgrader && lock->state == 0) {
+		// The upgrading reader was the last one left
+		lock->state = -1;
+		scheduler_schedule(lock->upgrader);
+		lock->upgrader = 0;
+	}
+	else if(lock->state == 0) {
+		rw_wake_writer(lock);
+	}
+	EndCritical(i);
+}
+
+void OS_WriteLock(RWLock_t *lock) {
+	DisableInterrupts();
+	if(lock->state == 0) {
+		lock->state = -1;
+		EnableInterrupts();
+		return;
+	}
+	lock->writers_waiting++;
+	rw_block(&lock->writers_head);
+}
+
+void OS_WriteUnlock(RWLock_t *lock) {
+	int i = StartCritical();
+	lock->state = 0;
+	if(lock->readers_head) {
+		rw_wake_readers(lock);
+	}
+	else {
+		rw_wake_writer(lock);
+	}
+	EndCritical(i);
+}
+
+int OS_RWUpgrade(RWLock_t *lock) {
+	DisableInterrupts();
+	if(lock->state == 1) {
+		lock->state = -1;
+		EnableInterrupts();
+		return 1;
+	}
+	if(lock->upgrader == 0) {
+		// Give up the shared hold and wait for the other readers, new readers are held off
+		lock->state--;
+		lock->upgrader = RunPt;
+		scheduler_unschedule(RunPt);
+		ContextSwitch(); // Trigger PendSV
+		EnableInterrupts();
+		return 1;
+	}
+	
+	// Two upgraders would wait on each other forever, this one queues as a writer instead
+	EnableInterrupts();
+	OS_ReadUnlock(lock);
+	OS_WriteLock(lock);
+	return 0;
+}
+
+void OS_RWDowngrade(RWLock_t *lock) {
+	int i = StartCritical();
+	lock->state = 1;
+	rw_wake_readers(lock);
+	EndCritical(i);
+}
+
 // TODO Update from popping from pool and turn into malloc
 TCB_t* SpawnThread(uint8_t isBackgroundThread, uint8_t priority, uint32_t stack_size) {
 	
@@ -548,6 +723,8 @@ TCB_t* SpawnThread(uint8_t isBackgroundThread, uint8_t priority, uint32_t stack_
 	thread->sleep_count = 0;
 	thread->priority = priority;
 	thread->currentDir = 0;
+	thread->stream = 0;
+	thread->cwd = 0;
 	thread->process = 0;
 	
 	// Inherit the RunPt process if possible. Defaults to 0 (base OS process)
@@ -555,6 +732,9 @@ TCB_t* SpawnThread(uint8_t isBackgroundThread, uint8_t priority, uint32_t stack_
 		thread->process = RunPt->process;
 	}
 	
+	// The stack belongs to the new thread, and is freed by OS_Kill rather than reclaimed
+	Heap_SetOwner(stack_base, thread->id, thread->process ? thread->process->id : 0, HEAP_TAG_KERNEL);
+	
 	EndCritical(i);
 	return thread;
 }
@@ -589,23 +769,11 @@ int OS_AddThread(void(*task)(void),
   return 1; 
 };
 
-//******** OS_AddProcess *************** 
-// add a process with foregound thread to the scheduler
-// Inputs: pointer to a void/void entry point
-//         pointer to process text (code) segment
-//         pointer to process data segment
-//         number of bytes allocated for its stack
-//         priority (0 is highest)
-// Outputs: 1 if successful, 0 if this process can not be added
-// This function will be needed for Lab 5
-// In Labs 2-4, this function can be ignored
-int OS_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[])
-	{
-  // put Lab 5 solution here
-		void* text = heaps[0];
-		void* data = heaps[1];
-		unsigned long stackSize = stack_pri[0];
-		unsigned long priority = stack_pri[1];
+//******** process_add *************** 
+// Create a PCB and its first thread, see OS_AddProcess
+// Inputs: sharedText - the text segment belongs to the caller, not to the process
+static int process_add(void(*entry)(void), void *text, void *data,
+	unsigned long stackSize, unsigned long priority, uint8_t sharedText) {
 	if(stackSize < 512) {
 			 stackSize = 512;
 		 }
@@ -618,12 +786,22 @@ int OS_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[])
 		
 	PCB->text = text;
 	PCB->data = data;
+	PCB->sharedText = sharedText;
 	PCB->id = ++num_processes;
 	++num_processes_alive;
-	PCB->heap_size = PROCESS_HEAP_SIZE;
-	PCB->heap = malloc(PROCESS_HEAP_SIZE);
 	PCB->parent = RunPt->process; // Will be 0 for the base OS process, and nonzero for any user added process.
-	if(!PCB->heap) {
+	PCB->numThreadsAlive = 0;
+	PCB->budget = PROCESS_DEFAULT_BUDGET;
+	PCB->period = PROCESS_DEFAULT_PERIOD;
+	PCB->period_left = PROCESS_DEFAULT_PERIOD;
+	PCB->used = 0;
+	PCB->last_used = 0;
+	PCB->total_used = 0;
+	PCB->throttle_cnt = 0;
+	PCB->throttled = 0;
+	
+	// First region holds the initial stack, the heap grows from the parent as needed
+	if(!Heap_CreateProcessHeap(&PCB->heap, stackSize + 8 + PROCESS_HEAP_SIZE)) {
 		free(PCB);
 		return 0;
 	}
@@ -641,14 +819,13 @@ int OS_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[])
 	RunPt->process = PCB;
 	
 	// Allocate a foreground thread and link to the PCB
-	Heap_Init(); // initialize the new heap
 	TCB_t *thread = SpawnThread(0, priority, stackSize);
 	
 	// Return the heap context to the parent process
 	RunPt->process = PCB->parent;
 	
 	if(thread == 0) {
-		free(PCB->heap);
+		Heap_Destroy(&PCB->heap);
 		free(PCB);
 		EndCritical(I);
 		return 0;
@@ -656,13 +833,83 @@ int OS_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[])
 	
 	thread->process = PCB;
 	PCB->numThreadsAlive++;
+	Heap_SetOwner(thread->stack_base, thread->id, PCB->id, HEAP_TAG_KERNEL);
+	Heap_SetOwner(PCB, thread->id, PCB->id, HEAP_TAG_KERNEL);	// Freed with the last thread
+	if(!sharedText) {
+		Heap_SetOwner(text, thread->id, PCB->id, HEAP_TAG_KERNEL);
+	}
+	Heap_SetOwner(data, thread->id, PCB->id, HEAP_TAG_KERNEL);
+	LL_append_linear((LL_node_t **) &process_list_head, (LL_node_t *)PCB);
 	thread_init_stack(thread, entry, &OS_Kill, stackSize);
 	scheduler_schedule(thread);
   EndCritical(I);
      
-  return 1; // replace this line with Lab 5 solution
+  return 1;
 }
 
+//******** OS_AddProcess *************** 
+// add a process with foregound thread to the scheduler
+// Inputs: pointer to a void/void entry point
+//         heaps[0] pointer to process text (code) segment
+//         heaps[1] pointer to process data segment
+//         stack_pri[0] number of bytes allocated for its stack
+//         stack_pri[1] priority (0 is highest)
+// Outputs: 1 if successful, 0 if this process can not be added
+// The process owns both segments, they are freed when its last thread exits
+int OS_AddProcess(void(*entry)(void), void *heaps[], unsigned long stack_pri[]) {
+	return process_add(entry, heaps[0], heaps[1], stack_pri[0], stack_pri[1], 0);
+}
+
+//******** OS_AddSharedProcess *************** 
+// add a process whose text segment is shared with other processes (the loader's
+// image cache), only the data segment is freed when its last thread exits
+// Inputs: pointer to a void/void entry point
+//         pointer to process text (code) segment, owned by the caller
+//         pointer to process data segment
+//         number of bytes allocated for its stack
+//         priority (0 is highest)
+// Outputs: 1 if successful, 0 if this process can not be added
+int OS_AddSharedProcess(void(*entry)(void), void *text, void *data,
+	unsigned long stackSize, unsigned long priority) {
+	return process_add(entry, text, data, stackSize, priority, 1);
+}
+
+
+//******** OS_SetReservation *************** 
+// Set the CPU reservation of a process. When a process uses budget ms of CPU
+// within one period its threads are not scheduled until the period ends.
+// Inputs: process id, budget in ms (0 for unlimited), period in ms
+// Outputs: 1 if successful, 0 if the process does not exist or the period is 0
+int OS_SetReservation(uint32_t pid, uint32_t budget, uint32_t period) {
+	if(period == 0) {
+		return 0;
+	}
+	
+	int I = StartCritical();
+	PCB_t *proc = process_list_head;
+	while(proc && proc->id != pid) {
+		proc = proc->next_ptr;
+	}
+	if(!proc) {
+		EndCritical(I);
+		return 0;
+	}
+	
+	proc->budget = budget;
+	proc->period = period;
+	proc->period_left = period;
+	proc->used = 0;
+	proc->throttled = 0;
+	EndCritical(I);
+	return 1;
+}
+
+//******** OS_get_process_list *************** 
+// Inputs: none
+// Outputs: head of the linear list of live processes (0 if none)
+PCB_t* OS_get_process_list(void) {
+	return process_list_head;
+}
 
 //******** OS_Id *************** 
 // returns the thread ID for the currently running thread
@@ -897,6 +1144,11 @@ void OS_Sleep(uint32_t sleepTime){
 // output: none
 void OS_Kill(void){
 	
+	#if EFILE_H
+	// Flush redirected output while the thread can still block on the disk
+	OS_EndRedirectToFile();
+	#endif
+	
 	DisableInterrupts();
 	ContextSwitch();
 	
@@ -913,6 +1165,12 @@ void OS_Kill(void){
 	#if EFILE_H
 	iNode_close(RunPt->currentDir);
 	#endif
+	Heap_KernelFree(node->cwd);
+	
+	#if HEAP_PROFILE && HEAP_RECLAIM_ON_KILL
+	// Free anything the thread leaked
+	Heap_ReclaimThread(proc ? &proc->heap : &BaseHeap, node->id);
+	#endif
 	
 	// Note: We don't need to mess with the SP 
 	//				as it will be automatically reset when a new thread is added
@@ -923,9 +1181,12 @@ void OS_Kill(void){
 		if(--proc->numThreadsAlive == 0) {
 			// Need to free the process resources from the base heap (or other parent's heap)
 			RunPt->process = proc->parent; // Since we are killing the thread anyways this is fine
+			LL_remove((LL_node_t **) &process_list_head, (LL_node_t *)proc);
 			free(proc->data);
-			free(proc->text);
-			free(proc->heap);
+			if(!proc->sharedText) {
+				free(proc->text);
+			}
+			Heap_Destroy(&proc->heap);
 			free(proc);
 			
 			num_processes_alive--;
@@ -1143,9 +1404,37 @@ void OS_Launch(uint32_t theTimeSlice){
 // TODO Figure out how to redirect to ESP if necessary
 // See the value of f when called from printf
 
+// Output of a thread redirected to a file. Characters collect in buff and go to
+// the file in one eFile_F_write, rather than a locked read-modify-write per character
+typedef struct Stream {
+	File_t file;
+	uint16_t count;
+	uint8_t policy;
+	char buff[REDIRECT_BUFFER_SIZE];
+} Stream_t;
+
+// ******** stream_flush ************
+// Write out the buffered output of a stream
+// input:  Stream_t *s - stream to flush
+// output: 1 on success, 0 on fail
+static int stream_flush(Stream_t *s) {
+	uint32_t n = s->count;
+	s->count = 0;
+	return n == 0 || eFile_F_write(&s->file, s->buff, n) == n;
+}
+
 int fputc (int ch, FILE *f) { 
-	// if ID == telnet_id
-	if(f == stdout) {
+	Stream_t *s = RunPt->stream;
+	if(f == stdout && s) {
+		s->buff[s->count++] = ch;
+		if(s->count == REDIRECT_BUFFER_SIZE || (ch == '\n' && s->policy == REDIRECT_LINE)) {
+			if(!stream_flush(s)) {
+				OS_EndRedirectToFile(); // cannot write to file
+				return EOF;
+			}
+		}
+	}
+	else if(f == stdout) {
 		UART_OutChar(ch);
 	}
 	else {
@@ -1175,6 +1464,56 @@ int getc (FILE *f){
   return fgetc(f);
 }
 
+int OS_RedirectToFile(const char *name){
+	if(RunPt->stream) {
+		OS_EndRedirectToFile();
+	}
+	Stream_t *s = Heap_KernelMalloc(sizeof(Stream_t));
+	if(s == 0) {
+		return 1;
+	}
+	
+	eFile_Create(name);
+	if(!eFile_Open(name, &s->file)) {
+		Heap_KernelFree(s);
+		return 1;
+	}
+	eFile_F_seek(&s->file, eFile_F_length(&s->file));
+	s->count = 0;
+	s->policy = REDIRECT_DEFAULT_FLUSH;
+	RunPt->stream = s;
+	return 0;
+}
+
+int OS_RedirectFlushPolicy(int policy){
+	Stream_t *s = RunPt->stream;
+	if(s == 0) {
+		return 1;
+	}
+	s->policy = policy;
+	return 0;
+}
+
+int OS_EndRedirectToFile(void){
+	Stream_t *s = RunPt->stream;
+	if(s == 0) {
+		return 0;
+	}
+	RunPt->stream = 0;	// printf goes to the UART from here, even if the flush fails
+	int r = stream_flush(s);
+	r &= eFile_F_close(&s->file);
+	Heap_KernelFree(s);
+	return !r;
+}
+
+int OS_RedirectToUART(void){
+	return OS_EndRedirectToFile();
+}
+
+int OS_RedirectToST7735(void){
+	return 1;
+}
+
 #else
 
 int StreamToDevice=0;                // 0=UART, 1=stream to file (Lab 4)
@@ -1244,3 +1583,53 @@ int OS_RedirectToST7735(void){
 
 #endif
 
+
+
+//************** Syscall dispatch *************** 
+// Indexed by the SVC immediate, see svc.h for the numbering and ABI rules.
+// Entries left 0 are unimplemented in this build and return SVC_ENOSYS.
+
+//******** OS_ABIVersion *************** 
+// Inputs: none
+// Outputs: SVC_ABI_VERSION, major version in the upper halfword
+uint32_t OS_ABIVersion(void) {
+	return SVC_ABI_VERSION;
+}
+
+const void * const SVC_Table[SVC_TABLE_SIZE] = {
+	[SVC_NUM_OS_ID]							= (void *)&OS_Id,
+	[SVC_NUM_OS_KILL]						= (void *)&OS_Kill,
+	[SVC_NUM_OS_SLEEP]					= (void *)&OS_Sleep,
+	[SVC_NUM_OS_TIME]						= (void *)&OS_Time,
+	[SVC_NUM_OS_ADDTHREAD]			= (void *)&OS_AddThread,
+	[SVC_NUM_CONTEXTSWITCH]			= (void *)&ContextSwitch,
+	[SVC_NUM_INITSEMAPHORE]			= (void *)&OS_InitSemaphore,
+	[SVC_NUM_WAIT]							= (void *)&OS_Wait,
+	[SVC_NUM_SIGNAL]						= (void *)&OS_Signal,
+	[SVC_NUM_BWAIT]							= (void *)&OS_bWait,
+	[SVC_NUM_BSIGNAL]						= (void *)&OS_bSignal,
+	[SVC_NUM_ADDPERIODICTHREAD]	= (void *)&OS_AddPeriodicThread,
+	[SVC_NUM_ADDSW1TASK]				= (void *)&OS_AddSW1Task,
+	[SVC_NUM_ADDSW2TASK]				= (void *)&OS_AddSW2Task,
+	[SVC_NUM_SUSPEND]						= (void *)&OS_Suspend,
+	[SVC_NUM_LOCKSCHEDULER]			= (void *)&OS_LockScheduler,
+	[SVC_NUM_UNLOCKSCHEDULER]		= (void *)&OS_UnLockScheduler,
+	[SVC_NUM_FIFO_INIT]					= (void *)&OS_Fifo_Init,
+	[SVC_NUM_FIFO_PUT]					= (void *)&OS_Fifo_Put,
+	[SVC_NUM_FIFO_GET]					= (void *)&OS_Fifo_Get,
+	[SVC_NUM_FIFO_SIZE]					= (void *)&OS_Fifo_Size,
+	[SVC_NUM_MAILBOX_INIT]			= (void *)&OS_MailBox_Init,
+	[SVC_NUM_MAILBOX_SEND]			= (void *)&OS_MailBox_Send,
+	[SVC_NUM_MAILBOX_RECV]			= (void *)&OS_MailBox_Recv,
+	[SVC_NUM_TIMEDIFFERENCE]		= (void *)&OS_TimeDifference,
+	[SVC_NUM_CLEARMSTIME]				= (void *)&OS_ClearMsTime,
+	[SVC_NUM_MSTIME]						= (void *)&OS_MsTime,
+	[SVC_NUM_REDIRECTTOFILE]		= (void *)&OS_RedirectToFile,
+	[SVC_NUM_ENDREDIRECTTOFILE]	= (void *)&OS_EndRedirectToFile,
+	[SVC_NUM_REDIRECTTOUART]		= (void *)&OS_RedirectToUART,
+	[SVC_NUM_REDIRECTTOST7735]	= (void *)&OS_RedirectToST7735,
+	[SVC_NUM_ADDPROCESS]				= (void *)&OS_AddProcess,
+	[SVC_NUM_ABIVERSION]				= (void *)&OS_ABIVersion,
+};
+
+const uint32_t SVC_TableSize = SVC_TABLE_SIZE;
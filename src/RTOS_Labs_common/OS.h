@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include "../inc/tm4c123gh6pm.h"
 #include "../inc/CortexM.h"
+#include "../RTOS_Labs_common/heap.h"
 
 #define SWITCH_MASK_1 0x01
 #define SWITCH_MASK_2 0x10
@@ -33,6 +34,13 @@
 #define USEWIFI 0
 #define AUTOMOUNT 1
 
+// OS_RedirectToFile buffers printf per thread, and writes the buffer to the file when it
+// fills (REDIRECT_BLOCK) or also at every newline (REDIRECT_LINE)
+#define REDIRECT_BUFFER_SIZE 512
+#define REDIRECT_BLOCK 0
+#define REDIRECT_LINE 1
+#define REDIRECT_DEFAULT_FLUSH REDIRECT_BLOCK
+
 // Note: Periodic threads and switch tasks DO have their own stack
 //			 and therefore they take away from the total pool of threads (when allocated)
 #define MAX_PERIODIC_THREADS 2
@@ -41,15 +49,30 @@
 #define MAX_THREAD_PRIORITY 10
 #define MAGIC 0x12312399
 
+// Default CPU reservation of a loaded process (budget ms out of every period ms)
+// A budget of 0 means unlimited
+#define PROCESS_DEFAULT_BUDGET 50
+#define PROCESS_DEFAULT_PERIOD 100
+
 typedef struct PCB {
+	struct PCB *next_ptr, *prev_ptr; 	// For use in linked lists
 	uint8_t id;
 	uint8_t numThreadsAlive;
 	void *text;
 	void *data;
-	void* heap;
-	int32_t heap_size;
+	uint8_t sharedText;				// Boolean for whether text belongs to the loader's image cache (not freed on exit)
+	heap_t heap;							// Growable heap, regions are allocated from the parent heap
 	struct PCB *parent;
 	
+	// CPU reservation, all times in ms
+	uint32_t budget;					// CPU time allowed per period (0 is unlimited)
+	uint32_t period;					// Replenishment period
+	uint32_t period_left;			// Time until the next replenishment
+	uint32_t used;						// CPU time used in the current period
+	uint32_t last_used;				// CPU time used in the previous period
+	uint32_t total_used;			// CPU time used since creation
+	uint32_t throttle_cnt;		// Number of times the budget was exhausted
+	uint8_t throttled;				// Boolean for whether the threads are held off the CPU
 } PCB_t;
 
 // 23 bytes large, not very expensive
@@ -65,6 +88,8 @@ typedef struct TCB {
 	uint32_t sleep_count;							// In ms
 	void *currentDir;									// Pointer to currently open file struct (circular dependencies mean this must be a void ptr)
 																				// TCB -> Sema4 -> File -> TCB
+	void *stream;											// printf redirected to a file (Stream_t in OS.c), 0 for the UART
+	char *cwd;												// VFS working directory (kernel heap), 0 for "/"
 	PCB_t *process;
 } TCB_t;
 
@@ -85,6 +110,18 @@ struct  Sema4{
 };
 typedef struct Sema4 Sema4Type;
 
+/**
+ * \brief Reader-writer lock. Any number of readers or one writer; threads that cannot
+ * have it block on a wait queue rather than polling
+ */
+typedef struct RWLock {
+	int32_t state;							// Readers holding the lock, -1 while a writer has it
+	uint32_t writers_waiting;
+	TCB_t *readers_head;				// Blocked readers
+	TCB_t *writers_head;				// Blocked writers
+	TCB_t *upgrader;						// Reader waiting in OS_RWUpgrade for the others to leave
+} RWLock_t;
+
 typedef struct Mailbox {
 	Sema4Type data_ready;
 	Sema4Type data_received;
@@ -197,6 +234,52 @@ void OS_bWait(Sema4Type *semaPt);
 // output: none
 void OS_bSignal(Sema4Type *semaPt); 
 
+// ******** OS_InitRWLock ************
+// Initialize a reader-writer lock, unlocked
+// input:  pointer to a reader-writer lock
+// output: none
+void OS_InitRWLock(RWLock_t *lock);
+
+// ******** OS_ReadLock ************
+// Take a reader-writer lock shared. Writers are preferred: a reader blocks
+// while a writer holds the lock or is waiting for it
+// input:  pointer to a reader-writer lock
+// output: none
+void OS_ReadLock(RWLock_t *lock);
+
+// ******** OS_ReadUnlock ************
+// Release a shared hold, the last reader out lets a waiting writer in
+// input:  pointer to a reader-writer lock
+// output: none
+void OS_ReadUnlock(RWLock_t *lock);
+
+// ******** OS_WriteLock ************
+// Take a reader-writer lock exclusive, blocking until readers and writers leave
+// input:  pointer to a reader-writer lock
+// output: none
+void OS_WriteLock(RWLock_t *lock);
+
+// ******** OS_WriteUnlock ************
+// Release an exclusive hold. All blocked readers are let in together if there are any,
+// otherwise the next writer, so neither side starves the other
+// input:  pointer to a reader-writer lock
+// output: none
+void OS_WriteUnlock(RWLock_t *lock);
+
+// ******** OS_RWUpgrade ************
+// Turn a shared hold into an exclusive one, going ahead of waiting writers.
+// Only one reader can upgrade at a time, a second gives up its shared hold
+// and queues as an ordinary writer
+// input:  pointer to a reader-writer lock held shared
+// output: 1 if no other writer had the lock in between, 0 if one may have
+int OS_RWUpgrade(RWLock_t *lock);
+
+// ******** OS_RWDowngrade ************
+// Turn an exclusive hold into a shared one, letting blocked readers in with it
+// input:  pointer to a reader-writer lock held exclusive
+// output: none
+void OS_RWDowngrade(RWLock_t *lock);
+
 //******** OS_AddThread *************** 
 // add a foregound thread to the scheduler
 // Inputs: pointer to a void/void foreground task
@@ -381,9 +464,10 @@ uint32_t OS_MsTime(void);
 void OS_Launch(uint32_t theTimeSlice);
 
 /**
- * @details open the file for writing, redirect stream I/O (printf) to this file
+ * @details open the file for writing, redirect stream I/O (printf) of the current thread to this file
  * @note if the file exists it will append to the end<br>
- If the file doesn't exist, it will create a new file with the name
+ If the file doesn't exist, it will create a new file with the name<br>
+ Output is buffered (REDIRECT_BUFFER_SIZE bytes), and flushed by OS_EndRedirectToFile or when the thread exits
  * @param  name file name is an ASCII string up to seven characters
  * @return 0 if successful and 1 on failure (e.g., can't open)
  * @brief  redirect printf output into this file (Lab 4)
@@ -391,7 +475,17 @@ void OS_Launch(uint32_t theTimeSlice);
 int OS_RedirectToFile(const char *name);
 
 /**
- * @details close the file for writing, redirect stream I/O (printf) back to the UART
+ * @details choose when the redirect buffer of the current thread is written out:
+ *          REDIRECT_BLOCK when it is full, REDIRECT_LINE also at every newline.
+ *          Call after OS_RedirectToFile, which starts at REDIRECT_DEFAULT_FLUSH
+ * @param  policy REDIRECT_BLOCK or REDIRECT_LINE
+ * @return 0 if successful and 1 on failure (not redirected)
+ * @brief  set the flush policy of printf to file
+ */
+int OS_RedirectFlushPolicy(int policy);
+
+/**
+ * @details flush and close the file for writing, redirect stream I/O (printf) back to the UART
  * @param  none
  * @return 0 if successful and 1 on failure (e.g., trouble writing)
  * @brief  Stop streaming printf to file (Lab 4)
@@ -414,6 +508,18 @@ int OS_RedirectToUART(void);
 
 TCB_t* OS_get_current_TCB(void);
 
+//******** OS_SetReservation *************** 
+// Set the CPU reservation of a process. When a process uses budget ms of CPU
+// within one period its threads are not scheduled until the period ends.
+// Inputs: process id, budget in ms (0 for unlimited), period in ms
+// Outputs: 1 if successful, 0 if the process does not exist or the period is 0
+int OS_SetReservation(uint32_t pid, uint32_t budget, uint32_t period);
+
+//******** OS_get_process_list *************** 
+// Inputs: none
+// Outputs: head of the linear list of live processes (0 if none)
+PCB_t* OS_get_process_list(void);
+
 // Time defines
 #define TIME_1S			80000000
 #define TIME_1MS    80000          
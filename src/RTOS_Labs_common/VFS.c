@@ -0,0 +1,382 @@
+// ************************** VFS.c **************************
+// Virtual file system: one path space and one file handle API over several file systems
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+#include <string.h>
+#include "VFS.h"
+#include "OS.h"
+#include "heap.h"
+
+// An open file or directory, free while mount is 0
+typedef struct VFSFile {
+	VFSMount_t *mount;
+	void *handle;					// Backend handle
+	uint8_t isDir;
+	uint8_t mounts;				// Directories: mounts (bit per Mounts[] entry) still to be listed
+} VFSFile_t;
+
+// Both tables are guarded by critical sections a few instructions long, backend calls run outside them
+VFSMount_t Mounts[VFS_MAX_MOUNTS];
+VFSFile_t Files[VFS_MAX_FILES];
+
+
+// ------------------------------------- Paths ------------------------------------------- //
+
+int VFS_Resolve(const char path[], char out[]) {
+	// Built without a trailing '/', so the root is the empty string until the end
+	uint32_t len = 0;
+	if(path[0] != '/') {
+		const char *cwd = VFS_Cwd();
+		len = strlen(cwd);
+		memcpy(out, cwd, len);
+		if(len == 1) {
+			len = 0;
+		}
+	}
+
+	while(*path) {
+		while(*path == '/') {
+			path++;
+		}
+		uint32_t n = 0;
+		while(path[n] != '/' && path[n] != 0) {
+			n++;
+		}
+
+		if(n == 0 || (n == 1 && path[0] == '.')) {
+			// Nothing to add
+		}
+		else if(n == 2 && path[0] == '.' && path[1] == '.') {
+			// Up a level, the root is its own parent
+			while(len > 0 && out[--len] != '/') { }
+		}
+		else {
+			if(len + 1 + n + 1 > VFS_PATH_LENGTH) {
+				return 0;
+			}
+			out[len++] = '/';
+			memcpy(&out[len], path, n);
+			len += n;
+		}
+		path += n;
+	}
+
+	if(len == 0) {
+		out[len++] = '/';
+	}
+	out[len] = 0;
+	return 1;
+}
+
+// ******** vfs_match ************
+// Mount holding an absolute path, and the path within that mount
+static VFSMount_t* vfs_match(const char abs[], const char **rest) {
+	VFSMount_t *best = 0;
+	uint32_t best_len = 0;
+
+	int32_t sr = StartCritical();
+	for(uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+		VFSMount_t *m = &Mounts[i];
+		if(m->ops == 0) {
+			continue;
+		}
+		uint32_t len = strlen(m->prefix);
+		if(len == 1) {
+			len = 0;			// "/" holds everything
+		}
+		else if(strncmp(abs, m->prefix, len) || (abs[len] != 0 && abs[len] != '/')) {
+			continue;
+		}
+		if(best == 0 || len > best_len) {
+			best = m;
+			best_len = len;
+		}
+	}
+	EndCritical(sr);
+
+	*rest = abs[best_len] ? &abs[best_len] : "/";
+	return best;
+}
+
+// ******** vfs_path ************
+// Resolve a path to its mount, abs (VFS_PATH_LENGTH bytes) holds the absolute path
+static VFSMount_t* vfs_path(const char path[], char abs[], const char **rest) {
+	if(!VFS_Resolve(path, abs)) {
+		return 0;
+	}
+	return vfs_match(abs, rest);
+}
+
+// ******** vfs_parent_is ************
+// Whether the mount point prefix is an entry of the directory dir
+static int vfs_parent_is(const char prefix[], const char dir[]) {
+	const char *last = strrchr(prefix, '/');
+	uint32_t len = last - prefix;
+	if(len == 0) {
+		return prefix[1] != 0 && dir[1] == 0;		// In the root, but not the root itself
+	}
+	return strlen(dir) == len && strncmp(prefix, dir, len) == 0;
+}
+
+
+// ------------------------------------- Mounts ------------------------------------------ //
+
+int VFS_Mount(const char prefix[], const VFSOps_t *ops, void *ctx) {
+	char abs[VFS_PATH_LENGTH];
+	if(prefix[0] != '/' || !VFS_Resolve(prefix, abs)) {
+		return 0;
+	}
+
+	int32_t sr = StartCritical();
+	VFSMount_t *m = 0;
+	for(uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+		if(Mounts[i].ops && strcmp(Mounts[i].prefix, abs) == 0) {
+			EndCritical(sr);
+			return 0;
+		}
+		if(m == 0 && Mounts[i].ops == 0) {
+			m = &Mounts[i];
+		}
+	}
+	if(m) {
+		strcpy(m->prefix, abs);
+		m->ctx = ctx;
+		m->ops = ops;
+	}
+	EndCritical(sr);
+	return m != 0;
+}
+
+VFSMount_t* VFS_Find(const char prefix[]) {
+	for(uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+		if(Mounts[i].ops && strcmp(Mounts[i].prefix, prefix) == 0) {
+			return &Mounts[i];
+		}
+	}
+	return 0;
+}
+
+int VFS_Unmount(const char prefix[]) {
+	int32_t sr = StartCritical();
+	VFSMount_t *m = VFS_Find(prefix);
+	for(uint32_t i = 0; m && i < VFS_MAX_FILES; i++) {
+		if(Files[i].mount == m) {
+			m = 0;	// Still in use
+		}
+	}
+	if(m) {
+		m->ops = 0;
+		m->ctx = 0;
+		m->prefix[0] = 0;
+	}
+	EndCritical(sr);
+	return m != 0;
+}
+
+
+// ------------------------------------- Descriptors ------------------------------------- //
+
+// ******** vfs_alloc ************
+// Reserve a descriptor on a mount
+// output: descriptor, -1 if all are in use
+static int vfs_alloc(VFSMount_t *m, uint8_t isDir) {
+	int32_t sr = StartCritical();
+	for(int fd = 0; fd < VFS_MAX_FILES; fd++) {
+		if(Files[fd].mount == 0) {
+			Files[fd].mount = m;
+			Files[fd].handle = 0;
+			Files[fd].isDir = isDir;
+			Files[fd].mounts = 0;
+			EndCritical(sr);
+			return fd;
+		}
+	}
+	EndCritical(sr);
+	return -1;
+}
+
+static void vfs_free(int fd) {
+	Files[fd].mount = 0;
+}
+
+// ******** vfs_file ************
+// The open file behind a descriptor, 0 if it is not one
+static VFSFile_t* vfs_file(int fd, uint8_t isDir) {
+	if(fd < 0 || fd >= VFS_MAX_FILES || Files[fd].mount == 0 || Files[fd].handle == 0 || Files[fd].isDir != isDir) {
+		return 0;
+	}
+	return &Files[fd];
+}
+
+int VFS_Open(const char path[], uint8_t mode) {
+	char abs[VFS_PATH_LENGTH];
+	const char *rest;
+	VFSMount_t *m = vfs_path(path, abs, &rest);
+	if(m == 0) {
+		return -1;
+	}
+
+	int fd = vfs_alloc(m, 0);
+	if(fd < 0) {
+		return -1;
+	}
+	Files[fd].handle = m->ops->open(m->ctx, rest, mode);
+	if(Files[fd].handle == 0) {
+		vfs_free(fd);
+		return -1;
+	}
+	return fd;
+}
+
+uint32_t VFS_Read(int fd, void *buff, uint32_t size) {
+	VFSFile_t *f = vfs_file(fd, 0);
+	return f ? f->mount->ops->read(f->handle, buff, size) : 0;
+}
+
+uint32_t VFS_Write(int fd, const void *buff, uint32_t size) {
+	VFSFile_t *f = vfs_file(fd, 0);
+	return f ? f->mount->ops->write(f->handle, buff, size) : 0;
+}
+
+uint32_t VFS_Seek(int fd, uint32_t pos) {
+	VFSFile_t *f = vfs_file(fd, 0);
+	return f ? f->mount->ops->seek(f->handle, pos) : 0;
+}
+
+uint32_t VFS_Tell(int fd) {
+	VFSFile_t *f = vfs_file(fd, 0);
+	return f ? f->mount->ops->tell(f->handle) : 0;
+}
+
+uint32_t VFS_Length(int fd) {
+	VFSFile_t *f = vfs_file(fd, 0);
+	return f ? f->mount->ops->length(f->handle) : 0;
+}
+
+int VFS_Close(int fd) {
+	VFSFile_t *f = vfs_file(fd, 0);
+	if(f == 0) {
+		f = vfs_file(fd, 1);
+	}
+	if(f == 0) {
+		return 0;
+	}
+
+	int r = f->isDir ? f->mount->ops->closedir(f->handle) : f->mount->ops->close(f->handle);
+	vfs_free(fd);
+	return r;
+}
+
+int VFS_OpenDir(const char path[]) {
+	char abs[VFS_PATH_LENGTH];
+	const char *rest;
+	VFSMount_t *m = vfs_path(path, abs, &rest);
+	if(m == 0) {
+		return -1;
+	}
+
+	int fd = vfs_alloc(m, 1);
+	if(fd < 0) {
+		return -1;
+	}
+	Files[fd].handle = m->ops->opendir(m->ctx, rest);
+	if(Files[fd].handle == 0) {
+		vfs_free(fd);
+		return -1;
+	}
+
+	// Mount points in this directory are listed with it
+	int32_t sr = StartCritical();
+	for(uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+		if(Mounts[i].ops && vfs_parent_is(Mounts[i].prefix, abs)) {
+			Files[fd].mounts |= 1 << i;
+		}
+	}
+	EndCritical(sr);
+	return fd;
+}
+
+int VFS_ReadDir(int fd, char name[], uint32_t *size) {
+	VFSFile_t *f = vfs_file(fd, 1);
+	if(f == 0) {
+		return 0;
+	}
+	if(f->mount->ops->readdir(f->handle, name, size)) {
+		return 1;
+	}
+
+	// Then the mount points
+	int32_t sr = StartCritical();
+	for(uint32_t i = 0; i < VFS_MAX_MOUNTS; i++) {
+		if(f->mounts & (1 << i)) {
+			f->mounts &= ~(1 << i);
+			if(Mounts[i].ops) {
+				strncpy(name, strrchr(Mounts[i].prefix, '/') + 1, VFS_NAME_LENGTH-1);
+				name[VFS_NAME_LENGTH-1] = 0;
+				*size = 0;
+				EndCritical(sr);
+				return 1;
+			}
+		}
+	}
+	EndCritical(sr);
+	return 0;
+}
+
+
+// ------------------------------------- Path operations --------------------------------- //
+
+int VFS_Create(const char path[]) {
+	char abs[VFS_PATH_LENGTH];
+	const char *rest;
+	VFSMount_t *m = vfs_path(path, abs, &rest);
+	return m && m->ops->create(m->ctx, rest);
+}
+
+int VFS_CreateDir(const char path[]) {
+	char abs[VFS_PATH_LENGTH];
+	const char *rest;
+	VFSMount_t *m = vfs_path(path, abs, &rest);
+	return m && m->ops->mkdir(m->ctx, rest);
+}
+
+int VFS_Remove(const char path[]) {
+	char abs[VFS_PATH_LENGTH];
+	const char *rest;
+	VFSMount_t *m = vfs_path(path, abs, &rest);
+	if(m == 0 || strcmp(abs, m->prefix) == 0) {
+		return 0;		// Not the mount point itself
+	}
+	return m->ops->remove(m->ctx, rest);
+}
+
+int VFS_CD(const char path[]) {
+	char abs[VFS_PATH_LENGTH];
+	const char *rest;
+	VFSMount_t *m = vfs_path(path, abs, &rest);
+	if(m == 0) {
+		return 0;
+	}
+
+	// Only a directory that opens as one
+	void *dir = m->ops->opendir(m->ctx, rest);
+	if(dir == 0) {
+		return 0;
+	}
+	m->ops->closedir(dir);
+
+	if(RunPt->cwd == 0) {
+		RunPt->cwd = Heap_KernelMalloc(VFS_PATH_LENGTH);
+		if(RunPt->cwd == 0) {
+			return 0;
+		}
+	}
+	strcpy(RunPt->cwd, abs);
+	return 1;
+}
+
+const char* VFS_Cwd(void) {
+	return RunPt->cwd ? RunPt->cwd : "/";
+}
@@ -0,0 +1,171 @@
+// ************************** VFS.h **************************
+// Virtual file system: one path space and one file handle API over several file systems
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	A file system is mounted at an absolute path (its prefix) with an ops table and a
+	context pointer handed back to open/opendir/create/mkdir/remove. A path is resolved
+	against the thread's working directory, "." and ".." are folded away, and the mount
+	with the longest matching prefix gets the rest of it (always starting with '/').
+	Mounting the file system itself (eFile_Mount, f_mount) is up to whoever mounts it
+	here, like a BlockDev backend is brought up before it is registered.
+
+	Backends:
+		eFile   eFile_VFSOps in eFile.c, the native file system. Fast appends, journaled
+		FAT     FatVFS_Mount in RTOS_Lab6_Networking/FatVFS.c (FatFs), for cards shared with PCs
+
+	The two file systems need separate drives: FatFs always uses drive 0 through diskio,
+	so eFile goes on another device (see eFile_SetDevice) when both are mounted.
+
+	Open files and directories are small integer descriptors, shared by all threads.
+	Reads and writes go straight to the backend in whole requests, so a block sized
+	request is a block sized backend call. A descriptor must not be used by two threads
+	at once, separate descriptors (even of the same file system) may.
+	Ops return 1 on success and 0 on fail, like the rest of the OS.
+*/
+
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+
+#define VFS_MAX_MOUNTS 4
+#define VFS_MAX_FILES 8
+#define VFS_PATH_LENGTH 96				// Longest absolute path, including the terminator
+#define VFS_NAME_LENGTH 40				// Longest name returned by VFS_ReadDir, including the terminator
+
+// VFS_Open modes, or'd together
+#define VFS_READ 0x01
+#define VFS_WRITE 0x02
+#define VFS_CREATE 0x04						// Create the file if it does not exist
+#define VFS_APPEND 0x08						// Start at the end of the file
+
+typedef struct VFSOps {
+	void* (*open)(void *ctx, const char path[], uint8_t mode);	// Handle, 0 on fail
+	uint32_t (*read)(void *file, void *buff, uint32_t size);			// Bytes read
+	uint32_t (*write)(void *file, const void *buff, uint32_t size);	// Bytes written
+	uint32_t (*seek)(void *file, uint32_t pos);										// New position
+	uint32_t (*tell)(void *file);
+	uint32_t (*length)(void *file);
+	int (*close)(void *file);
+	void* (*opendir)(void *ctx, const char path[]);								// Handle, 0 on fail
+	int (*readdir)(void *dir, char name[], uint32_t *size);				// 0 at the end
+	int (*closedir)(void *dir);
+	int (*create)(void *ctx, const char path[]);
+	int (*mkdir)(void *ctx, const char path[]);
+	int (*remove)(void *ctx, const char path[]);
+} VFSOps_t;
+
+typedef struct VFSMount {
+	char prefix[VFS_PATH_LENGTH];
+	const VFSOps_t *ops;
+	void *ctx;
+} VFSMount_t;
+
+extern const VFSOps_t eFile_VFSOps;
+
+// ******** VFS_Mount ************
+// Attach a file system at an absolute path
+// input:  const char prefix[]  - mount point, e.g. "/" or "/fat"
+//				 const VFSOps_t *ops  - operations
+//				 void *ctx            - passed to the path operations
+// output: 1 on success, 0 if the table is full or prefix is taken
+int VFS_Mount(const char prefix[], const VFSOps_t *ops, void *ctx);
+
+// ******** VFS_Unmount ************
+// Detach the file system at prefix. The backend still owns the context
+// input:  const char prefix[] - mount point
+// output: 1 on success, 0 if nothing is mounted there or it has files open
+int VFS_Unmount(const char prefix[]);
+
+// ******** VFS_Find ************
+// Look up a mount point
+// input:  const char prefix[] - mount point, exactly as mounted
+// output: the mount, 0 if there is none
+VFSMount_t* VFS_Find(const char prefix[]);
+
+// ******** VFS_Open ************
+// Open a file
+// input:  const char path[] - relative or absolute path
+//				 uint8_t mode      - VFS_READ, VFS_WRITE, VFS_CREATE, VFS_APPEND
+// output: descriptor, -1 on fail
+int VFS_Open(const char path[], uint8_t mode);
+
+// ******** VFS_Read ************
+// Read from the current position
+// output: bytes read, 0 at the end of the file or on fail
+uint32_t VFS_Read(int fd, void *buff, uint32_t size);
+
+// ******** VFS_Write ************
+// Write at the current position, growing the file as needed
+// output: bytes written
+uint32_t VFS_Write(int fd, const void *buff, uint32_t size);
+
+// ******** VFS_Seek ************
+// Move the current position
+// output: the new position
+uint32_t VFS_Seek(int fd, uint32_t pos);
+
+// ******** VFS_Tell ************
+// output: the current position
+uint32_t VFS_Tell(int fd);
+
+// ******** VFS_Length ************
+// output: size of the file in bytes
+uint32_t VFS_Length(int fd);
+
+// ******** VFS_Close ************
+// Close a file or directory descriptor
+// output: 1 on success, 0 on fail
+int VFS_Close(int fd);
+
+// ******** VFS_OpenDir ************
+// Open a directory for listing
+// input:  const char path[] - relative or absolute path
+// output: descriptor, -1 on fail
+int VFS_OpenDir(const char path[]);
+
+// ******** VFS_ReadDir ************
+// Next entry of a directory. File systems mounted in the directory are listed after its own entries
+// input:  int fd          - descriptor from VFS_OpenDir
+//				 char name[]     - VFS_NAME_LENGTH bytes for the entry name
+//				 uint32_t *size  - size of the entry in bytes
+// output: 1 with an entry, 0 at the end
+int VFS_ReadDir(int fd, char name[], uint32_t *size);
+
+// ******** VFS_Create ************
+// Create an empty file
+// output: 1 on success, 0 on fail (e.g. it exists)
+int VFS_Create(const char path[]);
+
+// ******** VFS_CreateDir ************
+// Create an empty directory
+// output: 1 on success, 0 on fail
+int VFS_CreateDir(const char path[]);
+
+// ******** VFS_Remove ************
+// Remove a file or an empty directory
+// output: 1 on success, 0 on fail
+int VFS_Remove(const char path[]);
+
+// ******** VFS_CD ************
+// Change this thread's working directory, which may be on any mount
+// input:  const char path[] - relative or absolute path to a directory
+// output: 1 on success, 0 if it is not a directory
+int VFS_CD(const char path[]);
+
+// ******** VFS_Cwd ************
+// This thread's working directory, "/" until it calls VFS_CD
+// output: absolute path
+const char* VFS_Cwd(void);
+
+// ******** VFS_Resolve ************
+// Make a path absolute against the working directory and fold away "." and ".."
+// input:  const char path[] - relative or absolute path
+//				 char out[]        - VFS_PATH_LENGTH bytes for the result
+// output: 1 on success, 0 if the result is too long
+int VFS_Resolve(const char path[], char out[]);
+
+#endif
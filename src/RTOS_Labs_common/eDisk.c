@@ -740,3 +740,29 @@ void disk_timerproc(void){
 //  Stat = s;
 }
 
+
+/*-----------------------------------------------------------------------*/
+/* Block device operations                                               */
+/*-----------------------------------------------------------------------*/
+// The context is unused, there is only drive 0
+// Trim is left out: CTRL_TRIM reads the CSD through disk_ioctl, which
+// is not implemented and would wait on LCDFree a second time
+static int sd_read(void *ctx, void *buff, uint32_t sector, uint32_t count){
+  return eDisk_Read(0, buff, sector, count) == RES_OK;
+}
+
+static int sd_write(void *ctx, const void *buff, uint32_t sector, uint32_t count){
+  return eDisk_Write(0, buff, sector, count) == RES_OK;
+}
+
+static uint32_t sd_count(void *ctx){
+  uint32_t sectors;
+  if(disk_ioctl(0, GET_SECTOR_COUNT, &sectors) != RES_OK) return 0;
+  return sectors;
+}
+
+static int sd_flush(void *ctx){
+  return disk_ioctl(0, CTRL_SYNC, 0) == RES_OK;
+}
+
+const BlockDevOps_t eDisk_Ops = {sd_read, sd_write, sd_count, sd_flush, 0};
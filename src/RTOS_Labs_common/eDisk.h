@@ -22,6 +22,7 @@
  */
 #ifndef _DISKIO
 #include <stdint.h>
+#include "../RTOS_Labs_common/BlockDev.h"
 
 /**
  * \brief set to 1 to enable disk write
@@ -230,6 +231,13 @@ void disk_timerproc(void);
  */
 DRESULT disk_ioctl (uint8_t drv, uint8_t cmd, void *buff);
 
+/**
+ * @details  Block device operations for drive 0, see BlockDev.h.
+ *           Register with BlockDev_Register("sd", &eDisk_Ops, 0) after eDisk_Init.
+ * @brief  SD card as a block device.
+ */
+extern const BlockDevOps_t eDisk_Ops;
+
 
 /**
  * \brief Disk Status Bits (DSTATUS)
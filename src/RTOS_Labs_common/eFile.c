@@ -3,33 +3,80 @@
 // Students implement these functions in Lab 4
 // Jonathan W. Valvano 1/12/20
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include "../RTOS_Labs_common/eDisk.h"
 #include "../RTOS_Labs_common/eFile.h"
-#include "../RTOS_Lab3_RTOSpriority/PriorityQueue.h"
+#include "../RTOS_Lab2_RTOSkernel/LinkedList.h"
+#include "../RTOS_Labs_common/heap.h"
 #include "../RTOS_Lab4_FileSystem/Bitmap.h"
 #include "../RTOS_Lab4_FileSystem/iNode.h"
-
+#include "../RTOS_Lab4_FileSystem/DirCache.h"
+#include "../RTOS_Lab4_FileSystem/Journal.h"
+#include "../RTOS_Lab4_FileSystem/BlockCache.h"
+#include "../RTOS_Lab4_FileSystem/LZ.h"
+#include "../RTOS_Lab4_FileSystem/CRC32.h"
+#include "../RTOS_Labs_common/VFS.h"
+
+BlockDev_t *eFileDev = 0;
 uint32_t NumSectors = 4096;
 uint32_t SectorSize = 512;
 
 uint8_t zeros[BLOCK_SIZE];
-iNode_t DISK_INODES[MAX_NODES_OPEN];
-PrioQ_node_t *Open_Nodes_Head;
+uint32_t eFile_ChecksumErrors = 0;
+
+// iNodes in memory are allocated from the kernel heap and found by header sector through iNode_Hash.
+// Closed iNodes stay in memory on an LRU list (up to INODE_CACHE_SIZE) so reopening skips the disk
+iNode_t *iNode_Hash[INODE_HASH_BUCKETS];
+iNode_t *iNode_LRU_Head = 0;		// Inactive (numOpen == 0) iNodes, head is the least recently closed
+uint32_t iNode_num_inactive = 0;
+
+// Scratch blocks for partial block I/O and directory index blocks, one per operation in progress.
+// A directory operation holds an index block while it reads entries through a data block, so at
+// most SCRATCH_BUFFERS-1 index blocks are out at once and a data block can always be had
+#define SCRATCH_BUFFERS 3
+uint8_t ScratchBuff[SCRATCH_BUFFERS][BLOCK_SIZE];
+uint8_t ScratchUsed[SCRATCH_BUFFERS];
 
-uint8_t buff1[BLOCK_SIZE];
-uint8_t buff2[BLOCK_SIZE];
-char pathbuff[BLOCK_SIZE];
+Sema4Type scratch_free;			// Scratch blocks not in use
+Sema4Type scratch_index;		// Scratch blocks that may still be taken for an index block
 
-Sema4Type buff1_lock;
-Sema4Type buff2_lock;
-Sema4Type pathbuff_lock;
+// On-disk structures are read and written as whole blocks (or whole fractions of one)
+typedef char iNodeDisk_size_check[sizeof(iNodeDisk_t) == BLOCK_SIZE ? 1 : -1];
+typedef char DirEntry_size_check[BLOCK_SIZE % sizeof(DirEntry_t) == 0 ? 1 : -1];
+typedef char VFS_name_check[MAX_FILE_NAME_LENGTH < VFS_NAME_LENGTH ? 1 : -1];
 
 // TODO Make work with general bitmap
 #define ROOTDIR_INODE 1
 
-// TODO allocate two global buffers, and provide mutex access to them for all iNode buffering
+// A leaf block of the overflow extent tree on disk
+typedef struct ExtentLeaf {
+	Extent_t extents[EXTENTS_PER_BLOCK];
+	uint32_t crc;									// CRC32 of extents
+	uint32_t reserved;
+} ExtentLeaf_t;
+typedef char ExtentLeaf_size_check[sizeof(ExtentLeaf_t) == BLOCK_SIZE ? 1 : -1];
+
+// The one group of a compressed file held uncompressed, and the group map block with its entry.
+// From the kernel heap on first use (~2.6KB), until the file's last close
+typedef struct CompGroup {
+	iNode_t *map;								// The group map, open while this is
+	uint32_t group;							// Group in data, COMP_NONE if none
+	uint8_t dirty;							// data changed since it was stored
+	uint8_t map_dirty;					// entries changed since they were written
+	uint32_t map_block;					// Group map block in entries, COMP_NONE if none
+	uint32_t entries[BLOCK_SIZE/4];
+	uint8_t data[COMP_GROUP_SIZE];
+} CompGroup_t;
+
+#define COMP_NONE 0xFFFFFFFF
+#define COMP_MAP_ENTRIES (BLOCK_SIZE/4)
+
+// A group is only stored compressed if that saves a block. Compressing takes an output buffer
+// that size and the LZ hash table, from the kernel heap while it runs (~2.5KB)
+#define COMP_OUT_SIZE (COMP_GROUP_SIZE - BLOCK_SIZE)
+#define COMP_WORK_SIZE (COMP_OUT_SIZE + LZ_HASH_SIZE*sizeof(uint16_t))
 
 // -------------------- ------------ Utility Functions -------------------------------------- //
 
@@ -41,324 +88,566 @@ Sema4Type pathbuff_lock;
 //	return i;
 //}
 
-char* strcpy(char *dst, const char *src) {
-	for(size_t i = 0; 1; i++) {
-		((char *) dst)[i] = ((char *) src)[i];
-		if(src[i] == 0) {
-			return dst;
-		}
+// ******** scratch_get ************
+// Take a free scratch block, waiting for one if all are in use
+static uint8_t* scratch_get(void) {
+	OS_Wait(&scratch_free);
+	int32_t sr = StartCritical();
+	uint32_t i = 0;
+	while(ScratchUsed[i]) {
+		i++;
 	}
-	return 0; // should never execute
+	ScratchUsed[i] = 1;
+	EndCritical(sr);
+	return ScratchBuff[i];
 }
 
+// ******** scratch_put ************
+// Return a block taken with scratch_get
+static void scratch_put(uint8_t *buff) {
+	ScratchUsed[(buff - ScratchBuff[0]) / BLOCK_SIZE] = 0;
+	OS_Signal(&scratch_free);
+}
+
+// ******** index_get ************
+// Take a scratch block for a directory index block, leaving one for the data it reads
+static uint8_t* index_get(void) {
+	OS_Wait(&scratch_index);
+	return scratch_get();
+}
 
+static void index_put(uint8_t *buff) {
+	scratch_put(buff);
+	OS_Signal(&scratch_index);
+}
 
-int32_t min(int32_t a, int32_t b) {
+uint32_t min(uint32_t a, uint32_t b) {
 	if(a < b) {
 		return a;
 	}
 	return b;
 }
 
-int32_t max(int32_t a, int32_t b) {
+uint32_t max(uint32_t a, uint32_t b) {
 	if(a > b) {
 		return a;
 	}
 	return b;
 }
 
+// ******** meta_check ***********
+// Compare the first len bytes of a metadata block read from disk against its stored CRC32
+static int meta_check(const void *buff, uint32_t len, uint32_t crc) {
+	if(CRC32(0, buff, len) == crc) {
+		return 1;
+	}
+	eFile_ChecksumErrors++;
+	return 0;
+}
+
 /* Bytes2Sectors - gives the number of sectors that <bytes> will take up */
 uint32_t Bytes2Sectors(uint32_t bytes) {
 	return (bytes+BLOCK_SIZE-1)/BLOCK_SIZE;
 }
 
-/* FilePos2Sector - returns the sector that a given file pos will be in*/
-uint32_t FilePos2Sector(iNode_t *node, uint32_t pos) {
-	uint32_t r;
-	if(pos > node->iNode.size) {
-		// The position exists outside the file
-		return 0;
+// ---------------------------------- Extent Functions ------------------------------------- //
+
+// ******** extent_at ***********
+// Extent number i of a file, in the iNode or the overflow cache
+static Extent_t* extent_at(iNode_t *node, uint32_t i) {
+	if(i < NUM_INODE_EXTENTS) {
+		return &node->iNode.extents[i];
+	}
+	return &node->overflow[i - NUM_INODE_EXTENTS];
+}
+
+// ******** extents_reserve ***********
+// Grow the overflow cache to hold n overflow extents (whole leaf blocks)
+// Returns 1 on success, 0 if out of memory or past MAX_EXTENTS
+static int extents_reserve(iNode_t *node, uint32_t n) {
+	if(n <= node->overflow_cap) {
+		return 1;
 	}
 	
-	uint32_t n = pos / BLOCK_SIZE; // The (file) sector that the position resides in
-	if(n < NUM_DIRECT_SECTORS) {
-		// The pos is in a direct data sector
-		return node->iNode.DP[n];
+	uint32_t cap = (n + EXTENTS_PER_BLOCK-1) / EXTENTS_PER_BLOCK * EXTENTS_PER_BLOCK;
+	if(cap > EXTENT_LEAVES*EXTENTS_PER_BLOCK) {
+		return 0;
 	}
 	
-	OS_Wait(&buff1_lock);
-	uint8_t* buf = buff1;
-	n -= NUM_DIRECT_SECTORS;
-	if(n < NUM_DIRECT_SECTORS) {
-		// The pos is in an indirect data sector
-		eDisk_ReadBlock(buf, node->iNode.SIP);
-		r = buf[n];
-		OS_Signal(&buff1_lock);
-		return r;
+	uint32_t *index = Heap_KernelMalloc(BLOCK_SIZE + cap*sizeof(Extent_t));
+	if(!index) {
+		return 0;
 	}
 	
-	n -= NUM_DIRECT_SECTORS;
-	if(n < NUM_DIRECT_SECTORS*NUM_DIRECT_SECTORS) {
-		// The pos is in one of the doubly indirect sectors
-		eDisk_ReadBlock(buf, node->iNode.DIP);		// Load doubly indirect data sector
-		eDisk_ReadBlock(buf, buf[n/BLOCK_SIZE]);	// Load the (singly) indirect data sector
-		r = buf[n % BLOCK_SIZE];
-		OS_Signal(&buff1_lock);
-		return r;
+	if(node->overflow_index) {
+		memcpy(index, node->overflow_index, BLOCK_SIZE + node->overflow_cap*sizeof(Extent_t));
+		Heap_KernelFree(node->overflow_index);
+	}
+	else {
+		memset(index, 0, BLOCK_SIZE);
 	}
 	
-	// The position is outside the max file length
-	OS_Signal(&buff1_lock);
-	return 0;
-}
-
-
-// ---------------------------------- iNode Functions -------------------------------------- //
-uint32_t num_direct_sectors_occupied(iNode_t *node) {
-	uint32_t num_sectors = Bytes2Sectors(node->iNode.size);
-	return min(NUM_DIRECT_SECTORS, num_sectors);
-}
-
-uint32_t num_direct_sectors_free(iNode_t *node) {
-	return NUM_DIRECT_SECTORS - num_direct_sectors_occupied(node);
-}
-
-
-uint32_t num_indirect_sectors_occupied(iNode_t *node) {
-	int32_t num_sectors = max(Bytes2Sectors(node->iNode.size) - NUM_DIRECT_SECTORS, 0);
-	return min(num_sectors, NUM_INDIRECT_SECTORS);
+	node->overflow_index = index;
+	node->overflow = (Extent_t *) (index + BLOCK_SIZE/4);
+	node->overflow_cap = cap;
+	return 1;
 }
 
-uint32_t num_indirect_sectors_free(iNode_t *node) {
-	return NUM_INDIRECT_SECTORS - num_indirect_sectors_occupied(node);
+// ******** extents_drop ***********
+// Free the extent cache of a node
+static void extents_drop(iNode_t *node) {
+	Heap_KernelFree(node->overflow_index);
+	node->overflow_index = 0;
+	node->overflow = 0;
+	node->overflow_cap = 0;
+	node->map_hint = 0;
+}
+
+// ******** extents_load ***********
+// Read the overflow tree of a node into memory, done once when the node is read from disk
+static int extents_load(iNode_t *node) {
+	node->num_blocks = 0;
+	if(node->iNode.num_extents > NUM_INODE_EXTENTS) {
+		uint32_t n = node->iNode.num_extents - NUM_INODE_EXTENTS;
+		if(!extents_reserve(node, n)) {
+			return 0;
+		}
+		
+		if(!Journal_Read(node->overflow_index, node->iNode.extent_index) ||
+			!meta_check(node->overflow_index, EXTENT_LEAVES*4, node->overflow_index[EXTENT_LEAVES])) {
+			return 0;
+		}
+		ExtentLeaf_t *blk = (ExtentLeaf_t *) scratch_get();
+		int r = 1;
+		for(uint32_t leaf = 0; r && leaf*EXTENTS_PER_BLOCK < n; leaf++) {
+			r = Journal_Read(blk, node->overflow_index[leaf]) && meta_check(blk, sizeof blk->extents, blk->crc);
+			memcpy(&node->overflow[leaf*EXTENTS_PER_BLOCK], blk->extents, sizeof blk->extents);
+		}
+		scratch_put((uint8_t *) blk);
+		if(!r) {
+			return 0;
+		}
+	}
+	
+	for(uint32_t i = 0; i < node->iNode.num_extents; i++) {
+		node->num_blocks += extent_at(node, i)->length;
+	}
+	return 1;
 }
 
-uint32_t num_doubly_indirect_sectors_occupied(iNode_t *node) {
-	int32_t num_sectors = max(Bytes2Sectors(node->iNode.size) - NUM_DIRECT_SECTORS - NUM_INDIRECT_SECTORS, 0);
-	return min(num_sectors, NUM_INDIRECT_SECTORS*NUM_INDIRECT_SECTORS);
+// ******** extent_dirty ***********
+// Note that extents from i on changed, they reach disk on the next iNode_sync
+static void extent_dirty(iNode_t *node, uint32_t i) {
+	node->dirty = 1;
+	if(i >= NUM_INODE_EXTENTS && i - NUM_INODE_EXTENTS < node->dirty_from) {
+		node->dirty_from = i - NUM_INODE_EXTENTS;
+	}
 }
 
-uint32_t num_doubly_indirect_sectors_free(iNode_t *node) {
-	return NUM_DIRECT_SECTORS*NUM_INDIRECT_SECTORS - num_doubly_indirect_sectors_occupied(node);
+// ******** extent_insert ***********
+// Open a hole for a new extent at i, capacity must already be reserved
+static void extent_insert(iNode_t *node, uint32_t i) {
+	uint32_t n = node->iNode.num_extents;
+	for(uint32_t j = n; j > i; j--) {
+		*extent_at(node, j) = *extent_at(node, j-1);
+	}
+	node->iNode.num_extents = n+1;
+	extent_dirty(node, i);
 }
 
-// Returns 1 TRUE on success, FALSE on fail
-int allocate_direct(iNode_t *iNode, uint32_t num_sectors) {
-	
-	uint32_t base = num_direct_sectors_occupied(iNode);
-	if(num_sectors + base > NUM_DIRECT_SECTORS) {
-		// Unable to allocate all the necessary sectors
-		return 0;
+// ******** extent_delete ***********
+// Remove extent i, shifting the rest down
+static void extent_delete(iNode_t *node, uint32_t i) {
+	uint32_t n = node->iNode.num_extents;
+	for(uint32_t j = i; j+1 < n; j++) {
+		*extent_at(node, j) = *extent_at(node, j+1);
+	}
+	node->iNode.num_extents = n-1;
+	extent_dirty(node, i);
+}
+
+// ******** extent_find ***********
+// Find the extent holding file block n, starting from the last lookup (sequential access)
+// Returns the extent number and its first file block, -1 if n is past the allocated blocks
+static int32_t extent_find(iNode_t *node, uint32_t n, uint32_t *first_block) {
+	uint32_t hint = node->map_hint;	// Read once, other readers may update it
+	uint32_t first = hint >> 16;		// File block at the start of extent i
+	uint32_t i = hint & 0xFFFF;
+	if(n < first || i >= node->iNode.num_extents) {
+		first = 0;
+		i = 0;
 	}
 	
-	OS_Wait(&buff1_lock);
-	uint32_t* buff = (uint32_t *) buff1;
-	Bitmap_AllocN(buff, num_sectors);
-	
-	for(int i = 0; i < num_sectors; i++) {
-		eDisk_WriteBlock(zeros, buff[i]);		// Erase block on disk
-		iNode->iNode.DP[base+i] = buff[i];
+	for(; i < node->iNode.num_extents; i++) {
+		Extent_t *e = extent_at(node, i);
+		if(n < first + e->length) {
+			node->map_hint = (first << 16) | i;
+			*first_block = first;
+			return i;
+		}
+		first += e->length;
 	}
-	OS_Signal(&buff1_lock);
-	return 1;
-}
-
-int allocate_indirect(iNode_t *iNode, uint32_t num_sectors) {
-	uint32_t base = num_indirect_sectors_occupied(iNode);
-	if(num_sectors + base > NUM_INDIRECT_SECTORS) {
-		return 0;
+	return -1;
+}
+
+// ******** extent_written ***********
+// Block o of unwritten extent i (starting at file block first) now holds data.
+// Usually the boundary with the written extent before it just moves up one block,
+// otherwise the extent is split. Must hold the node write lock
+static int extent_written(iNode_t *node, uint32_t i, uint32_t first, uint32_t o) {
+	Extent_t *e = extent_at(node, i);
+	Extent_t *prev = i ? extent_at(node, i-1) : 0;
+	
+	if(o == 0 && prev && !(prev->flags & EXTENT_UNWRITTEN) && 
+		prev->start + prev->length == e->start && prev->length < EXTENT_MAX_LENGTH) {
+		prev->length++;
+		e->start++;
+		e->length--;
+		node->map_hint = ((first - prev->length + 1) << 16) | (i-1);
+		if(e->length == 0) {
+			extent_delete(node, i);
+		}
+		extent_dirty(node, i-1);
+		return 1;
 	}
 	
-	OS_Wait(&buff1_lock);
-	OS_Wait(&buff2_lock);
-	
-	uint32_t* buff = (uint32_t *) buff1;
-	uint32_t* SIP_data = (uint32_t *) buff2;
-	
-	Bitmap_AllocN(buff, num_sectors); // Allocate the sectors (not necessarily continuous, but usually will be)
-	eDisk_ReadBlock(SIP_data, iNode->iNode.SIP);
-	
-	
-	for(int i = 0; i < num_sectors; i++) {
-		eDisk_WriteBlock(zeros, buff[i]);		// Erase block on disk
-		SIP_data[base+i] = buff[i];
+	if(e->length == 1) {
+		e->flags &= ~EXTENT_UNWRITTEN;
+		extent_dirty(node, i);
+		return 1;
 	}
-	eDisk_WriteBlock(SIP_data, iNode->iNode.SIP);
-	
-	OS_Signal(&buff2_lock);
-	OS_Signal(&buff1_lock);
-	return 1;
-}
-
-int allocate_doubly_indirect(iNode_t *iNode, uint32_t num_sectors) {
 	
-	uint32_t base = num_doubly_indirect_sectors_occupied(iNode);
-	if(num_sectors + base > NUM_INDIRECT_SECTORS*NUM_DIRECT_SECTORS) {
+	// Split into up to three: unwritten head, the written block, unwritten tail
+	uint32_t start = e->start;
+	uint32_t tail = e->length - o - 1;
+	uint32_t n = node->iNode.num_extents + (o > 0) + (tail > 0);
+	if(n > MAX_EXTENTS || (n > NUM_INODE_EXTENTS && !extents_reserve(node, n - NUM_INODE_EXTENTS))) {
 		return 0;
 	}
 	
-	// TODO fix
-	uint32_t buff[10];
-	Bitmap_AllocN(buff, num_sectors); // Allocate the sectors (not necessarily continuous, but usually will be)
-	OS_Wait(&buff1_lock);
-	OS_Wait(&buff2_lock);
-	uint32_t* DIP1_data = (uint32_t *) buff1;
-	uint32_t* DIP2_data = (uint32_t *) buff1;
-	eDisk_ReadBlock(DIP1_data, iNode->iNode.DIP);
-	
-	for(int i = 0; i < num_sectors; i++) {
-		eDisk_WriteBlock(zeros, buff[i]);		// Erase block on disk
-		
-		// Read in second indirect block
-		uint32_t n1 = (base+i)/NUM_INDIRECT_SECTORS; 
-		eDisk_ReadBlock(DIP2_data, DIP1_data[n1]);
-		for(uint32_t n2 = (base+i)%NUM_INDIRECT_SECTORS; n2 < NUM_INDIRECT_SECTORS; n2++) {
-			DIP2_data[n2] = buff[i++]; // Mark the allocated sector and move the pointer
-		}
-		eDisk_WriteBlock(DIP2_data, DIP1_data[n1]);
+	if(o > 0) {
+		extent_insert(node, i);
+		extent_at(node, i)->length = o;
+		i++;
 	}
-	eDisk_WriteBlock(DIP1_data, iNode->iNode.DIP);
-	
-	OS_Signal(&buff2_lock);
-	OS_Signal(&buff1_lock);
+	if(tail > 0) {
+		extent_insert(node, i+1);
+		e = extent_at(node, i+1);
+		e->start = start + o + 1;
+		e->length = tail;
+		e->flags = EXTENT_UNWRITTEN;
+	}
+	e = extent_at(node, i);
+	e->start = start + o;
+	e->length = 1;
+	e->flags = 0;
+	node->map_hint = ((first + o) << 16) | i;
+	extent_dirty(node, i);
 	return 1;
 }
 
+// Compressed files (see Compressed Files below)
+static int comp_sync(iNode_t *node);
+static void comp_release(iNode_t *node);
 
-// Allocates enough space for num_bytes additional bytes (and increases file size)
-int allocate_space(iNode_t *iNode, uint32_t num_bytes) {
-	uint32_t num_current_sectors = Bytes2Sectors(iNode->iNode.size);
-	uint32_t num_sectors = Bytes2Sectors(iNode->iNode.size + num_bytes);
-	num_sectors -= num_current_sectors;
-	uint32_t num_allocated = 0;
-	
-	if(num_current_sectors < NUM_DIRECT_SECTORS) {
-		// Can allocate direct sectors
-		num_allocated = min(num_direct_sectors_free(iNode), num_sectors);
-	
-		if(num_allocated == 0) {
-			// We can use the space in the sectors already allocated
-			iNode->iNode.size += num_bytes;
-			num_bytes = 0;
-		}
-		else {
-			if(!allocate_direct(iNode, num_allocated)) {
-				return 0; // failed to allocate
-			}
-			
-			uint32_t b = min(num_bytes, BLOCK_SIZE*num_allocated);
-			num_bytes -= b;
-			iNode->iNode.size += b;
-			num_current_sectors += num_allocated;
-			num_sectors -= num_allocated;
-		}
+// ******** iNode_sync ***********
+// Write a node's metadata (the iNode and changed overflow leaves) to disk if it changed.
+// Allocation and extent changes are made in memory, this is done by a write that grows
+// the file (file_write), on eFile_F_sync and on the last close. The writes are one journal transaction
+int iNode_sync(iNode_t *node) {
+	// Storing a compressed file's group in memory may allocate blocks, so it goes first
+	int r = comp_sync(node);
+	if(!node->dirty) {
+		return r;
 	}
 	
-	if(num_current_sectors < NUM_INDIRECT_SECTORS + NUM_DIRECT_SECTORS) {
-		// Can allocate indirect
-		num_allocated = min(num_indirect_sectors_free(iNode), num_sectors);
-		if(num_allocated == 0) {
-			iNode->iNode.size += num_bytes;
-			num_bytes = 0;
-		}
-		else {
-			if(!allocate_indirect(iNode, num_allocated)) {
+	Journal_Begin();
+	uint32_t n = node->iNode.num_extents;
+	if(n > NUM_INODE_EXTENTS && node->dirty_from < n - NUM_INODE_EXTENTS) {
+		uint8_t index_changed = 0;
+		if(node->iNode.extent_index == 0) {
+			uint32_t sector = Bitmap_AllocOne();
+			if(sector == (uint32_t) -1) {
+				Journal_End();
 				return 0;
 			}
-			
-			uint32_t b = min(num_bytes, BLOCK_SIZE*num_allocated);
-			num_bytes -= b;
-			iNode->iNode.size += b;
-			num_current_sectors += num_allocated;
-			num_sectors -= num_allocated;
+			node->iNode.extent_index = sector;
 		}
 		
+		ExtentLeaf_t *blk = (ExtentLeaf_t *) scratch_get();
+		for(uint32_t leaf = node->dirty_from / EXTENTS_PER_BLOCK; leaf*EXTENTS_PER_BLOCK < n - NUM_INODE_EXTENTS; leaf++) {
+			if(node->overflow_index[leaf] == 0) {
+				uint32_t sector = Bitmap_AllocOne();
+				if(sector == (uint32_t) -1) {
+					scratch_put((uint8_t *) blk);
+					Journal_End();
+					return 0;
+				}
+				node->overflow_index[leaf] = sector;
+				index_changed = 1;
+			}
+			memcpy(blk->extents, &node->overflow[leaf*EXTENTS_PER_BLOCK], sizeof blk->extents);
+			blk->crc = CRC32(0, blk->extents, sizeof blk->extents);
+			blk->reserved = 0;
+			r &= Journal_Write(blk, node->overflow_index[leaf]);
+		}
+		scratch_put((uint8_t *) blk);
 		
+		if(index_changed) {
+			node->overflow_index[EXTENT_LEAVES] = CRC32(0, node->overflow_index, EXTENT_LEAVES*4);
+			r &= Journal_Write(node->overflow_index, node->iNode.extent_index);
+		}
 	}
 	
-	if(num_current_sectors < NUM_DIRECT_SECTORS*NUM_INDIRECT_SECTORS + NUM_INDIRECT_SECTORS + NUM_DIRECT_SECTORS) {
-		// Can allocate doubly indirect
-		num_allocated = min(num_doubly_indirect_sectors_free(iNode), num_sectors);
-		if(num_allocated == 0) {
-			iNode->iNode.size += num_bytes;
-			num_bytes = 0;
+	node->iNode.crc = CRC32(0, &node->iNode, offsetof(iNodeDisk_t, crc));
+	r &= Journal_Write(&node->iNode, node->sector_num);
+	if(r) {
+		node->dirty = 0;
+		node->dirty_from = 0xFFFF;
+	}
+	r &= Journal_End();
+	return r;
+}
+
+/* FilePos2Sector - returns the sector that a given file pos will be in*/
+// All extents of a node in memory are cached, so this never touches the disk
+uint32_t FilePos2Sector(iNode_t *node, uint32_t pos) {
+	uint32_t first;
+	int32_t i = extent_find(node, pos / BLOCK_SIZE, &first);
+	if(i < 0) {
+		// The position exists outside the file
+		return 0;
+	}
+	return extent_at(node, i)->start + (pos / BLOCK_SIZE - first);
+}
+
+
+// ---------------------------------- iNode Functions -------------------------------------- //
+
+// ******** allocate_blocks ***********
+// Add num_sectors unwritten blocks to the end of a file, without changing its size.
+// New sectors continue the last extent whenever the bitmap has them free
+static int allocate_blocks(iNode_t *iNode, uint32_t num_sectors) {
+	while(num_sectors > 0) {
+		uint32_t n = iNode->iNode.num_extents;
+		Extent_t *last = n ? extent_at(iNode, n-1) : 0;
+		uint32_t goal = last ? last->start + last->length : 0;
+		
+		uint32_t len;
+		uint32_t start = Bitmap_AllocRun(goal, min(num_sectors, EXTENT_MAX_LENGTH), &len);
+		if(start == (uint32_t) -1) {
+			return 0; // Disk full
+		}
+		BCache_Invalidate(start, len); // May still hold what a previous owner wrote
+		
+		// Blocks are not erased on disk, reads of unwritten extents return zeros
+		if(last && start == goal && (last->flags & EXTENT_UNWRITTEN) && last->length + len <= EXTENT_MAX_LENGTH) {
+			// Contiguous with the end of the file
+			last->length += len;
+			extent_dirty(iNode, n-1);
 		}
 		else {
-			if(!allocate_doubly_indirect(iNode, num_allocated)) {
+			if(n == MAX_EXTENTS || 
+				(n >= NUM_INODE_EXTENTS && !extents_reserve(iNode, n+1 - NUM_INODE_EXTENTS))) {
+				Bitmap_FreeRun(start, len);
 				return 0;
 			}
 			
-			uint32_t b = min(num_bytes, BLOCK_SIZE*num_allocated);
-			num_bytes -= b;
-			iNode->iNode.size += b;
-			num_current_sectors += num_allocated;
-			num_sectors -= num_allocated;
+			Extent_t *e = extent_at(iNode, n);
+			e->start = start;
+			e->length = len;
+			e->flags = EXTENT_UNWRITTEN;
+			iNode->iNode.num_extents = n+1;
+			extent_dirty(iNode, n);
 		}
+		
+		iNode->num_blocks += len;
+		num_sectors -= len;
+	}
+	return 1;
+}
+
+// Allocates enough space for num_bytes additional bytes (and increases file size)
+// Blocks reserved by eFile_F_preallocate are used first
+int allocate_space(iNode_t *iNode, uint32_t num_bytes) {
+	uint32_t num_sectors = Bytes2Sectors(iNode->iNode.size + num_bytes);
+	int r = 1;
+	if(num_sectors > iNode->num_blocks) {
+		r = allocate_blocks(iNode, num_sectors - iNode->num_blocks);
 	}
 	
-	eDisk_WriteBlock(&iNode->iNode, iNode->sector_num);
-	if(num_bytes != 0) {
-		return 0; // Failed somewhere
+	// On failure the file still grows into whatever was allocated
+	iNode->iNode.size = min(iNode->iNode.size + num_bytes, iNode->num_blocks * BLOCK_SIZE);
+	iNode->dirty = 1;
+	return r;
+}
+
+// ******** iNode_preallocate ***********
+// Reserve unwritten blocks for num_bytes past the end of the file, the size is unchanged
+// A compressed file reserves blocks past its stored groups, num_bytes is then compressed bytes
+int iNode_preallocate(iNode_t *node, uint32_t num_bytes) {
+	uint32_t used = node->iNode.flags & INODE_COMPRESSED ? node->iNode.stored_blocks*BLOCK_SIZE : node->iNode.size;
+	uint32_t num_sectors = Bytes2Sectors(used + num_bytes);
+	if(num_sectors <= node->num_blocks) {
+		return 1;
 	}
+	int r = allocate_blocks(node, num_sectors - node->num_blocks);
+	r &= iNode_sync(node);
+	return r;
+}
+
+// Must be called in a critical section
+static iNode_t* inode_lookup(uint32_t sector) {
+	for(iNode_t *n = iNode_Hash[INODE_HASH(sector)]; n != 0; n = n->hash_next) {
+		if(n->sector_num == sector) {
+			return n;
+		}
+	}
+	return 0;
+}
+
+// Must be called in a critical section
+static void inode_unhash(iNode_t *node) {
+	iNode_t **link = &iNode_Hash[INODE_HASH(node->sector_num)];
+	while(*link != node) {
+		link = &(*link)->hash_next;
+	}
+	*link = node->hash_next;
+}
+
+// Free an in-memory iNode along with its extent cache
+static void inode_free(iNode_t *node) {
+	extents_drop(node);
+	Heap_KernelFree(node);
+}
+
+// ******** inode_evict ***********
+// Drop the least recently closed iNode from memory. Unless dirty_too, a dirty one (its last
+// close could not write it out) is skipped, it stays until a later close or eFile_Unmount writes it
+// Returns 0 if there were none to drop
+static int inode_evict(uint8_t dirty_too) {
+	int I = StartCritical();
+	iNode_t *node = iNode_LRU_Head;
+	while(node && node->dirty && !dirty_too) {
+		node = node->next_ptr;
+	}
+	if(node) {
+		LL_remove((LL_node_t **) &iNode_LRU_Head, (LL_node_t *) node);
+		inode_unhash(node);
+		iNode_num_inactive--;
+	}
+	EndCritical(I);
 	
-	return 1; // Success
+	if(!node) {
+		return 0;
+	}
+	inode_free(node);
+	return 1;
 }
 
+static int inode_evict_one(void) {
+	return inode_evict(0);
+}
+
+// ******** iNode_drop_cache ************
+// Forget every closed iNode kept in memory, e.g. when the disk changes underneath it
+void iNode_drop_cache(void) {
+	while(inode_evict(1)) {}
+}
+
+// Find an iNode in memory and take a reference to it
+// Returns 0 if the sector is not in memory
 iNode_t* iNode_find(uint32_t sector) {
-	// Check if already in memory
 	int I = StartCritical();
-	iNode_t *node = (iNode_t*) PrioQ_find(&Open_Nodes_Head, sector);
+	iNode_t *node = inode_lookup(sector);
+	if(node) {
+		if(node->numOpen++ == 0) {
+			// Reopened from the inactive cache
+			LL_remove((LL_node_t **) &iNode_LRU_Head, (LL_node_t *) node);
+			iNode_num_inactive--;
+		}
+	}
 	EndCritical(I);
 	return node;
 }
 
-iNode_t* iNode_spawn(uint32_t sector) {
-	iNode_t *node = 0;
+static uint32_t iNode_gen;
+
+// ******** inode_touch ***********
+// Give a node a generation no earlier copy of it had, its contents may have changed
+static void inode_touch(iNode_t *node) {
 	int I = StartCritical();
-	for(int i = 0; i < MAX_NODES_OPEN; i++) {
-		iNode_t *n = &DISK_INODES[i];
-		if(n->sector_num == 0) {
-			// this node is unused, use this one
-			node = n;
-			break;
+	node->gen = ++iNode_gen;
+	EndCritical(I);
+}
+
+// Allocate a new in-memory iNode with one reference, not yet visible to iNode_find
+// Closed iNodes are dropped from the cache until it fits
+iNode_t* iNode_spawn(uint32_t sector) {
+	iNode_t *node;
+	while((node = Heap_KernelMalloc(sizeof(iNode_t))) == 0) {
+		if(!inode_evict_one()) {
+			return 0; // Out of memory
 		}
 	}
 	
-	EndCritical(I);
-	if(!node) {
-		return 0;
-	}
 	memset(node, 0, sizeof(iNode_t));
-	
-	I = StartCritical();
-	PrioQ_insert(&Open_Nodes_Head, (PrioQ_node_t *) node);
+	node->sector_num = sector;
+	node->numOpen = 1;
+	node->dirty_from = 0xFFFF;
+	OS_InitRWLock(&node->NodeLock);
+	inode_touch(node);
+	return node;
+}
+
+// Publish a spawned iNode. If another thread loaded the same sector first,
+// the spawned copy is freed and a reference to the other is returned instead
+iNode_t* iNode_insert(iNode_t *node) {
+	int I = StartCritical();
+	iNode_t *other = iNode_find(node->sector_num);
+	if(!other) {
+		node->hash_next = iNode_Hash[INODE_HASH(node->sector_num)];
+		iNode_Hash[INODE_HASH(node->sector_num)] = node;
+	}
 	EndCritical(I);
+	
+	if(other) {
+		inode_free(node);
+		return other;
+	}
 	return node;
 }
 
 int iNode_create(uint32_t sector, uint32_t length, uint8_t isDir) {
-	volatile int status = 0;
+	int status = 0;
+	
+	// Note - creating a node is not equivalent to opening it,
+	// Here we only write out the data to disk to create the iNode.
+	// A copy already in memory (e.g. the root dir on format) is reset in place
 	iNode_t *node = iNode_find(sector);
 	if(!node) {
 		node = iNode_spawn(sector);
+		if(!node) {
+			return 0;
+		}
+		node = iNode_insert(node);
 	}
 	
-	
-	// Note - creating a node is not equivalent to opening it,
-	// Here we only write out the data to disk to create the iNode
-	node->sector_num = sector;
+	extents_drop(node);
+	memset(&node->iNode, 0, sizeof(iNodeDisk_t));
 	node->iNode.isDir = isDir;
-	node->iNode.magicByte = 0x12;
-	node->iNode.magicHW = 0x3456;
+	node->iNode.magicByte = INODE_MAGIC_BYTE;
+	node->iNode.magicHW = INODE_MAGIC_HW;
 
+	node->num_blocks = 0;
+	node->dirty_from = 0;
+	inode_touch(node);
 	if(allocate_space(node, length)) {
-		eDisk_WriteBlock(&node->iNode, node->sector_num);
-		status = 1;
+		status = iNode_sync(node);
 	}
 	
-	// Remove from memory list (i.e. free the buffer)
-	PrioQ_remove(&Open_Nodes_Head, (PrioQ_node_t *) node);
-	node->sector_num = 0;
+	// Leaves the new iNode in the inactive cache, it is usually opened next
+	iNode_close(node);
 	return status;
 }
 
@@ -366,17 +655,21 @@ iNode_t* iNode_open(uint32_t sector) {
 	// Check if already in memory
 	iNode_t *node = iNode_find(sector);
 	if(node) {
-		return iNode_reopen(node);
+		return node;
 	}
+	
 	node = iNode_spawn(sector);
+	if(!node) {
+		return 0;
+	}
 	
 	// Read in from disk
-	eDisk_ReadBlock(&node->iNode, sector);
-	node->sector_num = sector;
-	node->numOpen=1;
-	OS_InitSemaphore(&node->NodeLock, 1);
-
-	return node;
+	if(!Journal_Read(&node->iNode, sector) || !meta_check(&node->iNode, offsetof(iNodeDisk_t, crc), node->iNode.crc) ||
+		!extents_load(node)) {
+		inode_free(node);
+		return 0;
+	}
+	return iNode_insert(node);
 }
 
 
@@ -399,60 +692,96 @@ int iNode_close(iNode_t *node) {
 		return 1; // closing nothing is ok
 	}
 	
+	// The last close writes out metadata changed in memory, or frees a removed file.
+	// Only then is a transaction needed (and it must be started before the node lock).
+	// Whether this is the last reference is decided in the critical section that drops it,
+	// so two closers can't each leave the write to the other
+	uint8_t journal = 0;
+	int I;
+	for(;;) {
+		I = StartCritical();
+		if(node->numOpen > 1 || node->removed || !r || (!node->dirty && node->comp == 0)) {
+			break;	// Still in the critical section
+		}
+		EndCritical(I);
+		
+		if(!journal) {
+			Journal_Begin();
+			journal = 1;
+		}
+		iNode_lock_write(node);
+		r = iNode_sync(node);
+		comp_release(node);
+		iNode_unlock_write(node);
+	}
+	
 	// decrement the num_open count
+	uint8_t reclaim = 0;
+	uint8_t evict = 0;
 	if(--(node->numOpen) == 0) {
 		// Nothing has this open anymore
 		if(node->removed) {
-			// Free from disk entirely (reclaim bitmap space)
-			uint32_t s = Bytes2Sectors(node->iNode.size);
-			
-			// Direct sectors
-			uint32_t l = min(NUM_DIRECT_SECTORS, s);
-			for(uint32_t i = 0; i < l; i++) {
-				Bitmap_free(node->iNode.DP[i]);
+			// Nobody can find it again, free it once the disk space is reclaimed
+			inode_unhash(node);
+			reclaim = 1;
+		}
+		else {
+			// Keep it in memory for a quick reopen
+			LL_append_linear((LL_node_t **) &iNode_LRU_Head, (LL_node_t *) node);
+			evict = ++iNode_num_inactive > INODE_CACHE_SIZE;
+		}
+	}
+	EndCritical(I);
+	
+	if(evict) {
+		inode_evict_one();
+	}
+	
+	if(reclaim) {
+		if(!journal) {
+			Journal_Begin();
+			journal = 1;
+		}
+		
+		// Free from disk entirely (reclaim bitmap space)
+		for(uint32_t i = 0; i < node->iNode.num_extents; i++) {
+			Extent_t *e = extent_at(node, i);
+			Bitmap_FreeRun(e->start, e->length);
+		}
+		
+		// Overflow extent tree (sectors past the used leaves may still be allocated)
+		if(node->iNode.extent_index) {
+			for(uint32_t i = 0; i < EXTENT_LEAVES && node->overflow_index[i]; i++) {
+				Bitmap_free(node->overflow_index[i]);
 			}
-			s -= l;
-			
-			if(s > 0) {
-				OS_Wait(&buff1_lock);
-				uint32_t *b1 = (uint32_t *)buff1;
-				// Indirect sectors
-				l = min(NUM_INDIRECT_SECTORS, s);
-				r &= !eDisk_ReadBlock(b1, node->iNode.SIP);
-				for(uint32_t i = 0; i < l; i++) {
-					Bitmap_free(b1[i]);
-				}
-				s -= l;
-				
-				if(s > 0) {
-					OS_Wait(&buff2_lock);
-					uint32_t *b2 = (uint32_t *) buff2;
-					
-					// Doubly indirect sectors
-					uint32_t nds = (s+NUM_INDIRECT_SECTORS-1)/NUM_INDIRECT_SECTORS;
-					r &= !eDisk_ReadBlock(b1, node->iNode.DIP);
-					for(uint32_t i = 0; i < nds; i++) {
-						r &= !eDisk_ReadBlock(b2, b1[i]);
-						
-						l = min(s, NUM_INDIRECT_SECTORS);
-						for(uint32_t j = 0; j < l; j++) {
-							Bitmap_free(b2[j]);
-						}
-						s -= l;
-					}
-					OS_Signal(&buff2_lock);
-				}
-				OS_Signal(&buff1_lock);
+			Bitmap_free(node->iNode.extent_index);
+		}
+		
+		// The group map of a compressed file goes with it
+		if(node->iNode.flags & INODE_COMPRESSED) {
+			iNode_t *map = node->comp ? iNode_reopen(node->comp->map) : iNode_open(node->iNode.group_map);
+			comp_release(node);
+			if(map) {
+				iNode_remove(map);
+				iNode_close(map);
 			}
 		}
 		
-		// Remove from list in RAM
-		int I = StartCritical();
-		PrioQ_remove(&Open_Nodes_Head, (PrioQ_node_t *) node);
-		node->sector_num = 0; // Mark it as unused for the list
-		// free(node);
-		EndCritical(I);
+		// Directory index blocks
+		if(node->iNode.isDir) {
+			for(uint32_t i = 0; i < DIR_INDEX_BLOCKS; i++) {
+				if(node->iNode.dir_index[i]) {
+					Bitmap_free(node->iNode.dir_index[i]);
+				}
+			}
+		}
 		
+		Bitmap_free(node->sector_num);	// Header sector
+		inode_free(node);
+	}
+	
+	if(journal) {
+		r &= Journal_End();
 	}
 	return r;
 }
@@ -464,36 +793,374 @@ void iNode_remove(iNode_t *node) {
 }
 
 
-// Must be called when the node lock is held!
-int iNode_read_at(iNode_t *node, void* buff, uint32_t size, uint32_t offset) {
+// ******** block_read ***********
+// Directory blocks are metadata and go through the journal, file data through the block cache
+static int block_read(iNode_t *node, void *buff, uint32_t sector) {
+	if(node->iNode.isDir) {
+		return Journal_Read(buff, sector);
+	}
+	return BCache_Read(buff, sector);
+}
+
+// ******** block_write ***********
+static int block_write(iNode_t *node, const void *buff, uint32_t sector) {
+	if(node->iNode.isDir) {
+		return Journal_Write(buff, sector);
+	}
+	return BCache_Write(buff, sector);
+}
+
+// ******** block_written ***********
+// Sector s, block o of unwritten extent i (starting at file block first), now holds data
+static void block_written(iNode_t *node, uint32_t i, uint32_t first, uint32_t o, uint32_t s) {
+	if(!extent_written(node, i, first, o)) {
+		// No memory to split the extent, erase the rest of it instead
+		Extent_t *e = extent_at(node, i);
+		for(uint32_t k = 0; k < e->length; k++) {
+			if(e->start + k != s) {
+				block_write(node, zeros, e->start + k);
+			}
+		}
+		e->flags &= ~EXTENT_UNWRITTEN;
+		extent_dirty(node, i);
+	}
+}
+
+
+// -------------------------------- Compressed Files --------------------------------------- //
+// A compressed file is cut into groups of COMP_GROUP_SIZE bytes, each compressed on its own and
+// stored in as few whole blocks as it fits, one after another from the start of the file's blocks.
+// The group map entry of a group says where, so any group is read without the ones before it.
+// The group in memory takes the writes, it is compressed when the file moves on to another group
+// or is synced. A group that outgrows its blocks moves to the end of the stored blocks, but logs
+// only append, so it is the last group, already at the end.
+
+// ******** blocks_read ***********
+// Read count whole blocks of a file from file block b on, unwritten ones read as zeros
+static int blocks_read(iNode_t *node, uint8_t *buff, uint32_t b, uint32_t count) {
+	for(uint32_t k = 0; k < count; k++) {
+		uint32_t first;
+		int32_t i = extent_find(node, b + k, &first);
+		if(i < 0) {
+			return 0;
+		}
+		Extent_t *e = extent_at(node, i);
+		if(e->flags & EXTENT_UNWRITTEN) {
+			memset(buff + k*BLOCK_SIZE, 0, BLOCK_SIZE);
+		}
+		else if(!block_read(node, buff + k*BLOCK_SIZE, e->start + (b + k - first))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// ******** blocks_write ***********
+// Write count whole blocks of a file from file block b on, the blocks must be allocated
+static int blocks_write(iNode_t *node, const uint8_t *buff, uint32_t b, uint32_t count) {
+	for(uint32_t k = 0; k < count; k++) {
+		uint32_t first;
+		int32_t i = extent_find(node, b + k, &first);
+		if(i < 0) {
+			return 0;
+		}
+		Extent_t *e = extent_at(node, i);
+		uint32_t s = e->start + (b + k - first);
+		if(!block_write(node, buff + k*BLOCK_SIZE, s)) {
+			return 0;
+		}
+		if(e->flags & EXTENT_UNWRITTEN) {
+			block_written(node, i, first, b + k - first, s);
+		}
+	}
+	return 1;
+}
+
+// ******** comp_get ***********
+// The group in memory of a compressed file, set up (and its group map opened) on first use
+static CompGroup_t* comp_get(iNode_t *node) {
+	if(node->comp == 0) {
+		CompGroup_t *c = Heap_KernelMalloc(sizeof(CompGroup_t));
+		if(c == 0) {
+			return 0;
+		}
+		c->map = iNode_open(node->iNode.group_map);
+		if(c->map == 0) {
+			Heap_KernelFree(c);
+			return 0;
+		}
+		c->group = COMP_NONE;
+		c->dirty = 0;
+		c->map_block = COMP_NONE;
+		c->map_dirty = 0;
+		node->comp = c;
+	}
+	return node->comp;
+}
+
+// ******** comp_release ***********
+// Free the group in memory and close the group map, after comp_sync (or when the file is removed)
+static void comp_release(iNode_t *node) {
+	if(node->comp) {
+		iNode_close(node->comp->map);
+		Heap_KernelFree(node->comp);
+		node->comp = 0;
+	}
+}
+
+// ******** comp_map_flush ***********
+// Write out the group map block in memory if it changed
+static int comp_map_flush(iNode_t *node) {
+	CompGroup_t *c = node->comp;
+	if(!c->map_dirty) {
+		return 1;
+	}
+	if(iNode_write_at(c->map, c->entries, BLOCK_SIZE, c->map_block*BLOCK_SIZE) != BLOCK_SIZE) {
+		return 0;
+	}
+	c->map_dirty = 0;
+	return 1;
+}
+
+// ******** comp_map_load ***********
+// Bring in the group map block holding group g's entry. Past the end of the map all entries are holes
+static int comp_map_load(iNode_t *node, uint32_t g) {
+	CompGroup_t *c = node->comp;
+	uint32_t mb = g / COMP_MAP_ENTRIES;
+	if(c->map_block == mb) {
+		return 1;
+	}
+	if(!comp_map_flush(node)) {
+		return 0;
+	}
+	
+	c->map_block = COMP_NONE;
+	if(mb*BLOCK_SIZE < iNode_size(c->map)) {
+		if(!iNode_read_at(c->map, c->entries, BLOCK_SIZE, mb*BLOCK_SIZE)) {
+			return 0;
+		}
+	}
+	else {
+		memset(c->entries, 0, BLOCK_SIZE);
+	}
+	c->map_block = mb;
+	return 1;
+}
+
+// ******** comp_store ***********
+// Compress the group in memory and write it out, if it changed
+static int comp_store(iNode_t *node) {
+	CompGroup_t *c = node->comp;
+	if(!c->dirty) {
+		return 1;
+	}
+	if(!comp_map_load(node, c->group)) {
+		return 0;
+	}
+	
+	uint32_t valid = min(node->iNode.size - c->group*COMP_GROUP_SIZE, COMP_GROUP_SIZE);
+	uint32_t blocks = Bytes2Sectors(valid);
+	uint32_t bytes = valid | COMP_RAW;
+	const uint8_t *out = c->data;
+	uint8_t *work = blocks > 1 ? Heap_KernelMalloc(COMP_WORK_SIZE) : 0;
+	if(work) {
+		uint32_t n = LZ_Compress(c->data, valid, work, (blocks-1)*BLOCK_SIZE, (uint16_t *) (work + COMP_OUT_SIZE));
+		if(n) {
+			blocks = Bytes2Sectors(n);
+			memset(work + n, 0, blocks*BLOCK_SIZE - n);
+			bytes = n;
+			out = work;
+		}
+	}
+	
+	// Stay in place if it fits or is last, otherwise go to the end. Blocks past the end are spare
+	uint32_t *entry = &c->entries[c->group % COMP_MAP_ENTRIES];
+	uint32_t at = *entry >> 16;
+	uint32_t had = Bytes2Sectors(*entry & COMP_BYTES);
+	uint32_t end = node->iNode.stored_blocks;
+	if(*entry && at + had == end) {
+		end = at + blocks;
+	}
+	else if(*entry == 0 || blocks > had) {
+		at = end;
+		end += blocks;
+	}
+	
+	int r = end <= 0xFFFF;
+	if(r && end > node->num_blocks) {
+		r = allocate_blocks(node, end - node->num_blocks);
+	}
+	r = r && blocks_write(node, out, at, blocks);
+	if(r) {
+		*entry = (at << 16) | bytes;
+		c->map_dirty = 1;
+		c->dirty = 0;
+		node->iNode.stored_blocks = end;
+		node->dirty = 1;
+	}
+	Heap_KernelFree(work);
+	return r;
+}
+
+// ******** comp_select ***********
+// Make group g the one in memory, storing the one there. g is read in only if load
+static int comp_select(iNode_t *node, uint32_t g, uint8_t load) {
+	CompGroup_t *c = node->comp;
+	if(c->group == g) {
+		return 1;
+	}
+	if(!comp_store(node)) {
+		return 0;
+	}
+	
+	c->group = COMP_NONE;
+	memset(c->data, 0, COMP_GROUP_SIZE);
+	if(load && g*COMP_GROUP_SIZE < node->iNode.size) {
+		if(!comp_map_load(node, g)) {
+			return 0;
+		}
+		uint32_t entry = c->entries[g % COMP_MAP_ENTRIES];
+		uint32_t bytes = entry & COMP_BYTES;
+		uint32_t blocks = Bytes2Sectors(bytes);
+		if(entry & COMP_RAW) {
+			if(bytes > COMP_GROUP_SIZE || !blocks_read(node, c->data, entry >> 16, blocks)) {
+				return 0;
+			}
+		}
+		else if(entry) {
+			uint8_t *work = bytes <= COMP_OUT_SIZE ? Heap_KernelMalloc(COMP_OUT_SIZE) : 0;
+			int r = work && blocks_read(node, work, entry >> 16, blocks) && LZ_Decompress(work, bytes, c->data, COMP_GROUP_SIZE);
+			Heap_KernelFree(work);
+			if(!r) {
+				return 0;
+			}
+		}
+	}
+	c->group = g;
+	return 1;
+}
+
+// ******** comp_read ***********
+// iNode_read_at for a compressed file, all or nothing
+static int comp_read(iNode_t *node, uint8_t *buff, uint32_t size, uint32_t offset) {
+	if(offset > node->iNode.size || size > node->iNode.size - offset || !comp_get(node)) {
+		return 0;
+	}
+	
+	uint32_t done = 0;
+	while(done < size) {
+		uint32_t o = offset % COMP_GROUP_SIZE;
+		uint32_t n = min(size - done, COMP_GROUP_SIZE - o);
+		if(!comp_select(node, offset / COMP_GROUP_SIZE, 1)) {
+			return 0;
+		}
+		memcpy(buff + done, node->comp->data + o, n);
+		offset += n;
+		done += n;
+	}
+	return done;
+}
+
+// ******** comp_write ***********
+// iNode_write_at for a compressed file, the data is compressed later (comp_store)
+static int comp_write(iNode_t *node, const uint8_t *buff, uint32_t size, uint32_t offset) {
+	if(!comp_get(node)) {
+		return 0;
+	}
+	
+	uint32_t done = 0;
+	while(done < size) {
+		uint32_t o = offset % COMP_GROUP_SIZE;
+		uint32_t n = min(size - done, COMP_GROUP_SIZE - o);
+		
+		// A group written whole has nothing to read back
+		if(!comp_select(node, offset / COMP_GROUP_SIZE, n < COMP_GROUP_SIZE)) {
+			break;
+		}
+		memcpy(node->comp->data + o, buff + done, n);
+		node->comp->dirty = 1;
+		offset += n;
+		done += n;
+		if(offset > node->iNode.size) {
+			node->iNode.size = offset;
+		}
+		node->dirty = 1;
+	}
+	return done;
+}
+
+// ******** comp_sync ***********
+// Store the group in memory and the group map. Must hold the node write lock
+static int comp_sync(iNode_t *node) {
+	if(node->comp == 0) {
+		return 1;
+	}
+	int r = comp_store(node);
+	r &= comp_map_flush(node);
+	r &= iNode_sync(node->comp->map);
+	return r;
+}
+
+
+// ******** read_at ***********
+// iNode_read_at, reading ahead up to window blocks (within the extent) at each block not yet cached
+static int read_at(iNode_t *node, void* buff, uint32_t size, uint32_t offset, uint32_t window) {
+	if(node->iNode.flags & INODE_COMPRESSED) {
+		return comp_read(node, buff, size, offset);
+	}
 	
 	// Read from appropriate data sector and place in the buffer
-	uint32_t iNode_left = node->iNode.size - offset;
-	uint32_t bytes_read = 0;
-	if(size > iNode_left) {
+	// Nothing is read at or past the end of the file, or by a read running past it
+	if(offset >= node->iNode.size || size > node->iNode.size - offset) {
 		return 0;
 	}
+	uint32_t bytes_read = 0;
 	
 	while( size > 0) {
-		iNode_left = node->iNode.size - offset;
+		uint32_t iNode_left = node->iNode.size - offset;
 		uint32_t block_ofs = offset % BLOCK_SIZE;
 		uint32_t block_left = BLOCK_SIZE - block_ofs;
-		uint32_t s = FilePos2Sector(node, offset);
+		uint32_t first;
+		int32_t i = extent_find(node, offset / BLOCK_SIZE, &first);
+		if(i < 0) {
+			return bytes_read;
+		}
+		Extent_t *e = extent_at(node, i);
+		uint32_t s = e->start + (offset / BLOCK_SIZE - first);
 		
 		uint32_t toRead = min(iNode_left, block_left);
 		toRead = min(toRead, size);
-		if(block_ofs == 0 && toRead == BLOCK_SIZE) {
+		if(window && !(e->flags & EXTENT_UNWRITTEN)) {
+			// The rest of this request and the window after it, within the extent and the file
+			uint32_t b = offset / BLOCK_SIZE;
+			uint32_t n = Bytes2Sectors(offset + size) - b;
+			n = max(n, window);
+			n = min(n, first + e->length - b);
+			n = min(n, Bytes2Sectors(node->iNode.size) - b);
+			BCache_Prefetch(s, n);
+		}
+		
+		if(e->flags & EXTENT_UNWRITTEN) {
+			// Allocated but never written, nothing to read
+			memset(buff+bytes_read, 0, toRead);
+		}
+		else if(block_ofs == 0 && toRead == BLOCK_SIZE) {
 			// Read entire block
-			eDisk_ReadBlock(buff+bytes_read, s);
-			
+			if(!block_read(node, buff+bytes_read, s)) {
+				return bytes_read;
+			}
 		}
 		else {
 			// Read only a portion of the block
-			OS_Wait(&buff1_lock);
-			eDisk_ReadBlock(buff1, s);
-			memcpy(buff+bytes_read, buff1+block_ofs, toRead);
-			OS_Signal(&buff1_lock);
-			
+			uint8_t *block = scratch_get();
+			int ok = block_read(node, block, s);
+			if(ok) {
+				memcpy(buff+bytes_read, block+block_ofs, toRead);
+			}
+			scratch_put(block);
+			if(!ok) {
+				return bytes_read;
+			}
 		}
 		
 		offset += toRead;
@@ -505,8 +1172,18 @@ int iNode_read_at(iNode_t *node, void* buff, uint32_t size, uint32_t offset) {
 	return bytes_read;
 }
 
+// Must be called when the node lock is held!
+int iNode_read_at(iNode_t *node, void* buff, uint32_t size, uint32_t offset) {
+	return read_at(node, buff, size, offset, 0);
+}
+
 
 int iNode_write_at(iNode_t *node, const void* buff, uint32_t size, uint32_t offset) {
+	inode_touch(node);
+	if(node->iNode.flags & INODE_COMPRESSED) {
+		return comp_write(node, buff, size, offset);
+	}
+	
 	// Allocate additional sectors if necessary
 	if(node->iNode.size < offset) {
 		// Allocate up to offset we need to write at
@@ -516,29 +1193,54 @@ int iNode_write_at(iNode_t *node, const void* buff, uint32_t size, uint32_t offs
 	}
 	if(node->iNode.size < offset + size) {
 		// Allocate all the space we will need to write
-		if(!allocate_space(node, size)) {
+		if(!allocate_space(node, offset + size - node->iNode.size)) {
 				return 0;
 		}
 	}
 	
 	uint32_t bytes_written = 0;
 	while(size > 0) {
-		uint32_t s = FilePos2Sector(node, offset);
+		uint32_t first;
+		uint32_t n = offset / BLOCK_SIZE;
+		int32_t i = extent_find(node, n, &first);
+		if(i < 0) {
+			return bytes_written;
+		}
+		Extent_t *e = extent_at(node, i);
+		uint32_t s = e->start + (n - first);
+		uint8_t unwritten = e->flags & EXTENT_UNWRITTEN;
 		uint32_t sector_ofs = offset%BLOCK_SIZE;
 	
 		uint32_t space_left = min(BLOCK_SIZE - sector_ofs, iNode_size(node)-offset); // space left in sector (or iNode)
 		uint32_t count = min(size, space_left);	// number of bytes to write
 		
+		int ok;
 		if(sector_ofs == 0 && count == BLOCK_SIZE) {
 			// Write whole block
-			eDisk_WriteBlock(buff+bytes_written, s);
+			ok = block_write(node, buff+bytes_written, s);
 		}
 		else {
-			OS_Wait(&buff1_lock);
-			eDisk_ReadBlock(buff1, s);
-			memcpy(buff1+sector_ofs, buff+bytes_written, count);
-			eDisk_WriteBlock(buff1, s);
-			OS_Signal(&buff1_lock);
+			uint8_t *block = scratch_get();
+			if(unwritten) {
+				memset(block, 0, BLOCK_SIZE);	// The rest of the block reads as zeros
+				ok = 1;
+			}
+			else {
+				ok = block_read(node, block, s);
+			}
+			if(ok) {
+				memcpy(block+sector_ofs, buff+bytes_written, count);
+				ok = block_write(node, block, s);
+			}
+			scratch_put(block);
+		}
+		if(!ok) {
+			return bytes_written;
+		}
+		
+		// Only after the data is on disk is the block marked written
+		if(unwritten) {
+			block_written(node, i, first, n - first, s);
 		}
 		
 		offset += count;
@@ -555,39 +1257,57 @@ uint32_t iNode_size(iNode_t *node) {
 }
 
 void iNode_lock_read(iNode_t *node) {
-	OS_Wait(&node->NodeLock);
-	node->numReaders++;
-	OS_Signal(&node->NodeLock);
+	OS_ReadLock(&node->NodeLock);
 }
 
 
 void iNode_lock_write(iNode_t *node) {
-	do {
-		OS_Wait(&node->NodeLock);
-		if(node->numReaders == 0){
-			break;
-		}
-		OS_Signal(&node->NodeLock);
-		OS_Suspend();
-	} while (1);
+	OS_WriteLock(&node->NodeLock);
 }
 
 void iNode_unlock_read(iNode_t *node) {
-	OS_Wait(&node->NodeLock);
-	node->numReaders--;
-	OS_Signal(&node->NodeLock);
+	OS_ReadUnlock(&node->NodeLock);
 }
 
 void iNode_unlock_write(iNode_t *node) {
-	OS_Signal(&node->NodeLock);
+	OS_WriteUnlock(&node->NodeLock);
+}
+
+// ******** data_lock_read ***********
+// Lock a node to read its data. Reading a compressed file changes the group in memory,
+// so it takes the write lock. Returns 1 if it did
+static uint8_t data_lock_read(iNode_t *node) {
+	uint8_t exclusive = (node->iNode.flags & INODE_COMPRESSED) != 0;
+	if(exclusive) {
+		iNode_lock_write(node);
+	}
+	else {
+		iNode_lock_read(node);
+	}
+	return exclusive;
+}
+
+// ******** data_unlock_read ***********
+static void data_unlock_read(iNode_t *node, uint8_t exclusive) {
+	if(exclusive) {
+		iNode_unlock_write(node);
+	}
+	else {
+		iNode_unlock_read(node);
+	}
 }
 
 // ----------------------------------- File Functions -------------------------------------- //
 
 // TODO Replace with dynamic allocation instead of buffers and add return codes
 int eFile_F_open(iNode_t *node, File_t* buff) {
+	if(node == 0) {
+		return 0;
+	}
 	buff->iNode = node;
 	buff->pos = 0;
+	buff->ra_next = 0;
+	buff->ra_window = 0;
 	
 	return 1;
 }
@@ -608,33 +1328,128 @@ iNode_t* eFile_F_get_iNode(File_t *file) {
 }
 
 uint32_t eFile_F_read(File_t *file, void* buffer, uint32_t size) {
-	iNode_lock_read(file->iNode);
-	uint32_t r = iNode_read_at(file->iNode, buffer, size, file->pos);
-	file->pos += size;
-	iNode_unlock_read(file->iNode);
+	// Reading on from where the last read ended grows the read-ahead window, a seek resets it
+	if(file->pos == file->ra_next) {
+		file->ra_window = file->ra_window ? min(2*file->ra_window, READAHEAD_MAX) : READAHEAD_MIN;
+	}
+	else {
+		file->ra_window = 0;
+	}
+	
+	uint8_t exclusive = data_lock_read(file->iNode);
+	uint32_t r = read_at(file->iNode, buffer, size, file->pos, file->ra_window);
+	file->pos += r;
+	file->ra_next = file->pos;
+	data_unlock_read(file->iNode, exclusive);
 	return r;
 }
 
 uint32_t eFile_F_read_at(File_t *file, void* buffer, uint32_t size, uint32_t pos) {
-	iNode_lock_read(file->iNode);
+	uint8_t exclusive = data_lock_read(file->iNode);
 	uint32_t r = iNode_read_at(file->iNode, buffer, size, pos);
-	iNode_unlock_read(file->iNode);
+	data_unlock_read(file->iNode, exclusive);
 	return r;
 }
 
 
+// ******** inode_blocks ***********
+// Blocks allocated to a file, and to its group map while that is open
+static uint32_t inode_blocks(iNode_t *node) {
+	return node->num_blocks + (node->comp ? node->comp->map->num_blocks : 0);
+}
+
+// ******** file_write ***********
+// A write that allocates blocks is one transaction with the iNode and extents pointing at
+// them, so the bitmap is never committed (by this or any later transaction) ahead of the
+// iNode. A write that fills a block commits the new size too, so a crash with the file
+// still open loses at most its last partial block. A compressed file's size covers the
+// group still in memory, it is only synced when it allocates
+static uint32_t file_write(File_t *file, const void* buffer, uint32_t size, uint32_t pos) {
+	iNode_t *node = file->iNode;
+	uint8_t journal = 0;
+	iNode_lock_write(node);
+	if(pos + size > node->iNode.size) {
+		// The transaction must be started before the node lock
+		iNode_unlock_write(node);
+		Journal_Begin();
+		journal = 1;
+		iNode_lock_write(node);
+	}
+	
+	uint32_t blocks = inode_blocks(node);
+	uint32_t length = node->iNode.size;
+	uint32_t r = iNode_write_at(node, buffer, size, pos);
+	if(journal && (inode_blocks(node) != blocks ||
+		(!(node->iNode.flags & INODE_COMPRESSED) && node->iNode.size/BLOCK_SIZE != length/BLOCK_SIZE))) {
+		if(!iNode_sync(node)) {
+			r = 0;
+		}
+	}
+	iNode_unlock_write(node);
+	if(journal && !Journal_End()) {
+		r = 0;
+	}
+	return r;
+}
+
 uint32_t eFile_F_write(File_t *file, const void* buffer, uint32_t size) {
+	uint32_t r = file_write(file, buffer, size, file->pos);
+	file->pos += r;
+	return r;
+}
+
+uint32_t eFile_F_write_at(File_t *file, const void* buffer, uint32_t size, uint32_t pos) {
+	return file_write(file, buffer, size, pos);
+}
+
+int eFile_F_preallocate(File_t *file, uint32_t size) {
+	Journal_Begin();
 	iNode_lock_write(file->iNode);
-	uint32_t r = iNode_write_at(file->iNode, buffer, size, file->pos);
-	file->pos += size;
+	int r = iNode_preallocate(file->iNode, size);
 	iNode_unlock_write(file->iNode);
+	r &= Journal_End();
 	return r;
 }
 
-uint32_t eFile_F_write_at(File_t *file, const void* buffer, uint32_t size, uint32_t pos) {
+int eFile_F_compress(File_t *file) {
+	iNode_t *node = file->iNode;
+	Journal_Begin();
+	iNode_lock_write(node);
+	
+	// Only before anything is written, blocks already allocated become spare blocks for groups
+	int r = !node->iNode.isDir && !(node->iNode.flags & INODE_COMPRESSED);
+	for(uint32_t i = 0; r && i < node->iNode.num_extents; i++) {
+		r = (extent_at(node, i)->flags & EXTENT_UNWRITTEN) != 0;
+	}
+	
+	uint32_t map = (uint32_t) -1;
+	if(r) {
+		map = Bitmap_AllocOne();
+		r = map != (uint32_t) -1 && iNode_create(map, 0, 0);
+		if(!r && map != (uint32_t) -1) {
+			Bitmap_free(map);
+		}
+	}
+	if(r) {
+		node->iNode.flags |= INODE_COMPRESSED;
+		node->iNode.group_map = map;
+		node->iNode.stored_blocks = 0;
+		node->iNode.size = 0;
+		node->dirty = 1;
+		r = iNode_sync(node);
+	}
+	
+	iNode_unlock_write(node);
+	r &= Journal_End();
+	return r;
+}
+
+int eFile_F_sync(File_t *file) {
+	Journal_Begin();
 	iNode_lock_write(file->iNode);
-	uint32_t r = iNode_write_at(file->iNode, buffer, size, pos);
+	int r = iNode_sync(file->iNode);
 	iNode_unlock_write(file->iNode);
+	r &= Journal_End();
 	return r;
 }
 
@@ -662,7 +1477,9 @@ int eFile_D_create(uint32_t parent_sector, uint32_t dir_sector, uint32_t entry_c
 	
 	r &= iNode_create(dir_sector, entry_cnt * sizeof(DirEntry_t), 1);
 	
-	r &= eFile_D_open(iNode_open(dir_sector), &buff);
+	if(!eFile_D_open(iNode_open(dir_sector), &buff)) {
+		return 0;
+	}
 	
 	r &=eFile_D_add(&buff, ".", dir_sector, 1);
 	r &=eFile_D_add(&buff, "..", parent_sector, 1);
@@ -678,6 +1495,8 @@ int eFile_D_open(iNode_t *node, Dir_t *buff) {
 	}
 	buff->iNode = node;
 	buff->pos = 2 * sizeof(DirEntry_t);
+	buff->ra_next = 0;
+	buff->ra_window = 0;
 	return 1;
 }
 
@@ -697,49 +1516,286 @@ iNode_t* eFile_D_get_iNode(Dir_t *dir) {
 	return dir->iNode;
 }
 
-int eFile_D_dir_from_path(const char path[], Dir_t *buff) {
+static int dir_find(Dir_t *dir, uint8_t *index, const char name[], uint32_t h, DirEntry_t *de, uint32_t *entry, uint32_t *slot);
+
+/* dir_step - Find name within the directory whose header is at sector, going through the dentry cache.
+	 Returns 1 with the entry's header sector and type if it exists */
+static int dir_step(uint32_t sector, const char name[], uint32_t *child, uint8_t *isDir) {
+	if(name[0] == 0) {
+		// Empty names (e.g. from a trailing '/') are the directory itself
+		*child = sector;
+		*isDir = 1;
+		return 1;
+	}
+	
+	if(!DirCache_Lookup(sector, name, child, isDir)) {
+		Dir_t dir;
+		DirEntry_t de;
+		uint32_t entry, slot;
+		if(!eFile_D_open(iNode_open(sector), &dir)) {
+			return 0;
+		}
+		
+		*child = 0;
+		*isDir = 0;
+		iNode_lock_read(dir.iNode);
+		uint8_t *index = index_get();
+		if(dir_find(&dir, index, name, Dir_Hash(name), &de, &entry, &slot)) {
+			*child = de.Header_Sector;
+			*isDir = de.isDir;
+		}
+		index_put(index);
+		
+		// Cached before the lock is let go, so an eFile_D_add or eFile_D_remove
+		// of the name can not land between the lookup and the insert
+		DirCache_Insert(sector, name, *child, *isDir); // Negative if not found
+		iNode_unlock_read(dir.iNode);
+		eFile_D_close(&dir);
+	}
+	return *child != 0;
+}
+
+// ******** dir_walk ************
+// Open the directory named by the first len characters of path.
+// Works on the caller's string in place, so any number of threads can walk paths at once
+static int dir_walk(const char path[], uint32_t len, Dir_t *buff) {
 	uint32_t i = 0;
-	Dir_t dir;
-	if(path[i] == '/') {
-		// Absolute path, open root dir
-		eFile_D_open_root(&dir);
+	uint32_t sector;
+	if(len > 0 && path[i] == '/') {
+		// Absolute path, start from the root dir
+		sector = ROOTDIR_INODE;
 		i++;
 	}
 	else {
-		// Relative path, open current dir
+		// Relative path, start from the current dir
 		// Note: opening an empty string is treated as a relative access
 		// i.e. open(".") will yield dir= "" and file="."
 		// The dir is therefore a relative access to "."
-		eFile_OpenCurrentDir(&dir);
+		iNode_t *cur = eFile_getCurrentDirNode();
+		sector = cur->sector_num;
+		iNode_close(cur);
 	}
 	
+	// Walk the path by header sector, only the final directory is opened
 	char fn[MAX_FILE_NAME_LENGTH+1];
 	for(uint32_t j = 0; ; i++) {
-		fn[j++] = path[i];
-		if((path[i] == '/') || (path[i] == 0)) {
+		uint8_t end = (i >= len) || (path[i] == 0);
+		if(end || (path[i] == '/')) {
 			// We have found a complete dir name - change dir
-			Dir_t newDir;
-			if(!eFile_D_lookup(&dir, fn, &newDir)) {
-				eFile_D_close(&dir);
+			uint8_t isDir;
+			fn[j] = 0;
+			if(!dir_step(sector, fn, &sector, &isDir) || !isDir) {
 				return 0;
 			}
-			
-			eFile_D_close(&dir);
-			dir = newDir;
-			
-			// Reset filename bufer
-			memset(fn, 0, MAX_FILE_NAME_LENGTH+1);
 			j = 0;
 		}
+		else if(j < MAX_FILE_NAME_LENGTH) {
+			fn[j++] = path[i];
+		}
+		else {
+			return 0; // Name too long to exist
+		}
 		
-		// Breka once we reach the end of the string
-		if(path[i] == 0) {
+		// Break once we reach the end of the string
+		if(end) {
 			break;
 		}
 	}
 	
+	return eFile_D_open(iNode_open(sector), buff);
+}
+
+int eFile_D_dir_from_path(const char path[], Dir_t *buff) {
+	return dir_walk(path, strlen(path), buff);
+}
+
+// -------------------------------- Directory Index ---------------------------------------- //
+
+uint32_t Dir_Hash(const char name[]) {
+	uint32_t h = 2166136261u;
+	while(*name) {
+		h ^= (uint8_t) *name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Index block and first slot probed for a hash, and the slot value for an entry
+#define DIR_HASH_BLOCK(h)			(((h) >> 7) % DIR_INDEX_BLOCKS)
+#define DIR_HASH_SLOT(h)			((h) % DIR_INDEX_SLOTS)
+#define DIR_SLOT(h, entry)		(((h) & 0xFFFF0000) | ((entry)+1))
+
+/* dir_entry_read - Read entry number e of a directory and check its CRC (entries never used are zeros).
+	 The dir lock must be held. Returns 0 on a damaged entry */
+static int dir_entry_read(iNode_t *dir, uint32_t e, DirEntry_t *de) {
+	if(!iNode_read_at(dir, de, sizeof(DirEntry_t), e * sizeof(DirEntry_t))) {
+		return 0;
+	}
+	return e >= dir->iNode.dir_next || meta_check(de, offsetof(DirEntry_t, crc), de->crc);
+}
+
+/* dir_entry_write - Seal an entry with its CRC and write it as entry number e, the dir lock must be held */
+static int dir_entry_write(iNode_t *dir, uint32_t e, DirEntry_t *de) {
+	de->crc = CRC32(0, de, offsetof(DirEntry_t, crc));
+	return iNode_write_at(dir, de, sizeof(DirEntry_t), e * sizeof(DirEntry_t)) == sizeof(DirEntry_t);
+}
+
+/* dir_index_write - Seal index block b with its CRC and write it */
+static int dir_index_write(iNode_t *dir, uint8_t *index, uint32_t b) {
+	uint32_t *slots = (uint32_t *) index;
+	slots[DIR_INDEX_SLOTS] = CRC32(0, slots, DIR_INDEX_SLOTS*4);
+	return Journal_Write(index, dir->iNode.dir_index[b]);
+}
+
+/* dir_find - Search the index block for name, read into index (from index_get). The dir lock must be held.
+	 index is left holding the index block (zeroed if it has no sector yet).
+	 Returns 1 with the entry, its number and its slot if found.
+	 Returns 0 with slot set to where name can be inserted, or DIR_INDEX_SLOTS if the block is full */
+static int dir_find(Dir_t *dir, uint8_t *index, const char name[], uint32_t h, DirEntry_t *de, uint32_t *entry, uint32_t *slot) {
+	uint32_t sector = dir->iNode->iNode.dir_index[DIR_HASH_BLOCK(h)];
+	uint32_t *slots = (uint32_t *) index;
+	*slot = DIR_INDEX_SLOTS;
+	
+	if(sector == 0) {
+		memset(index, 0, BLOCK_SIZE);
+		*slot = DIR_HASH_SLOT(h);
+		return 0;
+	}
+	if(!Journal_Read(index, sector) || !meta_check(slots, DIR_INDEX_SLOTS*4, slots[DIR_INDEX_SLOTS])) {
+		return 0; // Damaged, nothing is found in it and nothing added to it
+	}
+	
+	uint32_t i = DIR_HASH_SLOT(h);
+	for(uint32_t n = 0; n < DIR_INDEX_SLOTS; n++, i = (i+1) % DIR_INDEX_SLOTS) {
+		uint32_t v = slots[i];
+		if(v == DIR_SLOT_EMPTY) {
+			if(*slot == DIR_INDEX_SLOTS) {
+				*slot = i;
+			}
+			return 0; // End of the probe chain
+		}
+		if((v & 0xFFFF) == DIR_SLOT_DELETED) {
+			if(*slot == DIR_INDEX_SLOTS) {
+				*slot = i; // Reuse the first removed slot
+			}
+			continue;
+		}
+		if((v >> 16) == (h >> 16)) {
+			// Upper hash bits match, compare the name itself
+			*entry = (v & 0xFFFF) - 1;
+			if(dir_entry_read(dir->iNode, *entry, de) && de->in_use && strcmp(de->name, name) == 0) {
+				*slot = i;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* dir_add - Add an entry through the index block buffer index, the dir lock must be held */
+static int dir_add(Dir_t *dir, uint8_t *index, DirEntry_t *de) {
+	iNode_t *node = dir->iNode;
+	DirEntry_t buff;
+	uint32_t entry, slot;
+	
+	if(dir_find(dir, index, de->name, de->hash, &buff, &entry, &slot) || slot == DIR_INDEX_SLOTS) {
+		return 0; // Already exists, or this index block is full
+	}
+	
+	// Reuse a removed entry, or take the next never used one
+	uint16_t old_free = node->iNode.dir_free;
+	uint16_t old_next = node->iNode.dir_next;
+	if(node->iNode.dir_free) {
+		entry = node->iNode.dir_free - 1;
+		if(!dir_entry_read(node, entry, &buff)) {
+			return 0; // The free list cannot be followed
+		}
+		node->iNode.dir_free = buff.Header_Sector;
+	}
+	else {
+		if(node->iNode.dir_next >= DIR_SLOT_DELETED - 1) {
+			return 0;
+		}
+		entry = node->iNode.dir_next++;
+	}
+	
+	uint32_t b = DIR_HASH_BLOCK(de->hash);
+	uint32_t *slots = (uint32_t *) index;
+	uint32_t old_slot = slots[slot];
+	uint32_t new_index = 0;
+	int ok = dir_entry_write(node, entry, de);
+	if(ok && node->iNode.dir_index[b] == 0) {
+		new_index = Bitmap_AllocOne();
+		ok = new_index != (uint32_t) -1;
+		if(ok) {
+			node->iNode.dir_index[b] = new_index;
+		}
+		else {
+			new_index = 0;
+		}
+	}
+	if(ok) {
+		slots[slot] = DIR_SLOT(de->hash, entry);
+		ok = dir_index_write(node, index, b);
+		node->dirty = 1;
+		ok = ok && iNode_sync(node);	// Free list and index sectors
+	}
+	if(ok) {
+		return 1;
+	}
+	
+	// Undo: the entry as it was (a free list link, or zeros past dir_next), the index slot,
+	// then the iNode. The whole transaction is in the caller, so this is best effort
+	if(old_free) {
+		dir_entry_write(node, entry, &buff);
+	}
+	else {
+		memset(&buff, 0, sizeof buff);
+		iNode_write_at(node, &buff, sizeof buff, entry * sizeof buff);
+	}
+	slots[slot] = old_slot;
+	if(new_index) {
+		node->iNode.dir_index[b] = 0;
+		Bitmap_free(new_index);
+	}
+	else if(node->iNode.dir_index[b]) {
+		dir_index_write(node, index, b);
+	}
+	node->iNode.dir_free = old_free;
+	node->iNode.dir_next = old_next;
+	node->dirty = 1;
+	iNode_sync(node);
+	return 0;
+}
+
+/* dir_remove - Remove an entry through the index block buffer index, the dir lock must be held */
+static int dir_remove(Dir_t *dir, uint8_t *index, const char name[], DirEntry_t *de) {
+	iNode_t *node = dir->iNode;
+	uint32_t h = Dir_Hash(name);
+	uint32_t entry, slot;
+	
+	if(!dir_find(dir, index, name, h, de, &entry, &slot)) {
+		return 0;
+	}
 	
-	memcpy(buff, &dir, sizeof(dir));
+	// A slot followed by an empty one ends every probe chain through it, so it can be emptied
+	uint32_t *slots = (uint32_t *) index;
+	if(slots[(slot+1) % DIR_INDEX_SLOTS] == DIR_SLOT_EMPTY) {
+		slots[slot] = DIR_SLOT_EMPTY;
+	}
+	else {
+		slots[slot] = (slots[slot] & 0xFFFF0000) | DIR_SLOT_DELETED;
+	}
+	dir_index_write(node, index, DIR_HASH_BLOCK(h));
+	
+	// Push the entry onto the free list
+	DirEntry_t freed;
+	memset(&freed, 0, sizeof freed);
+	freed.Header_Sector = node->iNode.dir_free;
+	dir_entry_write(node, entry, &freed);
+	node->iNode.dir_free = entry + 1;
+	node->dirty = 1;
+	iNode_sync(node);
 	return 1;
 }
 
@@ -749,25 +1805,24 @@ int lookup(Dir_t *dir, const char name[], DirEntry_t *buff, uint32_t *offset) {
 	if(name[0] == 0) {
 		// Empty strings will return the dir entry for . (which is always entry 0)
 		iNode_lock_read(dir->iNode);
-		iNode_read_at(dir->iNode, &de, sizeof de, 0);
+		int r = dir_entry_read(dir->iNode, 0, &de);
 		iNode_unlock_read(dir->iNode);
 		memcpy(buff, &de, sizeof de);
-		return 1;
+		*offset = 0;
+		return r;
 	}
 	
+	uint32_t entry, slot;
 	iNode_lock_read(dir->iNode);
-	for(uint32_t ofs = 0; ofs < dir->iNode->iNode.size; ofs += sizeof de) {
-		iNode_read_at(dir->iNode, &de, sizeof de, ofs);
-		if(strcmp(de.name, name) == 0) {
-			*offset = ofs;
-			memcpy(buff, &de, sizeof de);
-			iNode_unlock_read(dir->iNode);
-			return 1;
-		}
-	}
-	
+	uint8_t *index = index_get();
+	int found = dir_find(dir, index, name, Dir_Hash(name), buff, &entry, &slot);
+	index_put(index);
 	iNode_unlock_read(dir->iNode);
-	return 0;
+	
+	if(found) {
+		*offset = entry * sizeof(DirEntry_t);
+	}
+	return found;
 }
 
 int eFile_D_lookup_by_sector(Dir_t *dir, uint32_t sector, DirEntry_t *buff) {
@@ -775,9 +1830,8 @@ int eFile_D_lookup_by_sector(Dir_t *dir, uint32_t sector, DirEntry_t *buff) {
 	
 	iNode_lock_read(dir->iNode);
 	DirEntry_t de;
-	for(uint32_t ofs = 0; ofs < dir->iNode->iNode.size; ofs += sizeof de) {
-		iNode_read_at(dir->iNode, &de, sizeof de, ofs);
-		if(de.Header_Sector == sector) {
+	for(uint32_t e = 0; e < dir->iNode->iNode.size / sizeof de; e++) {
+		if(dir_entry_read(dir->iNode, e, &de) && de.Header_Sector == sector) {
 			ret = 1;
 			memcpy(buff, &de, sizeof de);
 		}
@@ -788,85 +1842,85 @@ int eFile_D_lookup_by_sector(Dir_t *dir, uint32_t sector, DirEntry_t *buff) {
 }
 
 int eFile_D_lookup(Dir_t *dir, const char name[], File_t *buff) {
-		
-	DirEntry_t de;
-	uint32_t ofs = 0;
+	uint32_t child;
+	uint8_t isDir;
 	
-	if (lookup(dir, name, &de, &ofs)) {
-		if(de.isDir) {
-			eFile_D_open(iNode_open(de.Header_Sector), buff);
-			
-		}
-		else {
-			eFile_F_open(iNode_open(de.Header_Sector), buff);
-		}
-		
-		return 1;
-	} 
-	return 0;
+	if(!dir_step(dir->iNode->sector_num, name, &child, &isDir)) {
+		return 0;
+	}
+	if(isDir) {
+		return eFile_D_open(iNode_open(child), buff);
+	}
+	return eFile_F_open(iNode_open(child), buff);
 }
 
 int eFile_D_add(Dir_t *dir, const char name[], uint32_t iNode_header_sector, uint8_t isDir) {
-	if(strlen(name) > MAX_FILE_NAME_LENGTH+1) {
+	if(strlen(name) > MAX_FILE_NAME_LENGTH) {
 		return 0;
 	}
 	
 	DirEntry_t de;
-	DirEntry_t buff;
-	uint32_t ofs = 0;
-	if(lookup(dir, name, &de, &ofs)) {
-		return 0;
-	}
-	
+	memset(&de, 0, sizeof de);
 	de.isDir = isDir;
 	strcpy(de.name, name);
+	de.hash = Dir_Hash(name);
 	de.Header_Sector = iNode_header_sector;
 	de.in_use = 1;
 	
+	Journal_Begin();
 	iNode_lock_write(dir->iNode);
-	
-	for (ofs = 0; ofs < dir->iNode->iNode.size; ofs += sizeof(DirEntry_t)) {
-		iNode_read_at(dir->iNode, &buff, sizeof(DirEntry_t), ofs);
-		if (!buff.in_use) {
-			break;
-		}
+	uint8_t *index = index_get();
+	int i = dir_add(dir, index, &de);
+	index_put(index);
+	if(i) {
+		DirCache_Insert(dir->iNode->sector_num, name, iNode_header_sector, isDir);
 	}
-
-	int i = iNode_write_at(dir->iNode, &de, sizeof(DirEntry_t), ofs);
 	iNode_unlock_write(dir->iNode);
-	
-	return i == sizeof(de);
+	i &= Journal_End();
+	return i;
 }
 
 int eFile_D_remove(Dir_t *dir, const char name[]) {
-
 	DirEntry_t de;
-	uint32_t ofs;
-	if(!lookup(dir, name, &de, &ofs)) {
+	
+	// Removing the entry and freeing the file (if nothing else has it open) are one transaction
+	Journal_Begin();
+	iNode_lock_write(dir->iNode);
+	uint8_t *index = index_get();
+	int i = dir_remove(dir, index, name, &de);
+	index_put(index);
+	if(i) {
+		DirCache_Insert(dir->iNode->sector_num, name, 0, 0);
+		if(de.isDir) {
+			DirCache_InvalidateDir(de.Header_Sector);
+		}
+	}
+	iNode_unlock_write(dir->iNode);
+	if(!i) {
+		Journal_End();
 		return 0;
 	}
 	
-	iNode_t* node = iNode_open(dir->iNode->sector_num);
-	
-	de.in_use = 0;
-	iNode_write_at(dir->iNode, &de, sizeof de, ofs);
-	
-	iNode_remove(node);
-	iNode_close(node);
-	return 1;
+	// Freed from disk once the last opener closes it
+	iNode_t* node = iNode_open(de.Header_Sector);
+	if(node) {
+		iNode_remove(node);
+		iNode_close(node);
+	}
+	return Journal_End();
 }
 
 int eFile_D_read_next(Dir_t *dir, char buff[], uint32_t *sizeBuffer) {
 	DirEntry_t de;
 	
 	while(dir->pos < dir->iNode->iNode.size) {
-		iNode_read_at(dir->iNode, &de, sizeof(DirEntry_t), dir->pos);
+		int r = dir_entry_read(dir->iNode, dir->pos / sizeof(DirEntry_t), &de);
 		dir->pos += sizeof(DirEntry_t);
-		if(de.in_use) {
+		if(r && de.in_use) {
 			strcpy(buff, de.name);
 			
 			iNode_t *n = iNode_open(de.Header_Sector);
-			*sizeBuffer = n->iNode.size;
+			*sizeBuffer = n ? n->iNode.size : 0;
 			iNode_close(n);
 			return 1;
 		}
@@ -900,30 +1954,45 @@ int eFile_OpenCurrentDir(File_t *buff) {
 // passing a directory path to this will technically work, but won't open the last level unless proceeded by a '/'
 int eFile_parse_filepath(const char path[], Dir_t* dirBuff, char **fn_buff) {
 	int i;	
-	for(i = strlen(path)-1; path[i] != '/' && i >= 0; --i) { }
+	for(i = strlen(path)-1; i >= 0 && path[i] != '/'; --i) { }
 	*fn_buff = (char *) path+i+1;
 	
-	OS_Wait(&pathbuff_lock);
-	memcpy(pathbuff, path, i+1);
-	pathbuff[i+1] = 0;
-	i = eFile_D_dir_from_path(pathbuff, dirBuff);
-	
-	return i;
+	// The directory part is everything up to and including the last '/'
+	return dir_walk(path, i+1, dirBuff);
+}
+
+// ******** name_taken ************
+// Whether dir has an entry called name (empty names, and names too long to store, count as taken)
+static int name_taken(Dir_t *dir, const char name[]) {
+	uint32_t child;
+	uint8_t isDir;
+	return name[0] == 0 || strlen(name) > MAX_FILE_NAME_LENGTH || dir_step(dir->iNode->sector_num, name, &child, &isDir);
 }
 
 int eFile_Create(const char path[]) { 
 	int i;
 	Dir_t d;
 	char *fn;
-	eFile_parse_filepath(path, &d, &fn);
+	Journal_Begin();
+	if(!eFile_parse_filepath(path, &d, &fn)) {
+		Journal_End();
+		return 0;
+	}
+	if(name_taken(&d, fn)) {
+		eFile_D_close(&d);
+		Journal_End();
+		return 0;
+	}
 	
-	// Create a file of zero size
+	// Create a file of zero size, giving the header sector back if it can't be linked in
 	uint32_t s = Bitmap_AllocOne();
-	i = iNode_create(s, 128, 0);
-	i &= eFile_D_add(&d, fn, s, 0);
-	OS_Signal(&pathbuff_lock);
+	i = s != (uint32_t) -1 && iNode_create(s, 0, 0) && eFile_D_add(&d, fn, s, 0);
+	if(!i && s != (uint32_t) -1) {
+		Bitmap_free(s);
+	}
 	
 	i &= eFile_D_close(&d);
+	i &= Journal_End();
 	
 	return i;
 }
@@ -933,21 +2002,35 @@ int eFile_CreateDir(const char path[]) {
 	Dir_t d;
 	char *fn;
 	
-	eFile_parse_filepath(path, &d, &fn);
+	Journal_Begin();
+	if(!eFile_parse_filepath(path, &d, &fn)) {
+		Journal_End();
+		return 0;
+	}
+	if(name_taken(&d, fn)) {
+		eFile_D_close(&d);
+		Journal_End();
+		return 0;
+	}
 	
-	// Create a file of zero size
+	// Create an empty directory, giving the header sector back if it can't be linked in
 	uint32_t s = Bitmap_AllocOne();
-	i = eFile_D_create(d.iNode->sector_num, s, 16);
-	i &= eFile_D_add(&d, fn, s, 1);
-	OS_Signal(&pathbuff_lock);
+	i = s != (uint32_t) -1 && eFile_D_create(d.iNode->sector_num, s, 16) && eFile_D_add(&d, fn, s, 1);
+	if(!i && s != (uint32_t) -1) {
+		Bitmap_free(s);
+	}
+	
 	i &= eFile_D_close(&d);
+	i &= Journal_End();
 	
 	return i;
 }
 
 int eFile_CD(const char path[]) {
 	Dir_t d;
-	eFile_D_dir_from_path(path, &d);
+	if(!eFile_D_dir_from_path(path, &d)) {
+		return 0;
+	}
 	iNode_close(RunPt->currentDir);
 	RunPt->currentDir = eFile_D_get_iNode(&d); // Don't need to reopen because dir_from_path already does
 	return 1;
@@ -958,10 +2041,11 @@ int eFile_Open(const char path[], File_t *buff) {
 	Dir_t d;
 	char *fn;
 	
-	eFile_parse_filepath(path, &d, &fn);
+	if(!eFile_parse_filepath(path, &d, &fn)) {
+		return 0;
+	}
 	
 	i = eFile_D_lookup(&d, fn, buff);
-	OS_Signal(&pathbuff_lock);
 	i &= eFile_D_close(&d);
 	return i;
 }
@@ -971,25 +2055,52 @@ int eFile_Remove(const char path[]) {
 	Dir_t d;
 	char *fn;
 	
-	eFile_parse_filepath(path, &d, &fn);
+	Journal_Begin();
+	if(!eFile_parse_filepath(path, &d, &fn)) {
+		Journal_End();
+		return 0;
+	}
 	
 	i = eFile_D_remove(&d, fn);
-	OS_Signal(&pathbuff_lock);
 	i &= eFile_D_close(&d);
+	i &= Journal_End();
 	return i;
 }
 
 
+int eFile_SetDevice(const char name[]) {
+	BlockDev_t *dev = BlockDev_Find(name);
+	uint32_t count = BlockDev_Count(dev);
+	if(count == 0) {
+		return 0;
+	}
+	
+	eFileDev = dev;
+	NumSectors = count < 8*BLOCK_SIZE ? count : 8*BLOCK_SIZE;
+	return 1;
+}
+
 /* Return success value */
 int eFile_Init(void) {
-	// Initialize the list of iNode(s)
-		// TODO Update with dynamic memory allocation after lab 5
-	OS_InitSemaphore(&buff1_lock, 1);
-	OS_InitSemaphore(&buff2_lock, 1);
-	OS_InitSemaphore(&pathbuff_lock, 1);
+	// Default to the SD card
+	if(eFileDev == 0) {
+		if(BlockDev_Find("sd") == 0) {
+			BlockDev_Register("sd", &eDisk_Ops, 0);
+		}
+		if(!eFile_SetDevice("sd")) {
+			return 0;
+		}
+	}
+	
+	OS_InitSemaphore(&scratch_free, SCRATCH_BUFFERS);
+	OS_InitSemaphore(&scratch_index, SCRATCH_BUFFERS-1);
+	memset(ScratchUsed, 0, sizeof ScratchUsed);
 	
 	// Initialize Bitmap
 	Bitmap_Init(BLOCK_SIZE);
+	DirCache_Reset();
+	Journal_Init();
+	BCache_Init();
 	
 	return 1;
 }
@@ -998,16 +2109,21 @@ int eFile_Format(void) {
 	// Format drive
 	int r = 1;
 	for(uint32_t i = 0; i < NumSectors; i++) {
-		r &= eDisk_WriteBlock(zeros, i);
+		r &= BlockDev_Write(eFileDev, zeros, i, 1);
 	}
 	
 	// Reset bitmap
 	Bitmap_Reset();
+	DirCache_Reset();
+	BCache_Reset();
+	iNode_drop_cache();
+	r &= Journal_Format();
 	
 	// Create root dir
 	r &= eFile_D_create(ROOTDIR_INODE, ROOTDIR_INODE, 16);
 	
-	Bitmap_Unmount();
+	// Bitmap and root dir in place
+	r &= Journal_Checkpoint();
 	//return r;
 	return 0;
 }
@@ -1017,16 +2133,128 @@ uint32_t eFile_get_root_sector(void) {
 }
 
 int eFile_Mount(void) {
+	// Finish whatever metadata updates were committed before the last power loss
+	int r = Journal_Mount();
+	
 	// Read in bitmap
 	Bitmap_Mount();
+	DirCache_Reset();
+	BCache_Reset();
+	iNode_drop_cache();
 	
-	return 1;
+	return r;
 }
 
 int eFile_Unmount(void) {
-	// Write out bitmap
-	Bitmap_Unmount();
+	// Write out iNodes still open, they may allocate sectors for their extents
+	for(uint32_t i = 0; i < INODE_HASH_BUCKETS; i++) {
+		for(iNode_t *node = iNode_Hash[i]; node != 0; node = node->hash_next) {
+			iNode_sync(node);
+		}
+	}
+	
+	// Write out bitmap, and everything else in the journal, in place
+	Journal_Checkpoint();
+	iNode_drop_cache();
+	BlockDev_Flush(eFileDev);
 	
 	// Could also close all iNodes if we wanted to but tbh that's on the callee
 	return 1;
 }	
+
+
+// -------------------------------- VFS Backend -------------------------------------------- //
+// Paths from the VFS are absolute within this file system. Handles are File_t/Dir_t from the kernel heap
+
+// ******** vfs_create_open ************
+// Create a file and open it
+static int vfs_create_open(const char path[], File_t *f) {
+	return eFile_Create(path) && eFile_Open(path, f);
+}
+
+static void* vfs_open(void *ctx, const char path[], uint8_t mode) {
+	File_t *f = Heap_KernelMalloc(sizeof(File_t));
+	if(f == 0) {
+		return 0;
+	}
+	if(!eFile_Open(path, f) && (!(mode & VFS_CREATE) || !vfs_create_open(path, f))) {
+		Heap_KernelFree(f);
+		return 0;
+	}
+	if(mode & VFS_APPEND) {
+		eFile_F_seek(f, eFile_F_length(f));
+	}
+	return f;
+}
+
+static uint32_t vfs_read(void *file, void *buff, uint32_t size) {
+	// eFile_F_read reads all or nothing, the VFS reads up to the end of the file
+	uint32_t length = eFile_F_length(file), pos = eFile_F_tell(file);
+	uint32_t left = pos < length ? length - pos : 0;
+	if(size > left) {
+		size = left;
+	}
+	return size ? eFile_F_read(file, buff, size) : 0;
+}
+
+static uint32_t vfs_write(void *file, const void *buff, uint32_t size) {
+	return eFile_F_write(file, buff, size);
+}
+
+static uint32_t vfs_seek(void *file, uint32_t pos) {
+	return eFile_F_seek(file, pos);
+}
+
+static uint32_t vfs_tell(void *file) {
+	return eFile_F_tell(file);
+}
+
+static uint32_t vfs_length(void *file) {
+	return eFile_F_length(file);
+}
+
+static int vfs_close(void *file) {
+	int r = eFile_F_close(file);
+	Heap_KernelFree(file);
+	return r;
+}
+
+static void* vfs_opendir(void *ctx, const char path[]) {
+	Dir_t *d = Heap_KernelMalloc(sizeof(Dir_t));
+	if(d == 0) {
+		return 0;
+	}
+	if(!eFile_D_dir_from_path(path, d)) {
+		Heap_KernelFree(d);
+		return 0;
+	}
+	return d;
+}
+
+static int vfs_readdir(void *dir, char name[], uint32_t *size) {
+	return eFile_D_read_next(dir, name, size);
+}
+
+static int vfs_closedir(void *dir) {
+	int r = eFile_D_close(dir);
+	Heap_KernelFree(dir);
+	return r;
+}
+
+static int vfs_create(void *ctx, const char path[]) {
+	File_t f;
+	return vfs_create_open(path, &f) && eFile_F_close(&f);
+}
+
+static int vfs_mkdir(void *ctx, const char path[]) {
+	return eFile_CreateDir(path);
+}
+
+static int vfs_remove(void *ctx, const char path[]) {
+	return eFile_Remove(path);
+}
+
+const VFSOps_t eFile_VFSOps = {
+	vfs_open, vfs_read, vfs_write, vfs_seek, vfs_tell, vfs_length, vfs_close,
+	vfs_opendir, vfs_readdir, vfs_closedir, vfs_create, vfs_mkdir, vfs_remove
+};
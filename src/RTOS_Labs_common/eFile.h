@@ -22,27 +22,60 @@
 #include "../RTOS_Lab4_FileSystem/Bitmap.h"
 #include "../RTOS_Labs_common/OS.h"
 #include "../RTOS_Lab4_FileSystem/iNode.h"
+#include "../RTOS_Labs_common/BlockDev.h"
 
 #define BLOCK_SIZE 512
 #define MAX_FILE_NAME_LENGTH 33
+
+// Device holding the file system, see eFile_SetDevice
+extern BlockDev_t *eFileDev;
+
+// Sectors on the device, at most 8*BLOCK_SIZE (the bitmap is one sector).
+// The sectors past it are marked in use by eFile_Format
+extern uint32_t NumSectors;
+
+// Metadata blocks (iNodes, extent tree, directory entries and index) read from disk with a
+// bad CRC32. Such a block is not used: the file or entry reads as missing, or the call fails
+extern uint32_t eFile_ChecksumErrors;
 #define DIR_ENTRY_LENGTH MAX_FILE_NAME_LENGH+7
-#define MAX_NODES_OPEN 3
+
+// iNodes in memory are found by hashing their header sector into one of INODE_HASH_BUCKETS (power of 2)
+#define INODE_HASH_BUCKETS 16
+#define INODE_HASH(sector) ((sector) & (INODE_HASH_BUCKETS-1))
+
+// Number of closed iNodes kept in memory for a fast reopen (~540 bytes each)
+#define INODE_CACHE_SIZE 4
 
 typedef struct File {
 	iNode_t *iNode;
 	uint32_t pos; // Cursor position
+	uint32_t ra_next;		// Where the last eFile_F_read ended, a read starting there is sequential
+	uint32_t ra_window;	// Read-ahead in blocks, grows while reads are sequential
 } File_t;
 
 // Dirs are also files, but this makes the code more readable
 #define Dir_t File_t
 
+// Directory entries are 64 bytes so a block holds exactly 8 and no entry straddles two blocks
+// Free entries form a list through Header_Sector, headed by the directory's dir_free.
+// Each written entry carries its own CRC32, entries past the directory's dir_next are all zeros
 typedef struct DirEntry {
 	uint32_t Header_Sector;
+	uint32_t hash;										 // Dir_Hash of name
 	char name[MAX_FILE_NAME_LENGTH+1]; // To ensure null termination
 	uint8_t in_use;
 	uint8_t isDir;
+	uint32_t crc;											 // CRC32 of the entry up to here
+	uint8_t reserved[16];
 } DirEntry_t;
 
+// Directory index blocks are open addressed hash tables of DIR_INDEX_SLOTS slots.
+// A slot holds the upper half of the name hash and the entry number + 1.
+// The last word of the block is a CRC32 of the slots
+#define DIR_INDEX_SLOTS (BLOCK_SIZE/4 - 1)
+#define DIR_SLOT_EMPTY 0
+#define DIR_SLOT_DELETED 0xFFFF			// Entry half of a removed slot, keeps probe chains intact
+
 // ----------------------------------------------------------------- File Functions -------------------------------------------------------------------- //
 
 // ******** eFile_F_open ************
@@ -76,7 +109,8 @@ iNode_t* eFile_F_get_iNode(File_t *file);
 // input:  File_t *file - File being read 
 //				 void* buffer - Output buffer to read into
 //				uint32_t size - number of bytes to read
-// output: 1 on success, 0 on fail
+// output: number of bytes read (the cursor moves by as much), fewer on a disk error,
+//				 0 if the file ends before size bytes
 uint32_t eFile_F_read(File_t *file, void* buffer, uint32_t size);
 
 // ******** eFile_F_read_at ************
@@ -85,7 +119,7 @@ uint32_t eFile_F_read(File_t *file, void* buffer, uint32_t size);
 //				 void* buffer - Output buffer to read into
 //				uint32_t size - number of bytes to read
 //				 uint32_t pos - file position to start reading from
-// output: 1 on success, 0 on fail
+// output: number of bytes read, fewer on a disk error, 0 if the file ends before size bytes
 uint32_t eFile_F_read_at(File_t *file, void* buffer, uint32_t size, uint32_t pos);
 
 // ******** eFile_F_write ************
@@ -93,7 +127,8 @@ uint32_t eFile_F_read_at(File_t *file, void* buffer, uint32_t size, uint32_t pos
 // input:  File_t *file - File being written to 
 //				 void* buffer - Output buffer to write from
 //				uint32_t size - number of bytes to write
-// output: 1 on success, 0 on fail
+// output: number of bytes written (the cursor moves by as much), fewer on a disk error,
+//				 0 if the disk is full
 uint32_t eFile_F_write(File_t *file, const void* buffer, uint32_t size);
 
 // ******** eFile_F_write_at ************
@@ -102,9 +137,35 @@ uint32_t eFile_F_write(File_t *file, const void* buffer, uint32_t size);
 //				 void* buffer - Output buffer to write from
 //				uint32_t size - number of bytes to write
 //				 uint32_t pos - file position to start reading from
-// output: 1 on success, 0 on fail
+// output: number of bytes written, fewer on a disk error, 0 if the disk is full
 uint32_t eFile_F_write_at(File_t *file, const void* buffer, uint32_t size, uint32_t pos);
 
+// ******** eFile_F_preallocate ************
+// Reserve space for size bytes past the end of a file, e.g. for a streaming logger.
+// The file length does not change. The space is contiguous when the disk allows,
+// and appends into it need neither allocation nor erasing
+// input:  File_t *file - File being extended
+//				uint32_t size - number of bytes to reserve
+// output: 1 on success, 0 on fail (disk full)
+int eFile_F_preallocate(File_t *file, uint32_t size);
+
+// ******** eFile_F_compress ************
+// Store a new, never written file compressed from now on (e.g. a log). Data is compressed
+// COMP_GROUP_SIZE bytes at a time, any group can still be read or rewritten. Reads and
+// writes then work as before, but an open compressed file holds ~2.6KB of heap for its
+// group in memory, and compressing a group briefly takes ~2.5KB more.
+// Preallocating reserves blocks for compressed data
+// input:  File_t *file - File to compress, nothing written to it yet
+// output: 1 on success, 0 on fail (written to, a directory, or disk full)
+int eFile_F_compress(File_t *file);
+
+// ******** eFile_F_sync ************
+// Write out a file's data held in memory (a compressed file's last group) and its iNode,
+// so it survives power loss without a close
+// input:  File_t *file - File to sync
+// output: 1 on success, 0 on fail
+int eFile_F_sync(File_t *file);
+
 // ******** eFile_F_length ************
 // Get the current size of a file
 // input:  File_t *file - File being inspected
@@ -189,6 +250,12 @@ int eFile_D_lookup(Dir_t *dir, const char name[], File_t *buff);
 // output: 1 on success, 0 on fail
 int eFile_D_lookup_by_sector(Dir_t *dir, uint32_t sector, DirEntry_t *buff);
 
+// ******** Dir_Hash ************
+// Hash of a file name used by the directory index (FNV-1a)
+// input: const char name[] - null terminated file name
+// output: 32 bit hash
+uint32_t Dir_Hash(const char name[]);
+
 // ******** eFile_D_add ************
 // Add a new entry into a directory
 // input: 						Dir_t *dir - Directory to add to
@@ -250,9 +317,16 @@ int eFile_Remove(const char path[]);
 // output: 1 on success, 0 on fail
 int eFile_OpenCurrentDir(Dir_t *buff);
 
+// ******** eFile_SetDevice ************
+// Choose the block device for the filesystem, unmount the current one first
+// input: const char name[] - registered device name (see BlockDev.h)
+// output: 1 on success, 0 if there is no such device
+int eFile_SetDevice(const char name[]);
+
 // ******** eFile_Init ************
 // Initialize the filesystem
-// Note: Does NOT initialize the disk. eDisk_Init should be called first
+// Note: Does NOT initialize the disk. eDisk_Init should be called first.
+//       Uses the SD card unless eFile_SetDevice picked a device
 // input: none
 // output: 1 on success, 0 on fail
 int eFile_Init(void);
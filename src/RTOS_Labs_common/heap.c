@@ -43,45 +43,43 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../RTOS_Labs_common/heap.h"
 #include "../RTOS_Labs_common/OS.h"
 
 
 extern int8_t HeapMem[HEAP_SIZE];	// Align to full word addresses
 
-uint32_t getHeapSize(void) {
-	TCB_t *r = OS_get_current_TCB();
-	if(r && r->process) {
-		return r->process->heap_size;
-	}
-	return HEAP_SIZE;
-}
+heap_region_t BaseRegion = {0, HEAP_SIZE, HeapMem};
+heap_t BaseHeap = {&BaseRegion, 0, HEAP_SIZE, 0, 0};
 
-int8_t* getHeapBase(void) {
-	TCB_t *r = OS_get_current_TCB();
-	if(r && r->process) {
-		return r->process->heap;
-	}
-	return HeapMem;
-}
+#if HEAP_PROFILE
+#define HEAP_TAG_SIZE ((int32_t) sizeof(heap_tag_t))
+#else
+#define HEAP_TAG_SIZE 0
+#endif
 
-void* memset(void* dst, int v, size_t num_bytes) {
-	for(uint32_t i = 0; i < num_bytes; i++) {
-		*((int8_t*)dst+i) = v;
-	}
-	return dst;
-}
+// Address the allocating function will return to
+#if defined(__CC_ARM)
+#define HEAP_CALLER() ((uint32_t) __return_address())
+#else
+#define HEAP_CALLER() ((uint32_t) __builtin_return_address(0))
+#endif
 
-void* memcpy(void* dst, const void *src, size_t num_bytes) {
-	for(uint32_t i = 0; i < num_bytes; i++) {
-		*((int* ) dst+i) = *((int *) src+i);
+static void* heap_alloc(int32_t desiredBytes, uint32_t caller);
+
+// Heap of the current process (the whole of HeapMem for the base OS process)
+heap_t* getHeap(void) {
+	TCB_t *r = OS_get_current_TCB();
+	if(r && r->process) {
+		return &r->process->heap;
 	}
-	return dst;
+	return &BaseHeap;
 }
 
 void* malloc(size_t size) {
-	// Get current process heap, then pass to Heap_Malloc
-	return Heap_Malloc(size);
+	// Get current process heap, then allocate on behalf of our caller
+	return heap_alloc(size, HEAP_CALLER());
 }
 
 void free(void* ptr) {
@@ -123,52 +121,50 @@ void free(void* ptr) {
 
 
 
-//******** Heap_Init *************** 
-// Initialize the Heap
-// input: none
-// output: always 0
-// notes: Initializes/resets the heap to a clean state where no memory
-//  is allocated.
-int32_t Heap_Init(void){
-	uint32_t hs = getHeapSize();
-	int32_t* heap = (int32_t*) getHeapBase();
+// ******** region_format ************
+// Reset a region to a single free block
+static void region_format(heap_region_t *r) {
+	int32_t* blocks = (int32_t*) r->base;
 	
 	// set header and footer
-	heap[0] = 8-hs;
-	heap[hs/4-1] = 8-hs;
-	
-  return 0; 
+	blocks[0] = 8-r->size;
+	blocks[r->size/4-1] = 8-r->size;
 }
 
+// ******** region_is_empty ************
+// Output: 1 if the region is a single free block
+static int region_is_empty(heap_region_t *r) {
+	return *(int32_t*) r->base == 8-(int32_t)r->size;
+}
 
-//******** Heap_Malloc *************** 
-// Allocate memory, data not initialized
-// input: 
-//   desiredBytes: desired number of bytes to allocate
-// output: void* pointing to the allocated memory or will return NULL
-//   if there isn't sufficient space to satisfy allocation request
-void* Heap_Malloc(int32_t desiredBytes){
-	desiredBytes = (desiredBytes+3)/4 * 4; // Round up to nearest word
-	
-	int I = StartCritical();
-	uint32_t hs = getHeapSize();
-	void* heap = getHeapBase();
-	
-	void* currentBlock = heap;
+// ******** region_find ************
+// Output: region containing ptr, 0 if ptr is not in the heap
+static heap_region_t* region_find(heap_t *h, void *ptr) {
+	for(heap_region_t *r = h->regions; r != 0; r = r->next) {
+		if((int8_t*) ptr > r->base && (int8_t*) ptr < r->base + r->size) {
+			return r;
+		}
+	}
+	return 0;
+}
+
+// ******** region_malloc ************
+// First fit allocation of a word aligned number of bytes within one region
+static void* region_malloc(heap_region_t *r, int32_t desiredBytes) {
+	void* currentBlock = r->base;
 	
-	while(currentBlock - heap < hs) {
+	while(currentBlock - (void*) r->base < r->size) {
 		int32_t block_size = *((int32_t*) currentBlock);
 		
-		if(block_size < 0 && block_size == -1 * desiredBytes) {
+		if(block_size < 0 && -block_size >= desiredBytes && -block_size < desiredBytes + 12) {
 			// Large enough free block to allocate directly
-			*(int32_t *) currentBlock 			 					= desiredBytes;		// Allocated header
-			*(int32_t *)(currentBlock-block_size+4)   = desiredBytes;	// Fragment footer
-			
-			EndCritical(I);
+			// Note: Splitting would leave a fragment with no room for data, which could never be merged
+			*(int32_t *) currentBlock 			 					= -block_size;		// Allocated header
+			*(int32_t *)(currentBlock-block_size+4)   = -block_size;	// Fragment footer
 			return currentBlock+4;
 		}
 		
-		if(block_size < 0 && block_size + 8 <= -1 * desiredBytes) {
+		if(block_size < 0 && block_size + 12 <= -1 * desiredBytes) {
 			// Large enough free block to split and allocate
 			int32_t frag_size = block_size + desiredBytes + 8; // Size of the new block accounting for the new header and footer in the middle
 			
@@ -176,8 +172,6 @@ void* Heap_Malloc(int32_t desiredBytes){
 			*(int32_t *)(currentBlock+desiredBytes+4) = desiredBytes;		// Allocated footer
 			*(int32_t *)(currentBlock+desiredBytes+8) = frag_size;	// Frament header
 			*(int32_t *)(currentBlock-block_size+4)   = frag_size;	// Fragment footer
-			
-			EndCritical(I);
 			return currentBlock+4;
 		}
 		
@@ -188,11 +182,259 @@ void* Heap_Malloc(int32_t desiredBytes){
 			currentBlock += block_size + 8;
 		}
 	}
+	return 0;
+}
+
+// ******** region_free ************
+// Free a block and merge it with free neighbours within its region
+// Output: 0 if everything is ok, 1 if the block is corrupt or already free
+static int32_t region_free(heap_region_t *r, void* pointer) {
+	int32_t* block_header = (int32_t*) (pointer-4);
+	int32_t* block_footer = (int32_t*) (pointer + *block_header);
 	
-	EndCritical(I);
+	if(*block_header <= 0 || *block_header != *block_footer) {
+		return 1; // uh oh
+	}
+	
+	// Mark block as free
+	*block_footer *= -1;
+	*block_header *= -1;
+	
+	// Check to see if we can merge with the next and previous block (and also make sure they exist before doing so)
+	// Also reclaim space for header and footer
+	if(((int8_t*)block_header - r->base >= 8) 
+			&& *(block_header-1) < 0) {
+		// Merge
+		int32_t* new_header = block_header + *(block_header-1)/4 - 2;
+		
+		*new_header 	= *(block_header-1) + *(block_header)-8;
+		*block_footer = *(block_header-1) + *(block_header)-8;
+		
+		block_header = new_header;
+		
+	}
+	if(((int8_t*)block_footer - r->base + 8 < r->size) && *(block_footer+1) < 0) {
+		// Merge
+		int32_t* footer = block_footer - *(block_footer+1)/4 + 2;
+		
+		*block_header = *(block_footer) + *(block_footer+1)-8;
+		*footer 			= *(block_footer) + *(block_footer+1)-8;
+	}
 	return 0;
 }
 
+static void* heap_malloc(heap_t *h, int32_t desiredBytes, uint32_t caller, uint8_t flags);
+static int32_t heap_free(heap_t *h, void *pointer);
+
+// ******** heap_grow ************
+// Chain a new region, large enough for desiredBytes, allocated from the parent heap
+// Output: the new region, 0 if the heap can not grow
+static heap_region_t* heap_grow(heap_t *h, int32_t desiredBytes) {
+	if(!h->parent) {
+		return 0; // The base heap is fixed size
+	}
+	
+	uint32_t size = desiredBytes + 8;
+	if(size < PROCESS_HEAP_GROW_SIZE) {
+		size = PROCESS_HEAP_GROW_SIZE;
+	}
+	if(h->size + size > PROCESS_HEAP_MAX_SIZE) {
+		return 0;
+	}
+	
+	heap_region_t *r = heap_malloc(h->parent, sizeof(heap_region_t) + size, 0, HEAP_TAG_KERNEL);
+	if(!r) {
+		return 0;
+	}
+	r->size = size;
+	r->base = (int8_t*) (r+1);
+	region_format(r);
+	
+	// Append so that the original region is searched first
+	heap_region_t **tail = &h->regions;
+	while(*tail) {
+		tail = &(*tail)->next;
+	}
+	r->next = 0;
+	*tail = r;
+	h->size += size;
+	return r;
+}
+
+// ******** heap_shrink ************
+// Return a region to the parent heap if it is no longer used
+static void heap_shrink(heap_t *h, heap_region_t *r) {
+	if(r == h->regions || !region_is_empty(r)) {
+		return; // The first region holds the process for its lifetime
+	}
+	
+	heap_region_t **prev = &h->regions;
+	while(*prev != r) {
+		prev = &(*prev)->next;
+	}
+	*prev = r->next;
+	h->size -= r->size;
+	heap_free(h->parent, r);
+}
+
+// ******** heap_tag ************
+// Record the owner of a new block
+static void heap_tag(void *block, uint32_t caller, uint8_t flags) {
+#if HEAP_PROFILE
+	heap_tag_t *tag = block;
+	TCB_t *t = OS_get_current_TCB();
+	tag->tid = t ? t->id : 0;
+	tag->pid = (t && t->process) ? t->process->id : 0;
+	tag->flags = flags;
+	tag->pad = 0;
+	tag->caller = caller;
+	tag->time = OS_MsTime();
+#endif
+}
+
+// ******** heap_malloc ************
+// Search each region of a heap in turn, growing the heap if none have space
+// The block is tagged with the current thread and caller when profiling
+static void* heap_malloc(heap_t *h, int32_t desiredBytes, uint32_t caller, uint8_t flags) {
+	void *ptr = 0;
+	desiredBytes += HEAP_TAG_SIZE;
+	for(heap_region_t *r = h->regions; r != 0 && ptr == 0; r = r->next) {
+		ptr = region_malloc(r, desiredBytes);
+	}
+	
+	if(!ptr) {
+		heap_region_t *r = heap_grow(h, desiredBytes);
+		if(r) {
+			ptr = region_malloc(r, desiredBytes);
+		}
+	}
+	
+	if(ptr) {
+		h->used += *((int32_t*) ptr - 1);
+		if(h->used > h->peak) {
+			h->peak = h->used;
+		}
+		heap_tag(ptr, caller, flags);
+		ptr = (int8_t*) ptr + HEAP_TAG_SIZE;
+	}
+	return ptr;
+}
+
+// ******** heap_free ************
+static int32_t heap_free(heap_t *h, void *pointer) {
+	heap_region_t *r = region_find(h, pointer);
+	if(!r) {
+		return 1; // Not part of this heap
+	}
+	
+	pointer = (int8_t*) pointer - HEAP_TAG_SIZE;
+	int32_t size = *((int32_t*) pointer - 1);
+	if(region_free(r, pointer)) {
+		return 1;
+	}
+	h->used -= size;
+	heap_shrink(h, r);
+	return 0;
+}
+
+
+//******** Heap_Init *************** 
+// Initialize the Heap
+// input: none
+// output: always 0
+// notes: Initializes/resets the heap to a clean state where no memory
+//  is allocated.
+int32_t Heap_Init(void){
+	heap_t *h = getHeap();
+	heap_region_t *r = h->regions;
+	
+	// Drop every region but the first
+	while(r->next) {
+		heap_region_t *next = r->next->next;
+		h->size -= r->next->size;
+		heap_free(h->parent, r->next);
+		r->next = next;
+	}
+	
+	region_format(r);
+	h->used = 0;
+	h->peak = 0;
+  return 0; 
+}
+
+
+//******** Heap_CreateProcessHeap *************** 
+// Create a process heap, with a first region allocated from the current heap
+// input: 
+//   heap: heap to initialize
+//   initialBytes: size of the first region
+// output: 1 if successful, 0 if the parent heap is out of memory
+int32_t Heap_CreateProcessHeap(heap_t *heap, uint32_t initialBytes){
+	initialBytes = (initialBytes+3)/4 * 4;
+	
+	int I = StartCritical();
+	heap_t *parent = getHeap();
+	heap_region_t *r = heap_malloc(parent, sizeof(heap_region_t) + initialBytes, 0, HEAP_TAG_KERNEL);
+	if(!r) {
+		EndCritical(I);
+		return 0;
+	}
+	
+	r->next = 0;
+	r->size = initialBytes;
+	r->base = (int8_t*) (r+1);
+	region_format(r);
+	
+	heap->regions = r;
+	heap->parent = parent;
+	heap->size = initialBytes;
+	heap->used = 0;
+	heap->peak = 0;
+	EndCritical(I);
+	return 1;
+}
+
+
+//******** Heap_Destroy *************** 
+// Return every region of a process heap to its parent heap
+// input: heap created by Heap_CreateProcessHeap
+// output: none
+void Heap_Destroy(heap_t *heap){
+	int I = StartCritical();
+	heap_region_t *r = heap->regions;
+	while(r) {
+		heap_region_t *next = r->next;
+		heap_free(heap->parent, r);
+		r = next;
+	}
+	heap->regions = 0;
+	heap->size = 0;
+	heap->used = 0;
+	EndCritical(I);
+}
+
+
+//******** Heap_Malloc *************** 
+// Allocate memory, data not initialized
+// input: 
+//   desiredBytes: desired number of bytes to allocate
+// output: void* pointing to the allocated memory or will return NULL
+//   if there isn't sufficient space to satisfy allocation request
+void* Heap_Malloc(int32_t desiredBytes){
+	return heap_alloc(desiredBytes, HEAP_CALLER());
+}
+
+// ******** heap_alloc ************
+// Allocate from the current process heap on behalf of caller
+static void* heap_alloc(int32_t desiredBytes, uint32_t caller) {
+	desiredBytes = (desiredBytes+3)/4 * 4; // Round up to nearest word
+	
+	int I = StartCritical();
+	void *ptr = heap_malloc(getHeap(), desiredBytes, caller, 0);
+	EndCritical(I);
+	return ptr;
+}
+
 
 //******** Heap_Calloc *************** 
 // Allocate memory, data are initialized to 0
@@ -202,7 +444,7 @@ void* Heap_Malloc(int32_t desiredBytes){
 //   if there isn't sufficient space to satisfy allocation request
 //notes: the allocated memory block will be zeroed out
 void* Heap_Calloc(int32_t desiredBytes){  
-	void *ptr = Heap_Malloc(desiredBytes); // Alloc
+	void *ptr = heap_alloc(desiredBytes, HEAP_CALLER()); // Alloc
 	
 	if(ptr)
 		memset(ptr, 0, desiredBytes);
@@ -221,39 +463,55 @@ void* Heap_Calloc(int32_t desiredBytes){
 // notes: the given block may be unallocated and its contents
 //   are copied to a new block if growing/shrinking not possible
 void* Heap_Realloc(void* oldBlock, int32_t desiredBytes){
-	desiredBytes = (desiredBytes+3)/4 * 4;	// Round up to the nearest word
+	desiredBytes = (desiredBytes+3)/4 * 4 + HEAP_TAG_SIZE;	// Round up to the nearest word, the tag stays in place
 	void* ptr = 0;
 	
 	int I = StartCritical();
-	int32_t* block_header = (int32_t*) (oldBlock-4);
+	heap_t *h = getHeap();
+	heap_region_t *r = region_find(h, oldBlock);
+	if(!r) {
+		EndCritical(I);
+		return 0;
+	}
+	
+	int8_t* raw = (int8_t*) oldBlock - HEAP_TAG_SIZE;
+	int32_t* block_header = (int32_t*) (raw-4);
 	int32_t block_size = *block_header;
-	int32_t* nextBlockHeader = (int32_t*) (oldBlock + block_size + 4);
-	int32_t next_block_size = *nextBlockHeader;
+	int32_t* nextBlockHeader = (int32_t*) (raw + block_size + 4);
+	int32_t next_block_size = 0;	// Treat the end of the region as an allocated block
+	if((int8_t*) nextBlockHeader < r->base + r->size) {
+		next_block_size = *nextBlockHeader;
+	}
 	
 	if(desiredBytes > block_size) { // Potential for growth
 			
 			if(next_block_size < 0 && 															// Next Block Free
-				block_size - next_block_size  + 8 == desiredBytes) { 	// Account for the fact that we can remove the header and footer in the middle potentially
+				block_size - next_block_size  + 8 >= desiredBytes &&		// Account for the fact that we can remove the header and footer in the middle potentially
+				block_size - next_block_size < desiredBytes + 4) {			// Not enough left over for a fragment
 				// Merge both of these blocks together as one
-				*block_header = desiredBytes;
-				*(nextBlockHeader+next_block_size/4+1) 	= desiredBytes;
+				int32_t merged_size = block_size - next_block_size + 8;
+				*block_header = merged_size;
+				*(nextBlockHeader-next_block_size/4+1) 	= merged_size;
+				h->used += merged_size - block_size;
 				ptr = oldBlock;
 			}
 			else if (next_block_size < 0 &&
-				block_size-next_block_size >= desiredBytes) {
+				block_size-next_block_size >= desiredBytes + 4) {
 				// Next page is free and large enough to grow this sector instead of reallocating , but we still need the headers and footers
+				*(nextBlockHeader-next_block_size/4+1) 	= next_block_size-block_size + desiredBytes ; 	// Frag footer
 				*block_header 													= desiredBytes;								// Alloc header
 				*(block_header+desiredBytes/4+1)  			= desiredBytes; 							// Alloc footer
 				*(block_header+desiredBytes/4+2)  			= next_block_size-block_size + desiredBytes; 		// Frag header
-				*(nextBlockHeader+next_block_size/4+1) 	= next_block_size-block_size + desiredBytes ; 	// Frag footer
-				
+				h->used += desiredBytes - block_size;
 				ptr = oldBlock;
 				// Note: if the next block isnt free, then nextBlockHeader will be positive, and therefore the subtraction will be less than the desired bytes
 			}
 			else { // Alloc new block
-				ptr = Heap_Malloc(desiredBytes);
-				memcpy(ptr, oldBlock, block_size);
-				Heap_Free(oldBlock);
+				ptr = heap_malloc(h, desiredBytes - HEAP_TAG_SIZE, HEAP_CALLER(), 0);
+				if(ptr) {
+					memcpy((int8_t*) ptr - HEAP_TAG_SIZE, raw, block_size);	// Keeps the original tag
+					heap_free(h, oldBlock);
+				}
 			}
 	}
 	else if(desiredBytes < block_size - 8) {
@@ -261,17 +519,20 @@ void* Heap_Realloc(void* oldBlock, int32_t desiredBytes){
 		
 		*block_header 									= desiredBytes;								// Alloc header
 		*(block_header+desiredBytes/4+1)= desiredBytes; 							// Alloc footer
-		*(block_header+desiredBytes/4+2)= desiredBytes-block_size+8; 	// Frag header
-		*(block_header+block_size/4+1) 	= desiredBytes-block_size+8; 	// Frag footer
+		*(block_header+desiredBytes/4+2)= block_size-desiredBytes-8; 	// Frag header
+		*(block_header+block_size/4+1) 	= block_size-desiredBytes-8; 	// Frag footer
+		region_free(r, block_header+desiredBytes/4+3);								// Free the fragment, merging with the next block
+		h->used -= block_size - desiredBytes;
 		
 		ptr = oldBlock;
-	}	
-	
-	// if the desired bytes is exactly what we have allocated already then who cares
-	// Additionally, if we are shrinking, we need to insert a new header and footer
+	}
+	else {
+		// if the desired bytes is exactly what we have allocated already then who cares
+		ptr = oldBlock;
+	}
 	
 	EndCritical(I);
-  return ptr;   // NULL
+  return ptr;
 }
 
 
@@ -286,43 +547,86 @@ int32_t Heap_Free(void* pointer){
 		return 0; // Freeing null pointer OK
 	
 	int I = StartCritical();
+	int32_t status = heap_free(getHeap(), pointer);
+	EndCritical(I);
+  return status;
+}
+
+
+//******** Heap_KernelMalloc *************** 
+// Allocate from the base heap regardless of the running process,
+// for objects shared by every process (e.g. file system state)
+// input: desired number of bytes to allocate
+// output: void* pointing to the allocated memory or NULL
+// notes: the block is tagged HEAP_TAG_KERNEL so it is never reclaimed from a thread
+void* Heap_KernelMalloc(int32_t desiredBytes){
+	desiredBytes = (desiredBytes+3)/4 * 4;
 	
-	uint32_t hs = getHeapSize();
-	int8_t* heap = getHeapBase();
-	int32_t* block_header = (int32_t*) (pointer-4);
-	int32_t* block_footer = (int32_t*) (pointer + *block_header);
-	
-	if(*block_header != *block_footer) {
-		EndCritical(I);
-		return 1; // uh oh
-	}
+	int I = StartCritical();
+	void *ptr = heap_malloc(&BaseHeap, desiredBytes, HEAP_CALLER(), HEAP_TAG_KERNEL);
+	EndCritical(I);
+	return ptr;
+}
+
+
+//******** Heap_KernelFree *************** 
+// return a block allocated with Heap_KernelMalloc
+// input: pointer to memory to unallocate
+// output: 0 if everything is ok, non-zero in case of error
+int32_t Heap_KernelFree(void* pointer){
+	if(!pointer) 
+		return 0;
 	
-	// Mark block as free
-	*block_footer *= -1;
-	*block_header *= -1;
+	int I = StartCritical();
+	int32_t status = heap_free(&BaseHeap, pointer);
+	EndCritical(I);
+  return status;
+}
+
+
+//******** Heap_StatsOf *************** 
+// return the current status of a given heap
+// input: heap to walk, reference to a heap_stats_t that returns the current usage of the heap
+// output: 0 in case of success, non-zeror in case of error (e.g. corrupted heap)
+int32_t Heap_StatsOf(heap_t *h, heap_stats_t *stats){
+	int I = StartCritical();
 	
+	stats->size = 0;
+	stats->free = 0;
+	stats->used = 0;
+	stats->peak = h->peak;
+	stats->regions = 0;
 	
-	// Check to see if we can merge with the next and previous block (and also make sure they exist before doing so)
-	// Also reclaim space for header and footer
-	if(((int8_t*)block_header - heap >= 8) 
-			&& *(block_header-1) < 0) {
-		// Merge
-		int32_t* new_header = block_header + *(block_header-1)/4 - 2;
+	// Go through every region of the heap
+	for(heap_region_t *r = h->regions; r != 0; r = r->next) {
+		int8_t* currentBlock = r->base;
+		stats->size += r->size;
+		stats->regions++;
 		
-		*new_header 	= *(block_header-1) + *(block_header)-8;
-		*block_footer = *(block_header-1) + *(block_header)-8;
-		
-		block_header = new_header;
-		
-	}
-	if(((int8_t*)block_footer - heap + 8 < hs) && *(block_footer+1) < 0) {
-		// Merge
-		int32_t* footer = block_footer - *(block_footer+1)/4 + 2;
-		
-		*block_header = *(block_footer) + *(block_footer+1)-8;
-		*footer 			= *(block_footer) + *(block_footer+1)-8;
+		while(currentBlock - r->base < r->size) {
+			int32_t n_bytes = *((int32_t*) currentBlock);
+			
+			if(n_bytes < 0) {
+				// Block is free
+				n_bytes *= -1;
+				stats->free += n_bytes; 
+			}
+			else {
+				// Block is used
+				stats->used += n_bytes; 
+			}
+			
+			// Check that the footer matches the header
+			int32_t check = *((int32_t*) (currentBlock+4+n_bytes));
+			if(check < 0) check *= -1;
+			if(check != n_bytes) {
+				EndCritical(I);
+				return 1;
+			}
+			
+			currentBlock += n_bytes+8; // Account for header / footer
+		}
 	}
-	
 	EndCritical(I);
   return 0;
 }
@@ -333,40 +637,161 @@ int32_t Heap_Free(void* pointer){
 // input: reference to a heap_stats_t that returns the current usage of the heap
 // output: 0 in case of success, non-zeror in case of error (e.g. corrupted heap)
 int32_t Heap_Stats(heap_stats_t *stats){
-	int I = StartCritical();
-	uint32_t hs = getHeapSize();
-	int8_t* heap = getHeapBase();
-	
-	stats->size = hs;
-	stats->free = 0;
-	stats->used = 0;
-	int8_t* currentBlock = heap;
-	
+	return Heap_StatsOf(getHeap(), stats);
+}
+
+
+//******** Heap_Profile *************** 
+// Summarize free space and, when profiling, live bytes per owner and call site
+// input: heap to walk, reference to a heap_profile_t to fill in
+// output: 0 in case of success, non-zero in case of error (e.g. corrupted heap)
+int32_t Heap_Profile(heap_t *h, heap_profile_t *p){
+	memset(p, 0, sizeof(heap_profile_t));
 	
-	// Go through the whole heap
-	while(currentBlock - heap < hs) {
-		int32_t n_bytes = *((int32_t*) currentBlock);
+	int I = StartCritical();
+	for(heap_region_t *r = h->regions; r != 0; r = r->next) {
+		int8_t* currentBlock = r->base;
 		
-		if(n_bytes < 0) {
-			// Block is free
-			n_bytes *= -1;
-			stats->free += n_bytes; 
+		while(currentBlock - r->base < r->size) {
+			int32_t n_bytes = *((int32_t*) currentBlock);
+			
+			if(n_bytes < 0) {
+				n_bytes *= -1;
+				p->free += n_bytes;
+				p->free_blocks++;
+				if(n_bytes - HEAP_TAG_SIZE > (int32_t) p->largest_free) {
+					p->largest_free = n_bytes - HEAP_TAG_SIZE;
+				}
+			}
+			else {
+				p->used_blocks++;
+#if HEAP_PROFILE
+				heap_tag_t *tag = (heap_tag_t*) (currentBlock+4);
+				uint32_t i;
+				
+				// Owner
+				for(i = 0; i < p->num_owners; i++) {
+					if(p->owners[i].tid == tag->tid && p->owners[i].pid == tag->pid) break;
+				}
+				if(i == p->num_owners && i < HEAP_PROFILE_OWNERS) {
+					p->owners[i].tid = tag->tid;
+					p->owners[i].pid = tag->pid;
+					p->num_owners++;
+				}
+				if(i < p->num_owners) {
+					p->owners[i].bytes += n_bytes;
+					p->owners[i].blocks++;
+				}
+				else {
+					p->other_bytes += n_bytes;
+				}
+				
+				// Call site, replacing the smallest site when the table is full
+				for(i = 0; i < p->num_sites; i++) {
+					if(p->sites[i].caller == tag->caller) break;
+				}
+				if(i == p->num_sites) {
+					if(p->num_sites < HEAP_PROFILE_SITES) {
+						p->num_sites++;
+					}
+					else {
+						uint32_t smallest = 0;
+						for(uint32_t j = 1; j < HEAP_PROFILE_SITES; j++) {
+							if(p->sites[j].bytes < p->sites[smallest].bytes) smallest = j;
+						}
+						i = p->sites[smallest].bytes < n_bytes ? smallest : HEAP_PROFILE_SITES;
+					}
+					if(i < HEAP_PROFILE_SITES) {
+						p->sites[i].caller = tag->caller;
+						p->sites[i].bytes = 0;
+						p->sites[i].blocks = 0;
+						p->sites[i].oldest = tag->time;
+					}
+				}
+				if(i < HEAP_PROFILE_SITES) {
+					p->sites[i].bytes += n_bytes;
+					p->sites[i].blocks++;
+					if((int32_t)(tag->time - p->sites[i].oldest) < 0) {
+						p->sites[i].oldest = tag->time;
+					}
+				}
+#endif
+			}
+			
+			int32_t check = *((int32_t*) (currentBlock+4+n_bytes));
+			if(check < 0) check *= -1;
+			if(check != n_bytes) {
+				EndCritical(I);
+				return 1;
+			}
+			currentBlock += n_bytes+8;
 		}
-		else {
-			// Block is used
-			stats->used += n_bytes; 
+	}
+	EndCritical(I);
+	
+	// Largest site first
+	for(uint32_t i = 1; i < p->num_sites; i++) {
+		heap_site_t site = p->sites[i];
+		uint32_t j = i;
+		for(; j > 0 && p->sites[j-1].bytes < site.bytes; j--) {
+			p->sites[j] = p->sites[j-1];
 		}
+		p->sites[j] = site;
+	}
+	return 0;
+}
+
+
+//******** Heap_SetOwner *************** 
+// Change the owner recorded for a block
+// input: block returned by malloc, new owning thread and process, HEAP_TAG_* flags
+// output: none
+void Heap_SetOwner(void *pointer, uint8_t tid, uint8_t pid, uint8_t flags){
+#if HEAP_PROFILE
+	if(!pointer) {
+		return;
+	}
+	heap_tag_t *tag = (heap_tag_t*) ((int8_t*) pointer - HEAP_TAG_SIZE);
+	tag->tid = tid;
+	tag->pid = pid;
+	tag->flags = flags;
+#endif
+}
+
+
+//******** Heap_ReclaimThread *************** 
+// Free every block of a heap still owned by a thread
+// input: heap to search, id of the thread
+// output: number of bytes reclaimed
+uint32_t Heap_ReclaimThread(heap_t *h, uint8_t tid){
+	uint32_t reclaimed = 0;
+#if HEAP_PROFILE
+	int I = StartCritical();
+	
+	// Freeing merges blocks and may release regions, so restart the walk after each free
+	for(heap_region_t *r = h->regions; r != 0; ) {
+		int8_t* currentBlock = r->base;
+		int8_t found = 0;
 		
-		// Check that the footer matches the header
-		int32_t check = *((int32_t*) (currentBlock+4+n_bytes));
-		if(check < 0) check *= -1;
-		if(check != n_bytes) {
-			EndCritical(I);
-			return 1;
+		while(currentBlock - r->base < r->size) {
+			int32_t n_bytes = *((int32_t*) currentBlock);
+			if(n_bytes > 0) {
+				heap_tag_t *tag = (heap_tag_t*) (currentBlock+4);
+				if(tag->tid == tid && !(tag->flags & HEAP_TAG_KERNEL)) {
+					heap_free(h, currentBlock+4+HEAP_TAG_SIZE);
+					reclaimed += n_bytes;
+					found = 1;
+					break;
+				}
+				currentBlock += n_bytes+8;
+			}
+			else {
+				currentBlock += 8-n_bytes;
+			}
 		}
-		
-		currentBlock += n_bytes+8; // Account for header / footer
+		r = found ? h->regions : r->next;
 	}
 	EndCritical(I);
-  return 0;
+#endif
+	return reclaimed;
 }
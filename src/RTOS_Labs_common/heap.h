@@ -16,7 +16,22 @@
 // Note [1]: the real heap size is defined in startup.s. These must match
 // Note [2]: This is the total heap space in RAM. Process heaps are virtual heaps allocated within the main heap
 #define HEAP_SIZE 12288
-#define PROCESS_HEAP_SIZE 2048
+
+// Process heaps are a chain of regions allocated from the parent heap.
+// The first region holds the initial stack plus PROCESS_HEAP_SIZE bytes,
+// further regions of at least PROCESS_HEAP_GROW_SIZE are added on demand
+// and returned to the parent once they are entirely free.
+#define PROCESS_HEAP_SIZE 256
+#define PROCESS_HEAP_GROW_SIZE 512
+#define PROCESS_HEAP_MAX_SIZE 8192
+
+// Allocation profiling. Each block carries a heap_tag_t (12 bytes) recording who allocated it,
+// which Heap_Profile summarizes per owner and per call site.
+// With HEAP_RECLAIM_ON_KILL, OS_Kill frees every block still owned by the dying thread
+#define HEAP_PROFILE 0
+#define HEAP_RECLAIM_ON_KILL 1
+#define HEAP_PROFILE_SITES 8			// Call sites reported by Heap_Profile (largest first)
+#define HEAP_PROFILE_OWNERS 12		// Threads reported by Heap_Profile
 
 // Corresponds to an order of 0
 // #define BASE_ORDER_BYTES 64
@@ -28,13 +43,68 @@ typedef struct heap_stats {
   uint32_t size;   // heap size (in bytes)
   uint32_t used;   // number of bytes used/allocated
   uint32_t free;   // number of bytes available to allocate
+  uint32_t peak;   // high water mark of used
+  uint32_t regions; // number of regions making up the heap
 } heap_stats_t;
 
+// Contiguous piece of a heap. For process heaps this struct sits at the start
+// of a block allocated from the parent heap, followed by the block space
+typedef struct heap_region {
+	struct heap_region *next;	// Next region in the chain
+	uint32_t size;						// Size of the block space (in bytes)
+	int8_t* base;							// First block header
+} heap_region_t;
+
 typedef struct heap {
-	uint32_t* base;	// Base pointer to the heap
-	uint32_t size;	// heap size (in bytes)
+	heap_region_t *regions;		// Chain of regions, the first is never released
+	struct heap *parent;			// Heap which regions are grown from (0 for the base heap)
+	uint32_t size;						// Total size of all regions (in bytes)
+	uint32_t used;						// Bytes currently allocated
+	uint32_t peak;						// High water mark of used
 } heap_t;
 
+// Tag at the start of every allocated block when HEAP_PROFILE is set
+typedef struct heap_tag {
+	uint8_t tid;			// Owning thread (0 before OS_Launch)
+	uint8_t pid;			// Owning process (0 for the base OS process)
+	uint8_t flags;		// HEAP_TAG_*
+	uint8_t pad;
+	uint32_t caller;	// Return address of the malloc call
+	uint32_t time;		// OS_MsTime at allocation
+} heap_tag_t;
+
+#define HEAP_TAG_KERNEL 0x01	// Freed by the kernel (stacks, PCBs, process images), never reclaimed
+
+typedef struct heap_site {
+	uint32_t caller;
+	uint32_t bytes;
+	uint32_t blocks;
+	uint32_t oldest;	// OS_MsTime of the oldest live block
+} heap_site_t;
+
+typedef struct heap_owner {
+	uint8_t tid;
+	uint8_t pid;
+	uint16_t blocks;
+	uint32_t bytes;
+} heap_owner_t;
+
+// Snapshot of a heap built by Heap_Profile
+typedef struct heap_profile {
+	uint32_t used_blocks;
+	uint32_t free_blocks;
+	uint32_t largest_free;	// Largest allocation that can succeed without growing the heap
+	uint32_t free;
+	// Only filled in when HEAP_PROFILE is set
+	heap_owner_t owners[HEAP_PROFILE_OWNERS];
+	uint32_t num_owners;
+	uint32_t other_bytes;		// Live bytes of owners which did not fit in owners[]
+	heap_site_t sites[HEAP_PROFILE_SITES];	// Sorted by bytes, largest first
+	uint32_t num_sites;
+} heap_profile_t;
+
+extern heap_t BaseHeap;
+
 /**
  * @details Initialize the Heap
  * @param  none
@@ -45,6 +115,26 @@ typedef struct heap {
 int32_t Heap_Init(void);
 
 
+/**
+ * @details Create a process heap, with a first region allocated from the
+ *          current heap. The current heap becomes the parent used for growth.
+ * @param  heap: heap to initialize
+ * @param  initialBytes: size of the first region
+ * @return 1 if successful, 0 if the parent heap is out of memory
+ * @brief  Create a growable process heap
+ */
+int32_t Heap_CreateProcessHeap(heap_t *heap, uint32_t initialBytes);
+
+
+/**
+ * @details Return every region of a process heap to its parent heap
+ * @param  heap: heap created by Heap_CreateProcessHeap
+ * @return none
+ * @brief  Destroy a process heap
+ */
+void Heap_Destroy(heap_t *heap);
+
+
 /**
  * @details Allocate memory, data not initialized
  * @param  desiredBytes: desired number of bytes to allocate
@@ -87,6 +177,26 @@ void* Heap_Realloc(void* oldBlock, int32_t desiredBytes);
 int32_t Heap_Free(void* pointer);
 
 
+/**
+ * @details Allocate from the base heap regardless of the running process.
+ *          For objects shared between processes, which must outlive the
+ *          process that happened to allocate them. Tagged HEAP_TAG_KERNEL
+ * @param  desiredBytes: desired number of bytes to allocate
+ * @return void* pointing to the allocated memory or NULL
+ * @brief  Allocate kernel memory
+ */
+void* Heap_KernelMalloc(int32_t desiredBytes);
+
+
+/**
+ * @details Return a block allocated with Heap_KernelMalloc
+ * @param  pointer to memory to unallocate
+ * @return 0 if everything is ok, non-zero in case of error
+ * @brief  Free kernel memory
+ */
+int32_t Heap_KernelFree(void* pointer);
+
+
 /**
  * @details Return the current usage status of the heap
  * @param  reference to a heap_stats_t that returns the current usage of the heap
@@ -96,4 +206,49 @@ int32_t Heap_Free(void* pointer);
 int32_t Heap_Stats(heap_stats_t *stats);
 
 
+/**
+ * @details Return the usage status of any heap (e.g. another process heap)
+ * @param  heap: heap to walk
+ * @param  reference to a heap_stats_t that returns the current usage of the heap
+ * @return 0 in case of success, non-zeror in case of error (e.g. corrupted heap)
+ * @brief  Get heap usage of a given heap
+ */
+int32_t Heap_StatsOf(heap_t *heap, heap_stats_t *stats);
+
+
+/**
+ * @details Summarize a heap: free space fragmentation, and with HEAP_PROFILE
+ *          the live bytes per owning thread and the largest call sites.
+ *          When more sites are live than fit, small sites may be dropped.
+ * @param  heap: heap to walk
+ * @param  profile: filled in with the summary
+ * @return 0 in case of success, non-zero in case of error (e.g. corrupted heap)
+ * @brief  Profile heap usage
+ */
+int32_t Heap_Profile(heap_t *heap, heap_profile_t *profile);
+
+
+/**
+ * @details Change the owner recorded for a block, e.g. to give a stack
+ *          allocated by the parent thread to the new thread. No-op without HEAP_PROFILE
+ * @param  pointer: block returned by malloc
+ * @param  tid, pid: new owner
+ * @param  flags: HEAP_TAG_* flags
+ * @return none
+ * @brief  Retag a block
+ */
+void Heap_SetOwner(void *pointer, uint8_t tid, uint8_t pid, uint8_t flags);
+
+
+/**
+ * @details Free every block in a heap still owned by a thread,
+ *          except those tagged HEAP_TAG_KERNEL. Requires HEAP_PROFILE
+ * @param  heap: heap to search
+ * @param  tid: thread whose blocks are freed
+ * @return number of bytes reclaimed
+ * @brief  Reclaim leaked blocks
+ */
+uint32_t Heap_ReclaimThread(heap_t *heap, uint8_t tid);
+
+
 #endif //#ifndef HEAP_H
@@ -0,0 +1,226 @@
+// ************************** memlib.c **************************
+// Word-at-a-time memcpy/memmove/memset/strcmp/strcpy for the Cortex-M4
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	These replace the C library versions (the linker prefers an object file over the library).
+
+	Bulk copies run on aligned words, 16 bytes per iteration so the compiler emits LDM/STM.
+	When src and dst have different alignments, dst is aligned and each output word is
+	merged from two aligned source loads, so no unaligned access is ever made.
+	The string functions scan a word at a time using the "has zero byte" test
+			(w - 0x01010101) & ~w & 0x80808080
+	and drop to bytes only for the word that ends the string.
+
+	NOTE: The byte loops must not be compiled into calls to memset/memcpy (gcc does this
+				at -O2 unless -fno-tree-loop-distribute-patterns is given). Keil does not.
+
+	Defining MEMLIB_NAME(f) renames the functions so they can be benchmarked against
+	another implementation on a host (see tools/membench.c).
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef MEMLIB_NAME
+#define MEMLIB_NAME(f) f
+#include <string.h>
+#endif
+
+#define ONES  0x01010101UL
+#define HIGHS 0x80808080UL
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
+// Little endian merge of two aligned source words, off is the byte offset of src (1-3)
+#define MERGE(lo, hi, off) (((lo) >> (8*(off))) | ((hi) << (32 - 8*(off))))
+
+
+// ******** copy_fwd ***********
+// Forward copy, dst and src may overlap only if dst < src
+static void copy_fwd(uint8_t *d, const uint8_t *s, size_t n) {
+	if(n >= 8) {
+		// Head: align dst
+		while((uintptr_t)d & 3) {
+			*d++ = *s++;
+			n--;
+		}
+
+		uint32_t *dw = (uint32_t *)d;
+		uint32_t off = (uintptr_t)s & 3;
+		if(off == 0) {
+			const uint32_t *sw = (const uint32_t *)s;
+			while(n >= 16) {
+				uint32_t a = sw[0], b = sw[1], c = sw[2], e = sw[3];
+				dw[0] = a; dw[1] = b; dw[2] = c; dw[3] = e;
+				dw += 4; sw += 4; n -= 16;
+			}
+			while(n >= 4) {
+				*dw++ = *sw++;
+				n -= 4;
+			}
+			s = (const uint8_t *)sw;
+		}
+		else {
+			// Aligned loads never cross into an unmapped word past the end of src
+			const uint32_t *sw = (const uint32_t *)(s - off);
+			uint32_t lo = *sw++;
+			while(n >= 4) {
+				uint32_t hi = *sw++;
+				*dw++ = MERGE(lo, hi, off);
+				lo = hi;
+				n -= 4;
+			}
+			s = (const uint8_t *)sw - 4 + off;
+		}
+		d = (uint8_t *)dw;
+	}
+
+	// Tail
+	while(n--) {
+		*d++ = *s++;
+	}
+}
+
+// ******** copy_bwd ***********
+// Backward copy for overlapping regions with dst > src
+static void copy_bwd(uint8_t *d, const uint8_t *s, size_t n) {
+	d += n;
+	s += n;
+	if(n >= 8 && (((uintptr_t)d ^ (uintptr_t)s) & 3) == 0) {
+		while((uintptr_t)d & 3) {
+			*--d = *--s;
+			n--;
+		}
+		uint32_t *dw = (uint32_t *)d;
+		const uint32_t *sw = (const uint32_t *)s;
+		while(n >= 16) {
+			uint32_t a = sw[-1], b = sw[-2], c = sw[-3], e = sw[-4];
+			dw[-1] = a; dw[-2] = b; dw[-3] = c; dw[-4] = e;
+			dw -= 4; sw -= 4; n -= 16;
+		}
+		while(n >= 4) {
+			*--dw = *--sw;
+			n -= 4;
+		}
+		d = (uint8_t *)dw;
+		s = (const uint8_t *)sw;
+	}
+
+	while(n--) {
+		*--d = *--s;
+	}
+}
+
+
+//******** memcpy ***************
+// Copy num_bytes from src to dst, regions must not overlap
+// Inputs: destination, source, number of bytes
+// Outputs: dst
+void* MEMLIB_NAME(memcpy)(void *dst, const void *src, size_t num_bytes) {
+	copy_fwd((uint8_t *)dst, (const uint8_t *)src, num_bytes);
+	return dst;
+}
+
+//******** memmove ***************
+// Copy num_bytes from src to dst, regions may overlap
+// Inputs: destination, source, number of bytes
+// Outputs: dst
+void* MEMLIB_NAME(memmove)(void *dst, const void *src, size_t num_bytes) {
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+	if(d == s || num_bytes == 0) {
+		return dst;
+	}
+	if(d < s || d >= s + num_bytes) {
+		copy_fwd(d, s, num_bytes);
+	}
+	else {
+		copy_bwd(d, s, num_bytes);
+	}
+	return dst;
+}
+
+//******** memset ***************
+// Fill num_bytes of dst with the byte v
+// Inputs: destination, fill value (low byte used), number of bytes
+// Outputs: dst
+void* MEMLIB_NAME(memset)(void *dst, int v, size_t num_bytes) {
+	uint8_t *d = (uint8_t *)dst;
+	uint8_t b = (uint8_t)v;
+
+	if(num_bytes >= 8) {
+		while((uintptr_t)d & 3) {
+			*d++ = b;
+			num_bytes--;
+		}
+		uint32_t w = b * ONES;
+		uint32_t *dw = (uint32_t *)d;
+		while(num_bytes >= 16) {
+			dw[0] = w; dw[1] = w; dw[2] = w; dw[3] = w;
+			dw += 4;
+			num_bytes -= 16;
+		}
+		while(num_bytes >= 4) {
+			*dw++ = w;
+			num_bytes -= 4;
+		}
+		d = (uint8_t *)dw;
+	}
+
+	while(num_bytes--) {
+		*d++ = b;
+	}
+	return dst;
+}
+
+//******** strcmp ***************
+// Compare two null terminated strings
+// Inputs: two strings
+// Outputs: <0, 0, >0 as s1 sorts before, equal to or after s2
+int MEMLIB_NAME(strcmp)(const char *s1, const char *s2) {
+	const uint8_t *a = (const uint8_t *)s1;
+	const uint8_t *b = (const uint8_t *)s2;
+
+	if((((uintptr_t)a | (uintptr_t)b) & 3) == 0) {
+		const uint32_t *aw = (const uint32_t *)a;
+		const uint32_t *bw = (const uint32_t *)b;
+		// Stop at the first word which differs or holds the terminator
+		while(*aw == *bw && !HAS_ZERO(*aw)) {
+			aw++;
+			bw++;
+		}
+		a = (const uint8_t *)aw;
+		b = (const uint8_t *)bw;
+	}
+
+	while(*a && *a == *b) {
+		a++;
+		b++;
+	}
+	return *a - *b;
+}
+
+//******** strcpy ***************
+// Copy a null terminated string, including the terminator
+// Inputs: destination, source
+// Outputs: dst
+char* MEMLIB_NAME(strcpy)(char *dst, const char *src) {
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+
+	if((((uintptr_t)d | (uintptr_t)s) & 3) == 0) {
+		uint32_t *dw = (uint32_t *)d;
+		const uint32_t *sw = (const uint32_t *)s;
+		// Aligned loads stay inside the word holding the terminator
+		while(!HAS_ZERO(*sw)) {
+			*dw++ = *sw++;
+		}
+		d = (uint8_t *)dw;
+		s = (const uint8_t *)sw;
+	}
+
+	while((*d++ = *s++) != 0) {}
+	return dst;
+}
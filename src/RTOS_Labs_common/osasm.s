@@ -199,39 +199,12 @@ PendSV_exit
 ;           The function ID to call is encoded in the instruction itself, the location of which can be
 ;           found relative to the return address saved on the stack on exception entry.
 ;           Function-call paramters in R0..R3 are also auto-saved on stack on exception entry.
+;           Dispatch is a bounds checked jump through SVC_Table (OS.c), indexed by the SVC number.
+;           The numbering is shared with the user stubs through svc.h.
 ;********************************************************************************************************
 
-        IMPORT    OS_Id
-        IMPORT    OS_Kill
-        IMPORT    OS_Sleep
-        IMPORT    OS_Time
-        IMPORT    OS_AddThread
-		IMPORT 	  OS_InitSemaphore
-		IMPORT	  OS_Wait
-		IMPORT OS_Signal
-		IMPORT OS_bWait
-		IMPORT OS_bSignal
-		IMPORT OS_AddPeriodicThread
-		IMPORT OS_AddSW1Task
-		IMPORT OS_AddSW2Task
-		IMPORT OS_Suspend
-		IMPORT OS_LockScheduler
-		IMPORT OS_UnLockScheduler
-		IMPORT OS_Fifo_Init
-		IMPORT OS_Fifo_Get
-		IMPORT OS_Fifo_Put
-		IMPORT OS_Fifo_Size
-		IMPORT OS_MailBox_Init
-		IMPORT OS_MailBox_Send
-		IMPORT OS_MailBox_Recv
-		IMPORT OS_TimeDifference
-		IMPORT OS_ClearMsTime
-		IMPORT OS_MsTime
-;		IMPORT OS_RedirectToFile
-;		IMPORT OS_EndRedirectToFile
-;		IMPORT OS_RedirectToUART
-;		IMPORT OS_RedirectToST7735
-		IMPORT OS_AddProcess
+		IMPORT SVC_Table
+		IMPORT SVC_TableSize
 			
 SVC_Handler
 ; put your Lab 5 code here
@@ -240,114 +213,29 @@ SVC_Handler
 	PUSH {R4}
 	MOV R4, R2
 
-	LDR R12, [R4, #24]
-	LDRH R12, [R12, #-2]
-	BIC R12, #0xFF00
+	LDR R12, [R4, #24]		; Stacked PC points after the SVC instruction
+	LDRB R12, [R12, #-2]	; SVC number is the low byte of the instruction
+	
+	LDR R0, =SVC_TableSize	; R0-R3 are reloaded from the stack below, use them as scratch
+	LDR R0, [R0]
+	CMP R12, R0
+	BHS svc_nosys			; Out of range (unsigned compare)
+	LDR R0, =SVC_Table
+	LDR R12, [R0, R12, LSL #2]
+	CMP R12, #0
+	BEQ svc_nosys			; Not implemented in this build
+	
 	LDM R4, {R0-R3}
 	SUBS R4, R4, #0x4 
 	STM R4, {LR} 
 	LDR LR, =svc_done
+	BX R12					; Handler returns to svc_done
 	
-	;
-	; ADD R12, R12, PC
-	; MOV PC, R12
-	
-	CMP R12, #0
-	BEQ OS_Id
-	
-	CMP R12, #1
-	BEQ OS_Kill
-	
-	CMP R12, #2
-	BEQ OS_Sleep
-	
-	CMP R12, #3
-	BEQ OS_Time
-	
-	CMP R12, #4
-	BEQ OS_AddThread
-	
-	CMP R12, #5
-	BEQ ContextSwitch
-	
-	CMP R12, #6
-	BEQ OS_InitSemaphore
-	
-	CMP R12, #7
-	BEQ OS_Wait
-	
-	CMP R12, #8
-	BEQ OS_Signal
-	
-	CMP R12, #9
-	BEQ OS_bWait
-	
-	CMP R12, #10
-	BEQ OS_bSignal
-	
-	CMP R12, #11
-	BEQ OS_AddPeriodicThread
-
-	CMP R12, #12
-	BEQ OS_AddSW1Task
-
-	CMP R12, #13
-	BEQ OS_AddSW2Task
-	
-	CMP R12, #14
-	BEQ OS_Suspend
-
-	CMP R12, #15
-	BEQ OS_LockScheduler
-
-	CMP R12, #16
-	BEQ OS_UnLockScheduler
-	
-	CMP R12, #17
-	BEQ OS_Fifo_Init
-	
-	CMP R12, #18
-	BEQ OS_Fifo_Put
-	
-	CMP R12, #19
-	BEQ OS_Fifo_Get
-
-	CMP R12, #20
-	BEQ OS_Fifo_Size
-	
-	CMP R12, #21
-	BEQ OS_MailBox_Init
-	
-	CMP R12, #22
-	BEQ OS_MailBox_Send
-	
-	CMP R12, #23
-	BEQ OS_MailBox_Recv
-	
-	CMP R12, #24
-	BEQ OS_TimeDifference
-	
-	CMP R12, #25
-	BEQ OS_ClearMsTime
-	
-	CMP R12, #26
-	BEQ OS_MsTime
-	
-;	CMP R12, #27
-;	BEQ OS_RedirectToFile
-;	
-;	CMP R12, #28
-;	BEQ OS_EndRedirectToFile
-;	
-;	CMP R12, #29
-;	BEQ OS_RedirectToUART
-;	
-;	CMP R12, #30
-;	BEQ OS_RedirectToST7735
-	
-	CMP R12, #31
-	BEQ OS_AddProcess
-	
+svc_nosys
+	MVN R0, #0				; SVC_ENOSYS
+	STR R0, [R4]
+	POP {R4}
+	BX LR
 	
 svc_done
 	LDM R4, {LR}
@@ -0,0 +1,104 @@
+// ************************** crcbench.c **************************
+// Host benchmark of the metadata checksum (RTOS_Lab4_FileSystem/CRC32.c)
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	Build and run (from src/tools):
+		gcc -O2 -Wall -I.. -o crcbench crcbench.c ../RTOS_Lab4_FileSystem/CRC32.c
+		./crcbench
+
+	Checks CRC32 against the standard check value and a bytewise CRC-32 over random
+	lengths and alignments, then times 512 byte blocks with the bytewise table loop, the
+	word FNV-1a sum the journal used before, and slicing-by-4. Host numbers are only
+	relative; on the board a block is ~550us of SPI, so a checksum costs a few percent
+	of the transfer either way (Lab4.c TestCRC times it on the TM4C123).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../RTOS_Lab4_FileSystem/CRC32.h"
+
+#define BLOCK_SIZE 512
+#define BLOCKS 2048
+#define RUNS 200
+
+static uint32_t data[BLOCKS * BLOCK_SIZE / 4];
+static uint32_t byte_table[256];
+
+static void byte_init(void) {
+	for(uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for(int k = 0; k < 8; k++) {
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+		}
+		byte_table[i] = c;
+	}
+}
+
+// ******** crc_bytewise ***********
+// One table lookup per byte
+static uint32_t crc_bytewise(uint32_t crc, const void *buff, uint32_t len) {
+	const uint8_t *p = buff;
+	crc = ~crc;
+	while(len--) {
+		crc = byte_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// ******** fnv_words ***********
+// The old journal block sum
+static uint32_t fnv_words(uint32_t h, const void *buff, uint32_t len) {
+	const uint32_t *w = buff;
+	h = 2166136261u;
+	for(uint32_t i = 0; i < len/4; i++) {
+		h = (h ^ w[i]) * 16777619u;
+	}
+	return h;
+}
+
+static int verify(void) {
+	int ok = CRC32(0, "123456789", 9) == 0xCBF43926u;
+	const uint8_t *bytes = (const uint8_t *) data;
+	for(int i = 0; i < 10000 && ok; i++) {
+		uint32_t off = rand() % 64;
+		uint32_t len = rand() % 2048;
+		uint32_t split = len ? rand() % len : 0;
+		uint32_t whole = CRC32(0, &bytes[off], len);
+		ok = whole == crc_bytewise(0, &bytes[off], len) &&
+			whole == CRC32(CRC32(0, &bytes[off], split), &bytes[off + split], len - split);
+	}
+	return ok;
+}
+
+static void bench(const char *name, uint32_t (*sum)(uint32_t, const void *, uint32_t)) {
+	volatile uint32_t sink = 0;
+	clock_t start = clock();
+	for(int run = 0; run < RUNS; run++) {
+		for(uint32_t b = 0; b < BLOCKS; b++) {
+			sink += sum(0, &data[b * BLOCK_SIZE / 4], BLOCK_SIZE);
+		}
+	}
+	double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+	double blocks = (double) BLOCKS * RUNS;
+	printf("%-14s %8.1f MB/s  %7.3f us per block\n",
+		name, blocks * BLOCK_SIZE / (1024*1024) / s, s * 1e6 / blocks);
+}
+
+int main(void) {
+	byte_init();
+	srand(1);
+	for(uint32_t i = 0; i < BLOCKS * BLOCK_SIZE / 4; i++) {
+		data[i] = rand() ^ (rand() << 16);
+	}
+
+	printf("CRC32 check: %s\n", verify() ? "ok" : "MISMATCH");
+	bench("bytewise crc", crc_bytewise);
+	bench("fnv-1a words", fnv_words);
+	bench("slicing-by-4", CRC32);
+	return 0;
+}
@@ -0,0 +1,681 @@
+// ************************** efs_tool.c **************************
+// Host tool for eFile disk images: mkfs, import, export, ls, dump and fsck
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	Build (from src/tools):
+		gcc -O2 -Wall -I.. -o efs_tool efs_tool.c hostdisk.c ../RTOS_Labs_common/eFile.c \
+			../RTOS_Labs_common/BlockDev.c \
+			../RTOS_Lab4_FileSystem/Bitmap.c ../RTOS_Lab4_FileSystem/DirCache.c \
+			../RTOS_Lab4_FileSystem/Journal.c ../RTOS_Lab4_FileSystem/BlockCache.c \
+			../RTOS_Lab4_FileSystem/LZ.c ../RTOS_Lab4_FileSystem/CRC32.c \
+			../RTOS_Lab3_RTOSpriority/PriorityQueue.c ../RTOS_Lab2_RTOSkernel/LinkedList.c
+
+	Usage:
+		efs_tool mkfs   <image> [sectors]            new image, 4096 sectors (2MB) by default
+		efs_tool import <image> <host path> [dir]    copy a host file or directory tree into dir (default /)
+		efs_tool export <image> <path> <host path>   copy a file or directory tree out
+		efs_tool ls     <image> [dir]
+		efs_tool dump   <image>                      bitmap usage, then every iNode and its extents
+		efs_tool fsck   <image>                      check the image and its metadata CRCs, exit status 1 if damaged
+
+	The image is run through the real file system code (eFile.c on a block device,
+	see hostdisk.h), so it is always in the board's format. Write it to a card with
+		dd if=<image> of=/dev/sdX bs=512
+
+	Sizes are limited to 4096 sectors: eFile keeps its bitmap in a single sector.
+	mkfs and import work on the image file itself. The other commands copy it to a RAM
+	disk and replay its journal there, so the image does not change.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "hostdisk.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab4_FileSystem/Journal.h"
+#include "../RTOS_Lab4_FileSystem/CRC32.h"
+
+#define MAX_SECTORS (8*BLOCK_SIZE)
+#define MIN_SECTORS (JOURNAL_START + JOURNAL_SECTORS + 16)
+#define COPY_CHUNK 4096
+#define PATH_MAX_LEN 1024
+
+static uint8_t copybuf[COPY_CHUNK];
+
+
+// ------------------------------------- Images -------------------------------------------- //
+
+// ******** image_open ***********
+// Mount an image (replaying its journal), in place or from a copy in a RAM disk
+static int image_open(const char *image, int writable) {
+	struct stat st;
+	if(stat(image, &st) || st.st_size % BLOCK_SIZE) {
+		fprintf(stderr, "%s: not an image (missing, or not a whole number of sectors)\n", image);
+		return 0;
+	}
+	uint32_t sectors = st.st_size / BLOCK_SIZE;
+	if(sectors < MIN_SECTORS || sectors > MAX_SECTORS) {
+		fprintf(stderr, "%s: %u sectors, eFile images are %u to %u\n", image, sectors, MIN_SECTORS, MAX_SECTORS);
+		return 0;
+	}
+
+	int ok;
+	if(writable) {
+		ok = HostDisk_Open("image", image, 0) != 0;
+	}
+	else {
+		BlockDev_t *ram = BlockDev_AddRAM("image", sectors);
+		FILE *f = fopen(image, "rb");
+		ok = ram && f;
+		for(uint32_t s = 0; ok && s < sectors; s++) {
+			ok = fread(copybuf, BLOCK_SIZE, 1, f) == 1 && BlockDev_Write(ram, copybuf, s, 1);
+		}
+		if(f) {
+			fclose(f);
+		}
+	}
+	if(!ok) {
+		fprintf(stderr, "%s: cannot read\n", image);
+		return 0;
+	}
+
+	eFile_SetDevice("image");
+	eFile_Init();
+	if(!eFile_Mount()) {
+		fprintf(stderr, "%s: no eFile journal, run mkfs first\n", image);
+		return 0;
+	}
+	return 1;
+}
+
+// ******** image_close ***********
+// Unmount an image opened writable, everything reaches the file
+static int image_close(const char *image) {
+	eFile_Unmount();
+	if(!HostDisk_Close(eFileDev)) {
+		fprintf(stderr, "%s: cannot write\n", image);
+		return 0;
+	}
+	return 1;
+}
+
+// ******** path_join ***********
+static void path_join(char *out, const char *dir, const char *name) {
+	size_t n = strlen(dir);
+	snprintf(out, PATH_MAX_LEN, "%s%s%s", dir, (n && dir[n-1] == '/') ? "" : "/", name);
+}
+
+// ******** open_path ***********
+// Open a file or directory by absolute path, "/" is the root
+static int open_path(const char *path, File_t *f) {
+	if(strcmp(path, "/") == 0) {
+		return eFile_D_open_root(f);
+	}
+	return eFile_Open(path, f);
+}
+
+// ******** dir_next ***********
+// Next in-use entry of a directory (skipping . and ..), from d->pos
+static int dir_next(Dir_t *d, DirEntry_t *de) {
+	while(d->pos < d->iNode->iNode.size) {
+		iNode_lock_read(d->iNode);
+		int r = iNode_read_at(d->iNode, de, sizeof(DirEntry_t), d->pos);
+		iNode_unlock_read(d->iNode);
+		d->pos += sizeof(DirEntry_t);
+		if(r && de->in_use && strcmp(de->name, ".") && strcmp(de->name, "..")) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// -------------------------------------- mkfs ---------------------------------------------- //
+
+static int cmd_mkfs(const char *image, uint32_t sectors) {
+	if(sectors < MIN_SECTORS || sectors > MAX_SECTORS) {
+		fprintf(stderr, "sectors must be %u to %u (the bitmap is one sector)\n", MIN_SECTORS, MAX_SECTORS);
+		return 1;
+	}
+	if(!HostDisk_Open("image", image, sectors)) {
+		fprintf(stderr, "%s: cannot create\n", image);
+		return 1;
+	}
+	eFile_SetDevice("image");
+	eFile_Init();
+	eFile_Format(); // Always returns 0
+	if(!eFile_Mount() || !image_close(image)) {
+		return 1;
+	}
+	printf("%s: %u sectors (%u KB)\n", image, sectors, sectors / 2);
+	return 0;
+}
+
+
+// ------------------------------------- import --------------------------------------------- //
+
+// ******** import_file ***********
+// Copy a host file to path, replacing a file already there
+static int import_file(const char *host, const char *path) {
+	FILE *in = fopen(host, "rb");
+	if(in == 0) {
+		fprintf(stderr, "%s: cannot read\n", host);
+		return 0;
+	}
+
+	File_t f;
+	if(eFile_Open(path, &f)) {
+		uint8_t isDir = f.iNode->iNode.isDir;
+		eFile_F_close(&f);
+		if(isDir || !eFile_Remove(path)) {
+			fprintf(stderr, "%s: already exists\n", path);
+			fclose(in);
+			return 0;
+		}
+	}
+	if(!eFile_Create(path) || !eFile_Open(path, &f)) {
+		fprintf(stderr, "%s: cannot create (name longer than %u, or directory missing?)\n", path, MAX_FILE_NAME_LENGTH);
+		fclose(in);
+		return 0;
+	}
+
+	int ok = 1;
+	uint32_t pos = 0;
+	size_t n;
+	while(ok && (n = fread(copybuf, 1, COPY_CHUNK, in)) > 0) {
+		ok = eFile_F_write_at(&f, copybuf, n, pos) == n;
+		pos += n;
+	}
+	eFile_F_close(&f);
+	fclose(in);
+
+	if(!ok) {
+		fprintf(stderr, "%s: disk full\n", path);
+		eFile_Remove(path);
+		return 0;
+	}
+	printf("%s -> %s (%u bytes)\n", host, path, pos);
+	return 1;
+}
+
+// ******** import_path ***********
+// Copy a host file or directory tree into the directory dir
+static int import_path(const char *host, const char *dir) {
+	struct stat st;
+	if(stat(host, &st)) {
+		fprintf(stderr, "%s: not found\n", host);
+		return 0;
+	}
+
+	const char *name = strrchr(host, '/');
+	name = name ? name+1 : host;
+	char path[PATH_MAX_LEN];
+	path_join(path, dir, name);
+
+	if(!S_ISDIR(st.st_mode)) {
+		return import_file(host, path);
+	}
+
+	File_t f;
+	if(open_path(path, &f)) {
+		eFile_F_close(&f);
+	}
+	else if(!eFile_CreateDir(path)) {
+		fprintf(stderr, "%s: cannot create directory\n", path);
+		return 0;
+	}
+
+	DIR *d = opendir(host);
+	if(d == 0) {
+		fprintf(stderr, "%s: cannot read\n", host);
+		return 0;
+	}
+	int ok = 1;
+	struct dirent *e;
+	while((e = readdir(d)) != 0) {
+		if(strcmp(e->d_name, ".") && strcmp(e->d_name, "..")) {
+			char child[PATH_MAX_LEN];
+			path_join(child, host, e->d_name);
+			ok &= import_path(child, path);
+		}
+	}
+	closedir(d);
+	return ok;
+}
+
+static int cmd_import(const char *image, const char *host, const char *dir) {
+	if(!image_open(image, 1)) {
+		return 1;
+	}
+	// A trailing slash would make the basename empty
+	char h[PATH_MAX_LEN];
+	snprintf(h, sizeof h, "%s", host);
+	while(strlen(h) > 1 && h[strlen(h)-1] == '/') {
+		h[strlen(h)-1] = 0;
+	}
+	int ok = import_path(h, dir);
+	ok &= image_close(image);
+	return !ok;
+}
+
+
+// ------------------------------------- export --------------------------------------------- //
+
+// ******** export_path ***********
+// Copy a file or directory tree out to the host path host
+static int export_path(const char *path, const char *host) {
+	File_t f;
+	if(!open_path(path, &f)) {
+		fprintf(stderr, "%s: not found\n", path);
+		return 0;
+	}
+
+	int ok = 1;
+	if(f.iNode->iNode.isDir) {
+		mkdir(host, 0777);
+		f.pos = 2*sizeof(DirEntry_t);
+		DirEntry_t de;
+		while(dir_next(&f, &de)) {
+			char child[PATH_MAX_LEN], hchild[PATH_MAX_LEN];
+			path_join(child, path, de.name);
+			path_join(hchild, host, de.name);
+			ok &= export_path(child, hchild);
+		}
+	}
+	else {
+		FILE *out = fopen(host, "wb");
+		if(out == 0) {
+			fprintf(stderr, "%s: cannot write\n", host);
+			eFile_F_close(&f);
+			return 0;
+		}
+		uint32_t size = eFile_F_length(&f);
+		for(uint32_t pos = 0; ok && pos < size; pos += COPY_CHUNK) {
+			uint32_t n = size - pos < COPY_CHUNK ? size - pos : COPY_CHUNK;
+			ok = eFile_F_read_at(&f, copybuf, n, pos) == n && fwrite(copybuf, 1, n, out) == n;
+		}
+		ok &= fclose(out) == 0;
+		printf("%s -> %s (%u bytes)%s\n", path, host, size, ok ? "" : " FAILED");
+	}
+	eFile_F_close(&f);
+	return ok;
+}
+
+static int cmd_export(const char *image, const char *path, const char *host) {
+	if(!image_open(image, 0)) {
+		return 1;
+	}
+	return !export_path(path, host);
+}
+
+
+// --------------------------------------- ls ----------------------------------------------- //
+
+static int cmd_ls(const char *image, const char *path) {
+	if(!image_open(image, 0)) {
+		return 1;
+	}
+	Dir_t d;
+	if(!open_path(path, &d) || !d.iNode->iNode.isDir) {
+		fprintf(stderr, "%s: not a directory\n", path);
+		return 1;
+	}
+	d.pos = 2*sizeof(DirEntry_t);
+	DirEntry_t de;
+	while(dir_next(&d, &de)) {
+		iNode_t *n = iNode_open(de.Header_Sector);
+		printf("%c %8u  %s\n", de.isDir ? 'd' : '-', n ? n->iNode.size : 0, de.name);
+		iNode_close(n);
+	}
+	eFile_D_close(&d);
+	return 0;
+}
+
+
+// ------------------------------------ dump / fsck ----------------------------------------- //
+
+/*
+	dump and fsck read the on-disk structures directly (after the journal is replayed)
+	rather than through eFile, so they see exactly what the board would.
+*/
+
+typedef struct Check {
+	uint32_t sectors;
+	uint32_t *owner;		// iNode sector that uses each sector, 0 if none
+	uint32_t errors;
+	uint32_t files, dirs;
+	int verbose;				// dump
+} Check_t;
+
+static void check_error(Check_t *c, const char *path, const char *msg, uint32_t a) {
+	printf("ERROR %s: %s %u\n", path, msg, a);
+	c->errors++;
+}
+
+// ******** check_use ***********
+// Mark sector s as used by the iNode at sector owner
+static void check_use(Check_t *c, const char *path, uint32_t s, uint32_t owner) {
+	if(s >= c->sectors) {
+		check_error(c, path, "points past the end of the disk, sector", s);
+	}
+	else if(c->owner[s]) {
+		printf("ERROR %s: sector %u is also used by the iNode at sector %u\n", path, s, c->owner[s]);
+		c->errors++;
+	}
+	else {
+		c->owner[s] = owner;
+		if(!Bitmap_isAllocd(s)) {
+			check_error(c, path, "uses a sector free in the bitmap,", s);
+		}
+	}
+}
+
+// ******** check_extents ***********
+// All extents of an iNode (reading the overflow tree), marking the tree sectors used.
+// Returns a malloc'd array, 0 if the tree is damaged
+static Extent_t* check_extents(Check_t *c, const char *path, const iNodeDisk_t *n, uint32_t owner) {
+	uint32_t count = n->num_extents;
+	if(count > MAX_EXTENTS) {
+		check_error(c, path, "too many extents,", count);
+		return 0;
+	}
+	Extent_t *ext = malloc((count ? count : 1) * sizeof(Extent_t));
+	memcpy(ext, n->extents, (count < NUM_INODE_EXTENTS ? count : NUM_INODE_EXTENTS) * sizeof(Extent_t));
+	if(count <= NUM_INODE_EXTENTS) {
+		return ext;
+	}
+
+	uint32_t index[BLOCK_SIZE/4];
+	if(n->extent_index == 0 || n->extent_index >= c->sectors) {
+		check_error(c, path, "overflow extents without a valid index sector,", n->extent_index);
+		free(ext);
+		return 0;
+	}
+	check_use(c, path, n->extent_index, owner);
+	BlockDev_Read(eFileDev, index, n->extent_index, 1);
+	if(CRC32(0, index, EXTENT_LEAVES*4) != index[EXTENT_LEAVES]) {
+		check_error(c, path, "bad CRC on the extent index at sector", n->extent_index);
+		free(ext);
+		return 0;
+	}
+
+	uint32_t over = count - NUM_INODE_EXTENTS;
+	for(uint32_t leaf = 0; leaf*EXTENTS_PER_BLOCK < over; leaf++) {
+		if(index[leaf] == 0 || index[leaf] >= c->sectors) {
+			check_error(c, path, "missing extent leaf", leaf);
+			free(ext);
+			return 0;
+		}
+		check_use(c, path, index[leaf], owner);
+		Extent_t blk[BLOCK_SIZE / sizeof(Extent_t)];
+		BlockDev_Read(eFileDev, blk, index[leaf], 1);
+		if(CRC32(0, blk, EXTENTS_PER_BLOCK*sizeof(Extent_t)) != *(uint32_t *) &blk[EXTENTS_PER_BLOCK]) {
+			check_error(c, path, "bad CRC on extent leaf at sector", index[leaf]);
+		}
+		uint32_t k = over - leaf*EXTENTS_PER_BLOCK;
+		if(k > EXTENTS_PER_BLOCK) {
+			k = EXTENTS_PER_BLOCK;
+		}
+		memcpy(&ext[NUM_INODE_EXTENTS + leaf*EXTENTS_PER_BLOCK], blk, k * sizeof(Extent_t));
+	}
+	return ext;
+}
+
+// ******** check_inode ***********
+// Check the iNode at sector (reached through path) and, for a directory, everything under it
+static void check_inode(Check_t *c, const char *path, uint32_t sector, uint32_t parent, uint8_t isDir, uint32_t depth) {
+	iNodeDisk_t n;
+	if(sector == 0 || sector >= c->sectors) {
+		check_error(c, path, "entry points at invalid sector", sector);
+		return;
+	}
+	if(c->owner[sector]) {
+		printf("ERROR %s: iNode at sector %u is already used by the iNode at sector %u\n", path, sector, c->owner[sector]);
+		c->errors++;
+		return;
+	}
+	if(depth > 64) {
+		check_error(c, path, "directories nested too deep, a loop? depth", depth);
+		return;
+	}
+	check_use(c, path, sector, sector);
+	BlockDev_Read(eFileDev, &n, sector, 1);
+
+	if(n.magicByte != INODE_MAGIC_BYTE || n.magicHW != INODE_MAGIC_HW) {
+		check_error(c, path, "bad iNode magic at sector", sector);
+		return;
+	}
+	if(CRC32(0, &n, offsetof(iNodeDisk_t, crc)) != n.crc) {
+		check_error(c, path, "bad CRC on the iNode at sector", sector);
+	}
+	if(n.isDir != isDir) {
+		check_error(c, path, "directory entry and iNode disagree on isDir, iNode says", n.isDir);
+	}
+
+	Extent_t *ext = check_extents(c, path, &n, sector);
+	if(ext == 0) {
+		return;
+	}
+	uint32_t blocks = 0;
+	for(uint32_t i = 0; i < n.num_extents; i++) {
+		if(ext[i].length == 0) {
+			check_error(c, path, "empty extent", i);
+		}
+		for(uint32_t b = 0; b < ext[i].length; b++) {
+			check_use(c, path, ext[i].start + b, sector);
+		}
+		blocks += ext[i].length;
+	}
+	// A compressed file's size is before compression, its groups are in the first stored_blocks
+	uint8_t compressed = (n.flags & INODE_COMPRESSED) != 0;
+	uint32_t used = compressed ? n.stored_blocks : (n.size + BLOCK_SIZE-1) / BLOCK_SIZE;
+	if(used > blocks) {
+		printf("ERROR %s: size %u needs more than its %u blocks\n", path, n.size, blocks);
+		c->errors++;
+	}
+
+	if(c->verbose) {
+		printf("%-40s sector %-5u %s %8u bytes %5u blocks %3u extents:", path, sector,
+			n.isDir ? "dir " : compressed ? "zfil" : "file", n.size, blocks, n.num_extents);
+		for(uint32_t i = 0; i < n.num_extents && i < 8; i++) {
+			printf(" %u+%u%s", ext[i].start, ext[i].length, (ext[i].flags & EXTENT_UNWRITTEN) ? "u" : "");
+		}
+		printf("%s\n", n.num_extents > 8 ? " ..." : "");
+	}
+
+	if(!n.isDir) {
+		c->files++;
+		free(ext);
+		if(compressed) {
+			// The group map is a file of its own, found through this one only
+			char map[PATH_MAX_LEN];
+			snprintf(map, sizeof map, "%s (group map)", path);
+			check_inode(c, map, n.group_map, sector, 0, depth+1);
+			c->files--;
+		}
+		return;
+	}
+	c->dirs++;
+
+	for(uint32_t i = 0; i < DIR_INDEX_BLOCKS; i++) {
+		if(n.dir_index[i]) {
+			check_use(c, path, n.dir_index[i], sector);
+			uint32_t slots[BLOCK_SIZE/4];
+			if(n.dir_index[i] < c->sectors && BlockDev_Read(eFileDev, slots, n.dir_index[i], 1) &&
+				CRC32(0, slots, DIR_INDEX_SLOTS*4) != slots[DIR_INDEX_SLOTS]) {
+				check_error(c, path, "bad CRC on directory index at sector", n.dir_index[i]);
+			}
+		}
+	}
+
+	// Entries, block by block in file order
+	uint32_t entries = n.size / sizeof(DirEntry_t);
+	uint32_t per_block = BLOCK_SIZE / sizeof(DirEntry_t);
+	DirEntry_t blk[BLOCK_SIZE / sizeof(DirEntry_t)];
+	uint32_t e = 0;
+	for(uint32_t i = 0; i < n.num_extents && e < entries; i++) {
+		for(uint32_t b = 0; b < ext[i].length && e < entries; b++) {
+			if(ext[i].flags & EXTENT_UNWRITTEN) {
+				memset(blk, 0, sizeof blk);
+			}
+			else {
+				BlockDev_Read(eFileDev, blk, ext[i].start + b, 1);
+			}
+			for(uint32_t k = 0; k < per_block && e < entries; k++, e++) {
+				DirEntry_t *de = &blk[k];
+				if(e < n.dir_next && CRC32(0, de, offsetof(DirEntry_t, crc)) != de->crc) {
+					check_error(c, path, "bad CRC on entry", e);
+					continue;
+				}
+				if(!de->in_use) {
+					continue;
+				}
+				if(memchr(de->name, 0, sizeof de->name) == 0) {
+					check_error(c, path, "unterminated name in entry", e);
+					continue;
+				}
+				if(de->hash != Dir_Hash(de->name)) {
+					printf("ERROR %s: entry %s has the wrong hash\n", path, de->name);
+					c->errors++;
+				}
+				if(strcmp(de->name, ".") == 0) {
+					if(de->Header_Sector != sector) {
+						check_error(c, path, ". points at sector", de->Header_Sector);
+					}
+					continue;
+				}
+				if(strcmp(de->name, "..") == 0) {
+					if(de->Header_Sector != parent) {
+						check_error(c, path, ".. points at sector", de->Header_Sector);
+					}
+					continue;
+				}
+				char child[PATH_MAX_LEN];
+				path_join(child, path, de->name);
+				check_inode(c, child, de->Header_Sector, sector, de->isDir, depth+1);
+			}
+		}
+	}
+	free(ext);
+}
+
+// ******** check_image ***********
+// Walk the whole tree. Returns the number of errors
+static uint32_t check_image(int verbose) {
+	Check_t c;
+	c.sectors = NumSectors;
+	c.owner = calloc(c.sectors, sizeof(uint32_t));
+	c.errors = 0;
+	c.files = 0;
+	c.dirs = 0;
+	c.verbose = verbose;
+
+	// Fixed metadata: the bitmap and the journal (the root is checked as an iNode)
+	check_use(&c, "(bitmap)", 0, 0xFFFFFFFF);
+	for(uint32_t s = JOURNAL_START; s < JOURNAL_START + JOURNAL_SECTORS; s++) {
+		check_use(&c, "(journal)", s, 0xFFFFFFFF);
+	}
+	check_inode(&c, "/", eFile_get_root_sector(), eFile_get_root_sector(), 1, 0);
+
+	uint32_t used = 0, leaked = 0, free_runs = 0, largest = 0, run = 0;
+	for(uint32_t s = 0; s < MAX_SECTORS; s++) {
+		if(s < c.sectors && !Bitmap_isAllocd(s)) {
+			run++;
+			continue;
+		}
+		if(run) {
+			free_runs++;
+			largest = run > largest ? run : largest;
+			run = 0;
+		}
+		if(s >= c.sectors) {
+			if(!Bitmap_isAllocd(s)) {
+				check_error(&c, "(bitmap)", "free sector past the end of the disk,", s);
+			}
+			continue;
+		}
+		used++;
+		if(c.owner[s] == 0) {
+			leaked++;
+			if(verbose) {
+				printf("leak: sector %u in use but not referenced\n", s);
+			}
+		}
+	}
+	if(run) {
+		free_runs++;
+		largest = run > largest ? run : largest;
+	}
+
+	printf("%u files, %u directories, %u/%u sectors used, %u free in %u runs (largest %u)\n",
+		c.files, c.dirs, used, c.sectors, c.sectors - used, free_runs, largest);
+	if(leaked) {
+		printf("%u sectors marked in use but not referenced (space leak, harmless)\n", leaked);
+	}
+	free(c.owner);
+	return c.errors;
+}
+
+static int cmd_dump(const char *image) {
+	if(!image_open(image, 0)) {
+		return 1;
+	}
+	return check_image(1) != 0;
+}
+
+static int cmd_fsck(const char *image) {
+	if(!image_open(image, 0)) {
+		return 1;
+	}
+	uint32_t errors = check_image(0);
+	printf("%s: %s (%u errors)\n", image, errors ? "DAMAGED" : "clean", errors);
+	return errors != 0;
+}
+
+
+static int usage(void) {
+	fprintf(stderr,
+		"usage: efs_tool mkfs   <image> [sectors]\n"
+		"       efs_tool import <image> <host path> [dir]\n"
+		"       efs_tool export <image> <path> <host path>\n"
+		"       efs_tool ls     <image> [dir]\n"
+		"       efs_tool dump   <image>\n"
+		"       efs_tool fsck   <image>\n");
+	return 2;
+}
+
+int main(int argc, char **argv) {
+	HostDiskCmdUs = 0;
+	HostDiskBlockUs = 0;
+	if(argc < 3) {
+		return usage();
+	}
+	const char *cmd = argv[1];
+	const char *image = argv[2];
+
+	if(strcmp(cmd, "mkfs") == 0) {
+		return cmd_mkfs(image, argc > 3 ? strtoul(argv[3], 0, 0) : MAX_SECTORS);
+	}
+	if(strcmp(cmd, "import") == 0 && argc >= 4) {
+		return cmd_import(image, argv[3], argc > 4 ? argv[4] : "/");
+	}
+	if(strcmp(cmd, "export") == 0 && argc == 5) {
+		return cmd_export(image, argv[3], argv[4]);
+	}
+	if(strcmp(cmd, "ls") == 0) {
+		return cmd_ls(image, argc > 3 ? argv[3] : "/");
+	}
+	if(strcmp(cmd, "dump") == 0) {
+		return cmd_dump(image);
+	}
+	if(strcmp(cmd, "fsck") == 0) {
+		return cmd_fsck(image);
+	}
+	return usage();
+}
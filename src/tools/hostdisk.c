@@ -0,0 +1,235 @@
+// ************************** hostdisk.c **************************
+// Image file block devices and single thread OS stubs for running the file system on a host
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hostdisk.h"
+#include "../RTOS_Labs_common/OS.h"
+#include "../RTOS_Labs_common/eDisk.h"
+
+uint32_t HostDiskCmdUs = 500;
+uint32_t HostDiskBlockUs = 550;
+
+uint64_t HostDiskTimeUs = 0;
+uint32_t HostDiskCommands = 0;
+uint32_t HostDiskReads = 0;
+uint32_t HostDiskWrites = 0;
+
+typedef struct HostDisk {
+	FILE *f;
+	uint32_t sectors;
+} HostDisk_t;
+
+static TCB_t HostThread;
+TCB_t *RunPt = &HostThread;
+
+
+// ----------------------------------- Image devices --------------------------------------- //
+
+// ******** disk_command ************
+// Check a command, seek to it and charge its time
+static int disk_command(HostDisk_t *d, uint32_t sector, uint32_t count) {
+	if(sector >= d->sectors || count > d->sectors - sector ||
+		fseek(d->f, (long) sector*BLOCKDEV_SECTOR, SEEK_SET)) {
+		return 0;
+	}
+	HostDiskCommands++;
+	HostDiskTimeUs += HostDiskCmdUs + (uint64_t) count*HostDiskBlockUs;
+	return 1;
+}
+
+static int disk_read(void *ctx, void *buff, uint32_t sector, uint32_t count) {
+	HostDisk_t *d = ctx;
+	if(!disk_command(d, sector, count) || fread(buff, BLOCKDEV_SECTOR, count, d->f) != count) {
+		return 0;
+	}
+	HostDiskReads += count;
+	return 1;
+}
+
+static int disk_write(void *ctx, const void *buff, uint32_t sector, uint32_t count) {
+	HostDisk_t *d = ctx;
+	if(!disk_command(d, sector, count) || fwrite(buff, BLOCKDEV_SECTOR, count, d->f) != count) {
+		return 0;
+	}
+	HostDiskWrites += count;
+	return 1;
+}
+
+static uint32_t disk_count(void *ctx) {
+	return ((HostDisk_t *) ctx)->sectors;
+}
+
+static int disk_flush(void *ctx) {
+	return fflush(((HostDisk_t *) ctx)->f) == 0;
+}
+
+static const BlockDevOps_t HostDisk_Ops = {disk_read, disk_write, disk_count, disk_flush, 0};
+
+BlockDev_t* HostDisk_Open(const char name[], const char *image, uint32_t sectors) {
+	HostDisk_t *d = malloc(sizeof(HostDisk_t));
+	if(d == 0) {
+		return 0;
+	}
+	d->f = image ? fopen(image, "r+b") : tmpfile();
+	if(d->f == 0 && image) {
+		d->f = fopen(image, "w+b");
+	}
+	if(d->f == 0) {
+		free(d);
+		return 0;
+	}
+
+	// Size the image, a partial last sector is ignored
+	fseek(d->f, 0, SEEK_END);
+	d->sectors = ftell(d->f) / BLOCKDEV_SECTOR;
+	if(sectors && (sectors != d->sectors || ftell(d->f) % BLOCKDEV_SECTOR)) {
+		fflush(d->f);
+		if(ftruncate(fileno(d->f), (off_t) sectors*BLOCKDEV_SECTOR)) {
+			fclose(d->f);
+			free(d);
+			return 0;
+		}
+		d->sectors = sectors;
+	}
+
+	BlockDev_t *dev = BlockDev_Register(name, &HostDisk_Ops, d);
+	if(dev == 0) {
+		fclose(d->f);
+		free(d);
+	}
+	HostDisk_ResetStats();
+	return dev;
+}
+
+int HostDisk_Close(BlockDev_t *dev) {
+	HostDisk_t *d = dev->ctx;
+	int r = fclose(d->f) == 0;
+	free(d);
+	BlockDev_Remove(dev);
+	return r;
+}
+
+void HostDisk_ResetStats(void) {
+	HostDiskTimeUs = 0;
+	HostDiskCommands = 0;
+	HostDiskReads = 0;
+	HostDiskWrites = 0;
+}
+
+// There is no card on the host, eFile_Init only falls back to it without eFile_SetDevice
+static int no_card_read(void *ctx, void *buff, uint32_t sector, uint32_t count) {
+	return 0;
+}
+
+static int no_card_write(void *ctx, const void *buff, uint32_t sector, uint32_t count) {
+	return 0;
+}
+
+static uint32_t no_card_count(void *ctx) {
+	return 0;
+}
+
+const BlockDevOps_t eDisk_Ops = {no_card_read, no_card_write, no_card_count, 0, 0};
+
+
+// ------------------------------------- OS stubs ------------------------------------------ //
+
+long StartCritical(void) {
+	return 0;
+}
+
+void EndCritical(long sr) {
+}
+
+void OS_InitSemaphore(Sema4Type *semaPt, int32_t value) {
+	semaPt->Value = value;
+}
+
+void OS_Wait(Sema4Type *semaPt) {
+	if(semaPt->Value <= 0) {
+		fprintf(stderr, "hostdisk: wait on a taken semaphore, nothing can signal it\n");
+		abort();
+	}
+	semaPt->Value--;
+}
+
+int OS_Wait_noblock(Sema4Type *semaPt) {
+	if(semaPt->Value <= 0) {
+		return 0;
+	}
+	semaPt->Value--;
+	return 1;
+}
+
+void OS_Signal(Sema4Type *semaPt) {
+	semaPt->Value++;
+}
+
+void OS_bWait(Sema4Type *semaPt) {
+	OS_Wait(semaPt);
+}
+
+void OS_bSignal(Sema4Type *semaPt) {
+	OS_Signal(semaPt);
+}
+
+void OS_Suspend(void) {
+}
+
+void OS_InitRWLock(RWLock_t *lock) {
+	lock->state = 0;
+}
+
+static void rw_deadlock(void) {
+	fprintf(stderr, "hostdisk: wait on a taken reader-writer lock, nothing can release it\n");
+	abort();
+}
+
+void OS_ReadLock(RWLock_t *lock) {
+	if(lock->state < 0) {
+		rw_deadlock();
+	}
+	lock->state++;
+}
+
+void OS_ReadUnlock(RWLock_t *lock) {
+	lock->state--;
+}
+
+void OS_WriteLock(RWLock_t *lock) {
+	if(lock->state != 0) {
+		rw_deadlock();
+	}
+	lock->state = -1;
+}
+
+void OS_WriteUnlock(RWLock_t *lock) {
+	lock->state = 0;
+}
+
+int OS_RWUpgrade(RWLock_t *lock) {
+	if(lock->state != 1) {
+		rw_deadlock();
+	}
+	lock->state = -1;
+	return 1;
+}
+
+void OS_RWDowngrade(RWLock_t *lock) {
+	lock->state = 1;
+}
+
+void* Heap_KernelMalloc(int32_t desiredBytes) {
+	return malloc(desiredBytes);
+}
+
+int32_t Heap_KernelFree(void* pointer) {
+	free(pointer);
+	return 0;
+}
@@ -0,0 +1,57 @@
+// ************************** hostdisk.h **************************
+// Image file block devices and single thread OS stubs for running the file system on a host
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	HostDisk_Open registers an image file as a block device (see BlockDev.h), read and
+	written in place with stdio. Also provides the few OS/heap functions the file system
+	calls, and an eDisk_Ops with no card behind it. Link it with BlockDev.c in place of
+	eDisk.c, OS.c and heap.c, then pick the device with eFile_SetDevice before eFile_Init.
+	BlockDev_AddRAM works too, its sectors come from malloc.
+
+	Every command on an image advances a simulated clock by
+			HostDiskCmdUs + count*HostDiskBlockUs
+	microseconds, roughly an SD card on the SPI bus (command and access latency,
+	then 512 bytes at 8 MHz), so I/O patterns can be compared without the board.
+	The clock and counters are shared by all images.
+
+	There is only one thread: a semaphore that would block is a deadlock and aborts.
+*/
+
+#ifndef HOSTDISK_H
+#define HOSTDISK_H
+
+#include <stdint.h>
+#include "../RTOS_Labs_common/BlockDev.h"
+
+extern uint32_t HostDiskCmdUs;			// Latency of one command (default 500)
+extern uint32_t HostDiskBlockUs;		// Transfer time of one block (default 550)
+
+extern uint64_t HostDiskTimeUs;			// Simulated time spent on the disk
+extern uint32_t HostDiskCommands;		// Commands issued
+extern uint32_t HostDiskReads;			// Blocks read
+extern uint32_t HostDiskWrites;			// Blocks written
+
+// ******** HostDisk_Open ************
+// Register an image file as a block device, creating the file if it does not exist
+// input:  const char name[]  - device name
+//				 const char *image  - image file, 0 for a scratch image deleted on close
+//				 uint32_t sectors   - the image is grown with zeros or cut to this size, 0 keeps its size
+// output: the device, 0 on fail
+BlockDev_t* HostDisk_Open(const char name[], const char *image, uint32_t sectors);
+
+// ******** HostDisk_Close ************
+// Flush and close an image, and remove its device
+// input:  BlockDev_t *dev - device from HostDisk_Open
+// output: 1 if everything reached the file, 0 on fail
+int HostDisk_Close(BlockDev_t *dev);
+
+// ******** HostDisk_ResetStats ************
+// Zero the simulated clock and counters
+// input:  none
+// output: none
+void HostDisk_ResetStats(void);
+
+#endif
@@ -0,0 +1,216 @@
+// ************************** lzbench.c **************************
+// Host benchmark of compressed eFile files (eFile_F_compress) on a simulated SD card
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	Build and run (from src/tools):
+		gcc -O2 -Wall -I.. -o lzbench lzbench.c hostdisk.c ../RTOS_Labs_common/eFile.c \
+			../RTOS_Labs_common/BlockDev.c \
+			../RTOS_Lab4_FileSystem/Bitmap.c ../RTOS_Lab4_FileSystem/DirCache.c \
+			../RTOS_Lab4_FileSystem/Journal.c ../RTOS_Lab4_FileSystem/BlockCache.c \
+			../RTOS_Lab4_FileSystem/LZ.c ../RTOS_Lab4_FileSystem/CRC32.c \
+			../RTOS_Lab3_RTOSpriority/PriorityQueue.c ../RTOS_Lab2_RTOSkernel/LinkedList.c
+		./lzbench [host file]
+
+	For each data set (a text log, a binary sensor trace, random bytes, or a host file):
+	LZ_Compress and LZ_Decompress speed and ratio over COMP_GROUP_SIZE groups, then the
+	data appended to a plain and to a compressed file in 64 byte writes, as a logger
+	would. The file system lines give blocks written to the disk, simulated disk time
+	(see hostdisk.h), blocks the file takes and the host CPU time, and check the data
+	read back. Part of the saving in writes is buffering: a plain file writes its block
+	on every write, a compressed one only each group. Groups take whole blocks, so data
+	that shrinks less than a block per group (a quarter) takes as much room as plain.
+	Host MB/s are only relative, a Cortex-M4 at 80 MHz is ~50x slower.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hostdisk.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab4_FileSystem/Bitmap.h"
+#include "../RTOS_Lab4_FileSystem/LZ.h"
+
+#define DATA_MAX (512*1024)
+#define LOG_WRITE 64
+#define CODEC_RUNS 20
+
+extern uint32_t NumSectors;
+
+static uint8_t data[DATA_MAX];
+static uint8_t back[DATA_MAX];
+
+// ******** make_text ***********
+// Log lines as a data logger prints them
+static uint32_t make_text(uint32_t size) {
+	uint32_t n = 0;
+	uint32_t t = 0;
+	while(n + 80 < size) {
+		t += 100 + rand() % 7;
+		n += sprintf((char *) &data[n], "%8u.%03u adc0=%4d adc1=%4d temp=%2d.%d state=%s\n",
+			t / 1000, t % 1000, 2000 + rand() % 64, 1000 + rand() % 16, 21 + rand() % 2, rand() % 10,
+			rand() % 50 ? "RUN" : "IDLE");
+	}
+	return n;
+}
+
+// ******** make_samples ***********
+// A binary trace: time stamp and three slowly moving 16 bit channels per record
+static uint32_t make_samples(uint32_t size) {
+	uint32_t n = 0;
+	uint32_t t = 0;
+	int16_t ch[3] = {0, 500, -300};
+	while(n + 10 <= size) {
+		t += 1000;
+		memcpy(&data[n], &t, 4);
+		for(int i = 0; i < 3; i++) {
+			ch[i] += rand() % 5 - 2;
+			memcpy(&data[n + 4 + 2*i], &ch[i], 2);
+		}
+		n += 10;
+	}
+	return n;
+}
+
+// ******** make_random ***********
+static uint32_t make_random(uint32_t size) {
+	for(uint32_t i = 0; i < size; i++) {
+		data[i] = rand();
+	}
+	return size;
+}
+
+// ******** load_file ***********
+static uint32_t load_file(const char *host) {
+	FILE *in = fopen(host, "rb");
+	if(in == 0) {
+		return 0;
+	}
+	uint32_t n = fread(data, 1, DATA_MAX, in);
+	fclose(in);
+	return n;
+}
+
+static double seconds(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// ******** codec ***********
+// Compress and decompress the data group by group, as eFile stores it
+static void codec(uint32_t size) {
+	static uint8_t out[COMP_GROUP_SIZE];
+	static uint16_t table[LZ_HASH_SIZE];
+	uint32_t packed = 0;
+	int ok = 1;
+
+	clock_t start = clock();
+	for(int run = 0; run < CODEC_RUNS; run++) {
+		packed = 0;
+		for(uint32_t pos = 0; pos < size; pos += COMP_GROUP_SIZE) {
+			uint32_t n = size - pos < COMP_GROUP_SIZE ? size - pos : COMP_GROUP_SIZE;
+			uint32_t k = LZ_Compress(&data[pos], n, out, sizeof out, table);
+			packed += k ? k : n;
+		}
+	}
+	double tc = seconds(start);
+
+	start = clock();
+	for(uint32_t pos = 0; pos < size; pos += COMP_GROUP_SIZE) {
+		uint32_t n = size - pos < COMP_GROUP_SIZE ? size - pos : COMP_GROUP_SIZE;
+		uint32_t k = LZ_Compress(&data[pos], n, out, sizeof out, table);
+		for(int run = 0; k && run < CODEC_RUNS; run++) {
+			ok &= LZ_Decompress(out, k, &back[pos], COMP_GROUP_SIZE) == n;
+		}
+		if(k == 0) {
+			memcpy(&back[pos], &data[pos], n);
+		}
+	}
+	double td = seconds(start);
+	ok &= memcmp(back, data, size) == 0;
+
+	double mb = (double) size * CODEC_RUNS / (1024*1024);
+	printf("  codec          %6.1f%% of original  compress %7.1f MB/s  decompress %7.1f MB/s  %s\n",
+		100.0 * packed / size, mb / tc, mb / td, ok ? "ok" : "DATA MISMATCH");
+}
+
+static uint32_t blocks_free(void) {
+	uint32_t n = 0;
+	for(uint32_t i = 0; i < NumSectors; i++) {
+		n += Bitmap_isFree(i);
+	}
+	return n;
+}
+
+// ******** store ***********
+// Append the data to a new file in LOG_WRITE pieces, plain or compressed, and read it back
+static void store(uint32_t size, int compress) {
+	File_t f;
+	eFile_Format();
+	eFile_Mount();
+	uint32_t free0 = blocks_free();
+	HostDisk_ResetStats();
+
+	clock_t start = clock();
+	int ok = eFile_Create("/log") && eFile_Open("/log", &f);
+	if(ok && compress) {
+		ok = eFile_F_compress(&f);
+	}
+	for(uint32_t pos = 0; ok && pos < size; pos += LOG_WRITE) {
+		uint32_t n = size - pos < LOG_WRITE ? size - pos : LOG_WRITE;
+		ok = eFile_F_write(&f, &data[pos], n) == n;
+	}
+	ok &= eFile_F_close(&f);
+	ok &= eFile_Unmount();
+	double cpu = seconds(start);
+	uint64_t us = HostDiskTimeUs;
+	uint32_t writes = HostDiskWrites;
+
+	eFile_Mount();
+	uint32_t used = free0 - blocks_free();
+	memset(back, 0, size);
+	ok &= eFile_Open("/log", &f) && eFile_F_read(&f, back, size) == size;
+	eFile_F_close(&f);
+	ok &= memcmp(back, data, size) == 0;
+	eFile_Unmount();
+
+	printf("  %-12s %7u blocks written  %8.1f ms disk  %5u blocks used  %6.1f ms cpu  %s\n",
+		compress ? "compressed" : "plain", writes, us / 1000.0, used, cpu * 1000, ok ? "ok" : "FAILED");
+}
+
+static void bench(const char *name, uint32_t size) {
+	printf("%s, %u bytes\n", name, size);
+	codec(size);
+	store(size, 0);
+	store(size, 1);
+}
+
+int main(int argc, char **argv) {
+	BlockDev_t *dev = HostDisk_Open("bench", 0, 4096);
+	if(dev == 0) {
+		printf("cannot create a scratch image\n");
+		return 1;
+	}
+	eFile_SetDevice("bench");
+	eFile_Init();
+
+	if(argc > 1) {
+		uint32_t n = load_file(argv[1]);
+		if(n == 0) {
+			printf("%s: cannot read\n", argv[1]);
+			return 1;
+		}
+		bench(argv[1], n);
+	}
+	else {
+		srand(1);
+		bench("text log", make_text(256*1024));
+		bench("sensor trace", make_samples(256*1024));
+		bench("random", make_random(256*1024));
+	}
+
+	HostDisk_Close(dev);
+	return 0;
+}
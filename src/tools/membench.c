@@ -0,0 +1,150 @@
+// ************************** membench.c **************************
+// Host benchmark of RTOS_Labs_common/memlib.c against the byte loops it replaced
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	Build and run (from src/tools):
+		gcc -O2 -Wall -fno-builtin -fno-tree-loop-distribute-patterns "-DMEMLIB_NAME(f)=fast_##f" \
+			-o membench membench.c ../RTOS_Labs_common/memlib.c
+		./membench
+
+	Each function is first checked against libc for every size 0-80 and every
+	src/dst alignment, then timed at 8, 64 and 512 bytes (aligned and misaligned).
+	The old heap.c memcpy overran by 4x, so the baseline below is the corrected byte loop.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void* fast_memcpy(void *dst, const void *src, size_t n);
+void* fast_memmove(void *dst, const void *src, size_t n);
+void* fast_memset(void *dst, int v, size_t n);
+int   fast_strcmp(const char *a, const char *b);
+char* fast_strcpy(char *dst, const char *src);
+
+// ******** Baseline (pre memlib) implementations ***********
+static void* old_memcpy(void *dst, const void *src, size_t n) {
+	for(uint32_t i = 0; i < n; i++) {
+		((volatile int8_t *)dst)[i] = ((const int8_t *)src)[i];
+	}
+	return dst;
+}
+
+static void* old_memset(void *dst, int v, size_t n) {
+	for(uint32_t i = 0; i < n; i++) {
+		((volatile int8_t *)dst)[i] = v;
+	}
+	return dst;
+}
+
+static char* old_strcpy(char *dst, const char *src) {
+	for(size_t i = 0; 1; i++) {
+		((volatile char *)dst)[i] = src[i];
+		if(src[i] == 0) {
+			return dst;
+		}
+	}
+}
+
+static int old_strcmp(const char *a, const char *b) {
+	volatile const char *va = a;
+	while(*va && *va == *b) {
+		va++;
+		b++;
+	}
+	return (uint8_t)*va - (uint8_t)*b;
+}
+
+static int sign(int x) { return (x > 0) - (x < 0); }
+
+static uint8_t A[1024], B[1024], C[1024];
+static int failures = 0;
+
+static void fail(const char *fn, int n, int da, int sa) {
+	printf("FAIL %s n=%d dst+%d src+%d\n", fn, n, da, sa);
+	failures++;
+}
+
+// ******** verify ***********
+static void verify(void) {
+	for(int n = 0; n <= 80; n++) {
+		for(int da = 0; da < 4; da++) {
+			for(int sa = 0; sa < 4; sa++) {
+				for(int i = 0; i < 256; i++) { A[i] = rand(); B[i] = C[i] = rand(); }
+
+				fast_memcpy(B+64+da, A+sa, n);
+				memcpy(C+64+da, A+sa, n);
+				if(memcmp(B, C, 256)) fail("memcpy", n, da, sa);
+
+				fast_memset(B+64+da, sa*0x55, n);
+				memset(C+64+da, sa*0x55, n);
+				if(memcmp(B, C, 256)) fail("memset", n, da, sa);
+
+				// Overlapping moves in both directions
+				memcpy(C, B, 256);
+				fast_memmove(B+64+da, B+64+sa*3, n);
+				memmove(C+64+da, C+64+sa*3, n);
+				if(memcmp(B, C, 256)) fail("memmove up", n, da, sa);
+				fast_memmove(B+64+sa*3, B+64+da, n);
+				memmove(C+64+sa*3, C+64+da, n);
+				if(memcmp(B, C, 256)) fail("memmove down", n, da, sa);
+
+				for(int i = 0; i < n; i++) { A[i+sa] = 'a' + rand()%3; }
+				A[sa+n] = 0;
+				fast_strcpy((char *)B+64+da, (char *)A+sa);
+				strcpy((char *)C+64+da, (char *)A+sa);
+				if(memcmp(B, C, 256)) fail("strcpy", n, da, sa);
+
+				int r1 = fast_strcmp((char *)B+64+da, (char *)A+sa);
+				if(r1 != 0) fail("strcmp eq", n, da, sa);
+				if(n) {
+					B[64+da+n-1]++;
+					r1 = fast_strcmp((char *)B+64+da, (char *)A+sa);
+					if(sign(r1) != sign(strcmp((char *)B+64+da, (char *)A+sa))) fail("strcmp ne", n, da, sa);
+				}
+			}
+		}
+	}
+}
+
+static double now_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+#define ITER 200000
+#define TIME(expr) ({ double t0 = now_ns(); for(int k = 0; k < ITER; k++) { expr; __asm__ volatile("" ::: "memory"); } (now_ns() - t0) / ITER; })
+
+int main(void) {
+	verify();
+	printf("correctness: %s\n\n", failures ? "FAILED" : "ok");
+
+	static const int sizes[] = {8, 64, 512};
+	printf("%-8s %5s %4s %10s %10s %8s\n", "func", "bytes", "algn", "old ns", "new ns", "speedup");
+	for(int i = 0; i < 3; i++) {
+		int n = sizes[i];
+		for(int mis = 0; mis < 2; mis++) {
+			uint8_t *d = B + mis, *s = A + 2*mis;
+			const char *al = mis ? "mis" : "ok";
+			double o, f;
+
+			o = TIME(old_memcpy(d, s, n)); f = TIME(fast_memcpy(d, s, n));
+			printf("%-8s %5d %4s %10.1f %10.1f %7.2fx\n", "memcpy", n, al, o, f, o/f);
+			o = TIME(old_memset(d, 0x5A, n)); f = TIME(fast_memset(d, 0x5A, n));
+			printf("%-8s %5d %4s %10.1f %10.1f %7.2fx\n", "memset", n, al, o, f, o/f);
+
+			memset(s, 'x', n-1); s[n-1] = 0;
+			o = TIME(old_strcpy((char *)d, (char *)s)); f = TIME(fast_strcpy((char *)d, (char *)s));
+			printf("%-8s %5d %4s %10.1f %10.1f %7.2fx\n", "strcpy", n, al, o, f, o/f);
+			o = TIME(old_strcmp((char *)d, (char *)s)); f = TIME(fast_strcmp((char *)d, (char *)s));
+			printf("%-8s %5d %4s %10.1f %10.1f %7.2fx\n", "strcmp", n, al, o, f, o/f);
+		}
+	}
+	return failures != 0;
+}
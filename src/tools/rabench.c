@@ -0,0 +1,126 @@
+// ************************** rabench.c **************************
+// Host benchmark of eFile_F_read read-ahead on a simulated SD card
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	Build and run (from src/tools):
+		gcc -O2 -Wall -I.. -o rabench rabench.c hostdisk.c ../RTOS_Labs_common/eFile.c \
+			../RTOS_Labs_common/BlockDev.c \
+			../RTOS_Lab4_FileSystem/Bitmap.c ../RTOS_Lab4_FileSystem/DirCache.c \
+			../RTOS_Lab4_FileSystem/Journal.c ../RTOS_Lab4_FileSystem/BlockCache.c \
+			../RTOS_Lab4_FileSystem/LZ.c ../RTOS_Lab4_FileSystem/CRC32.c \
+			../RTOS_Lab3_RTOSpriority/PriorityQueue.c ../RTOS_Lab2_RTOSkernel/LinkedList.c
+		./rabench [cmd_us block_us]
+
+	A 256KB file is read start to end in 64, 512 and 4096 byte pieces, once with
+	eFile_F_read (sequential, so it reads ahead) and once with eFile_F_read_at (never
+	reads ahead), then 512 byte pieces at random positions to check that seeks turn
+	read-ahead off. The drive is a scratch image file, times are simulated disk time
+	(see hostdisk.h), the data is checked.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hostdisk.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab4_FileSystem/BlockCache.h"
+
+#define FILE_SIZE (256*1024)
+#define CHUNK_MAX 4096
+
+static uint8_t chunk[CHUNK_MAX];
+
+// ******** expected ***********
+// Contents of the test file at pos
+static uint8_t expected(uint32_t pos) {
+	return (uint8_t)(pos*7 + pos/251);
+}
+
+static int check(const uint8_t *buff, uint32_t size, uint32_t pos) {
+	for(uint32_t i = 0; i < size; i++) {
+		if(buff[i] != expected(pos+i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// ******** run ***********
+// Read the file in pieces of size, sequential (read-ahead) or with read_at, and report
+static void run(const char *name, uint32_t size, int readahead, int random) {
+	File_t f;
+	int ok = eFile_Open("/data", &f);
+	BCache_Reset();
+	HostDisk_ResetStats();
+
+	uint32_t pieces = FILE_SIZE / size;
+	for(uint32_t i = 0; i < pieces && ok; i++) {
+		uint32_t pos = random ? (rand() % pieces) * size : i * size;
+		if(readahead) {
+			eFile_F_seek(&f, pos);
+			ok &= eFile_F_read(&f, chunk, size) == size;
+		}
+		else {
+			ok &= eFile_F_read_at(&f, chunk, size, pos) == size;
+		}
+		ok &= check(chunk, size, pos);
+	}
+	eFile_F_close(&f);
+
+	double ms = HostDiskTimeUs / 1000.0;
+	printf("%-12s %5u B  %8.1f ms  %7.1f KB/s  %5u commands  %5u blocks  %s\n",
+		name, size, ms, (FILE_SIZE/1024.0) / (ms/1000.0), HostDiskCommands, HostDiskReads,
+		ok ? "ok" : "DATA MISMATCH");
+}
+
+int main(int argc, char **argv) {
+	if(argc == 3) {
+		HostDiskCmdUs = atoi(argv[1]);
+		HostDiskBlockUs = atoi(argv[2]);
+	}
+	BlockDev_t *dev = HostDisk_Open("bench", 0, 4096);
+	if(dev == 0) {
+		printf("cannot create a scratch image\n");
+		return 1;
+	}
+
+	eFile_SetDevice("bench");
+	eFile_Init();
+	eFile_Format();
+	eFile_Mount();
+
+	File_t f;
+	if(!eFile_Create("/data") || !eFile_Open("/data", &f)) {
+		printf("create failed\n");
+		return 1;
+	}
+	for(uint32_t pos = 0; pos < FILE_SIZE; pos += CHUNK_MAX) {
+		for(uint32_t i = 0; i < CHUNK_MAX; i++) {
+			chunk[i] = expected(pos+i);
+		}
+		eFile_F_write_at(&f, chunk, CHUNK_MAX, pos);
+	}
+	eFile_F_close(&f);
+
+	// Start with nothing cached
+	eFile_Unmount();
+	eFile_Mount();
+
+	printf("Simulated disk: %u us per command, %u us per block\n", HostDiskCmdUs, HostDiskBlockUs);
+	uint32_t sizes[] = {64, 512, 4096};
+	for(uint32_t i = 0; i < 3; i++) {
+		run("read_at", sizes[i], 0, 0);
+		run("read-ahead", sizes[i], 1, 0);
+	}
+	srand(1);
+	run("random", 512, 0, 1);
+	srand(1);
+	run("random+seek", 512, 1, 1);
+
+	eFile_Unmount();
+	HostDisk_Close(dev);
+	return 0;
+}
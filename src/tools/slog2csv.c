@@ -0,0 +1,92 @@
+// ************************** slog2csv.c **************************
+// Host tool: decode a binary sample log (SampleLog.h) in an eFile disk image to CSV
+// Author: Jackson Paull
+// jackson.paull@utexas.edu
+// v1.0
+
+/*
+	Build (from src/tools):
+		gcc -O2 -Wall -I.. -o slog2csv slog2csv.c hostdisk.c ../RTOS_Labs_common/eFile.c \
+			../RTOS_Labs_common/BlockDev.c ../RTOS_Lab4_FileSystem/SampleLog.c \
+			../RTOS_Lab4_FileSystem/Bitmap.c ../RTOS_Lab4_FileSystem/DirCache.c \
+			../RTOS_Lab4_FileSystem/Journal.c ../RTOS_Lab4_FileSystem/BlockCache.c \
+			../RTOS_Lab4_FileSystem/LZ.c ../RTOS_Lab4_FileSystem/CRC32.c \
+			../RTOS_Lab3_RTOSpriority/PriorityQueue.c ../RTOS_Lab2_RTOSkernel/LinkedList.c
+
+	Usage:
+		slog2csv <image> <path> [from [to]]
+
+	Prints "time,value" lines for the samples of the log at path with from <= time < to
+	(times in the units the logger used, ms for OS_MsTime), seeking straight to from.
+	The image is read into a RAM disk and is not changed. Statistics go to stderr.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "hostdisk.h"
+#include "../RTOS_Labs_common/eFile.h"
+#include "../RTOS_Lab4_FileSystem/SampleLog.h"
+
+static uint8_t sector[BLOCK_SIZE];
+
+// ******** image_load ***********
+// Copy an image into a RAM disk and mount it
+static int image_load(const char *image) {
+	struct stat st;
+	if(stat(image, &st) || st.st_size % BLOCK_SIZE || st.st_size == 0) {
+		fprintf(stderr, "%s: not an image\n", image);
+		return 0;
+	}
+	uint32_t sectors = st.st_size / BLOCK_SIZE;
+	BlockDev_t *ram = BlockDev_AddRAM("image", sectors);
+	FILE *f = fopen(image, "rb");
+	int ok = ram && f;
+	for(uint32_t s = 0; ok && s < sectors; s++) {
+		ok = fread(sector, BLOCK_SIZE, 1, f) == 1 && BlockDev_Write(ram, sector, s, 1);
+	}
+	if(f) {
+		fclose(f);
+	}
+	if(!ok || !eFile_SetDevice("image") || !eFile_Init() || !eFile_Mount()) {
+		fprintf(stderr, "%s: cannot read, or not an eFile image\n", image);
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	if(argc < 3 || argc > 5) {
+		fprintf(stderr, "usage: slog2csv <image> <path> [from [to]]\n");
+		return 2;
+	}
+	uint32_t from = argc > 3 ? strtoul(argv[3], 0, 0) : 0;
+	uint32_t to = argc > 4 ? strtoul(argv[4], 0, 0) : 0xFFFFFFFF;
+	HostDiskCmdUs = 0;
+	HostDiskBlockUs = 0;
+	if(!image_load(argv[1])) {
+		return 1;
+	}
+
+	static SLog_t log;
+	if(!SLog_Open(argv[2], &log)) {
+		fprintf(stderr, "%s: not found, or not a sample log\n", argv[2]);
+		return 1;
+	}
+	if(from && !SLog_Seek(&log, from)) {
+		fprintf(stderr, "%s: read error\n", argv[2]);
+		return 1;
+	}
+
+	uint32_t time, count = 0;
+	int32_t value;
+	printf("time,value\n");
+	while(SLog_Next(&log, &time, &value) && time < to) {
+		printf("%u,%d\n", time, value);
+		count++;
+	}
+	fprintf(stderr, "%u samples, %u bytes on disk (%u chunks)\n",
+		count, eFile_F_length(&log.file), log.chunks);
+	SLog_Close(&log);
+	return 0;
+}